@@ -1,4 +1,5 @@
 LOCAL_PATH := $(call my-dir)
+BT_VENDOR_TOP := $(LOCAL_PATH)
 
 ifeq ($(BOARD_HAVE_BLUETOOTH_IBT), true)
 
@@ -6,19 +7,41 @@ include $(CLEAR_VARS)
 
 BDROID_DIR := $(TOP_DIR)external/bluetooth/bluedroid
 
-LOCAL_SRC_FILES := \
+# MEMWRITE records re-split into FW_PATCH_REPACK_CHUNK commands, by the
+# library and by bt_seq2bseq for the patches built here. Off unless the
+# board sets BT_FW_PATCH_REPACK := true in BoardConfig.mk.
+BT_SEQ2BSEQ_REPACK := $(if $(filter true,$(BT_FW_PATCH_REPACK)),-r)
+
+BT_VENDOR_SRC_FILES := \
         src/bt_vendor.c \
         src/hardware.c \
+        src/fw_bundle.c \
+        src/fw_cache.c \
+        src/fw_direct.c \
+        src/fw_embedded.c \
+        src/fw_patch.c \
+        src/fw_index.c \
+        src/fw_preload.c \
+        src/fw_repack.c \
+        src/fw_stats.c \
+        src/fw_stream.c \
+        src/hex_decode.c \
         src/userial_vendor.c \
+        src/userial_baud.c \
+        src/userial_demux.c \
         src/upio.c \
-        src/conf.c
+        src/conf.c \
+        src/vnd_trace.c
+
+LOCAL_SRC_FILES := $(BT_VENDOR_SRC_FILES)
 
 LOCAL_C_INCLUDES += \
         $(LOCAL_PATH)/include \
         $(BDROID_DIR)/hci/include
 
 LOCAL_SHARED_LIBRARIES := \
-        libcutils
+        libcutils \
+        libz
 
 LOCAL_MODULE := libbt-vendor
 LOCAL_MODULE_TAGS := optional
@@ -26,10 +49,42 @@ LOCAL_MODULE_CLASS := SHARED_LIBRARIES
 LOCAL_MODULE_OWNER := Intel
 LOCAL_MODULE_PATH := $(TARGET_OUT_VENDOR_SHARED_LIBRARIES)
 
+ifeq ($(BT_FW_PATCH_EMBEDDED), true)
+# Patches linked into the library as C tables, see FW_PATCH_EMBEDDED. All
+# the shipped patches unless the board names its own.
+BT_FW_EMBEDDED_PATCHES ?= $(basename $(notdir $(wildcard $(LOCAL_PATH)/fw/*.seq)))
+BT_FW_EMBEDDED_SRCS := $(foreach patch,$(BT_FW_EMBEDDED_PATCHES),$(LOCAL_PATH)/fw/$(patch).seq)
+BT_FW_EMBEDDED_GEN := $(local-intermediates-dir)/fw_embedded_data.c
+BT_FW_EMBEDDED_TOOL := $(HOST_OUT_EXECUTABLES)/bt_seq2bseq$(HOST_EXECUTABLE_SUFFIX)
+
+$(BT_FW_EMBEDDED_GEN): PRIVATE_SRCS := $(BT_FW_EMBEDDED_SRCS)
+$(BT_FW_EMBEDDED_GEN): PRIVATE_TOOL := $(BT_FW_EMBEDDED_TOOL)
+$(BT_FW_EMBEDDED_GEN): $(BT_FW_EMBEDDED_SRCS) $(BT_FW_EMBEDDED_TOOL)
+	@mkdir -p $(dir $@)
+	$(hide) $(PRIVATE_TOOL) $(BT_SEQ2BSEQ_REPACK) -c $@ $(PRIVATE_SRCS)
+
+LOCAL_GENERATED_SOURCES += $(BT_FW_EMBEDDED_GEN)
+LOCAL_CFLAGS += -DFW_PATCH_EMBEDDED=TRUE
+endif
+
+ifeq ($(BT_FW_PATCH_REPACK), true)
+LOCAL_CFLAGS += -DFW_PATCH_REPACK=TRUE
+endif
+
 include $(LOCAL_PATH)/vnd_buildcfg.mk
 
 include $(BUILD_SHARED_LIBRARY)
 
-include $(LOCAL_PATH)/cert/bt_cert.mk
+# Host tools and the binary patch-files they compile. The tools use Linux
+# only APIs (ptys, termios2, --wrap), and only a device that opts out of
+# the .seq patch-files (fw/btfw.mk) or embeds the patches needs them.
+ifeq ($(HOST_OS),linux)
+ifneq ($(filter-out seq,$(BT_FW_PATCH_FORMAT))$(filter true,$(BT_FW_PATCH_EMBEDDED)),)
+include $(BT_VENDOR_TOP)/tools/tools.mk
+include $(BT_VENDOR_TOP)/fw/bseq.mk
+endif
+endif
+
+include $(BT_VENDOR_TOP)/cert/bt_cert.mk
 
 endif # BOARD_HAVE_BLUETOOTH_IBT
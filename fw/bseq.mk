@@ -0,0 +1,45 @@
+# Binary firmware patch-files, compiled from the .seq patch-files at build
+# time so that the controller setup does not have to parse hex text. Each
+# patch is built both plain (.bseq) and deflated (.bseqz), and all of them
+# into one bundle; fw/btfw.mk selects which goes into the image.
+BT_FW_PATCHES := \
+        370710010002030d00 \
+        370710018002030d00 \
+        3707100180012d0d00 \
+        3707100100012d0d00
+
+BT_SEQ2BSEQ := $(HOST_OUT_EXECUTABLES)/bt_seq2bseq$(HOST_EXECUTABLE_SUFFIX)
+
+# $(1): patch name, $(2): extension, $(3): extra bt_seq2bseq options
+define bt-fw-bseq
+include $$(CLEAR_VARS)
+LOCAL_MODULE := $(1).$(2)
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE_CLASS := ETC
+LOCAL_MODULE_OWNER := Intel
+LOCAL_MODULE_PATH := $$(TARGET_OUT_ETC)/firmware
+include $$(BUILD_SYSTEM)/base_rules.mk
+$$(LOCAL_BUILT_MODULE): PRIVATE_SRC := $(BT_VENDOR_TOP)/fw/$(1).seq
+$$(LOCAL_BUILT_MODULE): PRIVATE_OPTS := $(3)
+$$(LOCAL_BUILT_MODULE): $(BT_VENDOR_TOP)/fw/$(1).seq $$(BT_SEQ2BSEQ)
+	@mkdir -p $$(dir $$@)
+	$$(hide) $$(BT_SEQ2BSEQ) $$(BT_SEQ2BSEQ_REPACK) $$(PRIVATE_OPTS) $$(PRIVATE_SRC) $$@
+endef
+
+$(foreach patch,$(BT_FW_PATCHES),$(eval $(call bt-fw-bseq,$(patch),bseq,)))
+$(foreach patch,$(BT_FW_PATCHES),$(eval $(call bt-fw-bseq,$(patch),bseqz,-z)))
+
+# All the patches in one bundle, their records stored once
+BT_FW_BUNDLE_SRCS := $(foreach patch,$(BT_FW_PATCHES),$(BT_VENDOR_TOP)/fw/$(patch).seq)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := ibt_patches.bundle
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE_CLASS := ETC
+LOCAL_MODULE_OWNER := Intel
+LOCAL_MODULE_PATH := $(TARGET_OUT_ETC)/firmware
+include $(BUILD_SYSTEM)/base_rules.mk
+$(LOCAL_BUILT_MODULE): PRIVATE_SRCS := $(BT_FW_BUNDLE_SRCS)
+$(LOCAL_BUILT_MODULE): $(BT_FW_BUNDLE_SRCS) $(BT_SEQ2BSEQ)
+	@mkdir -p $(dir $@)
+	$(hide) $(BT_SEQ2BSEQ) $(BT_SEQ2BSEQ_REPACK) -b $@ $(PRIVATE_SRCS)
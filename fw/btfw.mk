@@ -1,8 +1,29 @@
-# Firmware patch-file
-PRODUCT_COPY_FILES += \
-        vendor/intel/hardware/bluetooth/fw/370710010002030d00.seq:system/etc/firmware/370710010002030d00.seq \
-        vendor/intel/hardware/bluetooth/fw/370710018002030d00.seq:system/etc/firmware/370710018002030d00.seq \
-        vendor/intel/hardware/bluetooth/fw/3707100180012d0d00.seq:system/etc/firmware/3707100180012d0d00.seq \
-        vendor/intel/hardware/bluetooth/fw/3707100100012d0d00.seq:system/etc/firmware/3707100100012d0d00.seq
+# Firmware patch-files, in the format selected by BT_FW_PATCH_FORMAT, set
+# by the device makefile before this one is inherited; the textual .seq
+# patch-files unless the device opts in to a binary format:
+#   seq   : the textual patch-files, decoded at each controller setup
+#   bseq  : binary patch-files, mapped as they are
+#   bseqz : binary patch-files deflated, inflated on the fly while they
+#           are downloaded; the smallest in the system image
+#   bundle: one file holding every patch, each distinct record once,
+#           mapped once whatever the variant
+#   none  : no patch-file, the patches are linked into the library
+#           (BT_FW_PATCH_EMBEDDED := true in BoardConfig.mk)
+BT_FW_PATCH_FORMAT ?= seq
 
+BT_FW_PATCH_NAMES := \
+        370710010002030d00 \
+        370710018002030d00 \
+        3707100180012d0d00 \
+        3707100100012d0d00
 
+ifeq ($(BT_FW_PATCH_FORMAT),seq)
+PRODUCT_COPY_FILES += \
+        $(foreach patch,$(BT_FW_PATCH_NAMES),vendor/intel/hardware/bluetooth/fw/$(patch).seq:system/etc/firmware/$(patch).seq)
+else ifeq ($(BT_FW_PATCH_FORMAT),bundle)
+PRODUCT_PACKAGES += \
+        ibt_patches.bundle
+else ifneq ($(BT_FW_PATCH_FORMAT),none)
+PRODUCT_PACKAGES += \
+        $(addsuffix .$(BT_FW_PATCH_FORMAT),$(BT_FW_PATCH_NAMES))
+endif
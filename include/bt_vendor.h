@@ -66,10 +66,110 @@
 #define FW_PATCHFILE_LOCATION "/vendor/firmware/"  /* maguro */
 #endif
 
+/* UART_TARGET_BAUD_RATE
+
+    UART rate of the firmware download. Any line speed can be given: rates
+    without a TCIO Bxxx constant (e.g. 3250000, where the UART clock has an
+    exact divisor) are set on the host through termios2/BOTHER, and fall
+    back to the closest standard rate where the driver does not take them.
+    Can be overridden with UartBaud in the run-time conf file. Whether the
+    rate is probed is only set by UART_BAUD_AUTO (UartBaudAuto).
+*/
 #ifndef UART_TARGET_BAUD_RATE
 #define UART_TARGET_BAUD_RATE           3000000
 #endif
 
+/* UART_BAUD_AUTO
+
+    Find the download rate of the board instead of using
+    UART_TARGET_BAUD_RATE. On the first open of a port, the controller is
+    stepped up through HCI_VSC_UPDATE_BAUDRATE to each supported rate, and
+    to the UartBaud rate if it is not one of them, up to
+    UART_BAUD_AUTO_MAX, and every rate checked with a few RDSW_VERSION
+    exchanges; the highest rate that passes is kept for the port in
+    UART_BAUD_AUTO_CACHE. The rate that fails costs a power cycle of the
+    controller. A download at the kept rate that the UART fails (framing,
+    parity or overrun errors on the host UART, a wrong first answer after
+    the rate switch, or the controller gone silent) moves the port one rate
+    down for the next enable; other download failures leave it. After
+    UART_BAUD_AUTO_REPROBE clean downloads at a rate moved down, 0 for
+    never, the port is probed again. Can be overridden with UartBaudAuto
+    (0/1) in the run-time conf file.
+*/
+#ifndef UART_BAUD_AUTO
+#define UART_BAUD_AUTO                  FALSE
+#endif
+
+#ifndef UART_BAUD_AUTO_MAX
+#define UART_BAUD_AUTO_MAX              4000000
+#endif
+
+#ifndef UART_BAUD_AUTO_CACHE
+#define UART_BAUD_AUTO_CACHE            "/data/misc/bluedroid/bt_uart_baud"
+#endif
+
+#ifndef UART_BAUD_AUTO_REPROBE
+#define UART_BAUD_AUTO_REPROBE          20
+#endif
+
+/* UART_FLOW_CONTROL
+
+    RTS/CTS flow control of the UART. Only to be turned off on boards
+    without the handshake lines wired, as measured with bt_uartbench. Can be
+    overridden with UartFlowControl (0/1) in the run-time conf file.
+*/
+#ifndef UART_FLOW_CONTROL
+#define UART_FLOW_CONTROL               TRUE
+#endif
+
+/* UART_LATENCY_PROFILE
+
+    Serial settings of the HCI tty. UART_LATENCY_LOW asks the driver for
+    ASYNC_LOW_LATENCY, so that received bytes reach the reader without
+    waiting for the tty work queue, and has reads return on the first byte
+    (VMIN 1, VTIME 0); SCO over UART and HID reports depend on the wakeup
+    latency. UART_LATENCY_DEFAULT, the default, leaves the driver settings
+    alone; a board opts in with UART_LATENCY_PROFILE = UART_LATENCY_LOW in
+    its vnd_<board>.txt, or with UartLatencyProfile (default/low) in the
+    run-time conf file.
+
+    UART_XMIT_FIFO_SIZE is the transmit FIFO given to the driver along with
+    ASYNC_LOW_LATENCY, 0 to keep the size the driver has.
+*/
+#define UART_LATENCY_DEFAULT            0
+#define UART_LATENCY_LOW                1
+
+#ifndef UART_LATENCY_PROFILE
+#define UART_LATENCY_PROFILE            UART_LATENCY_DEFAULT
+#endif
+
+#ifndef UART_XMIT_FIFO_SIZE
+#define UART_XMIT_FIFO_SIZE             0
+#endif
+
+/* UART_DEMUX
+
+    Command over ACL priority on the UART. The library splits the H4
+    stream and gives the stack one socket per HCI channel (CH_CMD, CH_EVT,
+    CH_ACL_OUT, CH_ACL_IN) instead of the UART fd for all of them. Commands
+    are written ahead of queued ACL data, and a packet is only handed to
+    the UART once the driver queue is down to UART_DEMUX_TX_BACKLOG bytes,
+    so that a command waits behind at most one ACL packet. Only for a stack
+    built with the multi-channel transport (BLUETOOTH_HCI_USE_MCT := true).
+
+    It does nothing for voice: that transport has no SCO channel, so the
+    demultiplexer does not start when SCO_PCM_ROUTING sends SCO to the
+    transport, and the stack gets the UART fd as without it. Can be
+    overridden with UartDemux (0/1) in the run-time conf file.
+*/
+#ifndef UART_DEMUX
+#define UART_DEMUX                      FALSE
+#endif
+
+#ifndef UART_DEMUX_TX_BACKLOG
+#define UART_DEMUX_TX_BACKLOG           32
+#endif
+
 /* Enabling this flag will disable Hardware RF Kill implementation and
  * will send a Software RF Kill command to the Controller whenever BT
  * is made off. BT Controller will revive from SW RF KILL-ed state when
@@ -96,6 +196,134 @@
 #define FW_PATCH_SETTLEMENT_DELAY_MS          0
 #endif
 
+/* FW_PATCH_PIPELINE_DEPTH
+
+    Number of firmware patch records kept in flight during the download.
+    The window is further narrowed to the Num_HCI_Command_Packets reported
+    by the controller. Records other than MEMWRITE, and records the patch
+    file expects more than a Command Complete for, are always sent one at
+    a time. 1 sends every record only after the previous one completed.
+    Can be overridden with FwPatchPipelineDepth in the run-time conf file
+    (1 to 8, the depth of the stack's internal command queue).
+*/
+#ifndef FW_PATCH_PIPELINE_DEPTH
+#define FW_PATCH_PIPELINE_DEPTH         1
+#endif
+
+/* FW_PATCH_PRELOAD
+
+    Load the candidate patches of FwPatchFilePath on a worker thread from
+    init() and BT_VND_OP_POWER_CTRL on, overlapping the file I/O with the
+    power ramp and the UART open. Not used with FwPatchFileName, nor with
+    FW_PATCH_EMBEDDED. Off by default, as it adds a thread and loads every
+    patch of the index while only one is downloaded; a board opts in with
+    FW_PATCH_PRELOAD = TRUE in its vnd_<board>.txt.
+*/
+#ifndef FW_PATCH_PRELOAD
+#define FW_PATCH_PRELOAD                FALSE
+#endif
+
+/* FW_PATCH_STREAM
+
+    Read and decode .seq patch files on a worker thread while they are
+    downloaded, instead of loading the whole file when it is opened. The
+    HCI thread then only takes decoded records from a ring of
+    FW_PATCH_STREAM_DEPTH entries. .bseq files are always mapped. Off by
+    default, as it adds a thread per download; a board opts in with
+    FW_PATCH_STREAM = TRUE in its vnd_<board>.txt.
+*/
+#ifndef FW_PATCH_STREAM
+#define FW_PATCH_STREAM                 FALSE
+#endif
+
+#ifndef FW_PATCH_STREAM_DEPTH
+#define FW_PATCH_STREAM_DEPTH           32
+#endif
+
+/* FW_PATCH_REPACK
+
+    Merge the MEMWRITE records of a .seq patch that write contiguous
+    controller memory, and re-split them into commands of
+    FW_PATCH_REPACK_CHUNK data bytes (at most 249), when the patch is
+    loaded. Non-MEMWRITE records stay where they are and end the merge.
+    .bseq files are repacked by bt_seq2bseq -r when they are built. Off by
+    default: the shipped patches gain nothing from it, and the controller
+    then gets the vendor's command sequence as it is. A board turns it on
+    with BT_FW_PATCH_REPACK := true in BoardConfig.mk, which sets both.
+*/
+#ifndef FW_PATCH_REPACK
+#define FW_PATCH_REPACK                 FALSE
+#endif
+
+/* Largest MEMWRITE of the shipped patches */
+#ifndef FW_PATCH_REPACK_CHUNK
+#define FW_PATCH_REPACK_CHUNK           0xF4
+#endif
+
+/* FW_PATCH_CACHE
+
+    Compile a .seq patch into the .bseq form the first time it is used,
+    and keep it in FW_PATCH_CACHE_DIR; later enables map the cached file
+    instead of decoding the text. A cached patch is used while its source
+    keeps the same path, size and mtime, or the same content. Off by
+    default, as it writes to /data and has the library load what it finds
+    there; a board opts in with FW_PATCH_CACHE = TRUE in its
+    vnd_<board>.txt, or by giving the directory with FwPatchCacheDir in the
+    run-time conf file ("none" turning the cache off).
+*/
+#ifndef FW_PATCH_CACHE
+#define FW_PATCH_CACHE                  FALSE
+#endif
+
+#ifndef FW_PATCH_CACHE_DIR
+#define FW_PATCH_CACHE_DIR              "/data/misc/bluedroid/fw_cache"
+#endif
+
+/* FW_PATCH_EMBEDDED
+
+    Link the patches of the board into the library as constant record
+    tables, generated from the .seq files by bt_seq2bseq -c at build time
+    (BT_FW_PATCH_EMBEDDED := true in BoardConfig.mk, which also sets this
+    flag). HW_CFG_INTEL_OPEN_PATCHFILE then takes the patch of the RDSW
+    version key from the tables, without any file access; patch files are
+    only looked for when the key is not embedded, or with FwPatchFileName.
+*/
+#ifndef FW_PATCH_EMBEDDED
+#define FW_PATCH_EMBEDDED               FALSE
+#endif
+
+/* FW_PATCH_DIRECT
+
+    Download the firmware from BT_VND_OP_USERIAL_OPEN, writing the commands
+    to the UART and reading the events back in the vendor library, before
+    the stack takes the fd over. The following FW_CFG only reports the
+    result, or falls back to the download through the stack if it failed.
+    Can be overridden with FwPatchDirect (0/1) in the run-time conf file.
+*/
+#ifndef FW_PATCH_DIRECT
+#define FW_PATCH_DIRECT                 FALSE
+#endif
+
+/* VND_TRACE_RING_SIZE
+
+    Number of events kept by the binary trace ring (vnd_trace.h), a power
+    of two. The ring is dumped to the log when the firmware configuration
+    fails and on BT_VND_OP_INTEL_DUMP_TRACE.
+*/
+#ifndef VND_TRACE_RING_SIZE
+#define VND_TRACE_RING_SIZE             256
+#endif
+
+/* VND_TRACE_DEFAULT_LEVEL
+
+    Verbosity of every subsystem until overridden with TraceVendor,
+    TraceHw, TraceUserial or TraceUpio in the run-time conf file.
+    0: off, 1: trace ring only, 2: trace ring and debug log
+*/
+#ifndef VND_TRACE_DEFAULT_LEVEL
+#define VND_TRACE_DEFAULT_LEVEL         1
+#endif
+
 /* The Bluetooth Device Aaddress source switch:
  *
  * -FALSE- (default value)
@@ -373,6 +601,21 @@
 #define HW_END_WITH_HCI_RESET    TRUE
 #endif
 
+/* Private vendor ops, above the range of bt_vendor_opcode_t */
+
+/* BT_VND_OP_INTEL_GET_FW_STATS
+
+    Timing of the last firmware configuration, param is a fw_stats_t *
+    (fw_stats.h). Returns 0, or -1 while no FW_CFG has finished yet.
+*/
+#define BT_VND_OP_INTEL_GET_FW_STATS    0x1000
+
+/* BT_VND_OP_INTEL_DUMP_TRACE
+
+    Log the content of the trace ring, param is unused
+*/
+#define BT_VND_OP_INTEL_DUMP_TRACE      0x1001
+
 /******************************************************************************
 **  Extern variables and functions
 ******************************************************************************/
@@ -0,0 +1,134 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      fw_bundle.h
+ *
+ *  Description:   Patch bundle, the patches of several version keys in one
+ *                 file. Each distinct record is stored once, and every key
+ *                 maps to the sequence of records of its patch. The file is
+ *                 memory-mapped once, whatever the number of keys opened
+ *                 from it, and the records are sent from the mapping.
+ *
+ ******************************************************************************/
+
+#ifndef FW_BUNDLE_H
+#define FW_BUNDLE_H
+
+#include <stdint.h>
+#include "fw_patch.h"
+
+/******************************************************************************
+**  Constants & Macros
+******************************************************************************/
+
+#define FW_BUNDLE_MAGIC             "IBTB"
+#define FW_BUNDLE_MAGIC_LEN         4
+#define FW_BUNDLE_FORMAT_VERSION    1
+
+/* Record ids of the sequences are 16 bits */
+#define FW_BUNDLE_REC_MAX           0xFFFF
+
+/******************************************************************************
+**  Type definitions
+******************************************************************************/
+
+/* Bundle file header (all fields little endian)
+ *
+ * The header is followed by, at their offsets:
+ *   key_count fw_bundle_key_t
+ *   rec_count uint32_t, offset of each distinct record in the data
+ *   seq_count uint16_t, record ids, the sequences of all the keys
+ *   data_size bytes of records, in the fw_patch_hdr_t record format
+ * The tables are aligned on their entry size. crc covers the file from
+ * hdr_len to its end.
+ */
+typedef struct
+{
+    uint8_t  magic[FW_BUNDLE_MAGIC_LEN];    /* FW_BUNDLE_MAGIC */
+    uint16_t version;                       /* FW_BUNDLE_FORMAT_VERSION */
+    uint16_t hdr_len;                       /* size of this header */
+    uint16_t key_count;
+    uint16_t reserved;
+    uint32_t rec_count;                     /* distinct records */
+    uint32_t key_offset;
+    uint32_t tbl_offset;
+    uint32_t seq_offset;
+    uint32_t seq_count;
+    uint32_t data_offset;
+    uint32_t data_size;
+    uint32_t crc;                           /* CRC-32 after the header */
+} fw_bundle_hdr_t;
+
+/* Patch of one version key */
+typedef struct
+{
+    uint8_t  key[FW_PATCH_KEY_LEN];         /* RDSW version key */
+    uint8_t  reserved[3];
+    uint32_t seq_start;                     /* first record id in the seqs */
+    uint32_t rec_count;                     /* records of the patch */
+    uint32_t cmd_count;                     /* of which commands */
+    uint32_t rec_size;                      /* size of the records */
+} fw_bundle_key_t;
+
+/******************************************************************************
+**  Functions
+******************************************************************************/
+
+/*******************************************************************************
+**
+** Function        fw_bundle_keys
+**
+** Description     Read the version keys of the bundle p_path, up to max
+**
+** Returns         Number of keys copied to p_keys, -1 if not a bundle
+**
+*******************************************************************************/
+int fw_bundle_keys(const char *p_path, uint8_t (*p_keys)[FW_PATCH_KEY_LEN],
+                   int max);
+
+/*******************************************************************************
+**
+** Function        fw_bundle_open
+**
+** Description     Open the patch of version key p_key from the bundle
+**                 p_path. The bundle is checked and mapped on its first
+**                 open, and stays mapped while any of its patches is open.
+**
+** Returns         0 : Success
+**                 Otherwise : Fail, or no patch for the key
+**
+*******************************************************************************/
+int fw_bundle_open(const char *p_path, const uint8_t *p_key,
+                   fw_patch_t *p_patch);
+
+/*******************************************************************************
+**
+** Function        fw_bundle_save
+**
+** Description     Write the count patch images of p_patches, each with its
+**                 own key, to p_path as a bundle
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+int fw_bundle_save(fw_patch_t *p_patches, int count, const char *p_path);
+
+#endif /* FW_BUNDLE_H */
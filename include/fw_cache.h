@@ -0,0 +1,71 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      fw_cache.h
+ *
+ *  Description:   Cache of the compiled .seq patches. The first open of a
+ *                 .seq file decodes and repacks it, and writes the image as
+ *                 a .bseq file in FW_PATCH_CACHE_DIR; the following opens
+ *                 map that file. The cached file records the path, size,
+ *                 mtime and CRC-32 of its source after the .bseq header,
+ *                 and is rebuilt when they no longer match.
+ *
+ ******************************************************************************/
+
+#ifndef FW_CACHE_H
+#define FW_CACHE_H
+
+#include <stdint.h>
+#include "fw_patch.h"
+
+/******************************************************************************
+**  Functions
+******************************************************************************/
+
+/*******************************************************************************
+**
+** Function        fw_cache_open
+**
+** Description     Open the .seq patch p_src through the cache, repacked to
+**                 MEMWRITE commands of chunk data bytes. A valid cached
+**                 image is mapped; otherwise the source is loaded and the
+**                 cache written for the next open.
+**
+** Returns         0 : Success
+**                 Otherwise : Fail, cache disabled or not writable; the
+**                 caller opens the source itself
+**
+*******************************************************************************/
+int fw_cache_open(const char *p_src, uint8_t chunk, fw_patch_t *p_patch);
+
+/*******************************************************************************
+**
+** Function        fw_cache_set_dir
+**
+** Description     Conf entry setter of the cache directory, "none"
+**                 disables the cache
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+int fw_cache_set_dir(char *p_conf_name, char *p_conf_value, int param);
+
+#endif /* FW_CACHE_H */
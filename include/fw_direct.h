@@ -0,0 +1,68 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      fw_direct.h
+ *
+ *  Description:   Direct firmware download. Run from BT_VND_OP_USERIAL_OPEN,
+ *                 before the fd is handed over to the stack: the firmware
+ *                 configuration state machine of hardware.c runs unchanged,
+ *                 but its commands are written to the UART by the vendor
+ *                 library itself and the events read back by its own poll
+ *                 loop, instead of going through the HCI layer.
+ *
+ ******************************************************************************/
+
+#ifndef FW_DIRECT_H
+#define FW_DIRECT_H
+
+#include "bt_vendor_lib.h"
+
+/******************************************************************************
+**  Constants & Macros
+******************************************************************************/
+
+/* Commands waiting for their Command Complete/Status at most */
+#define FW_DIRECT_CMD_MAX       16
+
+/* Bytes of H4 packets collected before a write() */
+#define FW_DIRECT_TX_SIZE       4096
+
+/* Time allowed for the controller to answer a command */
+#define FW_DIRECT_EVT_TIMEOUT_MS 2000
+
+/******************************************************************************
+**  Functions
+******************************************************************************/
+
+/*******************************************************************************
+**
+** Function        fw_direct_run
+**
+** Description     Run the firmware configuration started by p_start over fd,
+**                 until it reports its result through fwcfg_cb. Events
+**                 other than Command Complete/Status go to p_evt_cback, if
+**                 set; it releases the buffer like a command callback.
+**
+** Returns         BT_VND_OP_RESULT_SUCCESS or BT_VND_OP_RESULT_FAIL
+**
+*******************************************************************************/
+int fw_direct_run(int fd, void (*p_start)(void), tINT_CMD_CBACK p_evt_cback);
+
+#endif /* FW_DIRECT_H */
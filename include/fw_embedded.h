@@ -0,0 +1,73 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      fw_embedded.h
+ *
+ *  Description:   Patches linked into the library (FW_PATCH_EMBEDDED). The
+ *                 tables are generated by bt_seq2bseq -c, with the records
+ *                 decoded and repacked as in a .bseq file.
+ *
+ ******************************************************************************/
+
+#ifndef FW_EMBEDDED_H
+#define FW_EMBEDDED_H
+
+#include <stdint.h>
+#include "fw_patch.h"
+
+/******************************************************************************
+**  Type definitions
+******************************************************************************/
+
+typedef struct
+{
+    uint8_t         key[FW_PATCH_KEY_LEN];  /* RDSW version key */
+    const uint8_t   *p_rec;                 /* record stream */
+    uint32_t        rec_size;
+    uint32_t        rec_count;
+    uint32_t        cmd_count;
+} fw_embedded_patch_t;
+
+/******************************************************************************
+**  Externs
+******************************************************************************/
+
+/* Generated tables, linked with FW_PATCH_EMBEDDED only */
+extern const fw_embedded_patch_t fw_embedded_patches[];
+extern const uint32_t fw_embedded_count;
+
+/******************************************************************************
+**  Functions
+******************************************************************************/
+
+/*******************************************************************************
+**
+** Function        fw_embedded_open
+**
+** Description     Open the embedded patch of version key p_key. The image
+**                 points to the constant tables, nothing is copied.
+**
+** Returns         0 : Success
+**                 Otherwise : no patch embedded for the key
+**
+*******************************************************************************/
+int fw_embedded_open(const uint8_t *p_key, fw_patch_t *p_patch);
+
+#endif /* FW_EMBEDDED_H */
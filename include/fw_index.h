@@ -0,0 +1,105 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      fw_index.h
+ *
+ *  Description:   Index of the firmware patch files, from RDSW version key
+ *                 to file. The patch directories (FwPatchFilePath, a ':'
+ *                 separated list in priority order) are scanned once; the
+ *                 index is kept across enable cycles and rebuilt when
+ *                 inotify reports a change in one of them.
+ *
+ ******************************************************************************/
+
+#ifndef FW_INDEX_H
+#define FW_INDEX_H
+
+#include <stdint.h>
+#include <limits.h>
+#include "fw_patch.h"
+
+/******************************************************************************
+**  Constants & Macros
+******************************************************************************/
+
+/* Patch directories searched at most */
+#define FW_INDEX_DIR_MAX        4
+
+/* Patch files indexed at most */
+#define FW_INDEX_MAX            32
+
+/* Separator of the directories in FwPatchFilePath */
+#define FW_INDEX_DIR_SEPARATOR  ':'
+
+/******************************************************************************
+**  Type definitions
+******************************************************************************/
+
+typedef struct
+{
+    uint8_t     key[FW_PATCH_KEY_LEN];
+    char        path[PATH_MAX];
+} fw_index_entry_t;
+
+/******************************************************************************
+**  Functions
+******************************************************************************/
+
+/*******************************************************************************
+**
+** Function        fw_index_lookup
+**
+** Description     Find the patch file of the version key in p_dirs. The
+**                 first directory holding it wins, and in a directory a
+**                 .bseq file is preferred over a .bseqz, then the .seq, then
+**                 a bundle holding the key.
+**
+** Returns         0 : Success, p_path filled
+**                 Otherwise : no patch file for the key
+**
+*******************************************************************************/
+int fw_index_lookup(const char *p_dirs, const uint8_t *p_key, char *p_path,
+                    size_t len);
+
+/*******************************************************************************
+**
+** Function        fw_index_list
+**
+** Description     Copy up to max entries of the index of p_dirs, one per
+**                 version key
+**
+** Returns         Number of entries, -1 if no directory could be read
+**
+*******************************************************************************/
+int fw_index_list(const char *p_dirs, fw_index_entry_t *p_entries, int max);
+
+/*******************************************************************************
+**
+** Function        fw_index_first_dir
+**
+** Description     Copy the first directory of p_dirs, without trailing '/'
+**
+** Returns         0 : Success
+**                 Otherwise : Fail, path too long
+**
+*******************************************************************************/
+int fw_index_first_dir(const char *p_dirs, char *p_dir, size_t len);
+
+#endif /* FW_INDEX_H */
@@ -0,0 +1,374 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      fw_patch.h
+ *
+ *  Description:   Contains definitions of the firmware patch image, loaded
+ *                 either from a precompiled binary patch (.bseq) or, as a
+ *                 fallback, from the textual patch file (.seq)
+ *
+ ******************************************************************************/
+
+#ifndef FW_PATCH_H
+#define FW_PATCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/******************************************************************************
+**  Constants & Macros
+******************************************************************************/
+
+#define FW_PATCH_SEQ_EXTENSION      ".seq"
+#define FW_PATCH_BIN_EXTENSION      ".bseq"
+#define FW_PATCH_ZIP_EXTENSION      ".bseqz"
+#define FW_PATCH_BUNDLE_EXTENSION   ".bundle"
+
+/* Patch file types, from the extension */
+#define FW_PATCH_FILE_SEQ           0
+#define FW_PATCH_FILE_BIN           1
+#define FW_PATCH_FILE_ZIP           2
+#define FW_PATCH_FILE_BUNDLE        3       /* fw_bundle.h */
+
+/* RDSW version bytes the patch applies to, also the patch file name */
+#define FW_PATCH_KEY_LEN            9
+#define FW_PATCH_KEY_STR_LEN        (2 * FW_PATCH_KEY_LEN)
+
+#define FW_PATCH_MAGIC              "IBTP"
+#define FW_PATCH_MAGIC_LEN          4
+#define FW_PATCH_FORMAT_VERSION     1
+
+/* Header flags */
+#define FW_PATCH_FLAG_DEFLATE       0x01    /* records are zlib compressed */
+
+/* Record types, as in the first column of the .seq file */
+#define FW_PATCH_REC_CMD            0x01
+#define FW_PATCH_REC_EVT            0x02
+
+/* HCI command/event preambles inside a record */
+#define FW_PATCH_CMD_PREAMBLE_SIZE  3
+#define FW_PATCH_EVT_PREAMBLE_SIZE  2
+
+/* Command Complete/Status events, and the offset of their
+ * Num_HCI_Command_Packets */
+#define FW_PATCH_EVT_CMD_CMPL       0x0E
+#define FW_PATCH_EVT_CMD_STAT       0x0F
+#define FW_PATCH_EVT_CMD_CMPL_NUM_PKTS 2
+#define FW_PATCH_EVT_CMD_STAT_NUM_PKTS 3
+
+/* Largest record: type byte and a command with 255 parameter bytes */
+#define FW_PATCH_REC_MAX            (1 + FW_PATCH_CMD_PREAMBLE_SIZE + 255)
+
+/* Records of a patch, at most; the shipped ones hold about 200. Bounds the
+ * records a binary patch header can ask memory for. */
+#define FW_PATCH_RECORDS_MAX        4096
+
+/* Leading bytes of an expected event that are compared; longer events
+ * only have their length checked beyond */
+#define FW_PATCH_EXPECT_LEN         16
+
+/* fw_patch_expect_match result when the event is the expected one */
+#define FW_PATCH_EXPECT_MATCH       (-1)
+
+/******************************************************************************
+**  Type definitions
+******************************************************************************/
+
+/* Binary patch file header (all fields little endian)
+ *
+ * The header is followed, at rec_offset, by rec_size bytes of records, or
+ * with FW_PATCH_FLAG_DEFLATE by their zlib stream up to the end of the
+ * file (the .bseqz container; rec_size and rec_crc are still those of the
+ * records). Each record is one type byte followed by the HCI packet exactly
+ * as it goes on the wire (without the H4 indicator):
+ *   FW_PATCH_REC_CMD: opcode (2), parameter length (1), parameters
+ *   FW_PATCH_REC_EVT: event code (1), parameter length (1), parameters
+ */
+typedef struct
+{
+    uint8_t  magic[FW_PATCH_MAGIC_LEN];     /* FW_PATCH_MAGIC */
+    uint16_t version;                       /* FW_PATCH_FORMAT_VERSION */
+    uint16_t hdr_len;                       /* size of this header */
+    uint8_t  key[FW_PATCH_KEY_LEN];         /* RDSW version key */
+    uint8_t  flags;
+    uint16_t reserved;
+    uint32_t rec_count;                     /* number of records */
+    uint32_t cmd_count;                     /* number of command records */
+    uint32_t rec_offset;                    /* file offset of the records */
+    uint32_t rec_size;                      /* size of the records */
+    uint32_t rec_crc;                       /* CRC-32 of the records */
+} fw_patch_hdr_t;
+
+/* One record of a patch image */
+typedef struct
+{
+    uint8_t         type;                   /* FW_PATCH_REC_CMD/EVT */
+    uint16_t        opcode;                 /* command opcode or event code */
+    const uint8_t   *p_pkt;                 /* HCI packet */
+    uint16_t        len;                    /* length of the HCI packet */
+    uint32_t        index;                  /* record index in the patch */
+} fw_patch_rec_t;
+
+/* Event expected from the controller, compiled from a FW_PATCH_REC_EVT
+ * record. The Num_HCI_Command_Packets of Command Complete/Status events
+ * is flow control, not part of the answer, and is not compared. */
+typedef struct
+{
+    uint16_t        len;                    /* length of the event */
+    uint8_t         cmp_len;                /* bytes of evt compared */
+    uint8_t         skip;                   /* offset not compared, 0: none */
+    uint8_t         evt[FW_PATCH_EXPECT_LEN];
+} fw_patch_expect_t;
+
+/* Record source of an image that is not held in memory (fw_stream.c) */
+typedef struct
+{
+    /* 1: *pp_rec set to the next record (type byte first), valid until
+     * the next call; 0: end of patch; -1: read or decoding error */
+    int             (*next)(void *p_ctx, const uint8_t **pp_rec);
+    void            (*close)(void *p_ctx);
+} fw_patch_src_t;
+
+/* Loaded patch image */
+typedef struct
+{
+    uint8_t         key[FW_PATCH_KEY_LEN];
+    const uint8_t   *p_rec;                 /* record stream */
+    uint32_t        rec_size;
+    uint32_t        rec_count;
+    uint32_t        cmd_count;
+    uint32_t        pos;                    /* read position in p_rec */
+    uint32_t        index;                  /* index of the next record */
+    void            *p_map;                 /* mmap()ed .bseq file */
+    size_t          map_len;
+    uint8_t         *p_alloc;               /* records decoded from .seq */
+    const fw_patch_src_t *p_src;            /* streamed image, else NULL */
+    void            *p_src_ctx;
+    uint8_t         error;                  /* the source failed */
+} fw_patch_t;
+
+/******************************************************************************
+**  Functions
+******************************************************************************/
+
+/*******************************************************************************
+**
+** Function        form_word
+**
+** Description     Convert input to a word
+**
+** Returns         formed word
+**
+*******************************************************************************/
+uint16_t form_word(uint8_t msb, uint8_t lsb);
+
+/*******************************************************************************
+**
+** Function        fw_patch_crc32
+**
+** Description     Update a CRC-32 (IEEE 802.3) over p_data
+**
+** Returns         updated CRC, start with 0
+**
+*******************************************************************************/
+uint32_t fw_patch_crc32(uint32_t crc, const uint8_t *p_data, size_t len);
+
+/*******************************************************************************
+**
+** Function        fw_patch_file_type
+**
+** Description     Tell the type of a patch file from its extension
+**
+** Returns         FW_PATCH_FILE_BIN/ZIP/BUNDLE, FW_PATCH_FILE_SEQ for any
+**                 other
+**
+*******************************************************************************/
+int fw_patch_file_type(const char *p_path);
+
+/*******************************************************************************
+**
+** Function        fw_patch_check_hdr
+**
+** Description     Check the header of a binary patch file of file_len bytes
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+int fw_patch_check_hdr(const fw_patch_hdr_t *p_hdr, size_t file_len);
+
+/*******************************************************************************
+**
+** Function        fw_patch_rec_len
+**
+** Description     Length of the record at p (type byte included). avail is
+**                 the number of bytes available at p.
+**
+** Returns         record length, 0 if the record is malformed or does not
+**                 fit in avail
+**
+*******************************************************************************/
+uint32_t fw_patch_rec_len(const uint8_t *p, uint32_t avail);
+
+/*******************************************************************************
+**
+** Function        fw_patch_key_from_name
+**
+** Description     Extract the version key from a patch file name, i.e. the
+**                 leading FW_PATCH_KEY_STR_LEN hex digits of its base name
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+int fw_patch_key_from_name(const char *p_name, uint8_t *p_key);
+
+/*******************************************************************************
+**
+** Function        fw_patch_decode_line
+**
+** Description     Decode one line of a .seq patch file into a record of at
+**                 most max bytes at p_out. line_no is for the error log.
+**
+** Returns         Record length, 0 if the line is not a record, -1 if it is
+**                 malformed
+**
+*******************************************************************************/
+int fw_patch_decode_line(const char *p_line, size_t len, int line_no,
+                         uint8_t *p_out, size_t max);
+
+/*******************************************************************************
+**
+** Function        fw_patch_parse_seq
+**
+** Description     Decode the text of a .seq patch file into a patch image
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+int fw_patch_parse_seq(const char *p_text, size_t len, fw_patch_t *p_patch);
+
+/*******************************************************************************
+**
+** Function        fw_patch_open
+**
+** Description     Load the patch file p_path. A .bseq file is memory-mapped
+**                 and used in place, a .bseqz file is inflated, any other
+**                 file is decoded as .seq text.
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+int fw_patch_open(const char *p_path, fw_patch_t *p_patch);
+
+/*******************************************************************************
+**
+** Function        fw_patch_next
+**
+** Description     Fetch the next record of the patch image. p_rec->p_pkt
+**                 stays valid until the next call.
+**
+** Returns         TRUE when p_rec was filled, FALSE at the end of the patch
+**                 or, with error set, when a streamed image failed
+**
+*******************************************************************************/
+int fw_patch_next(fw_patch_t *p_patch, fw_patch_rec_t *p_rec);
+
+/*******************************************************************************
+**
+** Function        fw_patch_expect_compile
+**
+** Description     Compile the event record p_rec for fw_patch_expect_match
+**
+** Returns         None
+**
+*******************************************************************************/
+void fw_patch_expect_compile(const fw_patch_rec_t *p_rec,
+                             fw_patch_expect_t *p_exp);
+
+/*******************************************************************************
+**
+** Function        fw_patch_expect_match
+**
+** Description     Compare the event p_evt (event code first) of len bytes
+**                 with the expected one
+**
+** Returns         FW_PATCH_EXPECT_MATCH, or the offset of the first byte
+**                 that differs (len for a length mismatch)
+**
+*******************************************************************************/
+int fw_patch_expect_match(const fw_patch_expect_t *p_exp,
+                          const uint8_t *p_evt, uint16_t len);
+
+/*******************************************************************************
+**
+** Function        fw_patch_rewind
+**
+** Description     Restart reading the patch image from its first record,
+**                 for images held in memory
+**
+** Returns         None
+**
+*******************************************************************************/
+void fw_patch_rewind(fw_patch_t *p_patch);
+
+/*******************************************************************************
+**
+** Function        fw_patch_save
+**
+** Description     Write the patch image to p_path as a binary patch file,
+**                 compressed if flags has FW_PATCH_FLAG_DEFLATE
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+int fw_patch_save(const fw_patch_t *p_patch, const char *p_path,
+                  uint8_t flags);
+
+/*******************************************************************************
+**
+** Function        fw_patch_save_ext
+**
+** Description     fw_patch_save with ext_len bytes of p_ext appended to the
+**                 header, hdr_len covering them. The file is synced before
+**                 it is closed.
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+int fw_patch_save_ext(const fw_patch_t *p_patch, const char *p_path,
+                      uint8_t flags, const void *p_ext, uint16_t ext_len);
+
+/*******************************************************************************
+**
+** Function        fw_patch_close
+**
+** Description     Release the patch image
+**
+** Returns         None
+**
+*******************************************************************************/
+void fw_patch_close(fw_patch_t *p_patch);
+
+#endif /* FW_PATCH_H */
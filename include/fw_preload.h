@@ -0,0 +1,88 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      fw_preload.h
+ *
+ *  Description:   Background preload of the firmware patches. A worker
+ *                 thread started from init()/BT_VND_OP_POWER_CTRL loads the
+ *                 image of every version key of the patch index, so that
+ *                 HW_CFG_INTEL_OPEN_PATCHFILE only has to pick the one
+ *                 matching the RDSW version of the controller.
+ *
+ ******************************************************************************/
+
+#ifndef FW_PRELOAD_H
+#define FW_PRELOAD_H
+
+#include <stdint.h>
+#include "fw_patch.h"
+
+/******************************************************************************
+**  Constants & Macros
+******************************************************************************/
+
+/* Images kept at most, one per controller version */
+#define FW_PRELOAD_MAX          8
+
+/* fw_preload_take results */
+#define FW_PRELOAD_FOUND        0
+#define FW_PRELOAD_UNAVAILABLE  (-1)    /* not preloaded, look it up */
+
+/******************************************************************************
+**  Functions
+******************************************************************************/
+
+/*******************************************************************************
+**
+** Function        fw_preload_start
+**
+** Description     Start loading the patches of p_dirs on a worker thread,
+**                 unless images are already loaded or being loaded
+**
+** Returns         None
+**
+*******************************************************************************/
+void fw_preload_start(const char *p_dirs);
+
+/*******************************************************************************
+**
+** Function        fw_preload_take
+**
+** Description     Wait for the worker and hand over the image of the given
+**                 version key to p_patch. The other images are released.
+**
+** Returns         FW_PRELOAD_FOUND, or FW_PRELOAD_UNAVAILABLE if the key
+**                 was not preloaded
+**
+*******************************************************************************/
+int fw_preload_take(const uint8_t *p_key, fw_patch_t *p_patch);
+
+/*******************************************************************************
+**
+** Function        fw_preload_cleanup
+**
+** Description     Stop the worker and release the images
+**
+** Returns         None
+**
+*******************************************************************************/
+void fw_preload_cleanup(void);
+
+#endif /* FW_PRELOAD_H */
@@ -0,0 +1,148 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      fw_repack.h
+ *
+ *  Description:   Patch optimisation pass. MEMWRITE records writing
+ *                 contiguous controller memory are merged and re-split into
+ *                 commands of the largest payload, so the download takes as
+ *                 few round trips as possible. Any other record, and any
+ *                 MEMWRITE the patch expects more than a successful Command
+ *                 Complete for, is kept as it is and ends the merge.
+ *
+ *                 Records are pushed one at a time and come out through a
+ *                 callback, for the streamed images; fw_repack_image runs
+ *                 the pass over an image held in memory.
+ *
+ ******************************************************************************/
+
+#ifndef FW_REPACK_H
+#define FW_REPACK_H
+
+#include <stdint.h>
+#include "fw_patch.h"
+
+/******************************************************************************
+**  Constants & Macros
+******************************************************************************/
+
+#define FW_REPACK_MEMWRITE          0xFC8E
+
+/* MEMWRITE parameters: address (4), mode (1), data length (1), data */
+#define FW_REPACK_MEMWRITE_HDR_SIZE 6
+
+/* Largest MEMWRITE data that fits an HCI command */
+#define FW_REPACK_DATA_MAX          (255 - FW_REPACK_MEMWRITE_HDR_SIZE)
+
+/* Data per MEMWRITE after repacking, the largest of the shipped patches */
+#define FW_REPACK_CHUNK_DEFAULT     0xF4
+
+/* Command Complete of a MEMWRITE: event code, length, credits, opcode,
+ * status */
+#define FW_REPACK_EVT_LEN           6
+
+/******************************************************************************
+**  Type definitions
+******************************************************************************/
+
+/* Receives every record of the repacked patch, type byte first.
+ * Returns 0, or non-zero to stop the pass. */
+typedef int (*fw_repack_emit_t)(void *p_ctx, const uint8_t *p_rec,
+                                size_t len);
+
+typedef struct
+{
+    uint8_t         chunk;                  /* data per MEMWRITE, 0: off */
+    fw_repack_emit_t p_emit;
+    void            *p_ctx;
+
+    /* MEMWRITE held until the records after it show its events */
+    uint8_t         cand[FW_PATCH_REC_MAX];
+    uint8_t         cand_evt[FW_REPACK_EVT_LEN];
+    uint8_t         cand_state;
+
+    /* Contiguous data merged so far, not sent yet */
+    uint32_t        run_addr;
+    uint8_t         run_mode;
+    uint16_t        run_len;
+    uint8_t         run_evt[FW_REPACK_EVT_LEN];
+    uint8_t         run[FW_REPACK_DATA_MAX + FW_REPACK_DATA_MAX];
+
+    uint32_t        cmds_in;                /* commands pushed */
+    uint32_t        cmds_out;               /* commands emitted */
+    uint32_t        recs_out;               /* records emitted */
+} fw_repack_t;
+
+/******************************************************************************
+**  Functions
+******************************************************************************/
+
+/*******************************************************************************
+**
+** Function        fw_repack_init
+**
+** Description     Start a pass emitting MEMWRITE commands of at most chunk
+**                 data bytes (FW_REPACK_DATA_MAX at most). A chunk of 0
+**                 passes the records through unchanged.
+**
+** Returns         None
+**
+*******************************************************************************/
+void fw_repack_init(fw_repack_t *p_rp, uint8_t chunk, fw_repack_emit_t p_emit,
+                    void *p_ctx);
+
+/*******************************************************************************
+**
+** Function        fw_repack_push
+**
+** Description     Feed the next record of the patch, type byte first
+**
+** Returns         0 : Success
+**                 Otherwise : the emit callback failed
+**
+*******************************************************************************/
+int fw_repack_push(fw_repack_t *p_rp, const uint8_t *p_rec);
+
+/*******************************************************************************
+**
+** Function        fw_repack_flush
+**
+** Description     End of patch, emit what is still held
+**
+** Returns         0 : Success
+**                 Otherwise : the emit callback failed
+**
+*******************************************************************************/
+int fw_repack_flush(fw_repack_t *p_rp);
+
+/*******************************************************************************
+**
+** Function        fw_repack_image
+**
+** Description     Repack a patch image held in memory in place; a mapped
+**                 image is replaced by an allocated copy
+**
+** Returns         0 : Success
+**                 Otherwise : Fail, the image is unchanged
+**
+*******************************************************************************/
+int fw_repack_image(fw_patch_t *p_patch, uint8_t chunk);
+
+#endif /* FW_REPACK_H */
@@ -0,0 +1,162 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      fw_stats.h
+ *
+ *  Description:   Timing of the firmware configuration. Every command sent
+ *                 by hw_config_cback is stamped against the stage it belongs
+ *                 to, and its round trip is taken from the matching Command
+ *                 Complete/Status. The summary is logged when FW_CFG ends and
+ *                 can be read back with BT_VND_OP_INTEL_GET_FW_STATS.
+ *
+ ******************************************************************************/
+
+#ifndef FW_STATS_H
+#define FW_STATS_H
+
+#include <stdint.h>
+
+/******************************************************************************
+**  Constants & Macros
+******************************************************************************/
+
+/* Stages of the firmware configuration */
+enum {
+    FW_STAT_HCI_RESET,
+    FW_STAT_RDSW_VERSION,
+    FW_STAT_OPEN_PATCHFILE,             /* patch lookup and open, no command */
+    FW_STAT_SET_UART_BAUD,              /* UART clock and both rate switches */
+    FW_STAT_MANUFACTURE_ON,
+    FW_STAT_MEMWRITE,                   /* every record of the patch */
+    FW_STAT_MANUFACTURE_OFF,            /* resets the controller */
+    FW_STAT_RDSW_VERSION_RECHECK,
+    FW_STAT_STAGE_MAX
+};
+
+/* Result while the configuration is still running */
+#define FW_STATS_RESULT_NONE        (-1)
+
+/******************************************************************************
+**  Type definitions
+******************************************************************************/
+
+/* All times in microseconds */
+typedef struct
+{
+    uint32_t    count;                  /* round trips taken */
+    uint32_t    min_us;
+    uint32_t    avg_us;
+    uint32_t    max_us;
+    uint32_t    p99_us;
+    uint32_t    start_us;               /* stage entered, from FW_CFG */
+    uint32_t    end_us;                 /* last round trip of the stage done */
+} fw_stats_stage_t;
+
+typedef struct
+{
+    int32_t             result;         /* BT_VND_OP_RESULT_* or NONE */
+    uint32_t            total_us;       /* FW_CFG to its fwcfg_cb */
+    fw_stats_stage_t    stage[FW_STAT_STAGE_MAX];
+} fw_stats_t;
+
+/******************************************************************************
+**  Functions
+******************************************************************************/
+
+/*******************************************************************************
+**
+** Function        fw_stats_start
+**
+** Description     Drop the previous run and take the FW_CFG timestamp
+**
+** Returns         None
+**
+*******************************************************************************/
+void fw_stats_start(void);
+
+/*******************************************************************************
+**
+** Function        fw_stats_now
+**
+** Description     Microseconds since fw_stats_start
+**
+** Returns         Timestamp
+**
+*******************************************************************************/
+uint32_t fw_stats_now(void);
+
+/*******************************************************************************
+**
+** Function        fw_stats_cmd_sent
+**
+** Description     A command of the given stage is handed to xmit_cb
+**
+** Returns         None
+**
+*******************************************************************************/
+void fw_stats_cmd_sent(uint8_t stage);
+
+/*******************************************************************************
+**
+** Function        fw_stats_cmd_done
+**
+** Description     The oldest command in flight completed, take its round trip
+**
+** Returns         None
+**
+*******************************************************************************/
+void fw_stats_cmd_done(void);
+
+/*******************************************************************************
+**
+** Function        fw_stats_add
+**
+** Description     Take a sample of the given stage that started at start_us
+**                 (from fw_stats_now) and ends now
+**
+** Returns         None
+**
+*******************************************************************************/
+void fw_stats_add(uint8_t stage, uint32_t start_us);
+
+/*******************************************************************************
+**
+** Function        fw_stats_finish
+**
+** Description     FW_CFG reported result, build and log the summary
+**
+** Returns         None
+**
+*******************************************************************************/
+void fw_stats_finish(int result);
+
+/*******************************************************************************
+**
+** Function        fw_stats_get
+**
+** Description     Copy the summary of the last finished run
+**
+** Returns         0 : Success
+**                 Otherwise : no run finished yet
+**
+*******************************************************************************/
+int fw_stats_get(fw_stats_t *p_stats);
+
+#endif /* FW_STATS_H */
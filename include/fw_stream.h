@@ -0,0 +1,72 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      fw_stream.h
+ *
+ *  Description:   Streaming reader of the textual and compressed patch
+ *                 files. A worker thread reads and decodes the .seq file,
+ *                 or inflates the .bseqz file, into a bounded ring of records (FW_PATCH_STREAM_DEPTH), and fw_patch_next
+ *                 on the HCI thread only dequeues them. Memory use does not
+ *                 depend on the size of the patch.
+ *
+ ******************************************************************************/
+
+#ifndef FW_STREAM_H
+#define FW_STREAM_H
+
+#include "fw_patch.h"
+
+/******************************************************************************
+**  Functions
+******************************************************************************/
+
+/*******************************************************************************
+**
+** Function        fw_stream_open
+**
+** Description     Open the patch file p_path for reading. A .seq or .bseqz
+**                 file is streamed; a .bseq file, or any file if
+**                 FW_PATCH_STREAM is FALSE, is loaded by fw_patch_open.
+**                 A .seq file compiled in the patch cache is mapped from
+**                 there instead (fw_cache_open).
+**                 The patch of a bundle is the one of version key p_key.
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+int fw_stream_open(const char *p_path, const uint8_t *p_key,
+                   fw_patch_t *p_patch);
+
+/*******************************************************************************
+**
+** Function        fw_stream_load
+**
+** Description     Load the patch file p_path as fw_stream_open does, but
+**                 whole and without a stream worker
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+int fw_stream_load(const char *p_path, const uint8_t *p_key,
+                   fw_patch_t *p_patch);
+
+#endif /* FW_STREAM_H */
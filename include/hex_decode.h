@@ -0,0 +1,80 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      hex_decode.h
+ *
+ *  Description:   Contains the hex text to binary decoder used by the
+ *                 textual firmware patch (.seq) loader
+ *
+ ******************************************************************************/
+
+#ifndef HEX_DECODE_H
+#define HEX_DECODE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/******************************************************************************
+**  Constants & Macros
+******************************************************************************/
+
+/* Value of a non hex character in hex_decode_lut */
+#define HEX_DECODE_INVALID  0xFF
+
+/******************************************************************************
+**  Variables
+******************************************************************************/
+
+/* Nibble value of every character, HEX_DECODE_INVALID if not a hex digit */
+extern const uint8_t hex_decode_lut[256];
+
+/******************************************************************************
+**  Functions
+******************************************************************************/
+
+/*******************************************************************************
+**
+** Function        hex_decode
+**
+** Description     Decode the 2 * len hex digits at p_in into len bytes at
+**                 p_out. Uses SSE2 or NEON when the target has it, the
+**                 lookup table otherwise. Upper and lower case digits are
+**                 accepted, any other character fails the whole run.
+**
+** Returns         0 : Success
+**                 Otherwise : p_in holds a non hex character, the content
+**                             of p_out is undefined
+**
+*******************************************************************************/
+int hex_decode(uint8_t *p_out, const char *p_in, size_t len);
+
+/*******************************************************************************
+**
+** Function        hex_decode_scalar
+**
+** Description     Lookup table only version of hex_decode
+**
+** Returns         0 : Success
+**                 Otherwise : p_in holds a non hex character
+**
+*******************************************************************************/
+int hex_decode_scalar(uint8_t *p_out, const char *p_in, size_t len);
+
+#endif /* HEX_DECODE_H */
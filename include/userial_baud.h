@@ -0,0 +1,100 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      userial_baud.h
+ *
+ *  Description:   Automatic UART rate discovery (UART_BAUD_AUTO). Run on
+ *                 the UART just opened, before the stack gets the fd: the
+ *                 controller is stepped up to the highest rate the board
+ *                 carries, then brought back to the init rate, and the rate
+ *                 found is used for the following patch downloads.
+ *
+ ******************************************************************************/
+
+#ifndef USERIAL_BAUD_H
+#define USERIAL_BAUD_H
+
+#include <stdint.h>
+
+/******************************************************************************
+**  Constants & Macros
+******************************************************************************/
+
+/* RDSW_VERSION exchanges a rate has to pass */
+#define USERIAL_BAUD_PROBE_ROUNDS       4
+
+/* Time allowed for the controller to answer a probe command */
+#define USERIAL_BAUD_PROBE_TIMEOUT_MS   100
+
+/* Controller power cycle after a failed rate: time off, and time allowed
+ * for it to answer again once back on */
+#define USERIAL_BAUD_POWER_OFF_MS       100
+#define USERIAL_BAUD_BOOT_TIMEOUT_MS    1000
+
+/* Ports remembered in UART_BAUD_AUTO_CACHE */
+#define USERIAL_BAUD_CACHE_PORTS        8
+
+/******************************************************************************
+**  Functions
+******************************************************************************/
+
+/*******************************************************************************
+**
+** Function        userial_baud_negotiate
+**
+** Description     Find the download rate of the port open on fd, by probing
+**                 the controller, or from UART_BAUD_AUTO_CACHE if the port
+**                 was probed before. The configured rate conf_baud is
+**                 probed along with the fixed candidates. The controller
+**                 and the host UART are left at init_baud.
+**
+** Returns         Line speed to download at, 0 if UART_BAUD_AUTO is off
+**
+*******************************************************************************/
+uint32_t userial_baud_negotiate(int fd, uint32_t init_baud, uint32_t conf_baud);
+
+/*******************************************************************************
+**
+** Function        userial_baud_report
+**
+** Description     Outcome of a download at the rate baud found by
+**                 userial_baud_negotiate. A failure moves the port to the
+**                 next candidate rate below for the next enable; after UART_BAUD_AUTO_REPROBE
+**                 clean downloads at a rate moved down, the port is probed
+**                 again on the next enable.
+**
+** Returns         None
+**
+*******************************************************************************/
+void userial_baud_report(uint32_t baud, uint8_t ok);
+
+/*******************************************************************************
+**
+** Function        userial_baud_set_auto
+**
+** Description     Conf entry setter of UART_BAUD_AUTO
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+int userial_baud_set_auto(char *p_conf_name, char *p_conf_value, int param);
+
+#endif /* USERIAL_BAUD_H */
@@ -0,0 +1,82 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      userial_demux.h
+ *
+ *  Description:   H4 demultiplexer of the UART (UART_DEMUX). A thread of the
+ *                 library owns the UART and gives the stack one socket per
+ *                 HCI channel, carrying the packets without their H4
+ *                 indicator, as the multi-channel transport of the stack
+ *                 expects. Packets towards the controller are taken
+ *                 commands first, then ACL data, and only handed to the
+ *                 UART once the driver has sent out what it had queued.
+ *                 There is no SCO channel, SCO has to go over PCM.
+ *
+ ******************************************************************************/
+
+#ifndef USERIAL_DEMUX_H
+#define USERIAL_DEMUX_H
+
+#include <stdint.h>
+
+/******************************************************************************
+**  Functions
+******************************************************************************/
+
+/*******************************************************************************
+**
+** Function        userial_demux_open
+**
+** Description     Start the demultiplexer on the UART fd, when UART_DEMUX is
+**                 set, and fill p_fds (CH_MAX entries) with the sockets of
+**                 the HCI channels. Not started when SCO is routed to the
+**                 transport, the channels of the stack carry no SCO.
+**
+** Returns         Number of fds of HCI channels, 0 if the demultiplexer is
+**                 off or could not start
+**
+*******************************************************************************/
+int userial_demux_open(int fd, int *p_fds);
+
+/*******************************************************************************
+**
+** Function        userial_demux_close
+**
+** Description     Stop the demultiplexer and close the channel sockets,
+**                 before the UART is closed
+**
+** Returns         None
+**
+*******************************************************************************/
+void userial_demux_close(void);
+
+/*******************************************************************************
+**
+** Function        userial_demux_set
+**
+** Description     Conf entry setter of UART_DEMUX
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+int userial_demux_set(char *p_conf_name, char *p_conf_value, int param);
+
+#endif /* USERIAL_DEMUX_H */
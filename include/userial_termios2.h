@@ -0,0 +1,67 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      userial_termios2.h
+ *
+ *  Description:   Kernel termios2, which carries the line speeds as plain
+ *                 integers when BOTHER is set in c_cflag, for the rates that
+ *                 have no Bxxx constant. asm/termbits.h declares it but can
+ *                 not be included along with termios.h, so the structure
+ *                 and its ioctls are declared here.
+ *
+ ******************************************************************************/
+
+#ifndef USERIAL_TERMIOS2_H
+#define USERIAL_TERMIOS2_H
+
+#include <termios.h>
+#include <sys/ioctl.h>
+
+/******************************************************************************
+**  Constants & Macros
+******************************************************************************/
+
+#ifndef BOTHER
+#define BOTHER                  0010000
+#endif
+
+/* Control characters of the kernel termios */
+#define USERIAL_TERMIOS2_NCCS   19
+
+#define USERIAL_TCGETS2         _IOR('T', 0x2A, userial_termios2_t)
+#define USERIAL_TCSETS2         _IOW('T', 0x2B, userial_termios2_t)
+
+/******************************************************************************
+**  Type definitions
+******************************************************************************/
+
+typedef struct
+{
+    tcflag_t c_iflag;
+    tcflag_t c_oflag;
+    tcflag_t c_cflag;
+    tcflag_t c_lflag;
+    cc_t     c_line;
+    cc_t     c_cc[USERIAL_TERMIOS2_NCCS];
+    speed_t  c_ispeed;                      /* line speed with BOTHER */
+    speed_t  c_ospeed;
+} userial_termios2_t;
+
+#endif /* USERIAL_TERMIOS2_H */
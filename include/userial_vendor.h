@@ -162,6 +162,54 @@ void userial_vendor_close(void);
 *******************************************************************************/
 void userial_vendor_set_baud(uint8_t userial_baud);
 
+/*******************************************************************************
+**
+** Function        userial_vendor_set_line_speed
+**
+** Description     Set new baud rate, as a line speed. Rates without a TCIO
+**                 constant go through termios2; where the driver does not
+**                 take them, the closest TCIO rate is used instead.
+**
+** Returns         None
+**
+*******************************************************************************/
+void userial_vendor_set_line_speed(uint32_t line_speed);
+
+/*******************************************************************************
+**
+** Function        userial_vendor_set_flow_control
+**
+** Description     Turn RTS/CTS flow control of the open port on or off
+**
+** Returns         None
+**
+*******************************************************************************/
+void userial_vendor_set_flow_control(uint8_t on);
+
+/*******************************************************************************
+**
+** Function        userial_vendor_port_name
+**
+** Description     Name of the UART device of the controller
+**
+** Returns         Port name
+**
+*******************************************************************************/
+const char *userial_vendor_port_name(void);
+
+/*******************************************************************************
+**
+** Function        userial_vendor_line_errors
+**
+** Description     Read the framing, parity, overrun and break counts of the
+**                 open port, summed, from the driver (TIOCGICOUNT)
+**
+** Returns         0 : Success
+**                 Otherwise : not supported by the driver
+**
+*******************************************************************************/
+int userial_vendor_line_errors(uint32_t *p_count);
+
 /*******************************************************************************
 **
 ** Function        userial_vendor_ioctl
@@ -0,0 +1,158 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      vnd_trace.h
+ *
+ *  Description:   Binary trace ring of the vendor library. Trace points
+ *                 store an event id, a timestamp and up to three integer
+ *                 arguments; formatting happens only when the ring is
+ *                 dumped, on a failure or through BT_VND_OP_INTEL_DUMP_TRACE.
+ *
+ *                 Each subsystem has a run-time verbosity (Trace* entries
+ *                 of the conf file):
+ *                      0 : nothing recorded
+ *                      1 : recorded in the ring (default)
+ *                      2 : recorded and logged at once, along with the
+ *                          subsystem's debug messages
+ *
+ ******************************************************************************/
+
+#ifndef VND_TRACE_H
+#define VND_TRACE_H
+
+#include <stdint.h>
+#include <utils/Log.h>
+
+/******************************************************************************
+**  Constants & Macros
+******************************************************************************/
+
+/* Subsystems */
+enum {
+    VND_TRACE_VND,                      /* bt_vendor.c */
+    VND_TRACE_HW,                       /* hardware.c */
+    VND_TRACE_USERIAL,                  /* userial_vendor.c */
+    VND_TRACE_UPIO,                     /* upio.c */
+    VND_TRACE_SUB_MAX
+};
+
+/* Verbosity */
+#define VND_TRACE_OFF           0
+#define VND_TRACE_RING          1
+#define VND_TRACE_LOG           2
+
+#define VND_TRACE_ID(sub, n)    (((sub) << 8) | (n))
+#define VND_TRACE_SUB(id)       ((id) >> 8)
+
+/* Events, the format of each is in vnd_trace.c */
+enum {
+    TRC_VND_OP = VND_TRACE_ID(VND_TRACE_VND, 0),
+
+    TRC_HW_RESET = VND_TRACE_ID(VND_TRACE_HW, 0),
+    TRC_HW_EVENT,
+    TRC_HW_RDSW_VERSION,
+    TRC_HW_OPEN_PATCHFILE,
+    TRC_HW_SET_UART_CLOCK,
+    TRC_HW_SET_UART_BAUD,
+    TRC_HW_HOST_BAUD,
+    TRC_HW_MANUFACTURE_ON,
+    TRC_HW_RECORD,
+    TRC_HW_END_OF_PATCH,
+    TRC_HW_MANUFACTURE_OFF,
+    TRC_HW_RDSW_VERSION_RECHECK,
+    TRC_HW_RESULT,
+    TRC_HW_PRELOAD,
+    TRC_HW_INDEX,
+    TRC_HW_STREAM,
+    TRC_HW_DIRECT,
+    TRC_HW_EVT_MISMATCH,
+
+    TRC_USERIAL_OPEN = VND_TRACE_ID(VND_TRACE_USERIAL, 0),
+    TRC_USERIAL_CLOSE,
+    TRC_USERIAL_BAUD,
+    TRC_USERIAL_BT_WAKE,
+    TRC_USERIAL_BAUD_PROBE,
+
+    TRC_UPIO_POWER = VND_TRACE_ID(VND_TRACE_UPIO, 0),
+    TRC_UPIO_LPM,
+    TRC_UPIO_BT_WAKE
+};
+
+/* Record an event with up to three arguments */
+#define VND_TRACE(id, a0, a1, a2) \
+    do { \
+        if (vnd_trace_level[VND_TRACE_SUB(id)] != VND_TRACE_OFF) \
+            vnd_trace_add((id), (uint32_t) (a0), (uint32_t) (a1), \
+                          (uint32_t) (a2)); \
+    } while (0)
+
+/* Debug message of a subsystem, logged at VND_TRACE_LOG only */
+#define VND_DBG(sub, param, ...) \
+    do { \
+        if (vnd_trace_level[sub] >= VND_TRACE_LOG) \
+            ALOGD(param, ## __VA_ARGS__); \
+    } while (0)
+
+/******************************************************************************
+**  Variables
+******************************************************************************/
+
+extern uint8_t vnd_trace_level[VND_TRACE_SUB_MAX];
+
+/******************************************************************************
+**  Functions
+******************************************************************************/
+
+/*******************************************************************************
+**
+** Function        vnd_trace_add
+**
+** Description     Append an event to the ring, callable from any thread.
+**                 Use VND_TRACE, which skips the call for silent subsystems.
+**
+** Returns         None
+**
+*******************************************************************************/
+void vnd_trace_add(uint16_t id, uint32_t a0, uint32_t a1, uint32_t a2);
+
+/*******************************************************************************
+**
+** Function        vnd_trace_dump
+**
+** Description     Log the content of the ring, oldest event first
+**
+** Returns         None
+**
+*******************************************************************************/
+void vnd_trace_dump(const char *p_reason);
+
+/*******************************************************************************
+**
+** Function        vnd_trace_set_level
+**
+** Description     Conf entry setter, param is the subsystem
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+int vnd_trace_set_level(char *p_conf_name, char *p_conf_value, int param);
+
+#endif /* VND_TRACE_H */
@@ -32,22 +32,22 @@
 #include "bt_vendor.h"
 #include "upio.h"
 #include "userial_vendor.h"
+#include "userial_demux.h"
+#include "fw_preload.h"
+#include "fw_stats.h"
+#include "vnd_trace.h"
 
-#ifndef BTVND_DBG
-#define BTVND_DBG FALSE
-#endif
-
-#if (BTVND_DBG == TRUE)
-#define BTVNDDBG(param, ...) {ALOGD(param, ## __VA_ARGS__);}
-#else
-#define BTVNDDBG(param, ...) {}
-#endif
+#define BTVNDDBG(param, ...) VND_DBG(VND_TRACE_VND, param, ## __VA_ARGS__)
 
 /******************************************************************************
 **  Externs
 ******************************************************************************/
 
 void hw_config_start(void);
+void hw_config_preload(void);
+void hw_config_negotiate_baud(int fd);
+void hw_config_direct(int fd);
+void hw_config_userial_close(void);
 uint8_t hw_lpm_enable(uint8_t turn_on);
 uint32_t hw_lpm_get_idle_timeout(void);
 void hw_lpm_set_wake_state(uint8_t wake_assert);
@@ -118,6 +118,9 @@ static int init(const bt_vendor_callbacks_t* p_cb, unsigned char *local_bdaddr)
 
     vnd_load_conf(VENDOR_LIB_CONF_FILE);
 
+    /* Load the patches while the stack powers up the controller */
+    hw_config_preload();
+
     /* store reference to user callbacks */
     bt_vendor_cbacks = (bt_vendor_callbacks_t *) p_cb;
 
@@ -133,9 +136,9 @@ static int op(bt_vendor_opcode_t opcode, void *param)
 {
     int retval = 0;
 
-    BTVNDDBG("op for %d", opcode);
+    VND_TRACE(TRC_VND_OP, opcode, 0, 0);
 
-    switch(opcode)
+    switch((int) opcode)
     {
         case BT_VND_OP_POWER_CTRL:
             {
@@ -143,7 +146,10 @@ static int op(bt_vendor_opcode_t opcode, void *param)
                 if (*state == BT_VND_PWR_OFF)
                     upio_set_bluetooth_power(UPIO_BT_POWER_OFF);
                 else if (*state == BT_VND_PWR_ON)
+                {
+                    hw_config_preload();
                     upio_set_bluetooth_power(UPIO_BT_POWER_ON);
+                }
             }
             break;
 
@@ -170,10 +176,16 @@ static int op(bt_vendor_opcode_t opcode, void *param)
                 fd = userial_vendor_open((tUSERIAL_CFG *) &userial_init_cfg);
                 if (fd != -1)
                 {
-                    for (idx=0; idx < CH_MAX; idx++)
-                        (*fd_array)[idx] = fd;
+                    hw_config_negotiate_baud(fd);
+                    hw_config_direct(fd);
+
+                    if ((retval = userial_demux_open(fd, *fd_array)) == 0)
+                    {
+                        for (idx=0; idx < CH_MAX; idx++)
+                            (*fd_array)[idx] = fd;
 
-                    retval = 1;
+                        retval = 1;
+                    }
                 }
                 /* retval contains numbers of open fd of HCI channels */
             }
@@ -181,6 +193,8 @@ static int op(bt_vendor_opcode_t opcode, void *param)
 
         case BT_VND_OP_USERIAL_CLOSE:
             {
+                hw_config_userial_close();
+                userial_demux_close();
                 userial_vendor_close();
             }
             break;
@@ -221,6 +235,18 @@ static int op(bt_vendor_opcode_t opcode, void *param)
 #endif
             }
             break;
+
+        case BT_VND_OP_INTEL_GET_FW_STATS:
+            {
+                retval = fw_stats_get((fw_stats_t *) param);
+            }
+            break;
+
+        case BT_VND_OP_INTEL_DUMP_TRACE:
+            {
+                vnd_trace_dump("requested");
+            }
+            break;
     }
 
     return retval;
@@ -232,6 +258,7 @@ static void cleanup( void )
     BTVNDDBG("cleanup");
 
     upio_cleanup();
+    fw_preload_cleanup();
 
     bt_vendor_cbacks = NULL;
 }
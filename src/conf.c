@@ -32,13 +32,22 @@
 #include <utils/Log.h>
 #include <string.h>
 #include "bt_vendor.h"
+#include "vnd_trace.h"
 
 /******************************************************************************
 **  Externs
 ******************************************************************************/
 int userial_set_port(char *p_conf_name, char *p_conf_value, int param);
+int userial_set_flow_control(char *p_conf_name, char *p_conf_value, int param);
+int userial_set_latency_profile(char *p_conf_name, char *p_conf_value, int param);
+int userial_demux_set(char *p_conf_name, char *p_conf_value, int param);
 int hw_set_patch_file_path(char *p_conf_name, char *p_conf_value, int param);
 int hw_set_patch_file_name(char *p_conf_name, char *p_conf_value, int param);
+int hw_set_patch_pipeline_depth(char *p_conf_name, char *p_conf_value, int param);
+int hw_set_patch_direct(char *p_conf_name, char *p_conf_value, int param);
+int hw_set_uart_baud(char *p_conf_name, char *p_conf_value, int param);
+int fw_cache_set_dir(char *p_conf_name, char *p_conf_value, int param);
+int userial_baud_set_auto(char *p_conf_name, char *p_conf_value, int param);
 #if (VENDOR_LIB_RUNTIME_TUNING_ENABLED == TRUE)
 int hw_set_patch_settlement_delay(char *p_conf_name, char *p_conf_value, int param);
 #endif
@@ -70,8 +79,20 @@ typedef struct {
  */
 static const conf_entry_t conf_table[] = {
     {"UartPort", userial_set_port, 0},
+    {"UartFlowControl", userial_set_flow_control, 0},
+    {"UartLatencyProfile", userial_set_latency_profile, 0},
+    {"UartDemux", userial_demux_set, 0},
+    {"UartBaud", hw_set_uart_baud, 0},
+    {"UartBaudAuto", userial_baud_set_auto, 0},
     {"FwPatchFilePath", hw_set_patch_file_path, 0},
     {"FwPatchFileName", hw_set_patch_file_name, 0},
+    {"FwPatchCacheDir", fw_cache_set_dir, 0},
+    {"FwPatchPipelineDepth", hw_set_patch_pipeline_depth, 0},
+    {"FwPatchDirect", hw_set_patch_direct, 0},
+    {"TraceVendor", vnd_trace_set_level, VND_TRACE_VND},
+    {"TraceHw", vnd_trace_set_level, VND_TRACE_HW},
+    {"TraceUserial", vnd_trace_set_level, VND_TRACE_USERIAL},
+    {"TraceUpio", vnd_trace_set_level, VND_TRACE_UPIO},
 #if (VENDOR_LIB_RUNTIME_TUNING_ENABLED == TRUE)
     {"FwPatchSettlementDelay", hw_set_patch_settlement_delay, 0},
 #endif
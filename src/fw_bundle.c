@@ -0,0 +1,663 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      fw_bundle.c
+ *
+ *  Description:   Contains the reader and writer of the patch bundles
+ *
+ *                 A bundle is checked in full when it is mapped, so the
+ *                 records of its patches are then read from the mapping
+ *                 without further checks. The mappings are shared by path
+ *                 and reference counted, the preloaded images of every key
+ *                 use the same one.
+ *
+ ******************************************************************************/
+
+#define LOG_TAG "bt_fw_bundle"
+
+#include <utils/Log.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "fw_bundle.h"
+#include "fw_patch.h"
+
+/******************************************************************************
+**  Constants & Macros
+******************************************************************************/
+
+#ifndef FALSE
+#define FALSE  0
+#endif
+
+#ifndef TRUE
+#define TRUE   (!FALSE)
+#endif
+
+#define FW_BUNDLE_ALIGN(x)      (((x) + 3) & ~3)
+
+/******************************************************************************
+**  Local type definitions
+******************************************************************************/
+
+/* Mapped bundle, shared by the patches opened from it */
+typedef struct fw_bundle_map
+{
+    struct fw_bundle_map *p_next;
+    char            path[PATH_MAX];
+    const uint8_t   *p_map;
+    size_t          len;
+    int             refs;
+} fw_bundle_map_t;
+
+/* Record source of one patch of a bundle */
+typedef struct
+{
+    fw_bundle_map_t *p_map;
+    const uint8_t   *p_data;
+    const uint32_t  *p_tbl;
+    const uint16_t  *p_seq;                 /* sequence of the patch */
+    uint32_t        count;
+    uint32_t        pos;
+} fw_bundle_iter_t;
+
+/* Distinct records of the bundle being written, found by their CRC-32 */
+typedef struct
+{
+    uint8_t         *p_data;
+    uint32_t        size;
+    uint32_t        *p_tbl;                 /* offset of each record */
+    uint32_t        count;
+    uint32_t        *p_hash;                /* record id + 1, 0: free */
+    uint32_t        hash_size;              /* power of 2 */
+} fw_bundle_build_t;
+
+/******************************************************************************
+**  Static functions
+******************************************************************************/
+
+static int fw_bundle_next(void *p_ctx, const uint8_t **pp_rec);
+static void fw_bundle_close(void *p_ctx);
+
+/******************************************************************************
+**  Static variables
+******************************************************************************/
+
+static pthread_mutex_t fw_bundle_lock = PTHREAD_MUTEX_INITIALIZER;
+static fw_bundle_map_t *fw_bundle_maps = NULL;
+
+static const fw_patch_src_t fw_bundle_src = {
+    fw_bundle_next,
+    fw_bundle_close
+};
+
+/*******************************************************************************
+**
+** Function        fw_bundle_fits
+**
+** Description     Check that count entries of size bytes at offset fit in
+**                 a file of len bytes
+**
+** Returns         TRUE if they fit
+**
+*******************************************************************************/
+static int fw_bundle_fits(uint32_t offset, uint32_t count, uint32_t size,
+                          size_t len)
+{
+    return ((uint64_t) offset + (uint64_t) count * size <= len);
+}
+
+/*******************************************************************************
+**
+** Function        fw_bundle_check
+**
+** Description     Check the header, the tables and every record of the
+**                 bundle mapped at p_map
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+static int fw_bundle_check(const uint8_t *p_map, size_t len)
+{
+    const fw_bundle_hdr_t *p_hdr = (const fw_bundle_hdr_t *) p_map;
+    const fw_bundle_key_t *p_keys;
+    const uint32_t *p_tbl;
+    const uint16_t *p_seq;
+    const uint8_t *p_data;
+    uint32_t i, j, off, size, cmds;
+
+    if ((len < sizeof(fw_bundle_hdr_t)) ||
+        (memcmp(p_hdr->magic, FW_BUNDLE_MAGIC, FW_BUNDLE_MAGIC_LEN) != 0) ||
+        (p_hdr->version != FW_BUNDLE_FORMAT_VERSION) ||
+        (p_hdr->hdr_len < sizeof(fw_bundle_hdr_t)) || (p_hdr->hdr_len > len))
+        return -1;
+
+    if (fw_patch_crc32(0, p_map + p_hdr->hdr_len, len - p_hdr->hdr_len) !=
+        p_hdr->crc)
+    {
+        ALOGE("CRC mismatch");
+        return -1;
+    }
+
+    if ((p_hdr->key_offset & 3) || (p_hdr->tbl_offset & 3) ||
+        (p_hdr->seq_offset & 1) ||
+        !fw_bundle_fits(p_hdr->key_offset, p_hdr->key_count,
+                        sizeof(fw_bundle_key_t), len) ||
+        !fw_bundle_fits(p_hdr->tbl_offset, p_hdr->rec_count,
+                        sizeof(uint32_t), len) ||
+        !fw_bundle_fits(p_hdr->seq_offset, p_hdr->seq_count,
+                        sizeof(uint16_t), len) ||
+        !fw_bundle_fits(p_hdr->data_offset, p_hdr->data_size, 1, len))
+        return -1;
+
+    p_keys = (const fw_bundle_key_t *) (p_map + p_hdr->key_offset);
+    p_tbl = (const uint32_t *) (p_map + p_hdr->tbl_offset);
+    p_seq = (const uint16_t *) (p_map + p_hdr->seq_offset);
+    p_data = p_map + p_hdr->data_offset;
+
+    for (i = 0; i < p_hdr->rec_count; i++)
+    {
+        if ((p_tbl[i] >= p_hdr->data_size) ||
+            (fw_patch_rec_len(p_data + p_tbl[i],
+                              p_hdr->data_size - p_tbl[i]) == 0))
+            return -1;
+    }
+
+    for (i = 0; i < p_hdr->seq_count; i++)
+    {
+        if (p_seq[i] >= p_hdr->rec_count)
+            return -1;
+    }
+
+    for (i = 0; i < p_hdr->key_count; i++)
+    {
+        if ((uint64_t) p_keys[i].seq_start + p_keys[i].rec_count >
+            p_hdr->seq_count)
+            return -1;
+
+        for (j = 0, size = 0, cmds = 0; j < p_keys[i].rec_count; j++)
+        {
+            off = p_tbl[p_seq[p_keys[i].seq_start + j]];
+            size += fw_patch_rec_len(p_data + off, p_hdr->data_size - off);
+            if (p_data[off] == FW_PATCH_REC_CMD)
+                cmds++;
+        }
+
+        if ((size != p_keys[i].rec_size) || (cmds != p_keys[i].cmd_count))
+            return -1;
+    }
+
+    return 0;
+}
+
+/*******************************************************************************
+**
+** Function        fw_bundle_get
+**
+** Description     Take a reference on the mapping of the bundle p_path,
+**                 mapping and checking it if it is not mapped yet
+**
+** Returns         The mapping, NULL on failure
+**
+*******************************************************************************/
+static fw_bundle_map_t *fw_bundle_get(const char *p_path)
+{
+    fw_bundle_map_t *p_bm;
+    struct stat st;
+    void *p_map;
+    int fd;
+
+    pthread_mutex_lock(&fw_bundle_lock);
+
+    for (p_bm = fw_bundle_maps; p_bm != NULL; p_bm = p_bm->p_next)
+    {
+        if (strcmp(p_bm->path, p_path) == 0)
+        {
+            p_bm->refs++;
+            pthread_mutex_unlock(&fw_bundle_lock);
+            return p_bm;
+        }
+    }
+
+    if ((fd = open(p_path, O_RDONLY)) < 0)
+    {
+        ALOGE("Can not open %s: %s", p_path, strerror(errno));
+        pthread_mutex_unlock(&fw_bundle_lock);
+        return NULL;
+    }
+
+    if ((fstat(fd, &st) < 0) || (st.st_size < (off_t) sizeof(fw_bundle_hdr_t)))
+    {
+        ALOGE("Invalid patch bundle %s", p_path);
+        close(fd);
+        pthread_mutex_unlock(&fw_bundle_lock);
+        return NULL;
+    }
+
+    p_map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (p_map == MAP_FAILED)
+    {
+        ALOGE("Can not map %s: %s", p_path, strerror(errno));
+        pthread_mutex_unlock(&fw_bundle_lock);
+        return NULL;
+    }
+
+    if (fw_bundle_check((const uint8_t *) p_map, st.st_size) != 0)
+    {
+        ALOGE("Corrupted patch bundle %s", p_path);
+        munmap(p_map, st.st_size);
+        pthread_mutex_unlock(&fw_bundle_lock);
+        return NULL;
+    }
+
+    if ((p_bm = (fw_bundle_map_t *) calloc(1, sizeof(fw_bundle_map_t))) == NULL)
+    {
+        munmap(p_map, st.st_size);
+        pthread_mutex_unlock(&fw_bundle_lock);
+        return NULL;
+    }
+
+    snprintf(p_bm->path, sizeof(p_bm->path), "%s", p_path);
+    p_bm->p_map = (const uint8_t *) p_map;
+    p_bm->len = st.st_size;
+    p_bm->refs = 1;
+    p_bm->p_next = fw_bundle_maps;
+    fw_bundle_maps = p_bm;
+
+    pthread_mutex_unlock(&fw_bundle_lock);
+
+    return p_bm;
+}
+
+/*******************************************************************************
+**
+** Function        fw_bundle_put
+**
+** Description     Drop a reference on the mapping, unmapping the bundle
+**                 with the last one
+**
+** Returns         None
+**
+*******************************************************************************/
+static void fw_bundle_put(fw_bundle_map_t *p_bm)
+{
+    fw_bundle_map_t **pp;
+
+    pthread_mutex_lock(&fw_bundle_lock);
+
+    if (--p_bm->refs == 0)
+    {
+        for (pp = &fw_bundle_maps; *pp != NULL; pp = &(*pp)->p_next)
+        {
+            if (*pp == p_bm)
+            {
+                *pp = p_bm->p_next;
+                break;
+            }
+        }
+
+        munmap((void *) p_bm->p_map, p_bm->len);
+        free(p_bm);
+    }
+
+    pthread_mutex_unlock(&fw_bundle_lock);
+}
+
+/*******************************************************************************
+**
+** Function        fw_bundle_next
+**
+** Description     Next record of the patch, straight from the mapping
+**
+** Returns         1 : *pp_rec set
+**                 0 : end of patch
+**
+*******************************************************************************/
+static int fw_bundle_next(void *p_ctx, const uint8_t **pp_rec)
+{
+    fw_bundle_iter_t *p_it = (fw_bundle_iter_t *) p_ctx;
+
+    if (p_it->pos >= p_it->count)
+        return 0;
+
+    *pp_rec = p_it->p_data + p_it->p_tbl[p_it->p_seq[p_it->pos++]];
+
+    return 1;
+}
+
+/*******************************************************************************
+**
+** Function        fw_bundle_close
+**
+** Description     Release the patch and its reference on the mapping
+**
+** Returns         None
+**
+*******************************************************************************/
+static void fw_bundle_close(void *p_ctx)
+{
+    fw_bundle_iter_t *p_it = (fw_bundle_iter_t *) p_ctx;
+
+    fw_bundle_put(p_it->p_map);
+    free(p_it);
+}
+
+/*******************************************************************************
+**
+** Function        fw_bundle_add_rec
+**
+** Description     Find the record p of len bytes in the records of the
+**                 bundle being built, adding it if it is not there yet
+**
+** Returns         Id of the record, -1 if there are too many
+**
+*******************************************************************************/
+static int fw_bundle_add_rec(fw_bundle_build_t *p_bb, const uint8_t *p,
+                             uint32_t len)
+{
+    uint32_t mask = p_bb->hash_size - 1;
+    uint32_t h = fw_patch_crc32(0, p, len) & mask;
+    const uint8_t *p_old;
+    uint32_t id;
+
+    while ((id = p_bb->p_hash[h]) != 0)
+    {
+        p_old = p_bb->p_data + p_bb->p_tbl[id - 1];
+        if ((fw_patch_rec_len(p_old, len) == len) &&
+            (memcmp(p_old, p, len) == 0))
+            return id - 1;
+        h = (h + 1) & mask;
+    }
+
+    if (p_bb->count == FW_BUNDLE_REC_MAX)
+        return -1;
+
+    p_bb->p_tbl[p_bb->count] = p_bb->size;
+    memcpy(p_bb->p_data + p_bb->size, p, len);
+    p_bb->size += len;
+    p_bb->p_hash[h] = ++p_bb->count;
+
+    return p_bb->count - 1;
+}
+
+/*******************************************************************************
+**
+** Function        fw_bundle_write
+**
+** Description     Write the header and the body of len bytes to p_path
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+static int fw_bundle_write(const char *p_path, const fw_bundle_hdr_t *p_hdr,
+                           const uint8_t *p_body, uint32_t len)
+{
+    FILE *fp;
+    int ret = 0;
+
+    if ((fp = fopen(p_path, "wb")) == NULL)
+    {
+        ALOGE("Can not create %s: %s", p_path, strerror(errno));
+        return -1;
+    }
+
+    if ((fwrite(p_hdr, sizeof(fw_bundle_hdr_t), 1, fp) != 1) ||
+        (fwrite(p_body, 1, len, fp) != len))
+    {
+        ALOGE("Can not write %s: %s", p_path, strerror(errno));
+        ret = -1;
+    }
+
+    if (fclose(fp) != 0)
+        ret = -1;
+
+    return ret;
+}
+
+/*****************************************************************************
+**   PATCH BUNDLE FUNCTIONS
+*****************************************************************************/
+
+/*******************************************************************************
+**
+** Function        fw_bundle_keys
+**
+** Description     Read the version keys of the bundle p_path, up to max
+**
+** Returns         Number of keys copied to p_keys, -1 if not a bundle
+**
+*******************************************************************************/
+int fw_bundle_keys(const char *p_path, uint8_t (*p_keys)[FW_PATCH_KEY_LEN],
+                   int max)
+{
+    fw_bundle_hdr_t hdr;
+    fw_bundle_key_t key;
+    int fd, i, n = -1;
+
+    if ((fd = open(p_path, O_RDONLY)) < 0)
+        return -1;
+
+    if ((pread(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr)) &&
+        (memcmp(hdr.magic, FW_BUNDLE_MAGIC, FW_BUNDLE_MAGIC_LEN) == 0) &&
+        (hdr.version == FW_BUNDLE_FORMAT_VERSION))
+    {
+        for (i = 0, n = 0; (i < hdr.key_count) && (n < max); i++)
+        {
+            if (pread(fd, &key, sizeof(key), hdr.key_offset + i * sizeof(key))
+                != sizeof(key))
+                break;
+            memcpy(p_keys[n++], key.key, FW_PATCH_KEY_LEN);
+        }
+    }
+
+    close(fd);
+
+    return n;
+}
+
+/*******************************************************************************
+**
+** Function        fw_bundle_open
+**
+** Description     Open the patch of version key p_key from the bundle
+**                 p_path. The bundle is checked and mapped on its first
+**                 open, and stays mapped while any of its patches is open.
+**
+** Returns         0 : Success
+**                 Otherwise : Fail, or no patch for the key
+**
+*******************************************************************************/
+int fw_bundle_open(const char *p_path, const uint8_t *p_key,
+                   fw_patch_t *p_patch)
+{
+    const fw_bundle_hdr_t *p_hdr;
+    const fw_bundle_key_t *p_keys;
+    fw_bundle_iter_t *p_it;
+    fw_bundle_map_t *p_bm;
+    uint32_t i;
+
+    memset(p_patch, 0, sizeof(fw_patch_t));
+
+    if ((p_bm = fw_bundle_get(p_path)) == NULL)
+        return -1;
+
+    p_hdr = (const fw_bundle_hdr_t *) p_bm->p_map;
+    p_keys = (const fw_bundle_key_t *) (p_bm->p_map + p_hdr->key_offset);
+
+    for (i = 0; i < p_hdr->key_count; i++)
+    {
+        if (memcmp(p_keys[i].key, p_key, FW_PATCH_KEY_LEN) == 0)
+            break;
+    }
+
+    if ((i == p_hdr->key_count) ||
+        ((p_it = (fw_bundle_iter_t *) calloc(1, sizeof(fw_bundle_iter_t)))
+         == NULL))
+    {
+        ALOGE("No patch for the version key in %s", p_path);
+        fw_bundle_put(p_bm);
+        return -1;
+    }
+
+    p_it->p_map = p_bm;
+    p_it->p_data = p_bm->p_map + p_hdr->data_offset;
+    p_it->p_tbl = (const uint32_t *) (p_bm->p_map + p_hdr->tbl_offset);
+    p_it->p_seq = (const uint16_t *) (p_bm->p_map + p_hdr->seq_offset) +
+        p_keys[i].seq_start;
+    p_it->count = p_keys[i].rec_count;
+
+    memcpy(p_patch->key, p_key, FW_PATCH_KEY_LEN);
+    p_patch->rec_size = p_keys[i].rec_size;
+    p_patch->rec_count = p_keys[i].rec_count;
+    p_patch->cmd_count = p_keys[i].cmd_count;
+    p_patch->p_src = &fw_bundle_src;
+    p_patch->p_src_ctx = p_it;
+
+    ALOGI("Opened patch %u of %s: %u records, %u commands", i, p_path,
+        p_patch->rec_count, p_patch->cmd_count);
+
+    return 0;
+}
+
+/*******************************************************************************
+**
+** Function        fw_bundle_save
+**
+** Description     Write the count patch images of p_patches, each with its
+**                 own key, to p_path as a bundle
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+int fw_bundle_save(fw_patch_t *p_patches, int count, const char *p_path)
+{
+    fw_bundle_build_t bb;
+    fw_bundle_hdr_t hdr;
+    fw_bundle_key_t *p_keys;
+    fw_patch_rec_t rec;
+    uint16_t *p_seq;
+    uint8_t *p_body;
+    uint32_t total = 0, size = 0;
+    uint32_t body_len, n = 0;
+    int i, id, ret = 0;
+
+    for (i = 0; i < count; i++)
+    {
+        if (p_patches[i].p_src != NULL)
+            return -1;
+        total += p_patches[i].rec_count;
+        size += p_patches[i].rec_size;
+    }
+
+    memset(&bb, 0, sizeof(bb));
+    for (bb.hash_size = 1; bb.hash_size < 2 * total; bb.hash_size <<= 1)
+        ;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, FW_BUNDLE_MAGIC, FW_BUNDLE_MAGIC_LEN);
+    hdr.version = FW_BUNDLE_FORMAT_VERSION;
+    hdr.hdr_len = sizeof(fw_bundle_hdr_t);
+    hdr.key_count = count;
+    hdr.seq_count = total;
+    hdr.key_offset = FW_BUNDLE_ALIGN(sizeof(fw_bundle_hdr_t));
+    hdr.tbl_offset = hdr.key_offset + count * sizeof(fw_bundle_key_t);
+
+    /* Room for no record in common */
+    body_len = hdr.tbl_offset - hdr.hdr_len + total * sizeof(uint32_t) +
+        FW_BUNDLE_ALIGN(total * sizeof(uint16_t)) + size;
+
+    p_body = (uint8_t *) calloc(1, body_len);
+    p_seq = (uint16_t *) malloc((total + 1) * sizeof(uint16_t));
+    bb.p_data = (uint8_t *) malloc(size + 1);
+    bb.p_tbl = (uint32_t *) malloc((total + 1) * sizeof(uint32_t));
+    bb.p_hash = (uint32_t *) calloc(bb.hash_size, sizeof(uint32_t));
+
+    if ((p_body == NULL) || (p_seq == NULL) || (bb.p_data == NULL) ||
+        (bb.p_tbl == NULL) || (bb.p_hash == NULL))
+        ret = -1;
+
+    for (i = 0; (i < count) && (ret == 0); i++)
+    {
+        p_keys = (fw_bundle_key_t *) (p_body + hdr.key_offset - hdr.hdr_len);
+        memcpy(p_keys[i].key, p_patches[i].key, FW_PATCH_KEY_LEN);
+        p_keys[i].seq_start = n;
+        p_keys[i].rec_count = p_patches[i].rec_count;
+        p_keys[i].cmd_count = p_patches[i].cmd_count;
+        p_keys[i].rec_size = p_patches[i].rec_size;
+
+        fw_patch_rewind(&p_patches[i]);
+        while ((ret == 0) && fw_patch_next(&p_patches[i], &rec))
+        {
+            if ((id = fw_bundle_add_rec(&bb, rec.p_pkt - 1, 1 + rec.len)) < 0)
+            {
+                ALOGE("Too many distinct records");
+                ret = -1;
+            }
+            else
+            {
+                p_seq[n++] = id;
+            }
+        }
+        fw_patch_rewind(&p_patches[i]);
+    }
+
+    if (ret == 0)
+    {
+        hdr.rec_count = bb.count;
+        hdr.seq_offset = hdr.tbl_offset + bb.count * sizeof(uint32_t);
+        hdr.data_offset = FW_BUNDLE_ALIGN(hdr.seq_offset +
+                                          n * sizeof(uint16_t));
+        hdr.data_size = bb.size;
+        body_len = hdr.data_offset + bb.size - hdr.hdr_len;
+
+        memcpy(p_body + hdr.tbl_offset - hdr.hdr_len, bb.p_tbl,
+               bb.count * sizeof(uint32_t));
+        memcpy(p_body + hdr.seq_offset - hdr.hdr_len, p_seq,
+               n * sizeof(uint16_t));
+        memcpy(p_body + hdr.data_offset - hdr.hdr_len, bb.p_data, bb.size);
+        hdr.crc = fw_patch_crc32(0, p_body, body_len);
+
+        ret = fw_bundle_write(p_path, &hdr, p_body, body_len);
+    }
+
+    if (ret == 0)
+        ALOGI("Bundled %d patches: %u records, %u distinct, %u bytes", count,
+            n, bb.count, hdr.hdr_len + body_len);
+
+    free(p_body);
+    free(p_seq);
+    free(bb.p_data);
+    free(bb.p_tbl);
+    free(bb.p_hash);
+
+    return ret;
+}
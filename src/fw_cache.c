@@ -0,0 +1,362 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      fw_cache.c
+ *
+ *  Description:   Contains the cache of the compiled .seq patches
+ *
+ *                 The cached file of a source is named after its base name
+ *                 and the CRC-32 of its full path, and is an ordinary .bseq
+ *                 file whose header is extended with fw_cache_ext_t. It is
+ *                 written to a temporary file, synced and renamed over the
+ *                 previous one, so an interrupted write never leaves a
+ *                 partial cache behind.
+ *
+ *                 Equal size and mtime are trusted without reading the
+ *                 source. When only the mtime changed, the source is read
+ *                 and its CRC-32 compared, and the cached image is kept,
+ *                 under the new mtime, if the content is the same.
+ *
+ ******************************************************************************/
+
+#define LOG_TAG "bt_fw_cache"
+
+#include <utils/Log.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "bt_vendor.h"
+#include "fw_cache.h"
+#include "fw_patch.h"
+#include "fw_repack.h"
+
+/******************************************************************************
+**  Constants & Macros
+******************************************************************************/
+
+/* Longest source path recorded in a cached file */
+#define FW_CACHE_SRC_PATH_MAX   256
+
+/******************************************************************************
+**  Local type definitions
+******************************************************************************/
+
+/* Source of a cached patch, written after its fw_patch_hdr_t */
+typedef struct
+{
+    uint32_t src_size;
+    uint32_t src_mtime;                     /* seconds */
+    uint32_t src_mtime_ns;
+    uint32_t src_crc;                       /* CRC-32 of the .seq text */
+    uint8_t  chunk;                         /* repacking of the records */
+    uint8_t  reserved[3];
+    char     src_path[FW_CACHE_SRC_PATH_MAX];
+} fw_cache_ext_t;
+
+/******************************************************************************
+**  Static variables
+******************************************************************************/
+
+/* Empty while the cache is off */
+#if (FW_PATCH_CACHE == TRUE)
+static char fw_cache_dir[PATH_MAX] = FW_PATCH_CACHE_DIR;
+#else
+static char fw_cache_dir[PATH_MAX] = "";
+#endif
+
+/*******************************************************************************
+**
+** Function        fw_cache_name
+**
+** Description     Path of the cached file of the source p_src
+**
+** Returns         0 : Success
+**                 Otherwise : Fail, path too long
+**
+*******************************************************************************/
+static int fw_cache_name(const char *p_src, char *p_path, size_t size)
+{
+    const char *p_base = strrchr(p_src, '/');
+    const char *p_ext;
+    int len;
+
+    p_base = (p_base != NULL) ? (p_base + 1) : p_src;
+    p_ext = strrchr(p_base, '.');
+    len = (p_ext != NULL) ? (int) (p_ext - p_base) : (int) strlen(p_base);
+    if (len > NAME_MAX)
+        return -1;
+
+    len = snprintf(p_path, size, "%s/%.*s.%08x.bseq", fw_cache_dir, len,
+        p_base, fw_patch_crc32(0, (const uint8_t *) p_src, strlen(p_src)));
+
+    return ((len < 0) || ((size_t) len >= size)) ? -1 : 0;
+}
+
+/*******************************************************************************
+**
+** Function        fw_cache_read_ext
+**
+** Description     Read the source record of the cached file p_path
+**
+** Returns         0 : Success
+**                 Otherwise : Fail, no cached file or not one of ours
+**
+*******************************************************************************/
+static int fw_cache_read_ext(const char *p_path, fw_cache_ext_t *p_ext)
+{
+    fw_patch_hdr_t hdr;
+    int fd, ret = -1;
+
+    if ((fd = open(p_path, O_RDONLY)) < 0)
+        return -1;
+
+    if ((pread(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr)) &&
+        (memcmp(hdr.magic, FW_PATCH_MAGIC, FW_PATCH_MAGIC_LEN) == 0) &&
+        (hdr.hdr_len == sizeof(hdr) + sizeof(fw_cache_ext_t)) &&
+        (pread(fd, p_ext, sizeof(fw_cache_ext_t), sizeof(hdr)) ==
+            sizeof(fw_cache_ext_t)))
+    {
+        p_ext->src_path[FW_CACHE_SRC_PATH_MAX - 1] = '\0';
+        ret = 0;
+    }
+
+    close(fd);
+
+    return ret;
+}
+
+/*******************************************************************************
+**
+** Function        fw_cache_read_src
+**
+** Description     Read the whole .seq text from fd
+**
+** Returns         The text (to be freed), NULL if it can not be read
+**
+*******************************************************************************/
+static char *fw_cache_read_src(int fd, size_t len)
+{
+    char *p_text;
+
+    if ((p_text = malloc(len + 1)) == NULL)
+        return NULL;
+
+    if (pread(fd, p_text, len, 0) != (ssize_t) len)
+    {
+        free(p_text);
+        return NULL;
+    }
+
+    return p_text;
+}
+
+/*******************************************************************************
+**
+** Function        fw_cache_write
+**
+** Description     Write the image p_patch as the cached file p_path,
+**                 through a temporary file renamed over it
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+static int fw_cache_write(const fw_patch_t *p_patch, const char *p_path,
+                          const fw_cache_ext_t *p_ext)
+{
+    char tmp[PATH_MAX];
+    int fd;
+
+    if ((size_t) snprintf(tmp, sizeof(tmp), "%s.XXXXXX", p_path) >= sizeof(tmp))
+        return -1;
+
+    if ((fd = mkstemp(tmp)) < 0)
+    {
+        ALOGW("Can not create %s: %s", tmp, strerror(errno));
+        return -1;
+    }
+
+    close(fd);
+
+    if ((fw_patch_save_ext(p_patch, tmp, 0, p_ext, sizeof(fw_cache_ext_t))
+            != 0) || (rename(tmp, p_path) != 0))
+    {
+        ALOGW("Can not write %s: %s", p_path, strerror(errno));
+        unlink(tmp);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*******************************************************************************
+**
+** Function        fw_cache_open
+**
+** Description     Open the .seq patch p_src through the cache, repacked to
+**                 MEMWRITE commands of chunk data bytes. A valid cached
+**                 image is mapped; otherwise the source is loaded and the
+**                 cache written for the next open.
+**
+** Returns         0 : Success
+**                 Otherwise : Fail, cache disabled or not writable; the
+**                 caller opens the source itself
+**
+*******************************************************************************/
+int fw_cache_open(const char *p_src, uint8_t chunk, fw_patch_t *p_patch)
+{
+    char path[PATH_MAX];
+    fw_cache_ext_t ext, cached;
+    struct stat st;
+    char *p_text = NULL;
+    int fd, hit = FALSE, ret;
+
+    if ((fw_cache_dir[0] == '\0') ||
+        (strlen(p_src) >= FW_CACHE_SRC_PATH_MAX) ||
+        (fw_cache_name(p_src, path, sizeof(path)) != 0))
+        return -1;
+
+    if ((fd = open(p_src, O_RDONLY)) < 0)
+        return -1;
+
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    memset(&ext, 0, sizeof(ext));
+    ext.src_size = st.st_size;
+    ext.src_mtime = st.st_mtim.tv_sec;
+    ext.src_mtime_ns = st.st_mtim.tv_nsec;
+    ext.chunk = chunk;
+    strcpy(ext.src_path, p_src);
+
+    if ((fw_cache_read_ext(path, &cached) == 0) &&
+        (strcmp(cached.src_path, ext.src_path) == 0) &&
+        (cached.src_size == ext.src_size) && (cached.chunk == ext.chunk))
+    {
+        if ((cached.src_mtime == ext.src_mtime) &&
+            (cached.src_mtime_ns == ext.src_mtime_ns))
+        {
+            hit = TRUE;
+        }
+        else if ((p_text = fw_cache_read_src(fd, st.st_size)) != NULL)
+        {
+            ext.src_crc = fw_patch_crc32(0, (const uint8_t *) p_text,
+                st.st_size);
+            hit = (ext.src_crc == cached.src_crc);
+        }
+    }
+
+    if ((hit == TRUE) && (fw_patch_open(path, p_patch) == 0))
+    {
+        ALOGI("%s from cache %s", p_src, path);
+
+        /* Same content under a new mtime, recorded so that the next open
+         * does not read the source again */
+        if (p_text != NULL)
+            fw_cache_write(p_patch, path, &ext);
+
+        free(p_text);
+        close(fd);
+        return 0;
+    }
+
+    /* Rebuilt only where it can be written, the caller streams the
+     * source otherwise */
+    if (((mkdir(fw_cache_dir, 0770) != 0) && (errno != EEXIST)) ||
+        (access(fw_cache_dir, W_OK) != 0))
+    {
+        ALOGW("Patch cache %s not writable", fw_cache_dir);
+        free(p_text);
+        close(fd);
+        return -1;
+    }
+
+    if ((p_text == NULL) &&
+        ((p_text = fw_cache_read_src(fd, st.st_size)) != NULL))
+        ext.src_crc = fw_patch_crc32(0, (const uint8_t *) p_text, st.st_size);
+
+    close(fd);
+
+    if (p_text == NULL)
+    {
+        ALOGE("Can not read %s", p_src);
+        return -1;
+    }
+
+    memset(p_patch, 0, sizeof(fw_patch_t));
+    ret = fw_patch_parse_seq(p_text, st.st_size, p_patch);
+    free(p_text);
+
+    if (ret != 0)
+    {
+        fw_patch_close(p_patch);
+        return ret;
+    }
+
+    if (fw_patch_key_from_name(p_src, p_patch->key) != 0)
+        ALOGW("No version key in patch file name %s", p_src);
+
+    if (chunk != 0)
+        fw_repack_image(p_patch, chunk);
+
+    /* The image is good whether or not it could be cached */
+    if (fw_cache_write(p_patch, path, &ext) == 0)
+        ALOGI("Cached %s as %s", p_src, path);
+
+    return 0;
+}
+
+/*******************************************************************************
+**
+** Function        fw_cache_set_dir
+**
+** Description     Conf entry setter of the cache directory, which turns the
+**                 cache on; "none" turns it off
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+int fw_cache_set_dir(char *p_conf_name, char *p_conf_value, int param)
+{
+    if (strcmp(p_conf_value, "none") == 0)
+    {
+        fw_cache_dir[0] = '\0';
+        return 0;
+    }
+
+    if (strlen(p_conf_value) >= sizeof(fw_cache_dir))
+    {
+        ALOGE("Invalid %s %s", p_conf_name, p_conf_value);
+        return -1;
+    }
+
+    strcpy(fw_cache_dir, p_conf_value);
+
+    return 0;
+}
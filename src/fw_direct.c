@@ -0,0 +1,422 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      fw_direct.c
+ *
+ *  Description:   Contains the direct firmware download
+ *
+ *                 While it runs, bt_vendor_cbacks points to local callbacks:
+ *                 xmit_cb queues the H4 command, the queue is written out
+ *                 with a single write() once the event callback that
+ *                 produced it returns, and events matching the oldest
+ *                 pending command are handed to its callback like the HCI
+ *                 layer would; the other events, which the HCI layer would
+ *                 pass up to the stack, go to the caller. Buffers come from
+ *                 malloc() meanwhile.
+ *
+ ******************************************************************************/
+
+#define LOG_TAG "bt_fw_direct"
+
+#include <utils/Log.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bt_hci_bdroid.h"
+#include "bt_vendor.h"
+#include "fw_direct.h"
+#include "vnd_trace.h"
+
+/******************************************************************************
+**  Constants & Macros
+******************************************************************************/
+
+#define FW_DIRECT_RESULT_NONE   (-1)
+
+/* H4 packet indicators */
+#define FW_DIRECT_H4_CMD        0x01
+#define FW_DIRECT_H4_ACL        0x02
+#define FW_DIRECT_H4_SCO        0x03
+#define FW_DIRECT_H4_EVT        0x04
+
+#define FW_DIRECT_EVT_CMD_CMPL  0x0E
+#define FW_DIRECT_EVT_CMD_STAT  0x0F
+
+/* Largest H4 packet read back: ACL header and a 16 bit length */
+#define FW_DIRECT_RX_SIZE       (1 + 4 + 0xFFFF)
+
+/******************************************************************************
+**  Local type definitions
+******************************************************************************/
+
+typedef struct
+{
+    uint16_t        opcode;
+    tINT_CMD_CBACK  p_cback;
+} fw_direct_cmd_t;
+
+typedef struct
+{
+    int         fd;
+    int         result;                     /* from fwcfg_cb */
+    uint8_t     head;                       /* oldest pending command */
+    uint8_t     count;
+    fw_direct_cmd_t cmd[FW_DIRECT_CMD_MAX];
+    tINT_CMD_CBACK p_evt_cback;             /* other events */
+    uint32_t    tx_len;
+    uint8_t     tx[FW_DIRECT_TX_SIZE];
+    uint32_t    rx_len;
+    uint8_t     *p_rx;
+    uint32_t    commands;
+    uint32_t    writes;
+} fw_direct_cb_t;
+
+/******************************************************************************
+**  Static variables
+******************************************************************************/
+
+static fw_direct_cb_t fw_direct_cb;
+
+/******************************************************************************
+**  Static functions
+******************************************************************************/
+
+static void fw_direct_fwcfg_cb(bt_vendor_op_result_t result)
+{
+    fw_direct_cb.result = result;
+}
+
+static void fw_direct_unused_cb(bt_vendor_op_result_t result)
+{
+    ALOGW("Unexpected vendor callback during the direct download");
+}
+
+static void *fw_direct_alloc(int size)
+{
+    return malloc(size);
+}
+
+static void fw_direct_dealloc(void *p_buf)
+{
+    free(p_buf);
+}
+
+/*******************************************************************************
+**
+** Function        fw_direct_flush
+**
+** Description     Write the queued H4 packets to the UART
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+static int fw_direct_flush(void)
+{
+    uint32_t pos = 0;
+    ssize_t n;
+
+    while (pos < fw_direct_cb.tx_len)
+    {
+        n = write(fw_direct_cb.fd, fw_direct_cb.tx + pos,
+                  fw_direct_cb.tx_len - pos);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            ALOGE("UART write failed: %s", strerror(errno));
+            return -1;
+        }
+        pos += n;
+    }
+
+    if (fw_direct_cb.tx_len > 0)
+        fw_direct_cb.writes++;
+    fw_direct_cb.tx_len = 0;
+
+    return 0;
+}
+
+/*******************************************************************************
+**
+** Function        fw_direct_xmit
+**
+** Description     xmit_cb of the direct download, queues the command
+**
+** Returns         TRUE/FALSE
+**
+*******************************************************************************/
+static uint8_t fw_direct_xmit(uint16_t opcode, void *p_buf,
+                              tINT_CMD_CBACK p_cback)
+{
+    HC_BT_HDR *p_hdr = (HC_BT_HDR *) p_buf;
+    fw_direct_cmd_t *p_cmd;
+
+    if (fw_direct_cb.count == FW_DIRECT_CMD_MAX)
+    {
+        ALOGE("Too many commands pending, 0x%04X not sent", opcode);
+        return FALSE;
+    }
+
+    if ((fw_direct_cb.tx_len + 1 + p_hdr->len > FW_DIRECT_TX_SIZE) &&
+        (fw_direct_flush() != 0))
+        return FALSE;
+
+    fw_direct_cb.tx[fw_direct_cb.tx_len++] = FW_DIRECT_H4_CMD;
+    memcpy(fw_direct_cb.tx + fw_direct_cb.tx_len,
+           (uint8_t *) (p_hdr + 1) + p_hdr->offset, p_hdr->len);
+    fw_direct_cb.tx_len += p_hdr->len;
+
+    p_cmd = &fw_direct_cb.cmd[(fw_direct_cb.head + fw_direct_cb.count) %
+                              FW_DIRECT_CMD_MAX];
+    p_cmd->opcode = opcode;
+    p_cmd->p_cback = p_cback;
+    fw_direct_cb.count++;
+    fw_direct_cb.commands++;
+
+    /* Consumed, as the HCI layer does once the command is on the wire */
+    free(p_buf);
+
+    return TRUE;
+}
+
+/*******************************************************************************
+**
+** Function        fw_direct_event
+**
+** Description     Hand a Command Complete/Status event to the callback of
+**                 the oldest pending command, any other event to the event
+**                 callback
+**
+** Returns         None
+**
+*******************************************************************************/
+static void fw_direct_event(const uint8_t *p_evt, uint16_t len)
+{
+    tINT_CMD_CBACK p_cback;
+    fw_direct_cmd_t *p_cmd;
+    HC_BT_HDR *p_buf;
+    uint16_t opcode;
+
+    if ((p_evt[0] == FW_DIRECT_EVT_CMD_CMPL) && (len >= 5))
+        opcode = p_evt[3] | (p_evt[4] << 8);
+    else if ((p_evt[0] == FW_DIRECT_EVT_CMD_STAT) && (len >= 6))
+        opcode = p_evt[4] | (p_evt[5] << 8);
+    else
+        opcode = 0;
+
+    p_cmd = &fw_direct_cb.cmd[fw_direct_cb.head];
+
+    if (opcode == 0)
+    {
+        if ((p_cback = fw_direct_cb.p_evt_cback) == NULL)
+        {
+            VND_DBG(VND_TRACE_HW, "direct: event 0x%02X dropped", p_evt[0]);
+            return;
+        }
+    }
+    else if ((fw_direct_cb.count == 0) || (opcode != p_cmd->opcode))
+    {
+        VND_DBG(VND_TRACE_HW, "direct: no command pending for 0x%04X", opcode);
+        return;
+    }
+    else
+    {
+        p_cback = p_cmd->p_cback;
+        fw_direct_cb.head = (fw_direct_cb.head + 1) % FW_DIRECT_CMD_MAX;
+        fw_direct_cb.count--;
+    }
+
+    if ((p_buf = (HC_BT_HDR *) malloc(BT_HC_HDR_SIZE + len)) == NULL)
+    {
+        fw_direct_cb.result = BT_VND_OP_RESULT_FAIL;
+        return;
+    }
+
+    p_buf->event = MSG_HC_TO_STACK_HCI_EVT;
+    p_buf->len = len;
+    p_buf->offset = 0;
+    p_buf->layer_specific = 0;
+    memcpy(p_buf + 1, p_evt, len);
+
+    /* Releases p_buf */
+    p_cback(p_buf);
+}
+
+/*******************************************************************************
+**
+** Function        fw_direct_receive
+**
+** Description     Split the bytes read so far into H4 packets
+**
+** Returns         None
+**
+*******************************************************************************/
+static void fw_direct_receive(void)
+{
+    uint8_t *p = fw_direct_cb.p_rx;
+    uint32_t pos = 0;
+    uint32_t avail, hdr, len;
+
+    while ((pos < fw_direct_cb.rx_len) &&
+           (fw_direct_cb.result == FW_DIRECT_RESULT_NONE))
+    {
+        avail = fw_direct_cb.rx_len - pos;
+
+        switch (p[pos])
+        {
+            case FW_DIRECT_H4_EVT:
+                hdr = 3;
+                len = (avail >= hdr) ? p[pos + 2] : 0;
+                break;
+
+            case FW_DIRECT_H4_ACL:
+                hdr = 5;
+                len = (avail >= hdr) ? (p[pos + 3] | (p[pos + 4] << 8)) : 0;
+                break;
+
+            case FW_DIRECT_H4_SCO:
+                hdr = 4;
+                len = (avail >= hdr) ? p[pos + 3] : 0;
+                break;
+
+            default:
+                /* Out of sync, look for the next packet indicator */
+                pos++;
+                continue;
+        }
+
+        if (avail < hdr + len)
+            break;
+
+        if (p[pos] == FW_DIRECT_H4_EVT)
+            fw_direct_event(p + pos + 1, 2 + len);
+
+        pos += hdr + len;
+    }
+
+    fw_direct_cb.rx_len -= pos;
+    memmove(p, p + pos, fw_direct_cb.rx_len);
+}
+
+/*****************************************************************************
+**   DIRECT DOWNLOAD FUNCTIONS
+*****************************************************************************/
+
+/*******************************************************************************
+**
+** Function        fw_direct_run
+**
+** Description     Run the firmware configuration started by p_start over fd,
+**                 until it reports its result through fwcfg_cb
+**
+** Returns         BT_VND_OP_RESULT_SUCCESS or BT_VND_OP_RESULT_FAIL
+**
+*******************************************************************************/
+int fw_direct_run(int fd, void (*p_start)(void), tINT_CMD_CBACK p_evt_cback)
+{
+    static bt_vendor_callbacks_t direct_cbacks = {
+        sizeof(bt_vendor_callbacks_t),
+        fw_direct_fwcfg_cb,
+        fw_direct_unused_cb,
+        fw_direct_unused_cb,
+        fw_direct_alloc,
+        fw_direct_dealloc,
+        fw_direct_xmit,
+        fw_direct_unused_cb
+    };
+    bt_vendor_callbacks_t *p_stack_cbacks = bt_vendor_cbacks;
+    struct pollfd pfd;
+    ssize_t n;
+    int ret;
+
+    memset(&fw_direct_cb, 0, sizeof(fw_direct_cb));
+    fw_direct_cb.fd = fd;
+    fw_direct_cb.result = FW_DIRECT_RESULT_NONE;
+    fw_direct_cb.p_evt_cback = p_evt_cback;
+
+    if ((fw_direct_cb.p_rx = (uint8_t *) malloc(FW_DIRECT_RX_SIZE)) == NULL)
+        return BT_VND_OP_RESULT_FAIL;
+
+    bt_vendor_cbacks = &direct_cbacks;
+
+    p_start();
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+
+    while (fw_direct_cb.result == FW_DIRECT_RESULT_NONE)
+    {
+        if (fw_direct_flush() != 0)
+            break;
+
+        if ((ret = poll(&pfd, 1, FW_DIRECT_EVT_TIMEOUT_MS)) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            ALOGE("UART poll failed: %s", strerror(errno));
+            break;
+        }
+
+        if ((ret == 0) && (fw_direct_cb.count > 0))
+        {
+            ALOGE("No answer to 0x%04X within %d ms",
+                fw_direct_cb.cmd[fw_direct_cb.head].opcode,
+                FW_DIRECT_EVT_TIMEOUT_MS);
+            break;
+        }
+        else if (ret == 0)
+        {
+            ALOGE("No event within %d ms", FW_DIRECT_EVT_TIMEOUT_MS);
+            break;
+        }
+
+        n = read(fd, fw_direct_cb.p_rx + fw_direct_cb.rx_len,
+                 FW_DIRECT_RX_SIZE - fw_direct_cb.rx_len);
+        if (n <= 0)
+        {
+            if ((n < 0) && ((errno == EINTR) || (errno == EAGAIN)))
+                continue;
+            ALOGE("UART read failed: %s", (n < 0) ? strerror(errno) : "EOF");
+            break;
+        }
+
+        fw_direct_cb.rx_len += n;
+        fw_direct_receive();
+    }
+
+    /* A state machine left waiting is failed by the stack path afterwards */
+    if (fw_direct_cb.result == FW_DIRECT_RESULT_NONE)
+        fw_direct_cb.result = BT_VND_OP_RESULT_FAIL;
+
+    bt_vendor_cbacks = p_stack_cbacks;
+
+    free(fw_direct_cb.p_rx);
+
+    VND_TRACE(TRC_HW_DIRECT, fw_direct_cb.result, fw_direct_cb.commands,
+        fw_direct_cb.writes);
+    ALOGI("Direct download %s: %u commands in %u writes",
+        (fw_direct_cb.result == BT_VND_OP_RESULT_SUCCESS) ? "done" : "failed",
+        fw_direct_cb.commands, fw_direct_cb.writes);
+
+    return fw_direct_cb.result;
+}
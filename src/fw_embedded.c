@@ -0,0 +1,79 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      fw_embedded.c
+ *
+ *  Description:   Contains the lookup of the patches linked into the
+ *                 library
+ *
+ ******************************************************************************/
+
+#define LOG_TAG "bt_fw_embedded"
+
+#include <utils/Log.h>
+#include <string.h>
+#include "bt_vendor.h"
+#include "fw_embedded.h"
+
+/*****************************************************************************
+**   EMBEDDED PATCH FUNCTIONS
+*****************************************************************************/
+
+/*******************************************************************************
+**
+** Function        fw_embedded_open
+**
+** Description     Open the embedded patch of version key p_key. The image
+**                 points to the constant tables, nothing is copied.
+**
+** Returns         0 : Success
+**                 Otherwise : no patch embedded for the key
+**
+*******************************************************************************/
+int fw_embedded_open(const uint8_t *p_key, fw_patch_t *p_patch)
+{
+#if (FW_PATCH_EMBEDDED == TRUE)
+    const fw_embedded_patch_t *p_emb;
+    uint32_t i;
+
+    for (i = 0; i < fw_embedded_count; i++)
+    {
+        p_emb = &fw_embedded_patches[i];
+        if (memcmp(p_emb->key, p_key, FW_PATCH_KEY_LEN) != 0)
+            continue;
+
+        memset(p_patch, 0, sizeof(fw_patch_t));
+        memcpy(p_patch->key, p_emb->key, FW_PATCH_KEY_LEN);
+        p_patch->p_rec = p_emb->p_rec;
+        p_patch->rec_size = p_emb->rec_size;
+        p_patch->rec_count = p_emb->rec_count;
+        p_patch->cmd_count = p_emb->cmd_count;
+
+        ALOGI("Embedded patch %u: %u records, %u commands", i,
+            p_patch->rec_count, p_patch->cmd_count);
+        return 0;
+    }
+#else
+    (void) p_key;
+    (void) p_patch;
+#endif
+
+    return -1;
+}
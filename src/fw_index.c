@@ -0,0 +1,546 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      fw_index.c
+ *
+ *  Description:   Contains the index of the firmware patch files
+ *
+ *                 Used from the HCI thread and the preload worker, hence
+ *                 the lock. Directories that could not be watched (missing
+ *                 at build time, no inotify) are checked with stat() on
+ *                 every use instead. The keys of a bundle are read from
+ *                 its key table, and rank after the files named by key.
+ *
+ ******************************************************************************/
+
+#define LOG_TAG "bt_fw_index"
+
+#include <utils/Log.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include "fw_bundle.h"
+#include "fw_index.h"
+#include "vnd_trace.h"
+
+/******************************************************************************
+**  Constants & Macros
+******************************************************************************/
+
+#ifndef FALSE
+#define FALSE  0
+#endif
+
+#ifndef TRUE
+#define TRUE   (!FALSE)
+#endif
+
+#define FW_INDEX_WATCH_MASK     (IN_CREATE | IN_DELETE | IN_MOVED_FROM | \
+                                 IN_MOVED_TO | IN_CLOSE_WRITE | \
+                                 IN_DELETE_SELF | IN_MOVE_SELF)
+
+/******************************************************************************
+**  Local type definitions
+******************************************************************************/
+
+typedef struct
+{
+    uint8_t     key[FW_PATCH_KEY_LEN];
+    uint8_t     dir;                    /* index in fw_index_cb.dir */
+    uint8_t     ext;                    /* index in fw_index_ext */
+    char        name[NAME_MAX + 1];
+} fw_index_rec_t;
+
+typedef struct
+{
+    char        path[PATH_MAX];
+    int         wd;                     /* inotify watch, -1 if none */
+    int         exists;                 /* when scanned, for unwatched dirs */
+    time_t      mtime;
+} fw_index_dir_t;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    uint8_t     valid;
+    char        dirs[PATH_MAX];         /* FwPatchFilePath indexed */
+    int         inotify_fd;
+    uint8_t     dir_count;
+    uint8_t     readable;               /* directories that could be read */
+    fw_index_dir_t dir[FW_INDEX_DIR_MAX];
+    uint8_t     count;
+    fw_index_rec_t rec[FW_INDEX_MAX];
+} fw_index_cb_t;
+
+/******************************************************************************
+**  Static variables
+******************************************************************************/
+
+static fw_index_cb_t fw_index_cb = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .valid = FALSE,
+    .inotify_fd = -1
+};
+
+/* Extensions in order of preference, bundles come last */
+static const char *fw_index_ext[] = {
+    FW_PATCH_BIN_EXTENSION,
+    FW_PATCH_ZIP_EXTENSION,
+    FW_PATCH_SEQ_EXTENSION,
+    (const char *) NULL
+};
+
+#define FW_INDEX_EXT_BUNDLE \
+    (sizeof(fw_index_ext) / sizeof(fw_index_ext[0]) - 1)
+
+/******************************************************************************
+**  Static functions
+******************************************************************************/
+
+/*******************************************************************************
+**
+** Function        fw_index_split
+**
+** Description     Copy the n-th directory of p_dirs to p_dir, without
+**                 trailing '/'
+**
+** Returns         TRUE if there is such a directory, FALSE otherwise
+**
+*******************************************************************************/
+static int fw_index_split(const char *p_dirs, int n, char *p_dir, size_t len)
+{
+    const char *p_end;
+    size_t dir_len;
+
+    while (n-- > 0)
+    {
+        if ((p_dirs = strchr(p_dirs, FW_INDEX_DIR_SEPARATOR)) == NULL)
+            return FALSE;
+        p_dirs++;
+    }
+
+    p_end = strchr(p_dirs, FW_INDEX_DIR_SEPARATOR);
+    dir_len = (p_end != NULL) ? (size_t) (p_end - p_dirs) : strlen(p_dirs);
+
+    while ((dir_len > 1) && (p_dirs[dir_len - 1] == '/'))
+        dir_len--;
+
+    if ((dir_len == 0) || (dir_len >= len))
+        return FALSE;
+
+    memcpy(p_dir, p_dirs, dir_len);
+    p_dir[dir_len] = '\0';
+
+    return TRUE;
+}
+
+/*******************************************************************************
+**
+** Function        fw_index_ext_of
+**
+** Description     Check that p_name is <version key><patch extension>
+**
+** Returns         Index of the extension, -1 if not a patch file
+**
+*******************************************************************************/
+static int fw_index_ext_of(const char *p_name, uint8_t *p_key)
+{
+    int ext;
+
+    if (fw_patch_key_from_name(p_name, p_key) != 0)
+        return -1;
+
+    for (ext = 0; fw_index_ext[ext] != NULL; ext++)
+    {
+        if (strcasecmp(p_name + FW_PATCH_KEY_STR_LEN, fw_index_ext[ext]) == 0)
+            return ext;
+    }
+
+    return -1;
+}
+
+/*******************************************************************************
+**
+** Function        fw_index_add
+**
+** Description     Index the patch of p_key in file p_name of directory d,
+**                 unless the key is already indexed from a directory of
+**                 higher priority or with a preferred extension
+**
+** Returns         None
+**
+*******************************************************************************/
+static void fw_index_add(uint8_t d, const uint8_t *p_key, int ext,
+                         const char *p_name)
+{
+    uint8_t i;
+
+    if (strlen(p_name) >= sizeof(fw_index_cb.rec[0].name))
+    {
+        ALOGW("Invalid patchfile name (too long), %s/%s not indexed",
+            fw_index_cb.dir[d].path, p_name);
+        return;
+    }
+
+    for (i = 0; i < fw_index_cb.count; i++)
+    {
+        if (memcmp(fw_index_cb.rec[i].key, p_key, FW_PATCH_KEY_LEN) == 0)
+            break;
+    }
+
+    if (i == fw_index_cb.count)
+    {
+        if (fw_index_cb.count == FW_INDEX_MAX)
+        {
+            ALOGW("Patch index full, %s/%s not indexed",
+                fw_index_cb.dir[d].path, p_name);
+            return;
+        }
+        fw_index_cb.count++;
+    }
+    else if ((fw_index_cb.rec[i].dir < d) ||
+             (ext >= fw_index_cb.rec[i].ext))
+    {
+        return;
+    }
+
+    memcpy(fw_index_cb.rec[i].key, p_key, FW_PATCH_KEY_LEN);
+    fw_index_cb.rec[i].dir = d;
+    fw_index_cb.rec[i].ext = ext;
+    strcpy(fw_index_cb.rec[i].name, p_name);
+}
+
+/*******************************************************************************
+**
+** Function        fw_index_add_bundle
+**
+** Description     Index the patches of the bundle p_name of directory d
+**
+** Returns         None
+**
+*******************************************************************************/
+static void fw_index_add_bundle(uint8_t d, const char *p_name)
+{
+    uint8_t keys[FW_INDEX_MAX][FW_PATCH_KEY_LEN];
+    char path[PATH_MAX];
+    int i, n;
+
+    if (snprintf(path, sizeof(path), "%s/%s", fw_index_cb.dir[d].path,
+                 p_name) >= (int) sizeof(path))
+    {
+        ALOGW("Invalid patchfile name (too long), %s/%s not indexed",
+            fw_index_cb.dir[d].path, p_name);
+        return;
+    }
+
+    if ((n = fw_bundle_keys(path, keys, FW_INDEX_MAX)) < 0)
+    {
+        ALOGW("Invalid patch bundle %s", path);
+        return;
+    }
+
+    for (i = 0; i < n; i++)
+        fw_index_add(d, keys[i], FW_INDEX_EXT_BUNDLE, p_name);
+}
+
+/*******************************************************************************
+**
+** Function        fw_index_scan_dir
+**
+** Description     Add the patch files of directory d. Keys already indexed
+**                 from a directory of higher priority are kept.
+**
+** Returns         None
+**
+*******************************************************************************/
+static void fw_index_scan_dir(uint8_t d)
+{
+    fw_index_dir_t *p_dir = &fw_index_cb.dir[d];
+    uint8_t key[FW_PATCH_KEY_LEN];
+    struct dirent *dp;
+    struct stat st;
+    DIR *dirp;
+    int ext;
+
+    p_dir->exists = (stat(p_dir->path, &st) == 0);
+    p_dir->mtime = p_dir->exists ? st.st_mtime : 0;
+
+    if ((dirp = opendir(p_dir->path)) == NULL)
+    {
+        ALOGW("Can not open patch directory %s", p_dir->path);
+        return;
+    }
+    fw_index_cb.readable++;
+
+    while ((dp = readdir(dirp)) != NULL)
+    {
+        if (fw_patch_file_type(dp->d_name) == FW_PATCH_FILE_BUNDLE)
+            fw_index_add_bundle(d, dp->d_name);
+        else if ((ext = fw_index_ext_of(dp->d_name, key)) >= 0)
+            fw_index_add(d, key, ext, dp->d_name);
+    }
+
+    closedir(dirp);
+}
+
+/*******************************************************************************
+**
+** Function        fw_index_unwatch
+**
+** Description     Drop the index and the inotify watches
+**
+** Returns         None
+**
+*******************************************************************************/
+static void fw_index_unwatch(void)
+{
+    if (fw_index_cb.inotify_fd >= 0)
+        close(fw_index_cb.inotify_fd);
+
+    fw_index_cb.inotify_fd = -1;
+    fw_index_cb.valid = FALSE;
+    fw_index_cb.count = 0;
+    fw_index_cb.dir_count = 0;
+    fw_index_cb.readable = 0;
+}
+
+/*******************************************************************************
+**
+** Function        fw_index_build
+**
+** Description     Watch and scan the directories of p_dirs
+**
+** Returns         None
+**
+*******************************************************************************/
+static void fw_index_build(const char *p_dirs)
+{
+    struct timespec t0, t1;
+    fw_index_dir_t *p_dir;
+    uint8_t d;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    fw_index_unwatch();
+    snprintf(fw_index_cb.dirs, sizeof(fw_index_cb.dirs), "%s", p_dirs);
+
+    if ((fw_index_cb.inotify_fd = inotify_init()) >= 0)
+    {
+        fcntl(fw_index_cb.inotify_fd, F_SETFL, O_NONBLOCK);
+        fcntl(fw_index_cb.inotify_fd, F_SETFD, FD_CLOEXEC);
+    }
+    else
+    {
+        ALOGW("No inotify (%s), patch directories checked on use",
+            strerror(errno));
+    }
+
+    for (d = 0; d < FW_INDEX_DIR_MAX; d++)
+    {
+        p_dir = &fw_index_cb.dir[d];
+
+        if (fw_index_split(p_dirs, d, p_dir->path, sizeof(p_dir->path)) ==
+            FALSE)
+            break;
+
+        /* Watch first, so that nothing slips between scan and watch */
+        p_dir->wd = -1;
+        if (fw_index_cb.inotify_fd >= 0)
+            p_dir->wd = inotify_add_watch(fw_index_cb.inotify_fd, p_dir->path,
+                                          FW_INDEX_WATCH_MASK);
+
+        fw_index_scan_dir(d);
+    }
+
+    fw_index_cb.dir_count = d;
+    fw_index_cb.valid = TRUE;
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    VND_TRACE(TRC_HW_INDEX, fw_index_cb.count, fw_index_cb.dir_count,
+        (t1.tv_sec - t0.tv_sec) * 1000000 + (t1.tv_nsec - t0.tv_nsec) / 1000);
+}
+
+/*******************************************************************************
+**
+** Function        fw_index_stale
+**
+** Description     Check whether the index no longer matches the directories
+**
+** Returns         TRUE/FALSE
+**
+*******************************************************************************/
+static int fw_index_stale(const char *p_dirs)
+{
+    char buf[1024];
+    fw_index_dir_t *p_dir;
+    struct stat st;
+    int exists, stale = FALSE;
+    uint8_t d;
+
+    if ((fw_index_cb.valid == FALSE) || (strcmp(fw_index_cb.dirs, p_dirs) != 0))
+        return TRUE;
+
+    /* Any event of a watched directory, drain them all */
+    if (fw_index_cb.inotify_fd >= 0)
+    {
+        while (read(fw_index_cb.inotify_fd, buf, sizeof(buf)) > 0)
+            stale = TRUE;
+    }
+
+    for (d = 0; (d < fw_index_cb.dir_count) && (stale == FALSE); d++)
+    {
+        p_dir = &fw_index_cb.dir[d];
+        if (p_dir->wd >= 0)
+            continue;
+
+        exists = (stat(p_dir->path, &st) == 0);
+        if ((exists != p_dir->exists) || (exists && (st.st_mtime != p_dir->mtime)))
+            stale = TRUE;
+    }
+
+    return stale;
+}
+
+/*******************************************************************************
+**
+** Function        fw_index_refresh
+**
+** Description     Bring the index up to date. Called with the lock held.
+**
+** Returns         None
+**
+*******************************************************************************/
+static void fw_index_refresh(const char *p_dirs)
+{
+    if (fw_index_stale(p_dirs) == TRUE)
+        fw_index_build(p_dirs);
+}
+
+/*****************************************************************************
+**   PATCH INDEX FUNCTIONS
+*****************************************************************************/
+
+/*******************************************************************************
+**
+** Function        fw_index_lookup
+**
+** Description     Find the patch file of the version key in p_dirs. The
+**                 first directory holding it wins, and in a directory a
+**                 .bseq file is preferred over a .bseqz, then the .seq, then
+**                 a bundle holding the key.
+**
+** Returns         0 : Success, p_path filled
+**                 Otherwise : no patch file for the key
+**
+*******************************************************************************/
+int fw_index_lookup(const char *p_dirs, const uint8_t *p_key, char *p_path,
+                    size_t len)
+{
+    fw_index_rec_t *p_rec;
+    int ret = -1;
+    uint8_t i;
+
+    pthread_mutex_lock(&fw_index_cb.lock);
+
+    fw_index_refresh(p_dirs);
+
+    for (i = 0; i < fw_index_cb.count; i++)
+    {
+        p_rec = &fw_index_cb.rec[i];
+        if (memcmp(p_rec->key, p_key, FW_PATCH_KEY_LEN) != 0)
+            continue;
+
+        if (snprintf(p_path, len, "%s/%s", fw_index_cb.dir[p_rec->dir].path,
+                     p_rec->name) < (int) len)
+            ret = 0;
+        else
+            ALOGE("Invalid patchfile name (too long)");
+        break;
+    }
+
+    pthread_mutex_unlock(&fw_index_cb.lock);
+
+    return ret;
+}
+
+/*******************************************************************************
+**
+** Function        fw_index_list
+**
+** Description     Copy up to max entries of the index of p_dirs, one per
+**                 version key
+**
+** Returns         Number of entries, -1 if no directory could be read
+**
+*******************************************************************************/
+int fw_index_list(const char *p_dirs, fw_index_entry_t *p_entries, int max)
+{
+    fw_index_rec_t *p_rec;
+    int i, n = -1;
+
+    pthread_mutex_lock(&fw_index_cb.lock);
+
+    fw_index_refresh(p_dirs);
+
+    if (fw_index_cb.readable > 0)
+    {
+        for (i = 0, n = 0; (i < fw_index_cb.count) && (n < max); i++)
+        {
+            p_rec = &fw_index_cb.rec[i];
+
+            memcpy(p_entries[n].key, p_rec->key, FW_PATCH_KEY_LEN);
+            if (snprintf(p_entries[n].path, sizeof(p_entries[n].path), "%s/%s",
+                         fw_index_cb.dir[p_rec->dir].path, p_rec->name) <
+                (int) sizeof(p_entries[n].path))
+                n++;
+        }
+    }
+
+    pthread_mutex_unlock(&fw_index_cb.lock);
+
+    return n;
+}
+
+/*******************************************************************************
+**
+** Function        fw_index_first_dir
+**
+** Description     Copy the first directory of p_dirs, without trailing '/'
+**
+** Returns         0 : Success
+**                 Otherwise : Fail, path too long
+**
+*******************************************************************************/
+int fw_index_first_dir(const char *p_dirs, char *p_dir, size_t len)
+{
+    if (fw_index_split(p_dirs, 0, p_dir, len) == TRUE)
+        return 0;
+
+    return (snprintf(p_dir, len, "%s", p_dirs) < (int) len) ? 0 : -1;
+}
@@ -0,0 +1,863 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      fw_patch.c
+ *
+ *  Description:   Contains functions to load firmware patch images
+ *                      binary patch (.bseq) mapping
+ *                      compressed binary patch (.bseqz) inflating
+ *                      textual patch (.seq) decoding
+ *                      record iteration
+ *
+ *                 This file is also built into the host patch compiler, it
+ *                 must not depend on the Bluetooth stack headers.
+ *
+ ******************************************************************************/
+
+#define LOG_TAG "bt_fw_patch"
+
+#include <utils/Log.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "fw_patch.h"
+#include "hex_decode.h"
+
+/******************************************************************************
+**  Constants & Macros
+******************************************************************************/
+
+#ifndef FALSE
+#define FALSE  0
+#endif
+
+#ifndef TRUE
+#define TRUE   (!FALSE)
+#endif
+
+/******************************************************************************
+**  Static variables
+******************************************************************************/
+
+static uint32_t crc32_table[256];
+static int crc32_table_ready = FALSE;
+
+/******************************************************************************
+**  Static functions
+******************************************************************************/
+
+/*******************************************************************************
+**
+** Function        fw_patch_count
+**
+** Description     Walk the record stream of p_patch, checking every record
+**                 and counting records and commands
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+static int fw_patch_count(fw_patch_t *p_patch)
+{
+    uint32_t pos = 0;
+    uint32_t len;
+
+    p_patch->rec_count = 0;
+    p_patch->cmd_count = 0;
+
+    while (pos < p_patch->rec_size)
+    {
+        len = fw_patch_rec_len(p_patch->p_rec + pos, p_patch->rec_size - pos);
+        if (len == 0)
+        {
+            ALOGE("Malformed patch record %d at offset %d",
+                p_patch->rec_count, pos);
+            return -1;
+        }
+
+        if (p_patch->p_rec[pos] == FW_PATCH_REC_CMD)
+            p_patch->cmd_count++;
+        p_patch->rec_count++;
+        pos += len;
+    }
+
+    return 0;
+}
+
+/*******************************************************************************
+**
+** Function        fw_patch_inflate
+**
+** Description     Replace the mapped records of a compressed binary patch
+**                 by their inflated copy
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+static int fw_patch_inflate(const fw_patch_hdr_t *p_hdr, fw_patch_t *p_patch)
+{
+    uLongf len = p_hdr->rec_size;
+    int ret;
+
+    if ((p_patch->p_alloc = (uint8_t *) malloc(p_hdr->rec_size + 1)) == NULL)
+        return -1;
+
+    ret = uncompress(p_patch->p_alloc, &len,
+                     (const uint8_t *) p_patch->p_map + p_hdr->rec_offset,
+                     p_patch->map_len - p_hdr->rec_offset);
+    if ((ret != Z_OK) || (len != p_hdr->rec_size))
+        return -1;
+
+    p_patch->p_rec = p_patch->p_alloc;
+    p_patch->rec_size = len;
+
+    return 0;
+}
+
+/*******************************************************************************
+**
+** Function        fw_patch_map
+**
+** Description     Memory-map a binary patch file and check its header. The
+**                 records of a compressed one are inflated and the file
+**                 unmapped.
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+static int fw_patch_map(const char *p_path, fw_patch_t *p_patch)
+{
+    const fw_patch_hdr_t *p_hdr;
+    struct stat st;
+    int fd;
+
+    if ((fd = open(p_path, O_RDONLY)) < 0)
+    {
+        ALOGE("Can not open %s: %s", p_path, strerror(errno));
+        return -1;
+    }
+
+    if ((fstat(fd, &st) < 0) || (st.st_size < (off_t) sizeof(fw_patch_hdr_t)))
+    {
+        ALOGE("Invalid binary patch %s", p_path);
+        close(fd);
+        return -1;
+    }
+
+    p_patch->map_len = st.st_size;
+    p_patch->p_map = mmap(NULL, p_patch->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (p_patch->p_map == MAP_FAILED)
+    {
+        ALOGE("Can not map %s: %s", p_path, strerror(errno));
+        p_patch->p_map = NULL;
+        return -1;
+    }
+
+    p_hdr = (const fw_patch_hdr_t *) p_patch->p_map;
+
+    if (fw_patch_check_hdr(p_hdr, p_patch->map_len) != 0)
+    {
+        ALOGE("Invalid binary patch header in %s", p_path);
+        return -1;
+    }
+
+    memcpy(p_patch->key, p_hdr->key, FW_PATCH_KEY_LEN);
+
+    if (p_hdr->flags & FW_PATCH_FLAG_DEFLATE)
+    {
+        if (fw_patch_inflate(p_hdr, p_patch) != 0)
+        {
+            ALOGE("Can not inflate binary patch %s", p_path);
+            return -1;
+        }
+    }
+    else
+    {
+        p_patch->p_rec = (const uint8_t *) p_patch->p_map + p_hdr->rec_offset;
+        p_patch->rec_size = p_hdr->rec_size;
+    }
+
+    if (fw_patch_crc32(0, p_patch->p_rec, p_patch->rec_size) != p_hdr->rec_crc)
+    {
+        ALOGE("CRC mismatch in binary patch %s", p_path);
+        return -1;
+    }
+
+    if ((fw_patch_count(p_patch) != 0) ||
+        (p_patch->rec_count != p_hdr->rec_count))
+    {
+        ALOGE("Corrupted binary patch %s", p_path);
+        return -1;
+    }
+
+    /* Only the inflated copy is used from now on */
+    if (p_patch->p_alloc != NULL)
+    {
+        munmap(p_patch->p_map, p_patch->map_len);
+        p_patch->p_map = NULL;
+        p_patch->map_len = 0;
+    }
+
+    return 0;
+}
+
+/*******************************************************************************
+**
+** Function        fw_patch_load_seq
+**
+** Description     Read and decode a textual patch file
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+static int fw_patch_load_seq(const char *p_path, fw_patch_t *p_patch)
+{
+    struct stat st;
+    char *p_text;
+    ssize_t len;
+    int fd, ret;
+
+    if ((fd = open(p_path, O_RDONLY)) < 0)
+    {
+        ALOGE("Can not open %s: %s", p_path, strerror(errno));
+        return -1;
+    }
+
+    if ((fstat(fd, &st) < 0) || ((p_text = malloc(st.st_size + 1)) == NULL))
+    {
+        close(fd);
+        return -1;
+    }
+
+    len = read(fd, p_text, st.st_size);
+    close(fd);
+
+    if (len != st.st_size)
+    {
+        ALOGE("Can not read %s", p_path);
+        free(p_text);
+        return -1;
+    }
+
+    ret = fw_patch_parse_seq(p_text, len, p_patch);
+    free(p_text);
+
+    if ((ret == 0) && (fw_patch_key_from_name(p_path, p_patch->key) != 0))
+        ALOGW("No version key in patch file name %s", p_path);
+
+    return ret;
+}
+
+/*****************************************************************************
+**   Firmware Patch Interface Functions
+*****************************************************************************/
+
+/*******************************************************************************
+**
+** Function         form_word
+**
+** Description      Convert input to a word
+**
+** Returns          formed word
+**
+*******************************************************************************/
+uint16_t form_word(uint8_t msb, uint8_t lsb)
+{
+    uint16_t byte;
+    byte = msb << 8;
+    byte |= lsb;
+    return byte;
+}
+
+/*******************************************************************************
+**
+** Function        fw_patch_rec_len
+**
+** Description     Length of the record at p (type byte included). avail is
+**                 the number of bytes available at p.
+**
+** Returns         record length, 0 if the record is malformed or does not
+**                 fit in avail
+**
+*******************************************************************************/
+uint32_t fw_patch_rec_len(const uint8_t *p, uint32_t avail)
+{
+    uint32_t len;
+
+    if (p[0] == FW_PATCH_REC_CMD)
+    {
+        if (avail < 1 + FW_PATCH_CMD_PREAMBLE_SIZE)
+            return 0;
+        len = 1 + FW_PATCH_CMD_PREAMBLE_SIZE + p[3];
+    }
+    else if (p[0] == FW_PATCH_REC_EVT)
+    {
+        if (avail < 1 + FW_PATCH_EVT_PREAMBLE_SIZE)
+            return 0;
+        len = 1 + FW_PATCH_EVT_PREAMBLE_SIZE + p[2];
+    }
+    else
+    {
+        return 0;
+    }
+
+    return (len <= avail) ? len : 0;
+}
+
+/*******************************************************************************
+**
+** Function        fw_patch_file_type
+**
+** Description     Tell the type of a patch file from its extension
+**
+** Returns         FW_PATCH_FILE_BIN/ZIP/BUNDLE, FW_PATCH_FILE_SEQ for any
+**                 other
+**
+*******************************************************************************/
+int fw_patch_file_type(const char *p_path)
+{
+    static const struct
+    {
+        const char  *p_ext;
+        int         type;
+    } types[] = {
+        { FW_PATCH_BIN_EXTENSION, FW_PATCH_FILE_BIN },
+        { FW_PATCH_ZIP_EXTENSION, FW_PATCH_FILE_ZIP },
+        { FW_PATCH_BUNDLE_EXTENSION, FW_PATCH_FILE_BUNDLE }
+    };
+    size_t len = strlen(p_path);
+    size_t ext_len;
+    unsigned i;
+
+    for (i = 0; i < sizeof(types) / sizeof(types[0]); i++)
+    {
+        ext_len = strlen(types[i].p_ext);
+        if ((len >= ext_len) &&
+            (strcasecmp(p_path + len - ext_len, types[i].p_ext) == 0))
+            return types[i].type;
+    }
+
+    return FW_PATCH_FILE_SEQ;
+}
+
+/*******************************************************************************
+**
+** Function        fw_patch_check_hdr
+**
+** Description     Check the header of a binary patch file of file_len bytes
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+int fw_patch_check_hdr(const fw_patch_hdr_t *p_hdr, size_t file_len)
+{
+    if ((memcmp(p_hdr->magic, FW_PATCH_MAGIC, FW_PATCH_MAGIC_LEN) != 0) ||
+        (p_hdr->version != FW_PATCH_FORMAT_VERSION) ||
+        (p_hdr->hdr_len < sizeof(fw_patch_hdr_t)) ||
+        (p_hdr->rec_offset < p_hdr->hdr_len) ||
+        (p_hdr->rec_offset > file_len))
+        return -1;
+
+    /* Before anything is allocated from it */
+    if ((p_hdr->rec_count > FW_PATCH_RECORDS_MAX) ||
+        (p_hdr->rec_size > p_hdr->rec_count * FW_PATCH_REC_MAX))
+        return -1;
+
+    /* The compressed records run to the end of the file */
+    if (!(p_hdr->flags & FW_PATCH_FLAG_DEFLATE) &&
+        (p_hdr->rec_size > file_len - p_hdr->rec_offset))
+        return -1;
+
+    return 0;
+}
+
+/*******************************************************************************
+**
+** Function        fw_patch_crc32
+**
+** Description     Update a CRC-32 (IEEE 802.3) over p_data
+**
+** Returns         updated CRC, start with 0
+**
+*******************************************************************************/
+uint32_t fw_patch_crc32(uint32_t crc, const uint8_t *p_data, size_t len)
+{
+    uint32_t c;
+    int i, j;
+
+    if (crc32_table_ready == FALSE)
+    {
+        for (i = 0; i < 256; i++)
+        {
+            c = i;
+            for (j = 0; j < 8; j++)
+                c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+            crc32_table[i] = c;
+        }
+        crc32_table_ready = TRUE;
+    }
+
+    crc = ~crc;
+    while (len--)
+        crc = crc32_table[(crc ^ *p_data++) & 0xFF] ^ (crc >> 8);
+
+    return ~crc;
+}
+
+/*******************************************************************************
+**
+** Function        fw_patch_key_from_name
+**
+** Description     Extract the version key from a patch file name, i.e. the
+**                 leading FW_PATCH_KEY_STR_LEN hex digits of its base name
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+int fw_patch_key_from_name(const char *p_name, uint8_t *p_key)
+{
+    const char *p_base = strrchr(p_name, '/');
+
+    p_base = (p_base != NULL) ? p_base + 1 : p_name;
+
+    if (strnlen(p_base, FW_PATCH_KEY_STR_LEN) < FW_PATCH_KEY_STR_LEN)
+        return -1;
+
+    return hex_decode(p_key, p_base, FW_PATCH_KEY_LEN);
+}
+
+/*******************************************************************************
+**
+** Function        fw_patch_decode_line
+**
+** Description     Decode one line of a .seq patch file. Lines starting with
+**                 "01" are commands, lines starting with "02" are the events
+**                 expected in return; everything else (comments, blank
+**                 lines) is skipped. White space between the hex digit pairs
+**                 is ignored.
+**
+** Returns         Record length, 0 if the line is not a record, -1 if it is
+**                 malformed
+**
+*******************************************************************************/
+int fw_patch_decode_line(const char *p_line, size_t len, int line_no,
+                         uint8_t *p_out, size_t max)
+{
+    const char *p_eol = p_line + len;
+    const char *p_tok;
+    const char *p;
+    size_t n;
+
+    if ((len < 2) || (p_line[0] != '0') ||
+        ((p_line[1] != '1') && (p_line[1] != '2')))
+        return 0;
+
+    p_out[0] = (p_line[1] == '1') ? FW_PATCH_REC_CMD : FW_PATCH_REC_EVT;
+    n = 1;
+
+    for (p = p_line + 2; p < p_eol; p = p_tok)
+    {
+        if ((unsigned char) *p <= ' ')
+        {
+            p_tok = p + 1;
+            continue;
+        }
+
+        /* Decode the whole run of digits up to the next white space */
+        for (p_tok = p; (p_tok < p_eol) && ((unsigned char) *p_tok > ' ');
+             p_tok++);
+
+        if (((p_tok - p) & 1) || (n + (p_tok - p) / 2 > max) ||
+            (hex_decode(p_out + n, p, (p_tok - p) / 2) != 0))
+        {
+            ALOGE("Patch line %d: invalid hex digits", line_no);
+            return -1;
+        }
+
+        n += (p_tok - p) / 2;
+    }
+
+    if (fw_patch_rec_len(p_out, n) != n)
+    {
+        ALOGE("Patch line %d: length does not match the record", line_no);
+        return -1;
+    }
+
+    return n;
+}
+
+/*******************************************************************************
+**
+** Function        fw_patch_parse_seq
+**
+** Description     Decode the text of a .seq patch file into a patch image
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+int fw_patch_parse_seq(const char *p_text, size_t len, fw_patch_t *p_patch)
+{
+    const char *p_line = p_text;
+    const char *p_end = p_text + len;
+    const char *p_eol;
+    uint32_t pos = 0;
+    int line_no = 0;
+    int n;
+
+    memset(p_patch, 0, sizeof(fw_patch_t));
+
+    /* A decoded record never takes more room than its line of text */
+    if ((p_patch->p_alloc = malloc(len + 1)) == NULL)
+        return -1;
+
+    for (; p_line < p_end; p_line = p_eol + 1)
+    {
+        line_no++;
+
+        if ((p_eol = memchr(p_line, '\n', p_end - p_line)) == NULL)
+            p_eol = p_end;
+
+        n = fw_patch_decode_line(p_line, p_eol - p_line, line_no,
+                                 p_patch->p_alloc + pos, len + 1 - pos);
+        if (n < 0)
+        {
+            fw_patch_close(p_patch);
+            return -1;
+        }
+
+        pos += n;
+    }
+
+    p_patch->p_rec = p_patch->p_alloc;
+    p_patch->rec_size = pos;
+
+    return fw_patch_count(p_patch);
+}
+
+/*******************************************************************************
+**
+** Function        fw_patch_open
+**
+** Description     Load the patch file p_path. A .bseq file is memory-mapped
+**                 and used in place, a .bseqz file is inflated, any other
+**                 file is decoded as .seq text.
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+int fw_patch_open(const char *p_path, fw_patch_t *p_patch)
+{
+    int ret;
+
+    memset(p_patch, 0, sizeof(fw_patch_t));
+
+    switch (fw_patch_file_type(p_path))
+    {
+        case FW_PATCH_FILE_SEQ:
+            ret = fw_patch_load_seq(p_path, p_patch);
+            break;
+
+        case FW_PATCH_FILE_BUNDLE:
+            /* Its patches are opened by version key, see fw_bundle_open */
+            ALOGE("%s is a patch bundle", p_path);
+            ret = -1;
+            break;
+
+        default:
+            ret = fw_patch_map(p_path, p_patch);
+            break;
+    }
+
+    if (ret != 0)
+    {
+        fw_patch_close(p_patch);
+        return ret;
+    }
+
+    ALOGI("Loaded %s: %d records, %d commands", p_path, p_patch->rec_count,
+        p_patch->cmd_count);
+
+    return 0;
+}
+
+/*******************************************************************************
+**
+** Function        fw_patch_next
+**
+** Description     Fetch the next record of the patch image
+**
+** Returns         TRUE when p_rec was filled, FALSE at the end of the patch
+**
+*******************************************************************************/
+int fw_patch_next(fw_patch_t *p_patch, fw_patch_rec_t *p_rec)
+{
+    const uint8_t *p;
+    int ret;
+
+    if (p_patch->p_src != NULL)
+    {
+        if ((ret = p_patch->p_src->next(p_patch->p_src_ctx, &p)) <= 0)
+        {
+            p_patch->error = (ret < 0);
+            return FALSE;
+        }
+    }
+    else
+    {
+        if (p_patch->pos >= p_patch->rec_size)
+            return FALSE;
+
+        /* Records were checked when the image was loaded */
+        p = p_patch->p_rec + p_patch->pos;
+    }
+
+    p_rec->type = p[0];
+    p_rec->p_pkt = p + 1;
+    if (p[0] == FW_PATCH_REC_CMD)
+    {
+        p_rec->opcode = form_word(p[2], p[1]);
+        p_rec->len = FW_PATCH_CMD_PREAMBLE_SIZE + p[3];
+    }
+    else
+    {
+        p_rec->opcode = p[1];
+        p_rec->len = FW_PATCH_EVT_PREAMBLE_SIZE + p[2];
+    }
+    p_rec->index = p_patch->index++;
+
+    p_patch->pos += 1 + p_rec->len;
+
+    return TRUE;
+}
+
+/*******************************************************************************
+**
+** Function        fw_patch_expect_compile
+**
+** Description     Compile the event record p_rec for fw_patch_expect_match
+**
+** Returns         None
+**
+*******************************************************************************/
+void fw_patch_expect_compile(const fw_patch_rec_t *p_rec,
+                             fw_patch_expect_t *p_exp)
+{
+    p_exp->len = p_rec->len;
+    p_exp->cmp_len = (p_rec->len < FW_PATCH_EXPECT_LEN) ?
+        p_rec->len : FW_PATCH_EXPECT_LEN;
+    memcpy(p_exp->evt, p_rec->p_pkt, p_exp->cmp_len);
+
+    if (p_rec->opcode == FW_PATCH_EVT_CMD_CMPL)
+        p_exp->skip = FW_PATCH_EVT_CMD_CMPL_NUM_PKTS;
+    else if (p_rec->opcode == FW_PATCH_EVT_CMD_STAT)
+        p_exp->skip = FW_PATCH_EVT_CMD_STAT_NUM_PKTS;
+    else
+        p_exp->skip = 0;
+
+    if (p_exp->skip >= p_exp->cmp_len)
+        p_exp->skip = 0;
+}
+
+/*******************************************************************************
+**
+** Function        fw_patch_expect_match
+**
+** Description     Compare the event p_evt (event code first) of len bytes
+**                 with the expected one
+**
+** Returns         FW_PATCH_EXPECT_MATCH, or the offset of the first byte
+**                 that differs (len for a length mismatch)
+**
+*******************************************************************************/
+int fw_patch_expect_match(const fw_patch_expect_t *p_exp,
+                          const uint8_t *p_evt, uint16_t len)
+{
+    uint8_t start = 0;
+    uint8_t end = (p_exp->skip != 0) ? p_exp->skip : p_exp->cmp_len;
+    int i;
+
+    /* Compared in at most two runs, around the skipped byte */
+    while (start < p_exp->cmp_len)
+    {
+        if ((end > len) ||
+            (memcmp(p_exp->evt + start, p_evt + start, end - start) != 0))
+        {
+            for (i = start; (i < end) && (i < len); i++)
+            {
+                if (p_exp->evt[i] != p_evt[i])
+                    return i;
+            }
+            return len;
+        }
+
+        start = end + 1;
+        end = p_exp->cmp_len;
+    }
+
+    if (len != p_exp->len)
+        return (len < p_exp->len) ? len : p_exp->len;
+
+    return FW_PATCH_EXPECT_MATCH;
+}
+
+/*******************************************************************************
+**
+** Function        fw_patch_rewind
+**
+** Description     Restart reading the patch image from its first record,
+**                 for images held in memory
+**
+** Returns         None
+**
+*******************************************************************************/
+void fw_patch_rewind(fw_patch_t *p_patch)
+{
+    p_patch->pos = 0;
+    p_patch->index = 0;
+}
+
+/*******************************************************************************
+**
+** Function        fw_patch_save
+**
+** Description     Write the patch image to p_path as a binary patch file,
+**                 compressed if flags has FW_PATCH_FLAG_DEFLATE
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+int fw_patch_save(const fw_patch_t *p_patch, const char *p_path,
+                  uint8_t flags)
+{
+    return fw_patch_save_ext(p_patch, p_path, flags, NULL, 0);
+}
+
+/*******************************************************************************
+**
+** Function        fw_patch_save_ext
+**
+** Description     fw_patch_save with ext_len bytes of p_ext appended to the
+**                 header, hdr_len covering them. The file is synced before
+**                 it is closed.
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+int fw_patch_save_ext(const fw_patch_t *p_patch, const char *p_path,
+                      uint8_t flags, const void *p_ext, uint16_t ext_len)
+{
+    fw_patch_hdr_t hdr;
+    const uint8_t *p_data = p_patch->p_rec;
+    uLongf data_len = p_patch->rec_size;
+    uint8_t *p_zip = NULL;
+    FILE *fp;
+    int ret = 0;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, FW_PATCH_MAGIC, FW_PATCH_MAGIC_LEN);
+    hdr.version = FW_PATCH_FORMAT_VERSION;
+    hdr.hdr_len = sizeof(fw_patch_hdr_t) + ext_len;
+    memcpy(hdr.key, p_patch->key, FW_PATCH_KEY_LEN);
+    hdr.rec_count = p_patch->rec_count;
+    hdr.cmd_count = p_patch->cmd_count;
+    hdr.rec_offset = hdr.hdr_len;
+    hdr.rec_size = p_patch->rec_size;
+    hdr.rec_crc = fw_patch_crc32(0, p_patch->p_rec, p_patch->rec_size);
+    hdr.flags = flags & FW_PATCH_FLAG_DEFLATE;
+
+    if (flags & FW_PATCH_FLAG_DEFLATE)
+    {
+        data_len = compressBound(p_patch->rec_size);
+        if (((p_zip = (uint8_t *) malloc(data_len)) == NULL) ||
+            (compress2(p_zip, &data_len, p_patch->p_rec, p_patch->rec_size,
+                       Z_BEST_COMPRESSION) != Z_OK))
+        {
+            ALOGE("Can not compress the patch");
+            free(p_zip);
+            return -1;
+        }
+        p_data = p_zip;
+    }
+
+    if ((fp = fopen(p_path, "wb")) == NULL)
+    {
+        ALOGE("Can not create %s: %s", p_path, strerror(errno));
+        free(p_zip);
+        return -1;
+    }
+
+    if ((fwrite(&hdr, sizeof(hdr), 1, fp) != 1) ||
+        ((ext_len > 0) && (fwrite(p_ext, ext_len, 1, fp) != 1)) ||
+        (fwrite(p_data, 1, data_len, fp) != data_len) ||
+        (fflush(fp) != 0) || (fsync(fileno(fp)) != 0))
+    {
+        ALOGE("Can not write %s: %s", p_path, strerror(errno));
+        ret = -1;
+    }
+
+    if (fclose(fp) != 0)
+        ret = -1;
+
+    free(p_zip);
+
+    return ret;
+}
+
+/*******************************************************************************
+**
+** Function        fw_patch_close
+**
+** Description     Release the patch image
+**
+** Returns         None
+**
+*******************************************************************************/
+void fw_patch_close(fw_patch_t *p_patch)
+{
+    if (p_patch->p_src != NULL)
+        p_patch->p_src->close(p_patch->p_src_ctx);
+
+    if (p_patch->p_map != NULL)
+        munmap(p_patch->p_map, p_patch->map_len);
+
+    if (p_patch->p_alloc != NULL)
+        free(p_patch->p_alloc);
+
+    memset(p_patch, 0, sizeof(fw_patch_t));
+}
@@ -0,0 +1,279 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      fw_preload.c
+ *
+ *  Description:   Contains the background preload of the firmware patches
+ *
+ *                 The worker owns the image table until it is joined; the
+ *                 table is only touched by the caller of fw_preload_take and
+ *                 fw_preload_cleanup afterwards.
+ *
+ ******************************************************************************/
+
+#define LOG_TAG "bt_fw_preload"
+
+#include <utils/Log.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "fw_index.h"
+#include "fw_patch.h"
+#include "fw_preload.h"
+#include "fw_stream.h"
+#include "vnd_trace.h"
+
+/******************************************************************************
+**  Constants & Macros
+******************************************************************************/
+
+#ifndef FALSE
+#define FALSE  0
+#endif
+
+#ifndef TRUE
+#define TRUE   (!FALSE)
+#endif
+
+/* Preload state */
+enum {
+    FW_PRELOAD_IDLE,
+    FW_PRELOAD_RUNNING,                 /* worker not joined yet */
+    FW_PRELOAD_DONE
+};
+
+/******************************************************************************
+**  Local type definitions
+******************************************************************************/
+
+typedef struct
+{
+    uint8_t     key[FW_PATCH_KEY_LEN];  /* from the file name */
+    char        path[PATH_MAX];
+    fw_patch_t  patch;
+    uint8_t     loaded;
+} fw_preload_img_t;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_t   thread;
+    uint8_t     state;
+    char        dirs[PATH_MAX];
+    uint8_t     count;
+    fw_preload_img_t img[FW_PRELOAD_MAX];
+} fw_preload_cb_t;
+
+/******************************************************************************
+**  Static variables
+******************************************************************************/
+
+static fw_preload_cb_t fw_preload_cb = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .state = FW_PRELOAD_IDLE
+};
+
+/******************************************************************************
+**  Static functions
+******************************************************************************/
+
+/*******************************************************************************
+**
+** Function        fw_preload_thread
+**
+** Description     Worker, looks the patches up in the index and loads them
+**
+** Returns         None
+**
+*******************************************************************************/
+static void *fw_preload_thread(void *p_arg)
+{
+    fw_index_entry_t entries[FW_PRELOAD_MAX];
+    struct timespec t0, t1;
+    fw_preload_img_t *p_img;
+    uint8_t i, loaded = 0;
+    int count;
+
+    (void) p_arg;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    count = fw_index_list(fw_preload_cb.dirs, entries, FW_PRELOAD_MAX);
+
+    for (i = 0; (int) i < count; i++)
+    {
+        p_img = &fw_preload_cb.img[i];
+
+        memcpy(p_img->key, entries[i].key, FW_PATCH_KEY_LEN);
+        snprintf(p_img->path, sizeof(p_img->path), "%s", entries[i].path);
+        fw_preload_cb.count++;
+
+        /* Loaded whole: a stream would park a worker per image */
+        if (fw_stream_load(p_img->path, p_img->key, &p_img->patch) == 0)
+        {
+            p_img->loaded = TRUE;
+            loaded++;
+        }
+        else
+        {
+            fw_patch_close(&p_img->patch);
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    VND_TRACE(TRC_HW_PRELOAD, loaded, fw_preload_cb.count,
+        (t1.tv_sec - t0.tv_sec) * 1000000 + (t1.tv_nsec - t0.tv_nsec) / 1000);
+
+    return NULL;
+}
+
+/*******************************************************************************
+**
+** Function        fw_preload_release
+**
+** Description     Join the worker and close the images. Called with the
+**                 lock held.
+**
+** Returns         None
+**
+*******************************************************************************/
+static void fw_preload_release(void)
+{
+    uint8_t i;
+
+    if (fw_preload_cb.state == FW_PRELOAD_RUNNING)
+        pthread_join(fw_preload_cb.thread, NULL);
+
+    for (i = 0; i < fw_preload_cb.count; i++)
+        fw_patch_close(&fw_preload_cb.img[i].patch);
+
+    memset(fw_preload_cb.img, 0, sizeof(fw_preload_cb.img));
+    fw_preload_cb.count = 0;
+    fw_preload_cb.state = FW_PRELOAD_IDLE;
+}
+
+/*****************************************************************************
+**   PATCH PRELOAD FUNCTIONS
+*****************************************************************************/
+
+/*******************************************************************************
+**
+** Function        fw_preload_start
+**
+** Description     Start loading the patches of p_dirs on a worker thread,
+**                 unless images are already loaded or being loaded
+**
+** Returns         None
+**
+*******************************************************************************/
+void fw_preload_start(const char *p_dirs)
+{
+    pthread_mutex_lock(&fw_preload_cb.lock);
+
+    /* The directory may have changed with the conf file */
+    if ((fw_preload_cb.state != FW_PRELOAD_IDLE) &&
+        (strcmp(fw_preload_cb.dirs, p_dirs) != 0))
+        fw_preload_release();
+
+    if (fw_preload_cb.state == FW_PRELOAD_IDLE)
+    {
+        snprintf(fw_preload_cb.dirs, sizeof(fw_preload_cb.dirs), "%s", p_dirs);
+
+        if (pthread_create(&fw_preload_cb.thread, NULL, fw_preload_thread,
+                           NULL) == 0)
+            fw_preload_cb.state = FW_PRELOAD_RUNNING;
+        else
+            ALOGW("Patch preload not started");
+    }
+
+    pthread_mutex_unlock(&fw_preload_cb.lock);
+}
+
+/*******************************************************************************
+**
+** Function        fw_preload_take
+**
+** Description     Wait for the worker and hand over the image of the given
+**                 version key to p_patch. The other images are released.
+**
+** Returns         FW_PRELOAD_FOUND, or FW_PRELOAD_UNAVAILABLE if the key
+**                 was not preloaded
+**
+*******************************************************************************/
+int fw_preload_take(const uint8_t *p_key, fw_patch_t *p_patch)
+{
+    int ret = FW_PRELOAD_UNAVAILABLE;
+    fw_preload_img_t *p_img;
+    uint8_t i;
+
+    pthread_mutex_lock(&fw_preload_cb.lock);
+
+    if (fw_preload_cb.state == FW_PRELOAD_RUNNING)
+    {
+        pthread_join(fw_preload_cb.thread, NULL);
+        fw_preload_cb.state = FW_PRELOAD_DONE;
+    }
+
+    /* A key not among the images may still have a patch: the index may
+     * hold more than FW_PRELOAD_MAX keys, or the image may not have loaded.
+     * The lookup decides. */
+    if (fw_preload_cb.state == FW_PRELOAD_DONE)
+    {
+        for (i = 0; i < fw_preload_cb.count; i++)
+        {
+            p_img = &fw_preload_cb.img[i];
+
+            if ((memcmp(p_img->key, p_key, FW_PATCH_KEY_LEN) != 0) ||
+                (p_img->loaded == FALSE))
+                continue;
+
+            ALOGI("Preloaded patchfile: %s", p_img->path);
+            memcpy(p_patch, &p_img->patch, sizeof(fw_patch_t));
+            memset(&p_img->patch, 0, sizeof(fw_patch_t));
+            ret = FW_PRELOAD_FOUND;
+            break;
+        }
+    }
+
+    fw_preload_release();
+
+    pthread_mutex_unlock(&fw_preload_cb.lock);
+
+    return ret;
+}
+
+/*******************************************************************************
+**
+** Function        fw_preload_cleanup
+**
+** Description     Stop the worker and release the images
+**
+** Returns         None
+**
+*******************************************************************************/
+void fw_preload_cleanup(void)
+{
+    pthread_mutex_lock(&fw_preload_cb.lock);
+    fw_preload_release();
+    pthread_mutex_unlock(&fw_preload_cb.lock);
+}
@@ -0,0 +1,473 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      fw_repack.c
+ *
+ *  Description:   Contains the MEMWRITE repacking pass of the patch images
+ *
+ *                 A MEMWRITE is held until the next command shows the
+ *                 events the patch expects for it. Answered by a successful
+ *                 Command Complete alone, its data joins the run of
+ *                 contiguous data, which goes out in commands of chunk bytes
+ *                 as soon as it holds one. Anything else ends the run.
+ *
+ *                 This file is also built into the host patch compiler, it
+ *                 must not depend on the Bluetooth stack headers.
+ *
+ ******************************************************************************/
+
+#define LOG_TAG "bt_fw_repack"
+
+#include <utils/Log.h>
+#include <sys/mman.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fw_patch.h"
+#include "fw_repack.h"
+
+/******************************************************************************
+**  Constants & Macros
+******************************************************************************/
+
+/* State of the held MEMWRITE */
+enum {
+    FW_REPACK_CAND_NONE = 0,
+    FW_REPACK_CAND_HELD,                    /* no event seen yet */
+    FW_REPACK_CAND_DONE                     /* its Command Complete seen */
+};
+
+#define FW_REPACK_LE32(p) ((uint32_t) (p)[0] | ((uint32_t) (p)[1] << 8) | \
+                           ((uint32_t) (p)[2] << 16) | ((uint32_t) (p)[3] << 24))
+
+/******************************************************************************
+**  Local type definitions
+******************************************************************************/
+
+/* Output of fw_repack_image */
+typedef struct
+{
+    uint8_t     *p_buf;
+    uint32_t    len;
+    uint32_t    size;
+} fw_repack_out_t;
+
+/******************************************************************************
+**  Static functions
+******************************************************************************/
+
+/*******************************************************************************
+**
+** Function        fw_repack_emit
+**
+** Description     Hand one record to the emit callback
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+static int fw_repack_emit(fw_repack_t *p_rp, const uint8_t *p_rec, size_t len)
+{
+    if (p_rec[0] == FW_PATCH_REC_CMD)
+        p_rp->cmds_out++;
+    p_rp->recs_out++;
+
+    return p_rp->p_emit(p_rp->p_ctx, p_rec, len);
+}
+
+/*******************************************************************************
+**
+** Function        fw_repack_emit_evt
+**
+** Description     Emit a MEMWRITE Command Complete kept as FW_REPACK_EVT_LEN
+**                 bytes
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+static int fw_repack_emit_evt(fw_repack_t *p_rp, const uint8_t *p_evt)
+{
+    uint8_t rec[1 + FW_REPACK_EVT_LEN];
+
+    rec[0] = FW_PATCH_REC_EVT;
+    memcpy(rec + 1, p_evt, FW_REPACK_EVT_LEN);
+
+    return fw_repack_emit(p_rp, rec, sizeof(rec));
+}
+
+/*******************************************************************************
+**
+** Function        fw_repack_emit_run
+**
+** Description     Emit the first len bytes of the run as one MEMWRITE
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+static int fw_repack_emit_run(fw_repack_t *p_rp, uint16_t len)
+{
+    uint8_t rec[FW_PATCH_REC_MAX];
+    uint8_t *p = rec;
+    int ret;
+
+    *p++ = FW_PATCH_REC_CMD;
+    *p++ = (uint8_t) FW_REPACK_MEMWRITE;
+    *p++ = (uint8_t) (FW_REPACK_MEMWRITE >> 8);
+    *p++ = FW_REPACK_MEMWRITE_HDR_SIZE + len;
+    *p++ = (uint8_t) p_rp->run_addr;
+    *p++ = (uint8_t) (p_rp->run_addr >> 8);
+    *p++ = (uint8_t) (p_rp->run_addr >> 16);
+    *p++ = (uint8_t) (p_rp->run_addr >> 24);
+    *p++ = p_rp->run_mode;
+    *p++ = (uint8_t) len;
+    memcpy(p, p_rp->run, len);
+
+    if ((ret = fw_repack_emit(p_rp, rec, (p - rec) + len)) != 0)
+        return ret;
+    if ((ret = fw_repack_emit_evt(p_rp, p_rp->run_evt)) != 0)
+        return ret;
+
+    p_rp->run_addr += len;
+    p_rp->run_len -= len;
+    memmove(p_rp->run, p_rp->run + len, p_rp->run_len);
+
+    return 0;
+}
+
+/*******************************************************************************
+**
+** Function        fw_repack_end_run
+**
+** Description     Emit what is left of the run
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+static int fw_repack_end_run(fw_repack_t *p_rp)
+{
+    if (p_rp->run_len == 0)
+        return 0;
+
+    return fw_repack_emit_run(p_rp, p_rp->run_len);
+}
+
+/*******************************************************************************
+**
+** Function        fw_repack_resolve
+**
+** Description     The events of the held MEMWRITE are all known: merge it
+**                 into the run, or emit it as it is
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+static int fw_repack_resolve(fw_repack_t *p_rp)
+{
+    const uint8_t *p_param = p_rp->cand + 1 + FW_PATCH_CMD_PREAMBLE_SIZE;
+    uint32_t addr = FW_REPACK_LE32(p_param);
+    uint8_t len = p_param[5];
+    int ret;
+
+    if (p_rp->cand_state == FW_REPACK_CAND_NONE)
+        return 0;
+
+    if (p_rp->cand_state == FW_REPACK_CAND_HELD)
+    {
+        /* No event to expect, keep it as the patch has it */
+        p_rp->cand_state = FW_REPACK_CAND_NONE;
+        if ((ret = fw_repack_end_run(p_rp)) != 0)
+            return ret;
+        return fw_repack_emit(p_rp, p_rp->cand, 1 +
+            FW_PATCH_CMD_PREAMBLE_SIZE + p_rp->cand[3]);
+    }
+
+    p_rp->cand_state = FW_REPACK_CAND_NONE;
+
+    if ((p_rp->run_len > 0) &&
+        ((addr != p_rp->run_addr + p_rp->run_len) ||
+         (p_param[4] != p_rp->run_mode)))
+    {
+        if ((ret = fw_repack_end_run(p_rp)) != 0)
+            return ret;
+    }
+
+    if (p_rp->run_len == 0)
+    {
+        p_rp->run_addr = addr;
+        p_rp->run_mode = p_param[4];
+        memcpy(p_rp->run_evt, p_rp->cand_evt, FW_REPACK_EVT_LEN);
+    }
+
+    memcpy(p_rp->run + p_rp->run_len, p_param + FW_REPACK_MEMWRITE_HDR_SIZE,
+           len);
+    p_rp->run_len += len;
+
+    while (p_rp->run_len >= p_rp->chunk)
+    {
+        if ((ret = fw_repack_emit_run(p_rp, p_rp->chunk)) != 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+/*******************************************************************************
+**
+** Function        fw_repack_is_cmpl
+**
+** Description     Check whether the event record p_rec is the successful
+**                 Command Complete of a MEMWRITE
+**
+** Returns         TRUE/FALSE
+**
+*******************************************************************************/
+static int fw_repack_is_cmpl(const uint8_t *p_rec)
+{
+    const uint8_t *p_evt = p_rec + 1;
+
+    return ((p_evt[0] == FW_PATCH_EVT_CMD_CMPL) &&
+            (p_evt[1] == FW_REPACK_EVT_LEN - FW_PATCH_EVT_PREAMBLE_SIZE) &&
+            (p_evt[3] == (uint8_t) FW_REPACK_MEMWRITE) &&
+            (p_evt[4] == (uint8_t) (FW_REPACK_MEMWRITE >> 8)) &&
+            (p_evt[5] == 0));
+}
+
+/*******************************************************************************
+**
+** Function        fw_repack_out
+**
+** Description     Emit callback of fw_repack_image, appends to the new image
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+static int fw_repack_out(void *p_ctx, const uint8_t *p_rec, size_t len)
+{
+    fw_repack_out_t *p_out = (fw_repack_out_t *) p_ctx;
+    uint8_t *p_buf;
+
+    if (p_out->len + len > p_out->size)
+    {
+        p_buf = (uint8_t *) realloc(p_out->p_buf, 2 * p_out->size + len);
+        if (p_buf == NULL)
+            return -1;
+        p_out->p_buf = p_buf;
+        p_out->size = 2 * p_out->size + len;
+    }
+
+    memcpy(p_out->p_buf + p_out->len, p_rec, len);
+    p_out->len += len;
+
+    return 0;
+}
+
+/*****************************************************************************
+**   PATCH REPACKING FUNCTIONS
+*****************************************************************************/
+
+/*******************************************************************************
+**
+** Function        fw_repack_init
+**
+** Description     Start a pass emitting MEMWRITE commands of at most chunk
+**                 data bytes (FW_REPACK_DATA_MAX at most). A chunk of 0
+**                 passes the records through unchanged.
+**
+** Returns         None
+**
+*******************************************************************************/
+void fw_repack_init(fw_repack_t *p_rp, uint8_t chunk, fw_repack_emit_t p_emit,
+                    void *p_ctx)
+{
+    memset(p_rp, 0, sizeof(fw_repack_t));
+
+    p_rp->chunk = (chunk > FW_REPACK_DATA_MAX) ? FW_REPACK_DATA_MAX : chunk;
+    p_rp->p_emit = p_emit;
+    p_rp->p_ctx = p_ctx;
+}
+
+/*******************************************************************************
+**
+** Function        fw_repack_push
+**
+** Description     Feed the next record of the patch, type byte first
+**
+** Returns         0 : Success
+**                 Otherwise : the emit callback failed
+**
+*******************************************************************************/
+int fw_repack_push(fw_repack_t *p_rp, const uint8_t *p_rec)
+{
+    uint16_t len;
+    int ret;
+
+    if (p_rec[0] == FW_PATCH_REC_CMD)
+    {
+        len = 1 + FW_PATCH_CMD_PREAMBLE_SIZE + p_rec[3];
+        p_rp->cmds_in++;
+    }
+    else
+    {
+        len = 1 + FW_PATCH_EVT_PREAMBLE_SIZE + p_rec[2];
+    }
+
+    if (p_rp->chunk == 0)
+        return fw_repack_emit(p_rp, p_rec, len);
+
+    if (p_rec[0] == FW_PATCH_REC_EVT)
+    {
+        if ((p_rp->cand_state == FW_REPACK_CAND_HELD) &&
+            (len == 1 + FW_REPACK_EVT_LEN) && fw_repack_is_cmpl(p_rec))
+        {
+            memcpy(p_rp->cand_evt, p_rec + 1, FW_REPACK_EVT_LEN);
+            p_rp->cand_state = FW_REPACK_CAND_DONE;
+            return 0;
+        }
+
+        /* The held MEMWRITE is answered by more than its completion */
+        if (p_rp->cand_state != FW_REPACK_CAND_NONE)
+        {
+            if ((ret = fw_repack_end_run(p_rp)) != 0)
+                return ret;
+            if ((ret = fw_repack_emit(p_rp, p_rp->cand, 1 +
+                    FW_PATCH_CMD_PREAMBLE_SIZE + p_rp->cand[3])) != 0)
+                return ret;
+            if ((p_rp->cand_state == FW_REPACK_CAND_DONE) &&
+                ((ret = fw_repack_emit_evt(p_rp, p_rp->cand_evt)) != 0))
+                return ret;
+            p_rp->cand_state = FW_REPACK_CAND_NONE;
+        }
+
+        return fw_repack_emit(p_rp, p_rec, len);
+    }
+
+    if ((ret = fw_repack_resolve(p_rp)) != 0)
+        return ret;
+
+    if ((p_rec[1] == (uint8_t) FW_REPACK_MEMWRITE) &&
+        (p_rec[2] == (uint8_t) (FW_REPACK_MEMWRITE >> 8)) &&
+        (p_rec[3] >= FW_REPACK_MEMWRITE_HDR_SIZE) &&
+        (p_rec[3] == FW_REPACK_MEMWRITE_HDR_SIZE + p_rec[4 + 5]))
+    {
+        memcpy(p_rp->cand, p_rec, len);
+        p_rp->cand_state = FW_REPACK_CAND_HELD;
+        return 0;
+    }
+
+    /* Any other command is a barrier */
+    if ((ret = fw_repack_end_run(p_rp)) != 0)
+        return ret;
+
+    return fw_repack_emit(p_rp, p_rec, len);
+}
+
+/*******************************************************************************
+**
+** Function        fw_repack_flush
+**
+** Description     End of patch, emit what is still held
+**
+** Returns         0 : Success
+**                 Otherwise : the emit callback failed
+**
+*******************************************************************************/
+int fw_repack_flush(fw_repack_t *p_rp)
+{
+    int ret;
+
+    if ((ret = fw_repack_resolve(p_rp)) != 0)
+        return ret;
+
+    return fw_repack_end_run(p_rp);
+}
+
+/*******************************************************************************
+**
+** Function        fw_repack_image
+**
+** Description     Repack a patch image held in memory in place; a mapped
+**                 image is replaced by an allocated copy
+**
+** Returns         0 : Success
+**                 Otherwise : Fail, the image is unchanged
+**
+*******************************************************************************/
+int fw_repack_image(fw_patch_t *p_patch, uint8_t chunk)
+{
+    fw_repack_out_t out;
+    fw_repack_t *p_rp;
+    fw_patch_rec_t rec;
+    int ret = 0;
+
+    if ((p_patch->p_src != NULL) || (chunk == 0))
+        return -1;
+
+    if ((p_rp = (fw_repack_t *) malloc(sizeof(fw_repack_t))) == NULL)
+        return -1;
+
+    out.len = 0;
+    out.size = p_patch->rec_size;
+    if ((out.p_buf = (uint8_t *) malloc(out.size)) == NULL)
+    {
+        free(p_rp);
+        return -1;
+    }
+
+    fw_repack_init(p_rp, chunk, fw_repack_out, &out);
+
+    fw_patch_rewind(p_patch);
+    while ((ret == 0) && fw_patch_next(p_patch, &rec))
+        ret = fw_repack_push(p_rp, rec.p_pkt - 1);
+    if (ret == 0)
+        ret = fw_repack_flush(p_rp);
+    fw_patch_rewind(p_patch);
+
+    if (ret != 0)
+    {
+        ALOGE("Can not repack the patch");
+        free(out.p_buf);
+        free(p_rp);
+        return -1;
+    }
+
+    ALOGI("Repacked patch: %u commands, was %u", p_rp->cmds_out,
+        p_rp->cmds_in);
+
+    if (p_patch->p_map != NULL)
+        munmap(p_patch->p_map, p_patch->map_len);
+    if (p_patch->p_alloc != NULL)
+        free(p_patch->p_alloc);
+
+    p_patch->p_map = NULL;
+    p_patch->map_len = 0;
+    p_patch->p_alloc = out.p_buf;
+    p_patch->p_rec = out.p_buf;
+    p_patch->rec_size = out.len;
+    p_patch->rec_count = p_rp->recs_out;
+    p_patch->cmd_count = p_rp->cmds_out;
+
+    free(p_rp);
+
+    return 0;
+}
@@ -0,0 +1,338 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      fw_stats.c
+ *
+ *  Description:   Contains the timing of the firmware configuration
+ *
+ *                 The samples are taken on the HCI thread; the summary is
+ *                 read by the stack through the vendor op, hence the lock.
+ *
+ ******************************************************************************/
+
+#define LOG_TAG "bt_fw_stats"
+
+#include <utils/Log.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "fw_stats.h"
+
+/******************************************************************************
+**  Constants & Macros
+******************************************************************************/
+
+/* Commands of a stage kept in flight at most, the stack's command queue */
+#define FW_STATS_INFLIGHT_MAX       8
+
+/* Round trips kept for the percentiles, the first ones win beyond that */
+#define FW_STATS_SAMPLES_MAX        1024
+
+/******************************************************************************
+**  Local type definitions
+******************************************************************************/
+
+typedef struct
+{
+    struct timespec t0;                             /* FW_CFG */
+
+    uint8_t     fifo_stage[FW_STATS_INFLIGHT_MAX];  /* commands in flight */
+    uint32_t    fifo_sent[FW_STATS_INFLIGHT_MAX];
+    uint8_t     fifo_head;
+    uint8_t     fifo_count;
+
+    uint32_t    sum[FW_STAT_STAGE_MAX];
+    uint16_t    n_samples;
+    uint8_t     sample_stage[FW_STATS_SAMPLES_MAX];
+    uint32_t    sample[FW_STATS_SAMPLES_MAX];
+
+    fw_stats_t  run;                                /* being collected */
+} fw_stats_cb_t;
+
+/******************************************************************************
+**  Static variables
+******************************************************************************/
+
+static fw_stats_cb_t fw_stats_cb;
+
+static pthread_mutex_t fw_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static fw_stats_t fw_stats_last;                    /* last finished run */
+static int fw_stats_valid = 0;
+
+static const char *fw_stats_stage_name[FW_STAT_STAGE_MAX] = {
+    "HCI_RESET",
+    "RDSW_VERSION",
+    "OPEN_PATCHFILE",
+    "SET_UART_BAUD",
+    "MANUFACTURE_ON",
+    "MEMWRITE",
+    "MANUFACTURE_OFF",
+    "RDSW_VERSION_RECHECK"
+};
+
+/******************************************************************************
+**  Static functions
+******************************************************************************/
+
+static int fw_stats_cmp(const void *p_a, const void *p_b)
+{
+    uint32_t a = *(const uint32_t *) p_a;
+    uint32_t b = *(const uint32_t *) p_b;
+
+    return (a > b) - (a < b);
+}
+
+/*******************************************************************************
+**
+** Function        fw_stats_p99
+**
+** Description     99th percentile (nearest rank) of the kept samples of a
+**                 stage
+**
+** Returns         Round trip in microseconds
+**
+*******************************************************************************/
+static uint32_t fw_stats_p99(uint8_t stage)
+{
+    static uint32_t sorted[FW_STATS_SAMPLES_MAX];
+    uint16_t i, n = 0;
+
+    for (i = 0; i < fw_stats_cb.n_samples; i++)
+    {
+        if (fw_stats_cb.sample_stage[i] == stage)
+            sorted[n++] = fw_stats_cb.sample[i];
+    }
+
+    if (n == 0)
+        return 0;
+
+    qsort(sorted, n, sizeof(sorted[0]), fw_stats_cmp);
+
+    return sorted[(n * 99 + 99) / 100 - 1];
+}
+
+/*****************************************************************************
+**   FIRMWARE CONFIGURATION TIMING FUNCTIONS
+*****************************************************************************/
+
+/*******************************************************************************
+**
+** Function        fw_stats_start
+**
+** Description     Drop the previous run and take the FW_CFG timestamp
+**
+** Returns         None
+**
+*******************************************************************************/
+void fw_stats_start(void)
+{
+    uint8_t i;
+
+    memset(&fw_stats_cb, 0, sizeof(fw_stats_cb));
+    clock_gettime(CLOCK_MONOTONIC, &fw_stats_cb.t0);
+
+    fw_stats_cb.run.result = FW_STATS_RESULT_NONE;
+    for (i = 0; i < FW_STAT_STAGE_MAX; i++)
+        fw_stats_cb.run.stage[i].min_us = UINT32_MAX;
+}
+
+/*******************************************************************************
+**
+** Function        fw_stats_now
+**
+** Description     Microseconds since fw_stats_start
+**
+** Returns         Timestamp
+**
+*******************************************************************************/
+uint32_t fw_stats_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint32_t) ((ts.tv_sec - fw_stats_cb.t0.tv_sec) * 1000000 +
+                       (ts.tv_nsec - fw_stats_cb.t0.tv_nsec) / 1000);
+}
+
+/*******************************************************************************
+**
+** Function        fw_stats_cmd_sent
+**
+** Description     A command of the given stage is handed to xmit_cb
+**
+** Returns         None
+**
+*******************************************************************************/
+void fw_stats_cmd_sent(uint8_t stage)
+{
+    uint8_t slot;
+
+    if ((stage >= FW_STAT_STAGE_MAX) ||
+        (fw_stats_cb.fifo_count == FW_STATS_INFLIGHT_MAX))
+        return;
+
+    slot = (fw_stats_cb.fifo_head + fw_stats_cb.fifo_count) %
+           FW_STATS_INFLIGHT_MAX;
+    fw_stats_cb.fifo_stage[slot] = stage;
+    fw_stats_cb.fifo_sent[slot] = fw_stats_now();
+    fw_stats_cb.fifo_count++;
+}
+
+/*******************************************************************************
+**
+** Function        fw_stats_cmd_done
+**
+** Description     The oldest command in flight completed, take its round trip
+**
+** Returns         None
+**
+*******************************************************************************/
+void fw_stats_cmd_done(void)
+{
+    uint8_t head = fw_stats_cb.fifo_head;
+
+    if (fw_stats_cb.fifo_count == 0)
+        return;
+
+    fw_stats_cb.fifo_head = (head + 1) % FW_STATS_INFLIGHT_MAX;
+    fw_stats_cb.fifo_count--;
+
+    fw_stats_add(fw_stats_cb.fifo_stage[head], fw_stats_cb.fifo_sent[head]);
+}
+
+/*******************************************************************************
+**
+** Function        fw_stats_add
+**
+** Description     Take a sample of the given stage that started at start_us
+**                 (from fw_stats_now) and ends now
+**
+** Returns         None
+**
+*******************************************************************************/
+void fw_stats_add(uint8_t stage, uint32_t start_us)
+{
+    fw_stats_stage_t *p_stage;
+    uint32_t now, rtt;
+
+    if (stage >= FW_STAT_STAGE_MAX)
+        return;
+
+    now = fw_stats_now();
+    rtt = now - start_us;
+    p_stage = &fw_stats_cb.run.stage[stage];
+
+    if (p_stage->count == 0)
+        p_stage->start_us = start_us;
+    p_stage->count++;
+    p_stage->end_us = now;
+    if (rtt < p_stage->min_us)
+        p_stage->min_us = rtt;
+    if (rtt > p_stage->max_us)
+        p_stage->max_us = rtt;
+    fw_stats_cb.sum[stage] += rtt;
+
+    if (fw_stats_cb.n_samples < FW_STATS_SAMPLES_MAX)
+    {
+        fw_stats_cb.sample_stage[fw_stats_cb.n_samples] = stage;
+        fw_stats_cb.sample[fw_stats_cb.n_samples] = rtt;
+        fw_stats_cb.n_samples++;
+    }
+}
+
+/*******************************************************************************
+**
+** Function        fw_stats_finish
+**
+** Description     FW_CFG reported result, build and log the summary
+**
+** Returns         None
+**
+*******************************************************************************/
+void fw_stats_finish(int result)
+{
+    fw_stats_t *p_run = &fw_stats_cb.run;
+    fw_stats_stage_t *p_stage;
+    uint8_t i;
+
+    /* Already reported, or never started */
+    if (p_run->result != FW_STATS_RESULT_NONE)
+        return;
+
+    p_run->result = result;
+    p_run->total_us = fw_stats_now();
+
+    ALOGI("FW_CFG %s in %u.%03u ms", (result == 0) ? "done" : "failed",
+        p_run->total_us / 1000, p_run->total_us % 1000);
+
+    for (i = 0; i < FW_STAT_STAGE_MAX; i++)
+    {
+        p_stage = &p_run->stage[i];
+
+        if (p_stage->count == 0)
+        {
+            p_stage->min_us = 0;
+            continue;
+        }
+
+        p_stage->avg_us = fw_stats_cb.sum[i] / p_stage->count;
+        p_stage->p99_us = fw_stats_p99(i);
+
+        ALOGI("  %-20s +%6u.%03u ms %4u x min/avg/max/p99 %u/%u/%u/%u us",
+            fw_stats_stage_name[i], p_stage->start_us / 1000,
+            p_stage->start_us % 1000, p_stage->count, p_stage->min_us,
+            p_stage->avg_us, p_stage->max_us, p_stage->p99_us);
+    }
+
+    pthread_mutex_lock(&fw_stats_lock);
+    memcpy(&fw_stats_last, p_run, sizeof(fw_stats_t));
+    fw_stats_valid = 1;
+    pthread_mutex_unlock(&fw_stats_lock);
+}
+
+/*******************************************************************************
+**
+** Function        fw_stats_get
+**
+** Description     Copy the summary of the last finished run
+**
+** Returns         0 : Success
+**                 Otherwise : no run finished yet
+**
+*******************************************************************************/
+int fw_stats_get(fw_stats_t *p_stats)
+{
+    int ret = -1;
+
+    if (p_stats == NULL)
+        return -1;
+
+    pthread_mutex_lock(&fw_stats_lock);
+    if (fw_stats_valid)
+    {
+        memcpy(p_stats, &fw_stats_last, sizeof(fw_stats_t));
+        ret = 0;
+    }
+    pthread_mutex_unlock(&fw_stats_lock);
+
+    return ret;
+}
@@ -0,0 +1,628 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      fw_stream.c
+ *
+ *  Description:   Contains the streaming reader of the textual and compressed
+ *                 patch files
+ *
+ *                 The worker decodes each line and runs it through the
+ *                 repacking pass, which copies the records it emits into
+ *                 the free slot at the head of the ring. The HCI thread
+ *                 reads the slot at the tail and keeps it until its next
+ *                 fw_patch_next call. Only the ring indexes are shared,
+ *                 under the lock.
+ *
+ *                 A .bseqz file is inflated by the worker instead, and its
+ *                 records queued as they come out of the zlib stream; they
+ *                 were repacked when the file was built.
+ *
+ ******************************************************************************/
+
+#define LOG_TAG "bt_fw_stream"
+
+#include <utils/Log.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include "bt_vendor.h"
+#include "fw_bundle.h"
+#include "fw_cache.h"
+#include "fw_patch.h"
+#include "fw_repack.h"
+#include "fw_stream.h"
+#include "vnd_trace.h"
+
+/******************************************************************************
+**  Constants & Macros
+******************************************************************************/
+
+/* Text read at once, also the longest .seq line accepted; same size for
+ * the compressed data read and inflated at once */
+#define FW_STREAM_TEXT_SIZE     4096
+
+#if (FW_PATCH_REPACK == TRUE)
+#define FW_STREAM_REPACK_CHUNK  FW_PATCH_REPACK_CHUNK
+#else
+#define FW_STREAM_REPACK_CHUNK  0
+#endif
+
+/******************************************************************************
+**  Local type definitions
+******************************************************************************/
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t  filled;                 /* a record was queued */
+    pthread_cond_t  freed;                  /* a slot was released */
+    pthread_t   thread;
+    int         fd;
+    uint8_t     stop;                       /* closing, producer must quit */
+    uint8_t     done;                       /* producer finished */
+    uint8_t     error;                      /* producer failed */
+    uint8_t     held;                       /* consumer holds the tail slot */
+    uint16_t    head;                       /* next slot to fill */
+    uint16_t    tail;                       /* next slot to read */
+    uint16_t    count;                      /* queued slots, held included */
+    uint32_t    records;
+    uint32_t    read_waits;                 /* consumer found the ring empty */
+    uint32_t    decode_waits;               /* producer found the ring full */
+    fw_repack_t repack;
+    uint8_t     line[FW_PATCH_REC_MAX];     /* record of the last line */
+    fw_patch_hdr_t hdr;                     /* of a .bseqz file */
+    char        text[FW_STREAM_TEXT_SIZE];  /* .seq text, or zlib stream */
+    uint8_t     raw[FW_STREAM_TEXT_SIZE];   /* inflated records */
+    uint8_t     slot[FW_PATCH_STREAM_DEPTH][FW_PATCH_REC_MAX];
+} fw_stream_t;
+
+/******************************************************************************
+**  Static functions
+******************************************************************************/
+
+static int fw_stream_next(void *p_ctx, const uint8_t **pp_rec);
+static void fw_stream_close(void *p_ctx);
+
+/******************************************************************************
+**  Static variables
+******************************************************************************/
+
+static const fw_patch_src_t fw_stream_src = {
+    fw_stream_next,
+    fw_stream_close
+};
+
+/*******************************************************************************
+**
+** Function        fw_stream_reserve
+**
+** Description     Wait for a free slot at the head of the ring
+**
+** Returns         The slot, NULL if the stream is being closed
+**
+*******************************************************************************/
+static uint8_t *fw_stream_reserve(fw_stream_t *p_st)
+{
+    uint8_t *p_slot = NULL;
+
+    pthread_mutex_lock(&p_st->lock);
+
+    if ((p_st->count == FW_PATCH_STREAM_DEPTH) && !p_st->stop)
+    {
+        p_st->decode_waits++;
+        while ((p_st->count == FW_PATCH_STREAM_DEPTH) && !p_st->stop)
+            pthread_cond_wait(&p_st->freed, &p_st->lock);
+    }
+
+    if (!p_st->stop)
+        p_slot = p_st->slot[p_st->head];
+
+    pthread_mutex_unlock(&p_st->lock);
+
+    return p_slot;
+}
+
+/*******************************************************************************
+**
+** Function        fw_stream_commit
+**
+** Description     Queue the record copied into the reserved slot
+**
+** Returns         None
+**
+*******************************************************************************/
+static void fw_stream_commit(fw_stream_t *p_st)
+{
+    pthread_mutex_lock(&p_st->lock);
+    p_st->head = (p_st->head + 1) % FW_PATCH_STREAM_DEPTH;
+    p_st->count++;
+    p_st->records++;
+    pthread_cond_signal(&p_st->filled);
+    pthread_mutex_unlock(&p_st->lock);
+}
+
+/*******************************************************************************
+**
+** Function        fw_stream_emit
+**
+** Description     Emit callback of the repacking pass, queues the record
+**
+** Returns         0 : Success
+**                 Otherwise : the stream is being closed
+**
+*******************************************************************************/
+static int fw_stream_emit(void *p_ctx, const uint8_t *p_rec, size_t len)
+{
+    fw_stream_t *p_st = (fw_stream_t *) p_ctx;
+    uint8_t *p_slot;
+
+    if ((p_slot = fw_stream_reserve(p_st)) == NULL)
+        return 1;
+
+    memcpy(p_slot, p_rec, len);
+    fw_stream_commit(p_st);
+
+    return 0;
+}
+
+/*******************************************************************************
+**
+** Function        fw_stream_finish
+**
+** Description     End of the producer, ret < 0 if it failed
+**
+** Returns         None
+**
+*******************************************************************************/
+static void fw_stream_finish(fw_stream_t *p_st, int ret)
+{
+    pthread_mutex_lock(&p_st->lock);
+    p_st->done = TRUE;
+    p_st->error = (ret < 0);
+    pthread_cond_signal(&p_st->filled);
+    pthread_mutex_unlock(&p_st->lock);
+}
+
+/*******************************************************************************
+**
+** Function        fw_stream_thread
+**
+** Description     Producer, reads the .seq text and decodes it line by line
+**                 into the ring
+**
+** Returns         None
+**
+*******************************************************************************/
+static void *fw_stream_thread(void *p_arg)
+{
+    fw_stream_t *p_st = (fw_stream_t *) p_arg;
+    char *p_end, *p_line, *p_eol;
+    size_t fill = 0;
+    ssize_t n;
+    int eof = FALSE;
+    int line_no = 0;
+    int ret = 0;
+    int len;
+
+    while ((ret == 0) && !eof)
+    {
+        n = read(p_st->fd, p_st->text + fill, sizeof(p_st->text) - fill);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            ALOGE("Can not read patch file: %s", strerror(errno));
+            ret = -1;
+            break;
+        }
+
+        eof = (n == 0);
+        fill += n;
+        p_end = p_st->text + fill;
+
+        for (p_line = p_st->text; (ret == 0) && (p_line < p_end);
+             p_line = p_eol + 1)
+        {
+            if ((p_eol = memchr(p_line, '\n', p_end - p_line)) == NULL)
+            {
+                /* Partial line, wait for the rest unless the file ended */
+                if (!eof)
+                    break;
+                p_eol = p_end;
+            }
+
+            line_no++;
+
+            len = fw_patch_decode_line(p_line, p_eol - p_line, line_no,
+                                       p_st->line, FW_PATCH_REC_MAX);
+            if (len < 0)
+                ret = -1;
+            else if (len > 0)
+                ret = fw_repack_push(&p_st->repack, p_st->line);
+        }
+
+        if (p_line >= p_end)
+        {
+            fill = 0;
+        }
+        else
+        {
+            fill = p_end - p_line;
+            memmove(p_st->text, p_line, fill);
+
+            if ((fill == sizeof(p_st->text)) && (ret == 0))
+            {
+                ALOGE("Patch line %d: too long", line_no + 1);
+                ret = -1;
+            }
+        }
+    }
+
+    if (ret == 0)
+        ret = fw_repack_flush(&p_st->repack);
+
+    fw_stream_finish(p_st, ret);
+
+    return NULL;
+}
+
+/*******************************************************************************
+**
+** Function        fw_stream_inflate_thread
+**
+** Description     Producer, inflates the records of a .bseqz file into the
+**                 ring as they come out of the zlib stream, and checks them
+**                 against the header at the end
+**
+** Returns         None
+**
+*******************************************************************************/
+static void *fw_stream_inflate_thread(void *p_arg)
+{
+    fw_stream_t *p_st = (fw_stream_t *) p_arg;
+    z_stream zs;
+    uint32_t crc = 0;
+    uint32_t size = 0;
+    uint32_t count = 0;
+    uint32_t fill = 0;
+    uint32_t pos, end, len;
+    ssize_t n;
+    int zret = Z_OK;
+    int ret = 0;
+
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit(&zs) != Z_OK)
+    {
+        fw_stream_finish(p_st, -1);
+        return NULL;
+    }
+
+    while ((ret == 0) && (zret != Z_STREAM_END))
+    {
+        if (zs.avail_in == 0)
+        {
+            n = read(p_st->fd, p_st->text, sizeof(p_st->text));
+            if ((n < 0) && (errno == EINTR))
+                continue;
+            if (n <= 0)
+            {
+                ALOGE("Can not read patch file: %s",
+                    (n < 0) ? strerror(errno) : "truncated");
+                ret = -1;
+                break;
+            }
+            zs.next_in = (Bytef *) p_st->text;
+            zs.avail_in = n;
+        }
+
+        zs.next_out = p_st->raw + fill;
+        zs.avail_out = sizeof(p_st->raw) - fill;
+
+        zret = inflate(&zs, Z_NO_FLUSH);
+        if ((zret != Z_OK) && (zret != Z_STREAM_END) && (zret != Z_BUF_ERROR))
+        {
+            ALOGE("Can not inflate patch file: %s", zs.msg ? zs.msg : "");
+            ret = -1;
+            break;
+        }
+
+        end = sizeof(p_st->raw) - zs.avail_out;
+        crc = fw_patch_crc32(crc, p_st->raw + fill, end - fill);
+        size += end - fill;
+
+        for (pos = 0; (ret == 0) && (pos < end); pos += len)
+        {
+            if ((len = fw_patch_rec_len(p_st->raw + pos, end - pos)) == 0)
+            {
+                /* A partial record waits for more output, unless the
+                 * stream ended or no record can be that long */
+                if ((zret == Z_STREAM_END) || (end - pos >= FW_PATCH_REC_MAX))
+                {
+                    ALOGE("Malformed patch record %u", count);
+                    ret = -1;
+                }
+                break;
+            }
+
+            ret = fw_stream_emit(p_st, p_st->raw + pos, len);
+            count++;
+        }
+
+        fill = end - pos;
+        memmove(p_st->raw, p_st->raw + pos, fill);
+    }
+
+    if ((ret == 0) && ((size != p_st->hdr.rec_size) ||
+        (crc != p_st->hdr.rec_crc) || (count != p_st->hdr.rec_count)))
+    {
+        ALOGE("Corrupted compressed patch");
+        ret = -1;
+    }
+
+    inflateEnd(&zs);
+
+    fw_stream_finish(p_st, ret);
+
+    return NULL;
+}
+
+/*******************************************************************************
+**
+** Function        fw_stream_next
+**
+** Description     Consumer, release the slot handed out last time and wait
+**                 for the next record
+**
+** Returns         1 : *pp_rec set
+**                 0 : end of patch
+**                 -1 : the producer failed
+**
+*******************************************************************************/
+static int fw_stream_next(void *p_ctx, const uint8_t **pp_rec)
+{
+    fw_stream_t *p_st = (fw_stream_t *) p_ctx;
+    int ret;
+
+    pthread_mutex_lock(&p_st->lock);
+
+    if (p_st->held)
+    {
+        p_st->tail = (p_st->tail + 1) % FW_PATCH_STREAM_DEPTH;
+        p_st->count--;
+        p_st->held = FALSE;
+        pthread_cond_signal(&p_st->freed);
+    }
+
+    if ((p_st->count == 0) && !p_st->done)
+    {
+        p_st->read_waits++;
+        while ((p_st->count == 0) && !p_st->done)
+            pthread_cond_wait(&p_st->filled, &p_st->lock);
+    }
+
+    /* No use sending the records left once the patch is known broken */
+    if (p_st->error)
+    {
+        ret = -1;
+    }
+    else if (p_st->count == 0)
+    {
+        ret = 0;
+    }
+    else
+    {
+        *pp_rec = p_st->slot[p_st->tail];
+        p_st->held = TRUE;
+        ret = 1;
+    }
+
+    pthread_mutex_unlock(&p_st->lock);
+
+    return ret;
+}
+
+/*******************************************************************************
+**
+** Function        fw_stream_close
+**
+** Description     Stop the producer and release the stream
+**
+** Returns         None
+**
+*******************************************************************************/
+static void fw_stream_close(void *p_ctx)
+{
+    fw_stream_t *p_st = (fw_stream_t *) p_ctx;
+
+    pthread_mutex_lock(&p_st->lock);
+    p_st->stop = TRUE;
+    pthread_cond_signal(&p_st->freed);
+    pthread_mutex_unlock(&p_st->lock);
+
+    pthread_join(p_st->thread, NULL);
+
+    VND_TRACE(TRC_HW_STREAM, p_st->records, p_st->read_waits,
+        p_st->decode_waits);
+
+    close(p_st->fd);
+    pthread_cond_destroy(&p_st->filled);
+    pthread_cond_destroy(&p_st->freed);
+    pthread_mutex_destroy(&p_st->lock);
+    free(p_st);
+}
+
+/*******************************************************************************
+**
+** Function        fw_stream_read_hdr
+**
+** Description     Read and check the header of the .bseqz file open on the
+**                 stream, and seek to its zlib stream
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+static int fw_stream_read_hdr(fw_stream_t *p_st)
+{
+    struct stat st;
+
+    if ((fstat(p_st->fd, &st) < 0) ||
+        (read(p_st->fd, &p_st->hdr, sizeof(p_st->hdr)) != sizeof(p_st->hdr)) ||
+        (fw_patch_check_hdr(&p_st->hdr, st.st_size) != 0) ||
+        !(p_st->hdr.flags & FW_PATCH_FLAG_DEFLATE) ||
+        (lseek(p_st->fd, p_st->hdr.rec_offset, SEEK_SET) < 0))
+        return -1;
+
+    return 0;
+}
+
+/*******************************************************************************
+**
+** Function        fw_stream_start
+**
+** Description     Open the patch file p_path, streaming a .seq or .bseqz
+**                 file if stream is TRUE
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+static int fw_stream_start(const char *p_path, const uint8_t *p_key,
+                           fw_patch_t *p_patch, int stream)
+{
+    int type = fw_patch_file_type(p_path);
+    fw_stream_t *p_st;
+
+    /* Bundles are mapped, and repacked when they are built */
+    if (type == FW_PATCH_FILE_BUNDLE)
+        return fw_bundle_open(p_path, p_key, p_patch);
+
+    /* Compiled on first use, then mapped from the cache */
+    if ((type == FW_PATCH_FILE_SEQ) &&
+        (fw_cache_open(p_path, FW_STREAM_REPACK_CHUNK, p_patch) == 0))
+        return 0;
+
+    if ((stream == FALSE) || (type == FW_PATCH_FILE_BIN))
+    {
+        if (fw_patch_open(p_path, p_patch) != 0)
+            return -1;
+
+        /* Binary patches are repacked when they are compiled */
+        if ((FW_STREAM_REPACK_CHUNK != 0) && (type == FW_PATCH_FILE_SEQ))
+            fw_repack_image(p_patch, FW_STREAM_REPACK_CHUNK);
+
+        return 0;
+    }
+
+    memset(p_patch, 0, sizeof(fw_patch_t));
+
+    if ((p_st = (fw_stream_t *) calloc(1, sizeof(fw_stream_t))) == NULL)
+        return -1;
+
+    if ((p_st->fd = open(p_path, O_RDONLY)) < 0)
+    {
+        ALOGE("Can not open %s: %s", p_path, strerror(errno));
+        free(p_st);
+        return -1;
+    }
+
+    if ((type == FW_PATCH_FILE_ZIP) && (fw_stream_read_hdr(p_st) != 0))
+    {
+        ALOGE("Invalid compressed patch %s", p_path);
+        close(p_st->fd);
+        free(p_st);
+        return -1;
+    }
+
+    fw_repack_init(&p_st->repack, FW_STREAM_REPACK_CHUNK, fw_stream_emit, p_st);
+
+    pthread_mutex_init(&p_st->lock, NULL);
+    pthread_cond_init(&p_st->filled, NULL);
+    pthread_cond_init(&p_st->freed, NULL);
+
+    if (pthread_create(&p_st->thread, NULL, (type == FW_PATCH_FILE_ZIP) ?
+                       fw_stream_inflate_thread : fw_stream_thread, p_st) != 0)
+    {
+        ALOGE("Can not start the patch stream");
+        close(p_st->fd);
+        pthread_cond_destroy(&p_st->filled);
+        pthread_cond_destroy(&p_st->freed);
+        pthread_mutex_destroy(&p_st->lock);
+        free(p_st);
+        return -1;
+    }
+
+    if (type == FW_PATCH_FILE_ZIP)
+        memcpy(p_patch->key, p_st->hdr.key, FW_PATCH_KEY_LEN);
+    else if (fw_patch_key_from_name(p_path, p_patch->key) != 0)
+        ALOGW("No version key in patch file name %s", p_path);
+
+    p_patch->p_src = &fw_stream_src;
+    p_patch->p_src_ctx = p_st;
+
+    ALOGI("Streaming %s", p_path);
+
+    return 0;
+}
+
+/*****************************************************************************
+**   PATCH STREAM FUNCTIONS
+*****************************************************************************/
+
+/*******************************************************************************
+**
+** Function        fw_stream_open
+**
+** Description     Open the patch file p_path for reading. A .seq or .bseqz
+**                 file is streamed; a .bseq file, or any file if
+**                 FW_PATCH_STREAM is FALSE, is loaded by fw_patch_open.
+**                 The patch of a bundle is the one of version key p_key.
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+int fw_stream_open(const char *p_path, const uint8_t *p_key,
+                   fw_patch_t *p_patch)
+{
+    return fw_stream_start(p_path, p_key, p_patch, FW_PATCH_STREAM);
+}
+
+/*******************************************************************************
+**
+** Function        fw_stream_load
+**
+** Description     Load the patch file p_path as fw_stream_open does, but
+**                 whole and without a stream worker
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+int fw_stream_load(const char *p_path, const uint8_t *p_key,
+                   fw_patch_t *p_patch)
+{
+    return fw_stream_start(p_path, p_key, p_patch, FALSE);
+}
@@ -37,7 +37,6 @@
 #include <time.h>
 #include <errno.h>
 #include <fcntl.h>
-#include <dirent.h>
 #include <ctype.h>
 #include <cutils/properties.h>
 #include <stdlib.h>
@@ -45,27 +44,25 @@
 #include "bt_vendor.h"
 #include "userial.h"
 #include "userial_vendor.h"
+#include "userial_baud.h"
 #include "upio.h"
+#include "fw_patch.h"
+#include "fw_direct.h"
+#include "fw_embedded.h"
+#include "fw_index.h"
+#include "fw_preload.h"
+#include "fw_stats.h"
+#include "fw_stream.h"
+#include "vnd_trace.h"
 
 /******************************************************************************
 **  Constants & Macros
 ******************************************************************************/
 
-#ifndef BTHW_DBG
-#define BTHW_DBG FALSE
-#endif
-
-#if (BTHW_DBG == TRUE)
-#define BTHWDBG(param, ...) {ALOGD(param, ## __VA_ARGS__);}
-#else
-#define BTHWDBG(param, ...) {}
-#endif
+#define BTHWDBG(param, ...) VND_DBG(VND_TRACE_HW, param, ## __VA_ARGS__)
 
-#define FW_PATCHFILE_EXTENSION      ".seq"
-#define FW_PATCHFILE_EXTENSION_LEN  4
 
 #define HCI_CMD_MAX_LEN             258
-#define LINE_LEN_MAX                1024
 
 #define HCI_RESET                               0x0C03
 #define HCI_VSC_WRITE_UART_CLOCK_SETTING        0xFC45
@@ -93,6 +90,9 @@
 #define HCI_EVT_CMD_CMPL_LOCAL_NAME_STRING      6
 #define HCI_EVT_CMD_CMPL_LOCAL_BDADDR_ARRAY     6
 #define HCI_EVT_CMD_CMPL_OPCODE                 3
+#define HCI_EVT_CMD_CMPL_NUM_PKTS               2
+#define HCI_EVT_CMD_STAT_OPCODE                 4
+#define HCI_EVT_CMD_STAT_NUM_PKTS               3
 #define LPM_CMD_PARAM_SIZE                      12
 #define UPDATE_BAUDRATE_CMD_PARAM_SIZE          6
 #define HCI_CMD_PREAMBLE_SIZE                   3
@@ -102,6 +102,18 @@
 #define LOCAL_BDADDR_PATH_BUFFER_LEN            256
 #define HCI_INTEL_MANUFACTURE_PARAM_SIZE        2
 
+/* Line speed of userial_init_cfg; the controller powers up at this rate */
+#define UART_INIT_BAUD_RATE                     115200
+
+/* Depth of the stack's internal command queue, caps the download window */
+#define FW_PATCH_PIPELINE_MAX                   8
+
+/* Events checked per patch record, at most */
+#define FW_PATCH_EXPECT_MAX                     4
+
+/* Controller silent this long at the target rate: the rate did not hold */
+#define HW_CFG_BAUD_EVT_TIMEOUT_MS              1000
+
 
 #define STREAM_TO_UINT16(u16, p) {u16 = ((uint16_t)(*(p)) + (((uint16_t)(*((p) + 1))) << 8)); (p) += 2;}
 #define UINT16_TO_STREAM(p, u16) {*(p)++ = (uint8_t)(u16); *(p)++ = (uint8_t)((u16) >> 8);}
@@ -143,9 +155,40 @@ typedef struct
     char    local_chip_name[LOCAL_NAME_BUFFER_LEN];
     uint8_t is_patch_enabled;               /* Is patch is enabled? 2: enabled 0:not enabled */
     uint8_t next_state;                     /* next state after manufacture off*/
+    uint8_t f_set_baud;                     /* UART raised to target rate? */
+    uint32_t line_errors;                   /* UART errors when raised */
+    uint32_t t_evt;                         /* last event, or the raise */
+    uint8_t f_baud_check;                   /* first answer at target rate due */
+    uint8_t f_baud_fault;                   /* and it was not the one sent for */
+    uint8_t f_direct;                       /* direct download, all events seen */
 
 } bt_hw_cfg_cb_t;
 
+/* patch record sent or about to be, with the events the patch expects */
+typedef struct
+{
+    uint16_t opcode;
+    uint16_t record;                        /* index of the record */
+    uint8_t  n_expect;                      /* events expected */
+    uint8_t  n_seen;                        /* events received so far */
+    fw_patch_expect_t expect[FW_PATCH_EXPECT_MAX];
+} bt_hw_dl_rec_t;
+
+/* patch download control block */
+typedef struct
+{
+    fw_patch_t patch;                       /* patch being downloaded */
+    uint8_t  inflight;                      /* records awaiting their events */
+    uint8_t  head;                          /* oldest in-flight record */
+    uint8_t  credits;                       /* last Num_HCI_Command_Packets */
+    bt_hw_dl_rec_t rec[FW_PATCH_PIPELINE_MAX];
+    uint16_t rec_count;                     /* records read so far */
+    uint8_t  cmd[2][FW_PATCH_REC_MAX];      /* pending and read ahead commands */
+    uint8_t  cmd_idx;                       /* slot of the pending command */
+    uint16_t pend_len;                      /* pending command, not yet sent */
+    uint16_t next_len;                      /* command read ahead */
+} bt_hw_dl_cb_t;
+
 /* low power mode parameters */
 typedef struct
 {
@@ -189,7 +232,21 @@ static char fw_patchfile_name[NAME_MAX];
 static int fw_patch_settlement_delay = -1;
 #endif
 
+static int fw_patch_pipeline_depth = FW_PATCH_PIPELINE_DEPTH;
+static int fw_patch_direct = FW_PATCH_DIRECT;
+
+/* Download rate, set with UartBaud or found by userial_baud_negotiate with
+ * UART_BAUD_AUTO */
+static uint32_t hw_target_baud = UART_TARGET_BAUD_RATE;
+
+/* UartBaud as configured, probed along with the fixed rates */
+static uint32_t hw_conf_baud = UART_TARGET_BAUD_RATE;
+
+/* Result of the direct download for the coming FW_CFG, -1 if none ran */
+static int hw_direct_result = -1;
+
 static bt_hw_cfg_cb_t hw_cfg_cb;
+static bt_hw_dl_cb_t hw_dl_cb;
 
 static bt_lpm_param_t lpm_param =
 {
@@ -252,31 +309,6 @@ static const fw_settlement_entry_t fw_settlement_table[] = {
 **  Controller Initialization Static Functions
 ******************************************************************************/
 
-/*******************************************************************************
-**
-** Function         hw_strncmp
-**
-** Description      Used to compare two strings in caseless
-**
-** Returns          0: match, otherwise: not match
-**
-*******************************************************************************/
-static int hw_strncmp (const char *p_str1, const char *p_str2, const int len)
-{
-    int i;
-
-    if (!p_str1 || !p_str2)
-        return (1);
-
-    for (i = 0; i < len; i++)
-    {
-        if (toupper(p_str1[i]) != toupper(p_str2[i]))
-            return (i+1);
-    }
-
-    return 0;
-}
-
 /*******************************************************************************
 **
 ** Function         hw_config_findpatch
@@ -284,17 +316,17 @@ static int hw_strncmp (const char *p_str1, const char *p_str2, const int len)
 ** Description      Search for a proper firmware patch file
 **                  The selected firmware patch file name with full path
 **                  will be stored in the input string parameter, i.e.
-**                  p_chip_id_str, when returns.
+**                  p_chip_id_str, when returns. The file is looked up by
+**                  version key in the patch index of fw_patchfile_path,
+**                  which prefers a binary patch (.bseq, then the compressed
+**                  .bseqz) over the .seq text of the same name.
 **
 ** Returns          TRUE when found the target patch file, otherwise FALSE
 **
 *******************************************************************************/
-static uint8_t hw_config_findpatch(char *p_chip_id_str)
+static uint8_t hw_config_findpatch(char *p_chip_id_str, const uint8_t *p_key)
 {
-    DIR *dirp;
-    struct dirent *dp;
-    int filenamelen;
-    uint8_t retval = FALSE;
+    char path[PATH_MAX];
 
     BTHWDBG("Target name = [%s]", p_chip_id_str);
 
@@ -305,160 +337,642 @@ static uint8_t hw_config_findpatch(char *p_chip_id_str)
          * to concatenate the filename to open rather than searching a file
          * matching to chipset name in the fw_patchfile_path folder.
          */
-        snprintf(p_chip_id_str, strlen(fw_patchfile_path), "%s", fw_patchfile_path);
-        if (fw_patchfile_path[strlen(fw_patchfile_path)- 1] != '/')
+        if ((fw_index_first_dir(fw_patchfile_path, path, sizeof(path)) != 0) ||
+            (snprintf(p_chip_id_str, NAME_MAX, "%s/%s", path,
+                      fw_patchfile_name) >= NAME_MAX))
         {
-            strncat(p_chip_id_str, "/", 1);
+            ALOGE("Invalid patchfile name (too long)");
+            return FALSE;
         }
-        strncat(p_chip_id_str, fw_patchfile_name, strlen(fw_patchfile_name));
 
         ALOGI("FW patchfile: %s", p_chip_id_str);
         return TRUE;
     }
 
-    if ((dirp = opendir(fw_patchfile_path)) != NULL)
+    if (fw_index_lookup(fw_patchfile_path, p_key, path, sizeof(path)) != 0)
+    {
+        ALOGE("Could not find patchfile %s at %s", p_chip_id_str,fw_patchfile_path);
+        return FALSE;
+    }
+
+    /* Make sure length does not exceed maximum */
+    if (strlen(path) >= NAME_MAX)
     {
-        /* Fetch next filename in patchfile directory */
-        while ((dp = readdir(dirp)) != NULL)
+        ALOGE("Invalid patchfile name (too long)");
+        return FALSE;
+    }
+
+    ALOGI("Found patchfile: %s", path);
+    strcpy(p_chip_id_str, path);
+
+    return TRUE;
+}
+
+/*******************************************************************************
+**
+** Function        hw_config_manufacture_mode_off
+**
+** Description     sends the manufacture mode off command to controller
+**
+** Returns         None
+**
+*******************************************************************************/
+static uint8_t hw_config_manufacture_mode_off(HC_BT_HDR *p_buf)
+{
+    uint8_t* p = (uint8_t *) (p_buf + 1);
+    VND_TRACE(TRC_HW_MANUFACTURE_OFF, hw_cfg_cb.is_patch_enabled, 0, 0);
+    UINT16_TO_STREAM(p, HCI_INTEL_MANUFACTURE);
+    *p++ = HCI_INTEL_MANUFACTURE_PARAM_SIZE; /* parameter length */
+    *p++ = 0x0;
+    *p++ = hw_cfg_cb.is_patch_enabled;
+
+    p_buf->len = HCI_CMD_PREAMBLE_SIZE +
+    HCI_INTEL_MANUFACTURE_PARAM_SIZE;
+    hw_cfg_cb.state = hw_cfg_cb.next_state;
+
+    fw_stats_cmd_sent(FW_STAT_MANUFACTURE_OFF);
+    return bt_vendor_cbacks->xmit_cb(HCI_INTEL_MANUFACTURE,
+        p_buf, hw_config_cback);
+}
+
+
+/*******************************************************************************
+**
+** Function        hw_config_manufacture_mode_on
+**
+** Description     sends the manufacture mode on command to controller
+**
+** Returns         None
+**
+*******************************************************************************/
+static uint8_t hw_config_manufacture_mode_on(HC_BT_HDR *p_buf)
+{
+    uint8_t* p = (uint8_t *) (p_buf + 1);
+    VND_TRACE(TRC_HW_MANUFACTURE_ON, 0, 0, 0);
+    UINT16_TO_STREAM(p, HCI_INTEL_MANUFACTURE);
+    *p++ = HCI_INTEL_MANUFACTURE_PARAM_SIZE; /* parameter length */
+    *p++ = 0x01;
+    *p = 0x00;
+
+    p_buf->len = HCI_CMD_PREAMBLE_SIZE +
+        HCI_INTEL_MANUFACTURE_PARAM_SIZE;
+    hw_cfg_cb.state = HW_CFG_INTEL_MEMWRITE;
+
+    fw_stats_cmd_sent(FW_STAT_MANUFACTURE_ON);
+    return bt_vendor_cbacks->xmit_cb(HCI_INTEL_MANUFACTURE,
+        p_buf, hw_config_cback);
+}
+
+/*******************************************************************************
+**
+** Function        hw_config_need_baud_switch
+**
+** Description     Check whether the patch download should run at
+**                 the target rate instead of the init rate
+**
+** Returns         TRUE/FALSE
+**
+*******************************************************************************/
+static uint8_t hw_config_need_baud_switch(void)
+{
+#if (BLUETOOTH_HCI_USE_USB == TRUE)
+    return FALSE;
+#else
+    return (hw_target_baud != UART_INIT_BAUD_RATE) ? TRUE : FALSE;
+#endif
+}
+
+/*******************************************************************************
+**
+** Function        hw_config_update_baudrate
+**
+** Description     sends the update baudrate command to controller
+**
+** Returns         None
+**
+*******************************************************************************/
+static uint8_t hw_config_update_baudrate(HC_BT_HDR *p_buf, uint32_t line_speed,
+                                         uint8_t next_state)
+{
+    uint8_t* p = (uint8_t *) (p_buf + 1);
+    VND_TRACE(TRC_HW_SET_UART_BAUD, line_speed, 0, 0);
+    UINT16_TO_STREAM(p, HCI_VSC_UPDATE_BAUDRATE);
+    *p++ = UPDATE_BAUDRATE_CMD_PARAM_SIZE; /* parameter length */
+    *p++ = 0; /* encoded baud rate */
+    *p++ = 0; /* use encoded form */
+    UINT32_TO_STREAM(p, line_speed);
+
+    p_buf->len = HCI_CMD_PREAMBLE_SIZE + UPDATE_BAUDRATE_CMD_PARAM_SIZE;
+    hw_cfg_cb.state = next_state;
+
+    fw_stats_cmd_sent(FW_STAT_SET_UART_BAUD);
+    return bt_vendor_cbacks->xmit_cb(HCI_VSC_UPDATE_BAUDRATE,
+        p_buf, hw_config_cback);
+}
+
+/*******************************************************************************
+**
+** Function        hw_config_start_baud_switch
+**
+** Description     Kick off raising the controller's UART to the target
+**                 rate. Rates above 3M need the 48MHz UART
+**                 clock to be selected first.
+**
+** Returns         None
+**
+*******************************************************************************/
+static uint8_t hw_config_start_baud_switch(HC_BT_HDR *p_buf)
+{
+    uint8_t* p = (uint8_t *) (p_buf + 1);
+
+    if (hw_target_baud > 3000000)
+    {
+        VND_TRACE(TRC_HW_SET_UART_CLOCK, 0, 0, 0);
+        UINT16_TO_STREAM(p, HCI_VSC_WRITE_UART_CLOCK_SETTING);
+        *p++ = 1; /* parameter length */
+        *p = 1; /* (1,"UART CLOCK 48 MHz")(2,"UART CLOCK 24 MHz") */
+
+        p_buf->len = HCI_CMD_PREAMBLE_SIZE + 1;
+        hw_cfg_cb.state = HW_CFG_SET_UART_CLOCK;
+
+        fw_stats_cmd_sent(FW_STAT_SET_UART_BAUD);
+        return bt_vendor_cbacks->xmit_cb(HCI_VSC_WRITE_UART_CLOCK_SETTING,
+            p_buf, hw_config_cback);
+    }
+
+    return hw_config_update_baudrate(p_buf, hw_target_baud,
+                                     HW_CFG_SET_UART_BAUD_1);
+}
+
+/*******************************************************************************
+**
+** Function        hw_config_end_download
+**
+** Description     Leave the download phase. If the UART was raised for the
+**                 download, the controller is brought back to the init rate
+**                 first so that it comes out of the following reset in a
+**                 known state; the manufacture mode off command follows from
+**                 HW_CFG_SET_UART_BAUD_2.
+**
+** Returns         None
+**
+*******************************************************************************/
+static uint8_t hw_config_end_download(HC_BT_HDR *p_buf)
+{
+    if (hw_cfg_cb.f_set_baud == TRUE)
+        return hw_config_update_baudrate(p_buf, UART_INIT_BAUD_RATE,
+                                         HW_CFG_SET_UART_BAUD_2);
+
+    return hw_config_manufacture_mode_off(p_buf);
+}
+
+/*******************************************************************************
+**
+** Function        hw_config_baud_event
+**
+** Description     An event came in while the UART is at the target rate.
+**                 The first one has to complete the command sent right after
+**                 the switch, as the expected answer.
+**
+** Returns         None
+**
+*******************************************************************************/
+static void hw_config_baud_event(uint8_t expected)
+{
+    if (hw_cfg_cb.f_set_baud == FALSE)
+        return;
+
+    hw_cfg_cb.t_evt = fw_stats_now();
+
+    if (hw_cfg_cb.f_baud_check == TRUE)
+    {
+        hw_cfg_cb.f_baud_check = FALSE;
+        hw_cfg_cb.f_baud_fault = (expected == TRUE) ? FALSE : TRUE;
+    }
+}
+
+/*******************************************************************************
+**
+** Function        hw_config_report_baud
+**
+** Description     Tell the rate discovery how the download at the target
+**                 rate went. Only what the UART causes counts against the
+**                 rate: line errors counted by the host UART since the rate
+**                 was raised, a wrong answer to the first command at the
+**                 target rate, or a controller gone silent. A download that
+**                 stopped for another reason (patch, expected events, stack)
+**                 is not reported.
+**
+** Returns         None
+**
+*******************************************************************************/
+static void hw_config_report_baud(uint8_t done)
+{
+    uint32_t errors, silent;
+    uint8_t fault = TRUE;
+
+    silent = (fw_stats_now() - hw_cfg_cb.t_evt) / 1000;
+
+    if ((userial_vendor_line_errors(&errors) == 0) &&
+        (errors != hw_cfg_cb.line_errors))
+        ALOGW("%u UART line errors during the download",
+            errors - hw_cfg_cb.line_errors);
+    else if (hw_cfg_cb.f_baud_fault == TRUE)
+        ALOGW("Wrong answer to the first command at %u baud",
+            hw_target_baud);
+    else if ((done == FALSE) && (silent >= HW_CFG_BAUD_EVT_TIMEOUT_MS))
+        ALOGW("No event for %u ms at %u baud", silent, hw_target_baud);
+    else
+        fault = FALSE;
+
+    if ((done == TRUE) || (fault == TRUE))
+        userial_baud_report(hw_target_baud, (fault == TRUE) ? FALSE : TRUE);
+}
+
+/*******************************************************************************
+**
+** Function        hw_config_restore_baud
+**
+** Description     Put the host UART back to the init rate after a failed
+**                 download. The controller is expected to be power cycled
+**                 before the next attempt.
+**
+** Returns         None
+**
+*******************************************************************************/
+static void hw_config_restore_baud(void)
+{
+    if (hw_cfg_cb.f_set_baud == TRUE)
+    {
+        ALOGW("restore UART baud %d", UART_INIT_BAUD_RATE);
+        hw_config_report_baud(FALSE);
+        userial_vendor_set_line_speed(UART_INIT_BAUD_RATE);
+        hw_cfg_cb.f_set_baud = FALSE;
+    }
+}
+
+/*******************************************************************************
+**
+** Function        hw_config_read_patch_record
+**
+** Description     Fetch the next HCI command of the patch image into the
+**                 pending slot of hw_dl_cb, and compile the events that
+**                 follow it into p_rec. Reading up to the next command
+**                 leaves that one read ahead in the other slot. Events the
+**                 stack does not hand to the vendor library (anything but
+**                 Command Complete/Status) are only kept for a direct
+**                 download.
+**
+** Returns         Length of the HCI command, 0 at end of patch or when the
+**                 patch could not be read
+**
+*******************************************************************************/
+static int hw_config_read_patch_record(bt_hw_dl_rec_t *p_rec)
+{
+    fw_patch_rec_t rec;
+    int len = hw_dl_cb.next_len;
+
+    hw_dl_cb.cmd_idx ^= 1;
+    hw_dl_cb.next_len = 0;
+    p_rec->n_expect = 0;
+    p_rec->n_seen = 0;
+
+    while (fw_patch_next(&hw_dl_cb.patch, &rec) == TRUE)
+    {
+        if (rec.type == FW_PATCH_REC_CMD)
         {
-            /* Check if filename starts with chip-id name */
-            if ((hw_strncmp(dp->d_name, p_chip_id_str, strlen(p_chip_id_str))
-                ) == 0)
+            if (len == 0)
             {
-                /* Check if it has .seq extenstion */
-                filenamelen = strlen(dp->d_name);
-                if ((filenamelen >= FW_PATCHFILE_EXTENSION_LEN) &&
-                    ((hw_strncmp(
-                          &dp->d_name[filenamelen-FW_PATCHFILE_EXTENSION_LEN],
-                          FW_PATCHFILE_EXTENSION,
-                          FW_PATCHFILE_EXTENSION_LEN)
-                     ) == 0))
-                {
-                    ALOGI("Found patchfile: %s/%s",
-                        fw_patchfile_path, dp->d_name);
-
-                    /* Make sure length does not exceed maximum */
-                    if ((filenamelen + strlen(fw_patchfile_path)) >
-                        (PATH_MAX - 2))
-                    {
-                        ALOGE("Invalid patchfile name (too long)");
-                    }
-                    else
-                    {
-                        memset(p_chip_id_str, 0, NAME_MAX);
-                        /* Found patchfile. Store location and name */
-                        strncpy(p_chip_id_str, fw_patchfile_path, strlen(fw_patchfile_path));
-                        if (fw_patchfile_path[
-                            strlen(fw_patchfile_path)- 1
-                            ] != '/')
-                        {
-                            strncat(p_chip_id_str, "/", 1);
-                        }
-                        strncat(p_chip_id_str, dp->d_name, strlen(dp->d_name));
-                        retval = TRUE;
-                    }
-                    break;
-                }
+                /* First command of the patch */
+                memcpy(hw_dl_cb.cmd[hw_dl_cb.cmd_idx], rec.p_pkt, rec.len);
+                len = rec.len;
+                continue;
             }
+
+            memcpy(hw_dl_cb.cmd[hw_dl_cb.cmd_idx ^ 1], rec.p_pkt, rec.len);
+            hw_dl_cb.next_len = rec.len;
+            break;
         }
 
-        closedir(dirp);
+        if ((len == 0) || ((hw_cfg_cb.f_direct == FALSE) &&
+            (rec.opcode != FW_PATCH_EVT_CMD_CMPL) &&
+            (rec.opcode != FW_PATCH_EVT_CMD_STAT)))
+            continue;
 
-        if (retval == FALSE)
+        if (p_rec->n_expect == FW_PATCH_EXPECT_MAX)
         {
-            ALOGE("Could not find patchfile %s at %s", p_chip_id_str,fw_patchfile_path);
+            ALOGW("Patch record %d: event 0x%02X not checked", rec.index,
+                rec.opcode);
+            continue;
         }
+
+        fw_patch_expect_compile(&rec, &p_rec->expect[p_rec->n_expect++]);
     }
-    else
-    {
-        ALOGE("Could not open %s", fw_patchfile_path);
-    }
 
-    return (retval);
+    if (hw_dl_cb.patch.error)
+        return 0;
+
+    return len;
 }
 
 /*******************************************************************************
 **
-** Function         char_to_hex
+** Function        hw_config_dl_pipelined
 **
-** Description      Convert char to hex
+** Description     Check whether later records may be sent before p_rec got
+**                 its events: only a MEMWRITE answered by nothing but its
+**                 Command Complete. Any other record is a barrier.
 **
-** Returns          hex value of the character
+** Returns         TRUE/FALSE
 **
 *******************************************************************************/
-unsigned char char_to_hex(char c)
+static uint8_t hw_config_dl_pipelined(const bt_hw_dl_rec_t *p_rec)
 {
-    volatile uint8_t x;
-    char str[2];
-    str[0] = c;
-    str[1] = '\0';
-    x = strtol(str, NULL, 16);
+    if (p_rec->opcode != HCI_INTEL_MEMWRITE)
+        return FALSE;
 
+    if (p_rec->n_expect == 0)
+        return TRUE;
 
-    return x;
+    return ((p_rec->n_expect == 1) &&
+            (p_rec->expect[0].evt[0] == FW_PATCH_EVT_CMD_CMPL)) ? TRUE : FALSE;
 }
 
 /*******************************************************************************
 **
-** Function         form_byte
+** Function        hw_config_dl_mismatch
 **
-** Description      Convert input to a byte
+** Description     Report an event that is not the one the patch expects
 **
-** Returns          formed byte
+** Returns         None
 **
 *******************************************************************************/
-unsigned char form_byte(char msb, char lsb)
+static void hw_config_dl_mismatch(const bt_hw_dl_rec_t *p_rec,
+                                  const uint8_t *p_evt, uint16_t len, int pos)
 {
-    unsigned char byte;
-    byte = (char_to_hex(msb)) << 4;
-    byte |= char_to_hex(lsb);
-    return byte;
+    const fw_patch_expect_t *p_exp = &p_rec->expect[p_rec->n_seen];
+    char got[3 * FW_PATCH_EXPECT_LEN + 1];
+    char exp[3 * FW_PATCH_EXPECT_LEN + 1];
+    int i;
+
+    got[0] = '\0';
+    exp[0] = '\0';
+    for (i = 0; (i < len) && (i < FW_PATCH_EXPECT_LEN); i++)
+        sprintf(got + 3 * i, " %02X", p_evt[i]);
+    for (i = 0; i < p_exp->cmp_len; i++)
+        sprintf(exp + 3 * i, " %02X", p_exp->evt[i]);
+
+    VND_TRACE(TRC_HW_EVT_MISMATCH, p_rec->record, pos,
+        (pos < len) ? p_evt[pos] : 0);
+    ALOGE("Patch record %d (0x%04X): event %d differs at byte %d",
+        p_rec->record, p_rec->opcode, p_rec->n_seen + 1, pos);
+    ALOGE("  expected%s%s (%d bytes)", exp,
+        (p_exp->len > p_exp->cmp_len) ? " ..." : "", p_exp->len);
+    ALOGE("  received%s%s (%d bytes)", got,
+        (len > FW_PATCH_EXPECT_LEN) ? " ..." : "", len);
 }
 
+/*******************************************************************************
+**
+** Function        hw_config_dl_event
+**
+** Description     Check an event received during the download against the
+**                 next one the oldest in-flight record expects. The record
+**                 is retired once all its events arrived; a record without
+**                 events in the patch is retired by its completion.
+**
+** Returns         TRUE/FALSE
+**
+*******************************************************************************/
+static uint8_t hw_config_dl_event(const uint8_t *p_evt, uint16_t len,
+                                  uint16_t opcode)
+{
+    bt_hw_dl_rec_t *p_rec = &hw_dl_cb.rec[hw_dl_cb.head];
+    int pos;
+
+    if (hw_dl_cb.inflight == 0)
+    {
+        ALOGE("Unexpected event 0x%02X during the patch download", p_evt[0]);
+        return FALSE;
+    }
+
+    if (p_rec->n_seen < p_rec->n_expect)
+    {
+        pos = fw_patch_expect_match(&p_rec->expect[p_rec->n_seen], p_evt, len);
+        if (pos != FW_PATCH_EXPECT_MATCH)
+        {
+            hw_config_dl_mismatch(p_rec, p_evt, len, pos);
+            return FALSE;
+        }
+        p_rec->n_seen++;
+    }
+    else if (opcode != p_rec->opcode)
+    {
+        ALOGE("Patch record %d: got completion of 0x%04X, expected 0x%04X",
+            p_rec->record, opcode, p_rec->opcode);
+        return FALSE;
+    }
+
+    if (p_rec->n_seen < p_rec->n_expect)
+        return TRUE;
+
+    hw_dl_cb.head = (hw_dl_cb.head + 1) % FW_PATCH_PIPELINE_MAX;
+    hw_dl_cb.inflight--;
+
+    return TRUE;
+}
 
 /*******************************************************************************
 **
-** Function         form_word
+** Function        hw_config_dl_complete
 **
-** Description      Convert input to a word
+** Description     Check a Command Complete/Status event received during the
+**                 download
 **
-** Returns          formed word
+** Returns         TRUE/FALSE
 **
 *******************************************************************************/
-uint16_t form_word(uint8_t msb, uint8_t lsb)
+static uint8_t hw_config_dl_complete(const uint8_t *p_evt, uint16_t len,
+                                     uint16_t opcode, uint8_t credits)
 {
-    uint16_t byte;
-    byte = msb << 8;
-    byte |= lsb;
-    return byte;
+    hw_dl_cb.credits = credits;
+
+    /* Completion of MANUFACTURE_ON, nothing in flight yet */
+    if ((hw_dl_cb.inflight == 0) && (opcode == HCI_INTEL_MANUFACTURE))
+        return TRUE;
+
+    return hw_config_dl_event(p_evt, len, opcode);
 }
 
 /*******************************************************************************
 **
-** Function        hw_config_manufacture_mode_off
+** Function        hw_config_dl_send
 **
-** Description     sends the manufacture mode off command to controller
+** Description     Send patch records until the download window is full.
+**                 The window is FW_PATCH_PIPELINE_DEPTH records, narrowed to
+**                 the Num_HCI_Command_Packets of the last event. Records that
+**                 are not pipelined (hw_config_dl_pipelined) act as
+**                 barriers: they are sent once all earlier records got their
+**                 events and nothing follows them before they got their own.
+**                 The command buffer *pp_buf is consumed; on failure it is
+**                 handed back for the caller to free.
 **
-** Returns         None
+** Returns         TRUE/FALSE
 **
 *******************************************************************************/
-static uint8_t hw_config_manufacture_mode_off(HC_BT_HDR *p_buf)
+static uint8_t hw_config_dl_send(HC_BT_HDR **pp_buf)
 {
-    uint8_t* p = (uint8_t *) (p_buf + 1);
-    ALOGI("HW_CFG_INTEL_MANUFACTURE_OFF");
-    UINT16_TO_STREAM(p, HCI_INTEL_MANUFACTURE);
-    *p++ = HCI_INTEL_MANUFACTURE_PARAM_SIZE; /* parameter length */
-    *p++ = 0x0;
-    *p++ = hw_cfg_cb.is_patch_enabled;
+    HC_BT_HDR *p_buf = *pp_buf;
+    uint8_t   window = fw_patch_pipeline_depth;
+    bt_hw_dl_rec_t *p_rec;
+    const uint8_t *p_cmd;
+    uint16_t  opcode;
+    uint8_t   ret;
+    int       len;
+
+    *pp_buf = NULL;
+
+    /* Some controllers report zero credits, fall back to lock step then */
+    if (hw_dl_cb.credits < window)
+        window = (hw_dl_cb.credits > 0) ? hw_dl_cb.credits : 1;
+
+    /* The pending record takes the ring slot after the in-flight ones,
+     * which stays the same while they retire */
+    while (hw_dl_cb.inflight < window)
+    {
+        p_rec = &hw_dl_cb.rec[(hw_dl_cb.head + hw_dl_cb.inflight) %
+                              FW_PATCH_PIPELINE_MAX];
 
-    p_buf->len = HCI_CMD_PREAMBLE_SIZE +
-    HCI_INTEL_MANUFACTURE_PARAM_SIZE;
-    hw_cfg_cb.state = hw_cfg_cb.next_state;
+        if (hw_dl_cb.pend_len == 0)
+        {
+            len = hw_config_read_patch_record(p_rec);
+            if ((len == 0) && hw_dl_cb.patch.error)
+            {
+                ALOGE("vendor lib fw conf aborted [patch file unreadable]");
+                *pp_buf = p_buf;
+                return FALSE;
+            }
+            else if (len == 0)
+            {
+                /* End of file, let the tail of the window drain first */
+                if (hw_dl_cb.inflight > 0)
+                    break;
 
-    return bt_vendor_cbacks->xmit_cb(HCI_INTEL_MANUFACTURE,
-        p_buf, hw_config_cback);
+                VND_TRACE(TRC_HW_END_OF_PATCH, hw_dl_cb.rec_count, 0, 0);
+                fw_patch_close(&hw_dl_cb.patch);
+
+                if (fw_patchfile_empty != 0)
+                {
+                    hw_cfg_cb.is_patch_enabled = 0x2;
+                    hw_cfg_cb.next_state = HW_CFG_INTEL_RDSW_VERSION_RECHECK;
+                }
+                else
+                {
+                    ALOGE("Patch file is empty");
+                }
+
+                if (p_buf == NULL)
+                    p_buf = (HC_BT_HDR *) bt_vendor_cbacks->alloc(
+                        BT_HC_HDR_SIZE + HCI_CMD_MAX_LEN);
+                if (p_buf == NULL)
+                    return FALSE;
+
+                p_buf->event = MSG_STACK_TO_HC_HCI_CMD;
+                p_buf->offset = 0;
+                p_buf->layer_specific = 0;
+
+                if ((ret = hw_config_end_download(p_buf)) == FALSE)
+                    *pp_buf = p_buf;
+                return ret;
+            }
+
+            hw_dl_cb.pend_len = len;
+            hw_dl_cb.rec_count++;
+
+            p_cmd = hw_dl_cb.cmd[hw_dl_cb.cmd_idx];
+            p_rec->opcode = form_word(p_cmd[1], p_cmd[0]);
+            p_rec->record = hw_dl_cb.rec_count;
+        }
+
+        p_cmd = hw_dl_cb.cmd[hw_dl_cb.cmd_idx];
+        opcode = p_rec->opcode;
+
+        if ((hw_config_dl_pipelined(p_rec) == FALSE) && (hw_dl_cb.inflight > 0))
+            break;
+
+        if (p_buf == NULL)
+            p_buf = (HC_BT_HDR *) bt_vendor_cbacks->alloc(BT_HC_HDR_SIZE +
+                                                           HCI_CMD_MAX_LEN);
+        if (p_buf == NULL)
+        {
+            ALOGE("vendor lib fw conf aborted [no buffer]");
+            return FALSE;
+        }
+
+        p_buf->event = MSG_STACK_TO_HC_HCI_CMD;
+        p_buf->offset = 0;
+        p_buf->layer_specific = 0;
+        p_buf->len = hw_dl_cb.pend_len;
+        memcpy((uint8_t *) (p_buf + 1), p_cmd, hw_dl_cb.pend_len);
+
+        VND_TRACE(TRC_HW_RECORD, hw_dl_cb.rec_count, opcode, p_cmd[2]);
+
+        hw_dl_cb.inflight++;
+        hw_dl_cb.pend_len = 0;
+        fw_patchfile_empty = 1;
+
+        fw_stats_cmd_sent(FW_STAT_MEMWRITE);
+        if (bt_vendor_cbacks->xmit_cb(opcode, p_buf, hw_config_cback) == FALSE)
+        {
+            *pp_buf = p_buf;
+            return FALSE;
+        }
+        p_buf = NULL;
+
+        if (hw_config_dl_pipelined(p_rec) == FALSE)
+            break;
+    }
+
+    /* Window full, the buffer handed in is not needed for now */
+    if (p_buf != NULL)
+        bt_vendor_cbacks->dealloc(p_buf);
+
+    return TRUE;
 }
 
+/*******************************************************************************
+**
+** Function         hw_config_proceed
+**
+** Description      Finish handling an event of the firmware configuration:
+**                  abort it if the next step could not be taken, p_buf is
+**                  the command buffer left over
+**
+** Returns          None
+**
+*******************************************************************************/
+static void hw_config_proceed(uint8_t is_proceeding, HC_BT_HDR *p_buf)
+{
+    if (is_proceeding == FALSE)
+    {
+        ALOGE("vendor lib fwcfg aborted!!!");
+        fw_stats_finish(BT_VND_OP_RESULT_FAIL);
+        VND_TRACE(TRC_HW_RESULT, BT_VND_OP_RESULT_FAIL, 0, 0);
+        vnd_trace_dump("fwcfg aborted");
+        if (bt_vendor_cbacks)
+        {
+            if (p_buf != NULL)
+                bt_vendor_cbacks->dealloc(p_buf);
+
+            bt_vendor_cbacks->fwcfg_cb(BT_VND_OP_RESULT_FAIL);
+        }
+
+        fw_patch_close(&hw_dl_cb.patch);
+
+        hw_config_restore_baud();
+        hw_cfg_cb.state = 0;
+    }
+}
 
 /*******************************************************************************
 **
@@ -478,19 +992,34 @@ void hw_config_cback(void *p_mem)
     uint8_t     is_proceeding = FALSE;
     uint8_t     *evt_buf;
     uint16_t    opcode;
-    int         pos;
-    static FILE *fp;
+    uint8_t     credits;
+    uint32_t    t_open;
+    int         preload;
 
-    if(*(uint8_t *)(p_evt_buf + 1) == HCI_EVT_CMD_CMPL_EVT_CODE)
-        status = *((uint8_t *)(p_evt_buf + 1) + HCI_EVT_CMD_CMPL_STATUS_RET_BYTE);
+    evt_buf = (uint8_t *)(p_evt_buf + 1);
+
+    fw_stats_cmd_done();
 
     if(*(uint8_t *)(p_evt_buf + 1) == HCI_EVT_CMD_STAT_EVT_CODE)
+    {
         status = *((uint8_t *)(p_evt_buf + 1) + HCI_EVT_CMD_STAT_STATUS_RET_BYTE);
-
-    evt_buf = (uint8_t *)(p_evt_buf + 1);
-    p = (uint8_t *)(p_evt_buf + 1) + HCI_EVT_CMD_CMPL_OPCODE;
+        credits = evt_buf[HCI_EVT_CMD_STAT_NUM_PKTS];
+        p = evt_buf + HCI_EVT_CMD_STAT_OPCODE;
+    }
+    else
+    {
+        if(*(uint8_t *)(p_evt_buf + 1) == HCI_EVT_CMD_CMPL_EVT_CODE)
+            status = *((uint8_t *)(p_evt_buf + 1) + HCI_EVT_CMD_CMPL_STATUS_RET_BYTE);
+        credits = evt_buf[HCI_EVT_CMD_CMPL_NUM_PKTS];
+        p = evt_buf + HCI_EVT_CMD_CMPL_OPCODE;
+    }
     STREAM_TO_UINT16(opcode,p);
 
+    VND_TRACE(TRC_HW_EVENT, opcode, status, credits);
+
+    hw_config_baud_event(((status == 0) &&
+                          (opcode == HCI_INTEL_MANUFACTURE)) ? TRUE : FALSE);
+
     if(status != 0)
         ALOGE("FW Patch download aborted as command 0x%04X failed ", opcode);
     else if (bt_vendor_cbacks)
@@ -508,8 +1037,7 @@ void hw_config_cback(void *p_mem)
         switch (hw_cfg_cb.state)
         {
         case HW_CFG_INTEL_RDSW_VERSION:
-#if (BLUETOOTH_HCI_USE_USB == TRUE)
-            ALOGI("HW_CFG_INTEL_RDSW_VERSION");
+            VND_TRACE(TRC_HW_RDSW_VERSION, 0, 0, 0);
             UINT16_TO_STREAM(p, HCI_INTEL_RDSW_VERSION);
             *p++ = 0;  /* parameter length */
 
@@ -517,33 +1045,55 @@ void hw_config_cback(void *p_mem)
 
             hw_cfg_cb.state = HW_CFG_INTEL_OPEN_PATCHFILE;
 
+            fw_stats_cmd_sent(FW_STAT_RDSW_VERSION);
             is_proceeding = bt_vendor_cbacks->xmit_cb(HCI_INTEL_RDSW_VERSION,
                 p_buf, hw_config_cback);
 
             break;
-#endif
 
         case HW_CFG_INTEL_OPEN_PATCHFILE:
-            ALOGI("OPEN_PATCHFILE");
+            t_open = fw_stats_now();
             char patchfile[NAME_MAX];
             memset(patchfile, 0, sizeof(patchfile));
-            snprintf(patchfile, NAME_MAX, "%02x%02x%02x%02x%02x%02x%02x%02x%02x.seq", evt_buf[6], evt_buf[7],
+            snprintf(patchfile, NAME_MAX, "%02x%02x%02x%02x%02x%02x%02x%02x%02x", evt_buf[6], evt_buf[7],
                 evt_buf[8], evt_buf[9], evt_buf[10], evt_buf[11],
                 evt_buf[12], evt_buf[13], evt_buf[14]);
 
-            if (hw_config_findpatch(patchfile) == TRUE)
-            {
-                fp = fopen(patchfile, "r");
+            preload = FW_PRELOAD_UNAVAILABLE;
+#if (FW_PATCH_PRELOAD == TRUE)
+            if (strlen(fw_patchfile_name) == 0)
+                preload = fw_preload_take(&evt_buf[6], &hw_dl_cb.patch);
+#endif
 
-                if(fp == NULL) {
+            if ((preload != FW_PRELOAD_FOUND) &&
+                (strlen(fw_patchfile_name) == 0) &&
+                (fw_embedded_open(&evt_buf[6], &hw_dl_cb.patch) == 0))
+            {
+                VND_TRACE(TRC_HW_OPEN_PATCHFILE, TRUE, FALSE, TRUE);
+                fw_stats_add(FW_STAT_OPEN_PATCHFILE, t_open);
+            }
+            else if (preload == FW_PRELOAD_FOUND)
+            {
+                VND_TRACE(TRC_HW_OPEN_PATCHFILE, TRUE, TRUE, 0);
+                fw_stats_add(FW_STAT_OPEN_PATCHFILE, t_open);
+            }
+            else if ((preload == FW_PRELOAD_UNAVAILABLE) &&
+                     (hw_config_findpatch(patchfile, &evt_buf[6]) == TRUE))
+            {
+                VND_TRACE(TRC_HW_OPEN_PATCHFILE, TRUE, FALSE, 0);
+                if (fw_stream_open(patchfile, &evt_buf[6], &hw_dl_cb.patch) != 0) {
                     ALOGE("Can not open patch filename: %s", patchfile);
                     break;
                 }
+                fw_stats_add(FW_STAT_OPEN_PATCHFILE, t_open);
             }
             else
             {
                 //Patch file not found, report fw download success
                 ALOGD("Firmware is already updated");
+                VND_TRACE(TRC_HW_OPEN_PATCHFILE, FALSE, FALSE, 0);
+                fw_stats_add(FW_STAT_OPEN_PATCHFILE, t_open);
+                fw_stats_finish(BT_VND_OP_RESULT_SUCCESS);
                 if (bt_vendor_cbacks)
                 {
                     if (p_buf != NULL)
@@ -555,104 +1105,63 @@ void hw_config_cback(void *p_mem)
                 break;
             }
 
+            if (hw_config_need_baud_switch() == TRUE)
+            {
+                /* Download the patch at the target rate */
+                is_proceeding = hw_config_start_baud_switch(p_buf);
+                break;
+            }
+
             //continue with manufacture on
 
         case HW_CFG_INTEL_MANUFACTURE_ON:
-            ALOGI("HW_CFG_INTEL_MANUFACTURE_ON");
-            UINT16_TO_STREAM(p, HCI_INTEL_MANUFACTURE);
-            *p++ = HCI_INTEL_MANUFACTURE_PARAM_SIZE; /* parameter length */
-            *p++ = 0x01;
-            *p = 0x00;
+            is_proceeding = hw_config_manufacture_mode_on(p_buf);
+            break;
 
-            p_buf->len = HCI_CMD_PREAMBLE_SIZE +
-                HCI_INTEL_MANUFACTURE_PARAM_SIZE;
-            hw_cfg_cb.state = HW_CFG_INTEL_MEMWRITE;
+        case HW_CFG_SET_UART_CLOCK:
+            is_proceeding = hw_config_update_baudrate(p_buf,
+                hw_target_baud, HW_CFG_SET_UART_BAUD_1);
+            break;
 
-            is_proceeding = bt_vendor_cbacks->xmit_cb(HCI_INTEL_MANUFACTURE,
-                p_buf, hw_config_cback);
+        case HW_CFG_SET_UART_BAUD_1:
+            /* update baud rate of host's UART port */
+            VND_TRACE(TRC_HW_HOST_BAUD, hw_target_baud, 0, 0);
+            userial_vendor_set_line_speed(hw_target_baud);
+            hw_cfg_cb.f_set_baud = TRUE;
+            if (userial_vendor_line_errors(&hw_cfg_cb.line_errors) != 0)
+                hw_cfg_cb.line_errors = 0;
+            hw_cfg_cb.t_evt = fw_stats_now();
+            hw_cfg_cb.f_baud_check = TRUE;
+            hw_cfg_cb.f_baud_fault = FALSE;
+
+            is_proceeding = hw_config_manufacture_mode_on(p_buf);
+            break;
+
+        case HW_CFG_SET_UART_BAUD_2:
+            /* controller is back at the init rate, follow with the host */
+            VND_TRACE(TRC_HW_HOST_BAUD, UART_INIT_BAUD_RATE, 0, 0);
+            hw_config_report_baud(TRUE);
+            userial_vendor_set_line_speed(UART_INIT_BAUD_RATE);
+            hw_cfg_cb.f_set_baud = FALSE;
 
+            is_proceeding = hw_config_manufacture_mode_off(p_buf);
             break;
 
         case HW_CFG_INTEL_MEMWRITE:
-            {
-                char line[LINE_LEN_MAX];
-                memset(line, 0, sizeof(line));
-                ALOGI("HW_CFG_INTEL_MEMWRITE");
-                if(!feof(fp)) {
-                    ALOGI("file not empty");
-                    fgets(line, sizeof(line), fp);
-
-                    while((line[0] == '*') || (line[0] == 0xd ) || (line[0] == 'F') || (line[1] == '2')){
-                        if(feof(fp)) {
-                            ALOGI("End of file");
-                            if(fp != NULL)
-                            {
-                                fclose(fp);
-                                fp = NULL;
-                            }
-
-                            if(fw_patchfile_empty != 0)
-                            {
-                                hw_cfg_cb.is_patch_enabled = 0x2;
-                                hw_cfg_cb.next_state = HW_CFG_INTEL_RDSW_VERSION_RECHECK;
-                                is_proceeding = hw_config_manufacture_mode_off(p_buf);
-                            }
-                            else
-                            {
-                                ALOGE("Patch file is empty");
-                                is_proceeding = hw_config_manufacture_mode_off(p_buf);
-                            }
-                            break;
-                        }
-
-                        fgets(line, sizeof(line), fp);
-                    }
-                    if((line[0] == '0') && (line[1] == '1')){
-                        int length = 0;
-                        int parameter_length = 0;
-                        uint8_t opcodeByte[2];
-                        uint16_t opcode = 0;
-                        opcodeByte[0] = form_byte(line[3], line[4]);
-                        opcodeByte[1] = form_byte(line[5], line[6]);
-                        opcode = form_word(opcodeByte[1], opcodeByte[0]);
-                        length = strlen(line);
-
-                        UINT16_TO_STREAM(p, opcode);
-                        parameter_length = form_byte(line[8], line[9]);
-                        *p = parameter_length;  /* parameter length */
-                        p++;
-                        p_buf->len = HCI_CMD_PREAMBLE_SIZE + parameter_length;
-                        ALOGI("Length =%X, %d", parameter_length, length);
-
-                        for(pos=0; pos < (length - 10); pos += 2){
-                            *p = form_byte(line[10+pos], line[11+pos]);
-                            p++;
-                        }
-
-                        fw_patchfile_empty = 1;
-                        hw_cfg_cb.state = HW_CFG_INTEL_MEMWRITE;
-
-                        is_proceeding = bt_vendor_cbacks->xmit_cb(opcode,
-                            p_buf, hw_config_cback);
-                    }
-                    break;
-                }
-                else
-                {
-                    ALOGE("Patch file is empty");
-                    is_proceeding = hw_config_manufacture_mode_off(p_buf);
-                }
-                break;
-            }
+            if (hw_config_dl_complete(evt_buf, p_evt_buf->len, opcode,
+                                      credits) == TRUE)
+                is_proceeding = hw_config_dl_send(&p_buf);
+            break;
 
         case HW_CFG_INTEL_RDSW_VERSION_RECHECK:
-            ALOGI("HW_CFG_INTEL_RDSW_VERSION_RECHECK");
+            VND_TRACE(TRC_HW_RDSW_VERSION_RECHECK, 0, 0, 0);
             UINT16_TO_STREAM(p, HCI_INTEL_RDSW_VERSION);
             *p++ = 0;  /* parameter length */
 
             p_buf->len = HCI_CMD_PREAMBLE_SIZE;
             hw_cfg_cb.state = HW_CFG_SUCCESS;
 
+            fw_stats_cmd_sent(FW_STAT_RDSW_VERSION_RECHECK);
             is_proceeding = bt_vendor_cbacks->xmit_cb(HCI_INTEL_RDSW_VERSION,
                 p_buf, hw_config_cback);
 
@@ -668,6 +1177,9 @@ void hw_config_cback(void *p_mem)
                     evt_buf[12], evt_buf[13], evt_buf[14]);
             }
 
+            fw_stats_finish(BT_VND_OP_RESULT_SUCCESS);
+            VND_TRACE(TRC_HW_RESULT, BT_VND_OP_RESULT_SUCCESS, 0, 0);
+
             //Report fw download success
             if (bt_vendor_cbacks)
             {
@@ -681,6 +1193,10 @@ void hw_config_cback(void *p_mem)
 
         case HW_CFG_FAIL:
             ALOGE("vendor lib fw conf aborted");
+            hw_config_restore_baud();
+            fw_stats_finish(BT_VND_OP_RESULT_FAIL);
+            VND_TRACE(TRC_HW_RESULT, BT_VND_OP_RESULT_FAIL, 0, 0);
+            vnd_trace_dump("fw conf aborted");
             //Report fw download failure
             if (bt_vendor_cbacks)
             {
@@ -702,25 +1218,44 @@ void hw_config_cback(void *p_mem)
     if (bt_vendor_cbacks)
         bt_vendor_cbacks->dealloc(p_evt_buf);
 
-    if (is_proceeding == FALSE)
-    {
-        ALOGE("vendor lib fwcfg aborted!!!");
-        if (bt_vendor_cbacks)
-        {
-            if (p_buf != NULL)
-                bt_vendor_cbacks->dealloc(p_buf);
+    hw_config_proceed(is_proceeding, p_buf);
+}
 
-            bt_vendor_cbacks->fwcfg_cb(BT_VND_OP_RESULT_FAIL);
-        }
+/*******************************************************************************
+**
+** Function         hw_config_evt_cback
+**
+** Description      Callback function for the events other than Command
+**                  Complete/Status, seen during a direct download only
+**
+** Returns          None
+**
+*******************************************************************************/
+static void hw_config_evt_cback(void *p_mem)
+{
+    HC_BT_HDR *p_evt_buf = (HC_BT_HDR *) p_mem;
+    uint8_t   *evt_buf = (uint8_t *) (p_evt_buf + 1);
+    HC_BT_HDR *p_buf = NULL;
+    uint8_t   is_proceeding = TRUE;
 
-        if (fp != NULL)
-        {
-            fclose(fp);
-            fp = NULL;
-        }
+    hw_config_baud_event(FALSE);
 
-        hw_cfg_cb.state = 0;
+    if (hw_cfg_cb.state == HW_CFG_INTEL_MEMWRITE)
+    {
+        VND_DBG(VND_TRACE_HW, "event 0x%02X", evt_buf[0]);
+
+        is_proceeding = hw_config_dl_event(evt_buf, p_evt_buf->len, 0);
+        if (is_proceeding == TRUE)
+            is_proceeding = hw_config_dl_send(&p_buf);
+    }
+    else
+    {
+        VND_DBG(VND_TRACE_HW, "event 0x%02X ignored", evt_buf[0]);
     }
+
+    bt_vendor_cbacks->dealloc(p_evt_buf);
+
+    hw_config_proceed(is_proceeding, p_buf);
 }
 
 #if (SW_RFKILL_CMD_SUPPORTED == TRUE)
@@ -902,10 +1437,32 @@ void hw_config_start(void)
 {
     HC_BT_HDR  *p_buf = NULL;
     uint8_t     *p;
+    int         direct = hw_direct_result;
+
+    hw_direct_result = -1;
+
+    if (direct == BT_VND_OP_RESULT_SUCCESS)
+    {
+        ALOGI("Firmware configured by the direct download");
+        if (bt_vendor_cbacks)
+            bt_vendor_cbacks->fwcfg_cb(BT_VND_OP_RESULT_SUCCESS);
+        return;
+    }
+    else if (direct != -1)
+    {
+        ALOGW("Direct download failed, retrying through the stack");
+    }
 
     hw_cfg_cb.state = 0;
     hw_cfg_cb.is_patch_enabled = 0;         //Patch is not enabled
     hw_cfg_cb.next_state = HW_CFG_SUCCESS;
+    hw_cfg_cb.f_set_baud = FALSE;
+    hw_cfg_cb.f_baud_check = FALSE;
+
+    fw_patch_close(&hw_dl_cb.patch);
+    memset(&hw_dl_cb, 0, sizeof(bt_hw_dl_cb_t));
+
+    fw_stats_start();
 
     /* As a workaround for the controller bug because of which controller is returning zero for number of completed command after sending the first HCI command,
     Start from sending HCI_RESET. this will reset the number of completed command */
@@ -929,6 +1486,8 @@ void hw_config_start(void)
 
         hw_cfg_cb.state = HW_CFG_INTEL_RDSW_VERSION;
 
+        VND_TRACE(TRC_HW_RESET, 0, 0, 0);
+        fw_stats_cmd_sent(FW_STAT_HCI_RESET);
         bt_vendor_cbacks->xmit_cb(HCI_RESET, p_buf, hw_config_cback);
     }
     else
@@ -936,11 +1495,103 @@ void hw_config_start(void)
         if (bt_vendor_cbacks)
         {
             ALOGE("vendor lib fw conf aborted [no buffer]");
+            fw_stats_finish(BT_VND_OP_RESULT_FAIL);
+            vnd_trace_dump("no buffer");
             bt_vendor_cbacks->fwcfg_cb(BT_VND_OP_RESULT_FAIL);
         }
     }
 }
 
+/*******************************************************************************
+**
+** Function        hw_config_negotiate_baud
+**
+** Description     Find the download rate of the board on the UART just
+**                 opened, when UART_BAUD_AUTO is set
+**
+** Returns         None
+**
+*******************************************************************************/
+void hw_config_negotiate_baud(int fd)
+{
+#if (BLUETOOTH_HCI_USE_USB == TRUE)
+    return;
+#else
+    uint32_t baud = userial_baud_negotiate(fd, UART_INIT_BAUD_RATE,
+                                           hw_conf_baud);
+
+    if (baud != 0)
+        hw_target_baud = baud;
+#endif
+}
+
+/*******************************************************************************
+**
+** Function        hw_config_userial_close
+**
+** Description     The UART is about to close. A download still running at
+**                 the target rate was given up by the stack; it counts
+**                 against the rate if the controller had gone silent.
+**
+** Returns         None
+**
+*******************************************************************************/
+void hw_config_userial_close(void)
+{
+    hw_config_restore_baud();
+}
+
+/*******************************************************************************
+**
+** Function        hw_config_direct
+**
+** Description     Run the firmware configuration on the UART just opened,
+**                 before the stack gets the fd, when FwPatchDirect is set.
+**                 The next FW_CFG reports its result.
+**
+** Returns         None
+**
+*******************************************************************************/
+void hw_config_direct(int fd)
+{
+    hw_direct_result = -1;
+
+    if (fw_patch_direct == FALSE)
+        return;
+
+    hw_cfg_cb.f_direct = TRUE;
+    hw_direct_result = fw_direct_run(fd, hw_config_start, hw_config_evt_cback);
+    hw_cfg_cb.f_direct = FALSE;
+
+    if (hw_direct_result != BT_VND_OP_RESULT_SUCCESS)
+    {
+        /* Leave the UART as the stack path expects it */
+        hw_config_restore_baud();
+        fw_patch_close(&hw_dl_cb.patch);
+        hw_cfg_cb.state = 0;
+    }
+}
+
+/*******************************************************************************
+**
+** Function        hw_config_preload
+**
+** Description     Start loading the patches of fw_patchfile_path in the
+**                 background, ahead of FW_CFG
+**
+** Returns         None
+**
+*******************************************************************************/
+void hw_config_preload(void)
+{
+    /* Embedded patches need no file, the directories are only searched
+     * when the key is not embedded */
+#if (FW_PATCH_PRELOAD == TRUE) && (FW_PATCH_EMBEDDED == FALSE)
+    if (strlen(fw_patchfile_name) == 0)
+        fw_preload_start(fw_patchfile_path);
+#endif
+}
+
 /*******************************************************************************
 **
 ** Function        hw_lpm_enable
@@ -1117,7 +1768,8 @@ void hw_sco_config(void)
 **
 ** Function        hw_set_patch_file_path
 **
-** Description     Set the location of firmware patch file
+** Description     Set the location of firmware patch file, a ':' separated
+**                 list of directories searched in order
 **
 ** Returns         0 : Success
 **                 Otherwise : Fail
@@ -1149,6 +1801,81 @@ int hw_set_patch_file_name(char *p_conf_name, char *p_conf_value, int param)
     return 0;
 }
 
+/*******************************************************************************
+**
+** Function        hw_set_patch_direct
+**
+** Description     Enable (1) or disable (0) the direct firmware download
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+int hw_set_patch_direct(char *p_conf_name, char *p_conf_value, int param)
+{
+    fw_patch_direct = (atoi(p_conf_value) != 0) ? TRUE : FALSE;
+
+    return 0;
+}
+
+/*******************************************************************************
+**
+** Function        hw_set_patch_pipeline_depth
+**
+** Description     Give the number of patch records kept in flight during the
+**                 firmware download
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+int hw_set_patch_pipeline_depth(char *p_conf_name, char *p_conf_value, int param)
+{
+    int depth = atoi(p_conf_value);
+
+    if ((depth < 1) || (depth > FW_PATCH_PIPELINE_MAX))
+    {
+        ALOGE("Invalid %s %d, keeping %d", p_conf_name, depth,
+            fw_patch_pipeline_depth);
+        return -1;
+    }
+
+    fw_patch_pipeline_depth = depth;
+
+    return 0;
+}
+
+/*******************************************************************************
+**
+** Function        hw_set_uart_baud
+**
+** Description     Give the UART rate of the firmware download, any line
+**                 speed the UART clock can make. With UART_BAUD_AUTO on, the
+**                 rate is the highest one probed (see UartBaudAuto)
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+int hw_set_uart_baud(char *p_conf_name, char *p_conf_value, int param)
+{
+    unsigned long baud;
+    char *p_end;
+
+    baud = strtoul(p_conf_value, &p_end, 10);
+    if ((p_end == p_conf_value) || (*p_end != '\0') || (baud == 0))
+    {
+        ALOGE("Invalid %s %s, keeping %u", p_conf_name, p_conf_value,
+            hw_target_baud);
+        return -1;
+    }
+
+    hw_target_baud = baud;
+    hw_conf_baud = baud;
+
+    return 0;
+}
+
 #if (VENDOR_LIB_RUNTIME_TUNING_ENABLED == TRUE)
 /*******************************************************************************
 **
@@ -0,0 +1,229 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      hex_decode.c
+ *
+ *  Description:   Contains the hex text to binary decoder
+ *                      lookup table path, any target
+ *                      SSE2 path, 32 digits per iteration
+ *                      NEON path, 32 digits per iteration
+ *
+ *                 Build with HEX_DECODE_NO_SIMD defined to force the lookup
+ *                 table path.
+ *
+ ******************************************************************************/
+
+#include "hex_decode.h"
+
+#if !defined(HEX_DECODE_NO_SIMD) && defined(__SSE2__)
+#define HEX_DECODE_SSE2
+#include <emmintrin.h>
+#elif !defined(HEX_DECODE_NO_SIMD) && (defined(__ARM_NEON__) || defined(__ARM_NEON))
+#define HEX_DECODE_NEON
+#include <arm_neon.h>
+#endif
+
+/******************************************************************************
+**  Variables
+******************************************************************************/
+
+const uint8_t hex_decode_lut[256] =
+{
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x08, 0x09, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+};
+
+/******************************************************************************
+**  Static functions
+******************************************************************************/
+
+#if defined(HEX_DECODE_SSE2)
+/*******************************************************************************
+**
+** Function        hex_nibbles_sse2
+**
+** Description     Convert 16 hex digits to their nibble values. Lanes that
+**                 are not hex digits are cleared in *p_valid.
+**
+** Returns         nibble values
+**
+*******************************************************************************/
+static inline __m128i hex_nibbles_sse2(__m128i c, __m128i *p_valid)
+{
+    /* c - '0' <= 9 for digits, (c | 0x20) - 'a' <= 5 for letters; the
+     * unsigned compare is done as min(x, n) == x */
+    __m128i d = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+    __m128i a = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)),
+                             _mm_set1_epi8('a'));
+    __m128i is_d = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+    __m128i is_a = _mm_cmpeq_epi8(_mm_min_epu8(a, _mm_set1_epi8(5)), a);
+
+    *p_valid = _mm_and_si128(*p_valid, _mm_or_si128(is_d, is_a));
+
+    return _mm_or_si128(_mm_and_si128(is_d, d),
+                        _mm_and_si128(is_a, _mm_add_epi8(a, _mm_set1_epi8(10))));
+}
+
+/*******************************************************************************
+**
+** Function        hex_pack_sse2
+**
+** Description     Merge the nibble pairs of 16 nibbles into 8 bytes, kept in
+**                 the low half of each 16 bit lane
+**
+** Returns         packed bytes
+**
+*******************************************************************************/
+static inline __m128i hex_pack_sse2(__m128i n)
+{
+    /* Each lane holds the high nibble in its low byte (first digit) and
+     * the low nibble in its high byte (second digit) */
+    return _mm_and_si128(_mm_or_si128(_mm_slli_epi16(n, 4),
+                                      _mm_srli_epi16(n, 8)),
+                         _mm_set1_epi16(0x00FF));
+}
+#endif
+
+/******************************************************************************
+**  Functions
+******************************************************************************/
+
+/*******************************************************************************
+**
+** Function        hex_decode_scalar
+**
+** Description     Lookup table only version of hex_decode
+**
+** Returns         0 : Success
+**                 Otherwise : p_in holds a non hex character
+**
+*******************************************************************************/
+int hex_decode_scalar(uint8_t *p_out, const char *p_in, size_t len)
+{
+    const uint8_t *p = (const uint8_t *) p_in;
+    uint8_t bad = 0;
+    uint8_t hi, lo;
+
+    /* Invalid characters map to 0xFF, collect them and check once */
+    while (len--)
+    {
+        hi = hex_decode_lut[p[0]];
+        lo = hex_decode_lut[p[1]];
+        bad |= hi | lo;
+        *p_out++ = (uint8_t) ((hi << 4) | (lo & 0x0F));
+        p += 2;
+    }
+
+    return (bad & 0xF0) ? -1 : 0;
+}
+
+/*******************************************************************************
+**
+** Function        hex_decode
+**
+** Description     Decode the 2 * len hex digits at p_in into len bytes at
+**                 p_out, 16 bytes per iteration when SIMD is available
+**
+** Returns         0 : Success
+**                 Otherwise : p_in holds a non hex character
+**
+*******************************************************************************/
+int hex_decode(uint8_t *p_out, const char *p_in, size_t len)
+{
+#if defined(HEX_DECODE_SSE2)
+    __m128i valid = _mm_set1_epi8(-1);
+    __m128i n0, n1;
+
+    for (; len >= 16; len -= 16, p_in += 32, p_out += 16)
+    {
+        n0 = hex_nibbles_sse2(_mm_loadu_si128((const __m128i *) p_in), &valid);
+        n1 = hex_nibbles_sse2(_mm_loadu_si128((const __m128i *) (p_in + 16)),
+                              &valid);
+        _mm_storeu_si128((__m128i *) p_out,
+                         _mm_packus_epi16(hex_pack_sse2(n0), hex_pack_sse2(n1)));
+    }
+
+    if (_mm_movemask_epi8(valid) != 0xFFFF)
+        return -1;
+#elif defined(HEX_DECODE_NEON)
+    uint8x16_t bad = vdupq_n_u8(0);
+    uint8x16x2_t c;
+    uint8x16_t d, a, is_d, is_a, hi, lo;
+    uint64x2_t bad64;
+
+    for (; len >= 16; len -= 16, p_in += 32, p_out += 16)
+    {
+        /* De-interleave first (high nibble) and second digits */
+        c = vld2q_u8((const uint8_t *) p_in);
+
+        d = vsubq_u8(c.val[0], vdupq_n_u8('0'));
+        a = vsubq_u8(vorrq_u8(c.val[0], vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+        is_d = vcleq_u8(d, vdupq_n_u8(9));
+        is_a = vcleq_u8(a, vdupq_n_u8(5));
+        bad = vorrq_u8(bad, vmvnq_u8(vorrq_u8(is_d, is_a)));
+        hi = vbslq_u8(is_d, d, vaddq_u8(a, vdupq_n_u8(10)));
+
+        d = vsubq_u8(c.val[1], vdupq_n_u8('0'));
+        a = vsubq_u8(vorrq_u8(c.val[1], vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+        is_d = vcleq_u8(d, vdupq_n_u8(9));
+        is_a = vcleq_u8(a, vdupq_n_u8(5));
+        bad = vorrq_u8(bad, vmvnq_u8(vorrq_u8(is_d, is_a)));
+        lo = vbslq_u8(is_d, d, vaddq_u8(a, vdupq_n_u8(10)));
+
+        vst1q_u8(p_out, vorrq_u8(vshlq_n_u8(hi, 4), lo));
+    }
+
+    bad64 = vreinterpretq_u64_u8(bad);
+    if ((vgetq_lane_u64(bad64, 0) | vgetq_lane_u64(bad64, 1)) != 0)
+        return -1;
+#endif
+
+    return hex_decode_scalar(p_out, p_in, len);
+}
@@ -37,20 +37,13 @@
 #include "bt_vendor.h"
 #include "upio.h"
 #include "userial_vendor.h"
+#include "vnd_trace.h"
 
 /******************************************************************************
 **  Constants & Macros
 ******************************************************************************/
 
-#ifndef UPIO_DBG
-#define UPIO_DBG FALSE
-#endif
-
-#if (UPIO_DBG == TRUE)
-#define UPIODBG(param, ...) {ALOGD(param, ## __VA_ARGS__);}
-#else
-#define UPIODBG(param, ...) {}
-#endif
+#define UPIODBG(param, ...) VND_DBG(VND_TRACE_UPIO, param, ## __VA_ARGS__)
 
 /******************************************************************************
 **  Local type definitions
@@ -272,6 +265,8 @@ int upio_set_bluetooth_power(int on)
             break;
     }
 
+    VND_TRACE(TRC_UPIO_POWER, on, 0, 0);
+
     if (is_emulator_context())
     {
         /* if new value is same as current, return -1 */
@@ -351,6 +346,7 @@ void upio_set(uint8_t pio, uint8_t action, uint8_t polarity)
             }
 
             upio_state[UPIO_LPM_MODE] = action;
+            VND_TRACE(TRC_UPIO_LPM, action, 0, 0);
 
 #if (BT_WAKE_VIA_PROC == TRUE)
             fd = open(VENDOR_LPM_PROC_NODE, O_WRONLY);
@@ -433,6 +429,7 @@ void upio_set(uint8_t pio, uint8_t action, uint8_t polarity)
             }
 
             upio_state[UPIO_BT_WAKE] = action;
+            VND_TRACE(TRC_UPIO_BT_WAKE, action, 0, 0);
 
 #if (BT_WAKE_VIA_USERIAL_IOCTL == TRUE)
 
@@ -0,0 +1,687 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      userial_baud.c
+ *
+ *  Description:   Contains the automatic UART rate discovery
+ *
+ *                 The commands are written to the UART and their Command
+ *                 Complete read back here, with a timeout, since a rate the
+ *                 board does not carry shows as silence or garbage. Rates
+ *                 are tried upwards from the init rate, so that only the
+ *                 first one that fails leaves the controller out of reach;
+ *                 it is then power cycled back to the init rate.
+ *
+ *                 UART_BAUD_AUTO_CACHE holds one "<port> <line speed>" line
+ *                 per port probed, followed by the count of clean downloads
+ *                 since when the rate was moved down after a failure.
+ *
+ ******************************************************************************/
+
+#define LOG_TAG "bt_userial_baud"
+
+#include <utils/Log.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "bt_vendor.h"
+#include "fw_patch.h"
+#include "upio.h"
+#include "userial_baud.h"
+#include "userial_vendor.h"
+#include "vnd_trace.h"
+
+/******************************************************************************
+**  Constants & Macros
+******************************************************************************/
+
+#define HCI_VSC_UPDATE_BAUDRATE             0xFC18
+#define HCI_VSC_WRITE_UART_CLOCK_SETTING    0xFC45
+#define HCI_INTEL_RDSW_VERSION              0xFC05
+
+#define USERIAL_BAUD_H4_CMD     0x01
+#define USERIAL_BAUD_H4_EVT     0x04
+#define USERIAL_BAUD_CMD_CMPL   0x0E
+
+/* Rates above need the 48MHz UART clock */
+#define USERIAL_BAUD_24MHZ_MAX  3000000
+
+#define USERIAL_BAUD_PORT_MAX   256
+
+/******************************************************************************
+**  Local type definitions
+******************************************************************************/
+
+typedef struct
+{
+    char        port[USERIAL_BAUD_PORT_MAX];
+    uint32_t    line_speed;
+    int         clean;                  /* -1 if the rate was probed */
+} userial_baud_entry_t;
+
+/******************************************************************************
+**  Static variables
+******************************************************************************/
+
+static int userial_baud_auto = UART_BAUD_AUTO;
+
+/* Candidate rates, in increasing order */
+static const uint32_t userial_baud_rates[] = {
+    115200, 921600, 1000000, 1500000, 2000000, 3000000, 4000000
+};
+
+#define USERIAL_BAUD_RATES \
+    (int) (sizeof(userial_baud_rates) / sizeof(userial_baud_rates[0]))
+
+/* UartBaud of the last negotiation, a candidate too */
+static uint32_t userial_baud_conf;
+
+/*******************************************************************************
+**
+** Function        userial_baud_now_ms
+**
+** Description     Monotonic time
+**
+** Returns         Milliseconds
+**
+*******************************************************************************/
+static uint32_t userial_baud_now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*******************************************************************************
+**
+** Function        userial_baud_candidates
+**
+** Description     Candidate rates in increasing order: userial_baud_rates,
+**                 with the configured UartBaud merged in when it is not
+**                 one of them
+**
+** Returns         Number of rates in p_rates
+**
+*******************************************************************************/
+static int userial_baud_candidates(uint32_t *p_rates)
+{
+    int i, n = 0;
+
+    for (i = 0; i < USERIAL_BAUD_RATES; i++)
+    {
+        if ((userial_baud_conf > (n ? p_rates[n - 1] : 0)) &&
+            (userial_baud_conf < userial_baud_rates[i]))
+            p_rates[n++] = userial_baud_conf;
+        p_rates[n++] = userial_baud_rates[i];
+    }
+
+    if (userial_baud_conf > p_rates[n - 1])
+        p_rates[n++] = userial_baud_conf;
+
+    return n;
+}
+
+/*******************************************************************************
+**
+** Function        userial_baud_find
+**
+** Description     Index of line_speed in the candidate rates p_rates
+**
+** Returns         Index, -1 if not a candidate rate
+**
+*******************************************************************************/
+static int userial_baud_find(const uint32_t *p_rates, int n,
+                             uint32_t line_speed)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+    {
+        if (p_rates[i] == line_speed)
+            return i;
+    }
+
+    return -1;
+}
+
+/*******************************************************************************
+**
+** Function        userial_baud_cmd
+**
+** Description     Send an HCI command and wait for its Command Complete,
+**                 copying its return parameters, status first, to p_ret
+**
+** Returns         Length of the return parameters, -1 on timeout or when
+**                 something else than an event came back
+**
+*******************************************************************************/
+static int userial_baud_cmd(int fd, uint16_t opcode, const uint8_t *p_param,
+                            uint8_t len, uint8_t *p_ret, int max)
+{
+    uint8_t pkt[4 + 8];
+    uint8_t evt[3 + 255];
+    struct pollfd pfd;
+    uint32_t start;
+    int n = 0, need = 3, ret, elapsed;
+
+    pkt[0] = USERIAL_BAUD_H4_CMD;
+    pkt[1] = (uint8_t) opcode;
+    pkt[2] = (uint8_t) (opcode >> 8);
+    pkt[3] = len;
+    if (len > 0)
+        memcpy(pkt + 4, p_param, len);
+
+    if (write(fd, pkt, 4 + len) != 4 + len)
+        return -1;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    start = userial_baud_now_ms();
+
+    while ((elapsed = userial_baud_now_ms() - start) <
+           USERIAL_BAUD_PROBE_TIMEOUT_MS)
+    {
+        if (poll(&pfd, 1, USERIAL_BAUD_PROBE_TIMEOUT_MS - elapsed) <= 0)
+            continue;
+
+        if ((ret = read(fd, evt + n, need - n)) <= 0)
+        {
+            if ((ret < 0) && (errno != EINTR) && (errno != EAGAIN))
+                return -1;
+            continue;
+        }
+
+        n += ret;
+
+        if (evt[0] != USERIAL_BAUD_H4_EVT)
+            return -1;
+
+        if (n < need)
+            continue;
+
+        if (need == 3)
+        {
+            need = 3 + evt[2];
+            if (n < need)
+                continue;
+        }
+
+        if ((evt[1] == USERIAL_BAUD_CMD_CMPL) && (evt[2] >= 4) &&
+            ((evt[4] | (evt[5] << 8)) == opcode))
+        {
+            ret = evt[2] - 3;
+            if (ret > max)
+                ret = max;
+            memcpy(p_ret, evt + 6, ret);
+            return ret;
+        }
+
+        /* Not ours, wait for the next event */
+        n = 0;
+        need = 3;
+    }
+
+    return -1;
+}
+
+/*******************************************************************************
+**
+** Function        userial_baud_version
+**
+** Description     Read the RDSW version of the controller
+**
+** Returns         0 : Success
+**                 Otherwise : no valid answer
+**
+*******************************************************************************/
+static int userial_baud_version(int fd, uint8_t *p_key)
+{
+    uint8_t ret[1 + FW_PATCH_KEY_LEN];
+
+    if ((userial_baud_cmd(fd, HCI_INTEL_RDSW_VERSION, NULL, 0, ret,
+                          sizeof(ret)) != sizeof(ret)) || (ret[0] != 0))
+        return -1;
+
+    memcpy(p_key, ret + 1, FW_PATCH_KEY_LEN);
+
+    return 0;
+}
+
+/*******************************************************************************
+**
+** Function        userial_baud_check
+**
+** Description     Sanity exchange at the current rate: the controller has
+**                 to answer USERIAL_BAUD_PROBE_ROUNDS RDSW_VERSION commands
+**                 with the version read at the init rate, without any line
+**                 error seen by the host UART
+**
+** Returns         0 : the rate works
+**                 Otherwise : it does not
+**
+*******************************************************************************/
+static int userial_baud_check(int fd, const uint8_t *p_key)
+{
+    uint8_t key[FW_PATCH_KEY_LEN];
+    uint32_t errors, errors_after;
+    int icount, i;
+
+    icount = (userial_vendor_line_errors(&errors) == 0);
+
+    for (i = 0; i < USERIAL_BAUD_PROBE_ROUNDS; i++)
+    {
+        if ((userial_baud_version(fd, key) != 0) ||
+            (memcmp(key, p_key, FW_PATCH_KEY_LEN) != 0))
+            return -1;
+    }
+
+    if (icount && (userial_vendor_line_errors(&errors_after) == 0) &&
+        (errors_after != errors))
+    {
+        ALOGW("%u UART line errors", errors_after - errors);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*******************************************************************************
+**
+** Function        userial_baud_switch
+**
+** Description     Move the controller, then the host UART, to line_speed
+**
+** Returns         0 : Success
+**                 Otherwise : the controller did not take the command
+**
+*******************************************************************************/
+static int userial_baud_switch(int fd, uint32_t line_speed)
+{
+    uint8_t param[6];
+    uint8_t status;
+
+    param[0] = 0; /* encoded baud rate */
+    param[1] = 0; /* use encoded form */
+    param[2] = (uint8_t) line_speed;
+    param[3] = (uint8_t) (line_speed >> 8);
+    param[4] = (uint8_t) (line_speed >> 16);
+    param[5] = (uint8_t) (line_speed >> 24);
+
+    /* Answered at the old rate */
+    if ((userial_baud_cmd(fd, HCI_VSC_UPDATE_BAUDRATE, param, sizeof(param),
+                          &status, 1) != 1) || (status != 0))
+        return -1;
+
+    userial_vendor_set_line_speed(line_speed);
+    tcflush(fd, TCIFLUSH);
+
+    return 0;
+}
+
+/*******************************************************************************
+**
+** Function        userial_baud_power_cycle
+**
+** Description     Power cycle the controller lost at a rate it could not
+**                 keep, and wait for it at the init rate
+**
+** Returns         0 : Success
+**                 Otherwise : the controller did not come back
+**
+*******************************************************************************/
+static int userial_baud_power_cycle(int fd, const uint8_t *p_key)
+{
+    uint8_t key[FW_PATCH_KEY_LEN];
+    uint32_t start;
+
+    ALOGW("Power cycling the controller back to the init rate");
+
+    upio_set_bluetooth_power(UPIO_BT_POWER_OFF);
+    usleep(USERIAL_BAUD_POWER_OFF_MS * 1000);
+    userial_vendor_set_line_speed(userial_baud_rates[0]);
+    upio_set_bluetooth_power(UPIO_BT_POWER_ON);
+    tcflush(fd, TCIOFLUSH);
+
+    start = userial_baud_now_ms();
+    do
+    {
+        if ((userial_baud_version(fd, key) == 0) &&
+            (memcmp(key, p_key, FW_PATCH_KEY_LEN) == 0))
+            return 0;
+
+        tcflush(fd, TCIFLUSH);
+    } while (userial_baud_now_ms() - start < USERIAL_BAUD_BOOT_TIMEOUT_MS);
+
+    return -1;
+}
+
+/*******************************************************************************
+**
+** Function        userial_baud_cache_read
+**
+** Description     Load UART_BAUD_AUTO_CACHE into p_entries. Any rate in the
+**                 range of the candidates is taken: the host UART sets
+**                 rates without a TCIO constant through termios2
+**
+** Returns         Number of entries
+**
+*******************************************************************************/
+static int userial_baud_cache_read(userial_baud_entry_t *p_entries)
+{
+    char line[USERIAL_BAUD_PORT_MAX + 16];
+    FILE *fp;
+    int n = 0;
+
+    if ((fp = fopen(UART_BAUD_AUTO_CACHE, "r")) == NULL)
+        return 0;
+
+    while ((n < USERIAL_BAUD_CACHE_PORTS) &&
+           (fgets(line, sizeof(line), fp) != NULL))
+    {
+        p_entries[n].clean = -1;
+        if ((sscanf(line, "%255s %u %d", p_entries[n].port,
+                    &p_entries[n].line_speed, &p_entries[n].clean) >= 2) &&
+            (p_entries[n].line_speed >= userial_baud_rates[0]) &&
+            (p_entries[n].line_speed <= UART_BAUD_AUTO_MAX))
+            n++;
+    }
+
+    fclose(fp);
+
+    return n;
+}
+
+/*******************************************************************************
+**
+** Function        userial_baud_cache_get
+**
+** Description     Entry kept for the port p_port
+**
+** Returns         0 : Success
+**                 Otherwise : the port was not probed
+**
+*******************************************************************************/
+static int userial_baud_cache_get(const char *p_port,
+                                  userial_baud_entry_t *p_entry)
+{
+    userial_baud_entry_t entries[USERIAL_BAUD_CACHE_PORTS];
+    int n = userial_baud_cache_read(entries);
+    int i;
+
+    for (i = 0; i < n; i++)
+    {
+        if (strcmp(entries[i].port, p_port) == 0)
+        {
+            *p_entry = entries[i];
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+/*******************************************************************************
+**
+** Function        userial_baud_cache_put
+**
+** Description     Keep line_speed and the count of clean downloads for the
+**                 port p_port, or forget the port if line_speed is 0,
+**                 replacing the file as a whole
+**
+** Returns         None
+**
+*******************************************************************************/
+static void userial_baud_cache_put(const char *p_port, uint32_t line_speed,
+                                   int clean)
+{
+    userial_baud_entry_t entries[USERIAL_BAUD_CACHE_PORTS];
+    char tmp[USERIAL_BAUD_PORT_MAX];
+    FILE *fp;
+    int n = userial_baud_cache_read(entries);
+    int i;
+
+    for (i = 0; (i < n) && (strcmp(entries[i].port, p_port) != 0); i++)
+        ;
+
+    /* Full, the oldest port gives way */
+    if (i == USERIAL_BAUD_CACHE_PORTS)
+    {
+        memmove(entries, entries + 1, (--n) * sizeof(userial_baud_entry_t));
+        i = n;
+    }
+
+    if (line_speed == 0)
+    {
+        if (i == n)
+            return;
+        memmove(entries + i, entries + i + 1,
+                (--n - i) * sizeof(userial_baud_entry_t));
+    }
+    else
+    {
+        if (i == n)
+        {
+            snprintf(entries[i].port, sizeof(entries[i].port), "%s", p_port);
+            n++;
+        }
+        entries[i].line_speed = line_speed;
+        entries[i].clean = clean;
+    }
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", UART_BAUD_AUTO_CACHE);
+
+    if ((fp = fopen(tmp, "w")) == NULL)
+    {
+        ALOGW("Can not write %s: %s", tmp, strerror(errno));
+        return;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        if (entries[i].clean < 0)
+            fprintf(fp, "%s %u\n", entries[i].port, entries[i].line_speed);
+        else
+            fprintf(fp, "%s %u %d\n", entries[i].port, entries[i].line_speed,
+                entries[i].clean);
+    }
+
+    if ((fclose(fp) != 0) || (rename(tmp, UART_BAUD_AUTO_CACHE) != 0))
+    {
+        ALOGW("Can not write %s: %s", UART_BAUD_AUTO_CACHE, strerror(errno));
+        unlink(tmp);
+    }
+}
+
+/*******************************************************************************
+**
+** Function        userial_baud_negotiate
+**
+** Description     Find the download rate of the port open on fd, by probing
+**                 the controller, or from UART_BAUD_AUTO_CACHE if the port
+**                 was probed before. The configured rate conf_baud is
+**                 probed along with the fixed candidates. The controller
+**                 and the host UART are left at init_baud.
+**
+** Returns         Line speed to download at, 0 if UART_BAUD_AUTO is off
+**
+*******************************************************************************/
+uint32_t userial_baud_negotiate(int fd, uint32_t init_baud, uint32_t conf_baud)
+{
+    const char *p_port = userial_vendor_port_name();
+    uint32_t rates[USERIAL_BAUD_RATES + 1];
+    userial_baud_entry_t entry;
+    uint8_t key[FW_PATCH_KEY_LEN];
+    uint8_t clock = 1; /* (1,"UART CLOCK 48 MHz")(2,"UART CLOCK 24 MHz") */
+    uint8_t status;
+    uint32_t line_speed, start;
+    int n, idx, cur, lost = FALSE;
+
+    if (userial_baud_auto == FALSE)
+        return 0;
+
+    userial_baud_conf = conf_baud;
+    n = userial_baud_candidates(rates);
+
+    if (userial_baud_cache_get(p_port, &entry) == 0)
+    {
+        ALOGI("UART %s: %u baud", p_port, entry.line_speed);
+        return entry.line_speed;
+    }
+
+    start = userial_baud_now_ms();
+
+    if (((cur = userial_baud_find(rates, n, init_baud)) < 0) ||
+        (userial_baud_version(fd, key) != 0))
+    {
+        ALOGE("UART %s: no controller at %u baud, rate not probed", p_port,
+            init_baud);
+        return init_baud;
+    }
+
+    for (idx = cur + 1; idx < n; idx++)
+    {
+        line_speed = rates[idx];
+        if (line_speed > UART_BAUD_AUTO_MAX)
+            break;
+
+        if ((line_speed > USERIAL_BAUD_24MHZ_MAX) &&
+            (rates[idx - 1] <= USERIAL_BAUD_24MHZ_MAX))
+        {
+            if ((userial_baud_cmd(fd, HCI_VSC_WRITE_UART_CLOCK_SETTING, &clock,
+                                  1, &status, 1) != 1) || (status != 0))
+                break;
+        }
+
+        /* Without an answer the controller may have switched already */
+        lost = ((userial_baud_switch(fd, line_speed) != 0) ||
+                (userial_baud_check(fd, key) != 0));
+
+        VND_TRACE(TRC_USERIAL_BAUD_PROBE, line_speed, !lost, 0);
+        ALOGI("UART %s: %u baud %s", p_port, line_speed,
+            lost ? "failed" : "passed");
+
+        if (lost)
+            break;
+
+        cur = idx;
+    }
+
+    /* Back to the init rate for the firmware configuration */
+    if ((lost == FALSE) && (rates[cur] != init_baud))
+    {
+        lost = ((userial_baud_switch(fd, init_baud) != 0) ||
+                (userial_baud_check(fd, key) != 0));
+    }
+
+    if (lost && (userial_baud_power_cycle(fd, key) != 0))
+    {
+        /* The next enable probes again */
+        ALOGE("UART %s: controller lost during the rate probe", p_port);
+        return init_baud;
+    }
+
+    line_speed = rates[cur];
+    userial_baud_cache_put(p_port, line_speed, -1);
+
+    ALOGI("UART %s: %u baud, probed in %u ms", p_port, line_speed,
+        userial_baud_now_ms() - start);
+
+    return line_speed;
+}
+
+/*******************************************************************************
+**
+** Function        userial_baud_report
+**
+** Description     Outcome of a download at the rate baud found by
+**                 userial_baud_negotiate. A failure moves the port to the
+**                 next candidate rate below for the next enable; after UART_BAUD_AUTO_REPROBE
+**                 clean downloads at a rate moved down, the port is probed
+**                 again on the next enable.
+**
+** Returns         None
+**
+*******************************************************************************/
+void userial_baud_report(uint32_t baud, uint8_t ok)
+{
+    const char *p_port = userial_vendor_port_name();
+    uint32_t rates[USERIAL_BAUD_RATES + 1];
+    userial_baud_entry_t entry;
+    int idx;
+
+    if ((userial_baud_auto == FALSE) ||
+        (userial_baud_cache_get(p_port, &entry) != 0) ||
+        (entry.line_speed != baud))
+        return;
+
+    if (ok == TRUE)
+    {
+        /* A probed rate is the highest the board passed */
+        if ((entry.clean < 0) || (UART_BAUD_AUTO_REPROBE == 0))
+            return;
+
+        if (++entry.clean < UART_BAUD_AUTO_REPROBE)
+        {
+            userial_baud_cache_put(p_port, baud, entry.clean);
+            return;
+        }
+
+        ALOGI("UART %s: %d clean downloads at %u baud, probing again",
+            p_port, entry.clean, baud);
+        userial_baud_cache_put(p_port, 0, 0);
+        return;
+    }
+
+    /* Highest candidate below, baud may be a rate only the cache knows */
+    idx = userial_baud_candidates(rates);
+    while ((idx > 0) && (rates[idx - 1] >= baud))
+        idx--;
+
+    if (idx == 0)
+        return;
+
+    ALOGW("UART %s: download failed at %u baud, %u baud from now on", p_port,
+        baud, rates[idx - 1]);
+
+    userial_baud_cache_put(p_port, rates[idx - 1], 0);
+}
+
+/*******************************************************************************
+**
+** Function        userial_baud_set_auto
+**
+** Description     Conf entry setter of UART_BAUD_AUTO
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+int userial_baud_set_auto(char *p_conf_name, char *p_conf_value, int param)
+{
+    userial_baud_auto = (atoi(p_conf_value) != 0) ? TRUE : FALSE;
+
+    return 0;
+}
@@ -0,0 +1,617 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      userial_demux.c
+ *
+ *  Description:   Contains the H4 demultiplexer of the UART
+ *
+ *                 One thread polls the UART, the channel sockets and a stop
+ *                 pipe. Bytes from the UART are cut into H4 packets and
+ *                 written, without their indicator, to the CH_EVT or
+ *                 CH_ACL_IN socket. Bytes from the CH_CMD and CH_ACL_OUT
+ *                 sockets are read up to the end of one packet per channel;
+ *                 a complete packet stops the reads of its channel until it
+ *                 has been written to the UART, so the stack is held back
+ *                 by the socket buffers rather than by the UART.
+ *
+ ******************************************************************************/
+
+#define LOG_TAG "bt_userial_demux"
+
+#include <utils/Log.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include "bt_vendor.h"
+#include "userial_demux.h"
+
+/******************************************************************************
+**  Constants & Macros
+******************************************************************************/
+
+#define DEMUX_H4_CMD            0x01
+#define DEMUX_H4_ACL            0x02
+#define DEMUX_H4_SCO            0x03
+#define DEMUX_H4_EVT            0x04
+
+/* Indicator, ACL header and the largest ACL payload */
+#define DEMUX_PKT_MAX           (1 + 4 + 0xFFFF)
+
+#define DEMUX_RX_CHUNK          1024
+
+/* Polling while the driver queue is above the backlog, and while the
+ * stack does not read */
+#define DEMUX_BACKLOG_POLL_MS   1
+#define DEMUX_SEND_POLL_MS      100
+
+/* Channels towards the controller, in priority order */
+enum {
+    DEMUX_TX_CMD,
+    DEMUX_TX_ACL,
+    DEMUX_TX_MAX
+};
+
+/******************************************************************************
+**  Local type definitions
+******************************************************************************/
+
+typedef struct
+{
+    uint32_t    len;                    /* bytes held, indicator included */
+    uint8_t     buf[DEMUX_PKT_MAX];
+} demux_pkt_t;
+
+typedef struct
+{
+    pthread_t   thread;
+    uint8_t     running;
+    int         uart_fd;
+    int         stop_fd[2];             /* pipe, written to stop the thread */
+    int         stack_fds[CH_MAX];      /* channel ends of the stack */
+    int         fds[CH_MAX];            /* channel ends of the thread */
+    demux_pkt_t *p_rx;                  /* from the UART */
+    demux_pkt_t *p_tx;                  /* DEMUX_TX_MAX, from the stack */
+    int         tx_cur;                 /* being written, -1 if none */
+    uint32_t    tx_off;
+    uint32_t    rx_pkts;
+    uint32_t    tx_pkts[DEMUX_TX_MAX];
+    uint32_t    dropped;                /* bytes out of sync */
+    uint32_t    sco_pkts;               /* no channel to the stack */
+} userial_demux_cb_t;
+
+/******************************************************************************
+**  Static variables
+******************************************************************************/
+
+static int userial_demux = UART_DEMUX;
+
+static userial_demux_cb_t demux_cb;
+
+/* Channel and H4 indicator of each DEMUX_TX_xxx */
+static const uint8_t demux_tx_ch[DEMUX_TX_MAX] = { CH_CMD, CH_ACL_OUT };
+static const uint8_t demux_tx_h4[DEMUX_TX_MAX] = { DEMUX_H4_CMD,
+                                                   DEMUX_H4_ACL };
+
+/*******************************************************************************
+**
+** Function        demux_pkt_need
+**
+** Description     Length of the packet being assembled, as far as its
+**                 header tells
+**
+** Returns         Bytes, indicator included
+**
+*******************************************************************************/
+static uint32_t demux_pkt_need(const demux_pkt_t *p_pkt)
+{
+    uint32_t hdr;
+
+    switch (p_pkt->buf[0])
+    {
+        case DEMUX_H4_CMD:                  /* opcode (2), length */
+        case DEMUX_H4_SCO:                  /* handle (2), length */
+            hdr = 3;
+            break;
+
+        case DEMUX_H4_EVT:                  /* code, length */
+            hdr = 2;
+            break;
+
+        default:                            /* handle (2), length (2) */
+            hdr = 4;
+            break;
+    }
+
+    if (p_pkt->len < 1 + hdr)
+        return 1 + hdr;
+
+    if (p_pkt->buf[0] == DEMUX_H4_ACL)
+        return 1 + hdr + (p_pkt->buf[3] | (p_pkt->buf[4] << 8));
+
+    return 1 + hdr + p_pkt->buf[hdr];
+}
+
+/*******************************************************************************
+**
+** Function        demux_pkt_ready
+**
+** Description     Check whether a packet from the stack is complete
+**
+** Returns         TRUE/FALSE
+**
+*******************************************************************************/
+static uint8_t demux_pkt_ready(const demux_pkt_t *p_pkt)
+{
+    return (p_pkt->len == demux_pkt_need(p_pkt)) ? TRUE : FALSE;
+}
+
+/*******************************************************************************
+**
+** Function        demux_send
+**
+** Description     Write a whole packet to a channel socket, waiting for the
+**                 stack to read if its buffer is full
+**
+** Returns         0 : Success
+**                 Otherwise : channel closed, or the demultiplexer stopped
+**
+*******************************************************************************/
+static int demux_send(int fd, const uint8_t *p_data, uint32_t len)
+{
+    struct pollfd pfds[2];
+    ssize_t n;
+
+    pfds[0].fd = fd;
+    pfds[0].events = POLLOUT;
+    pfds[1].fd = demux_cb.stop_fd[0];
+    pfds[1].events = POLLIN;
+
+    while (len > 0)
+    {
+        if ((n = send(fd, p_data, len, MSG_NOSIGNAL)) > 0)
+        {
+            p_data += n;
+            len -= n;
+            continue;
+        }
+
+        if ((n < 0) && (errno != EAGAIN) && (errno != EINTR))
+            return -1;
+
+        if ((poll(pfds, 2, DEMUX_SEND_POLL_MS) > 0) && (pfds[1].revents != 0))
+            return -1;
+    }
+
+    return 0;
+}
+
+/*******************************************************************************
+**
+** Function        demux_rx
+**
+** Description     Cut the bytes read from the UART into H4 packets and hand
+**                 them to their channel
+**
+** Returns         0 : Success
+**                 Otherwise : a channel is gone
+**
+*******************************************************************************/
+static int demux_rx(const uint8_t *p_data, int len)
+{
+    demux_pkt_t *p_rx = demux_cb.p_rx;
+    uint32_t n;
+    int ret = 0;
+
+    while ((len > 0) && (ret == 0))
+    {
+        if (p_rx->len == 0)
+        {
+            if ((*p_data == DEMUX_H4_EVT) || (*p_data == DEMUX_H4_ACL) ||
+                (*p_data == DEMUX_H4_SCO))
+                p_rx->buf[p_rx->len++] = *p_data;
+            else
+                demux_cb.dropped++;     /* resync on the next indicator */
+
+            p_data++;
+            len--;
+            continue;
+        }
+
+        n = demux_pkt_need(p_rx) - p_rx->len;
+        if (n > (uint32_t) len)
+            n = len;
+
+        memcpy(p_rx->buf + p_rx->len, p_data, n);
+        p_rx->len += n;
+        p_data += n;
+        len -= n;
+
+        if (p_rx->len < demux_pkt_need(p_rx))
+            continue;
+
+        demux_cb.rx_pkts++;
+
+        if (p_rx->buf[0] == DEMUX_H4_EVT)
+            ret = demux_send(demux_cb.fds[CH_EVT], p_rx->buf + 1,
+                             p_rx->len - 1);
+        else if (p_rx->buf[0] == DEMUX_H4_ACL)
+            ret = demux_send(demux_cb.fds[CH_ACL_IN], p_rx->buf + 1,
+                             p_rx->len - 1);
+        else if (demux_cb.sco_pkts++ == 0)
+            ALOGE("SCO packet on the UART, the stack has no SCO channel");
+
+        p_rx->len = 0;
+    }
+
+    return ret;
+}
+
+/*******************************************************************************
+**
+** Function        demux_tx_read
+**
+** Description     Read from a channel socket, up to the end of its packet
+**
+** Returns         0 : Success
+**                 Otherwise : the stack closed the channel
+**
+*******************************************************************************/
+static int demux_tx_read(int tx)
+{
+    demux_pkt_t *p_tx = &demux_cb.p_tx[tx];
+    ssize_t n;
+
+    n = read(demux_cb.fds[demux_tx_ch[tx]], p_tx->buf + p_tx->len,
+             demux_pkt_need(p_tx) - p_tx->len);
+
+    if (n > 0)
+        p_tx->len += n;
+    else if ((n == 0) || ((errno != EAGAIN) && (errno != EINTR)))
+        return -1;
+
+    return 0;
+}
+
+/*******************************************************************************
+**
+** Function        demux_tx_next
+**
+** Description     Pick the packet to write to the UART, the complete one of
+**                 the highest priority, once the driver queue is down to
+**                 UART_DEMUX_TX_BACKLOG bytes
+**
+** Returns         Time to wait for the driver queue to drain, in ms, -1 if
+**                 there is no need to
+**
+*******************************************************************************/
+static int demux_tx_next(void)
+{
+    int tx, outq;
+
+    if (demux_cb.tx_cur >= 0)
+        return -1;
+
+    for (tx = 0; tx < DEMUX_TX_MAX; tx++)
+    {
+        if (demux_pkt_ready(&demux_cb.p_tx[tx]) == TRUE)
+            break;
+    }
+
+    if (tx == DEMUX_TX_MAX)
+        return -1;
+
+    if ((ioctl(demux_cb.uart_fd, TIOCOUTQ, &outq) == 0) &&
+        (outq > UART_DEMUX_TX_BACKLOG))
+        return DEMUX_BACKLOG_POLL_MS;
+
+    demux_cb.tx_cur = tx;
+    demux_cb.tx_off = 0;
+
+    return -1;
+}
+
+/*******************************************************************************
+**
+** Function        demux_tx_write
+**
+** Description     Write the current packet to the UART
+**
+** Returns         0 : Success
+**                 Otherwise : UART error
+**
+*******************************************************************************/
+static int demux_tx_write(void)
+{
+    demux_pkt_t *p_tx = &demux_cb.p_tx[demux_cb.tx_cur];
+    ssize_t n;
+
+    n = write(demux_cb.uart_fd, p_tx->buf + demux_cb.tx_off,
+              p_tx->len - demux_cb.tx_off);
+
+    if (n < 0)
+        return ((errno == EAGAIN) || (errno == EINTR)) ? 0 : -1;
+
+    demux_cb.tx_off += n;
+
+    if (demux_cb.tx_off == p_tx->len)
+    {
+        demux_cb.tx_pkts[demux_cb.tx_cur]++;
+        p_tx->len = 1;                  /* indicator kept */
+        demux_cb.tx_cur = -1;
+    }
+
+    return 0;
+}
+
+/*******************************************************************************
+**
+** Function        demux_thread
+**
+** Description     Demultiplexer, runs until the stop pipe is written or an
+**                 end goes away
+**
+** Returns         None
+**
+*******************************************************************************/
+static void *demux_thread(void *p_arg)
+{
+    struct pollfd pfds[2 + DEMUX_TX_MAX];
+    uint8_t buf[DEMUX_RX_CHUNK];
+    int tx, timeout, ret = 0;
+    ssize_t n;
+
+    (void) p_arg;
+
+    pfds[0].fd = demux_cb.stop_fd[0];
+    pfds[0].events = POLLIN;
+    pfds[1].fd = demux_cb.uart_fd;
+
+    while (ret == 0)
+    {
+        timeout = demux_tx_next();
+
+        pfds[1].events = POLLIN | ((demux_cb.tx_cur >= 0) ? POLLOUT : 0);
+
+        /* A channel holding a complete packet is not read further */
+        for (tx = 0; tx < DEMUX_TX_MAX; tx++)
+        {
+            pfds[2 + tx].fd = (demux_pkt_ready(&demux_cb.p_tx[tx]) == TRUE) ?
+                -1 : demux_cb.fds[demux_tx_ch[tx]];
+            pfds[2 + tx].events = POLLIN;
+        }
+
+        if (poll(pfds, 2 + DEMUX_TX_MAX, timeout) < 0)
+        {
+            ret = (errno == EINTR) ? 0 : -1;
+            continue;
+        }
+
+        if (pfds[0].revents != 0)
+            break;
+
+        if (pfds[1].revents & POLLIN)
+        {
+            if ((n = read(demux_cb.uart_fd, buf, sizeof(buf))) > 0)
+                ret = demux_rx(buf, n);
+            else if ((n == 0) || ((errno != EAGAIN) && (errno != EINTR)))
+                ret = -1;
+        }
+        else if (pfds[1].revents & (POLLERR | POLLHUP))
+        {
+            ret = -1;
+        }
+
+        if ((ret == 0) && (pfds[1].revents & POLLOUT) &&
+            (demux_cb.tx_cur >= 0))
+            ret = demux_tx_write();
+
+        for (tx = 0; (tx < DEMUX_TX_MAX) && (ret == 0); tx++)
+        {
+            if (pfds[2 + tx].revents != 0)
+                ret = demux_tx_read(tx);
+        }
+    }
+
+    if (ret != 0)
+        ALOGE("HCI demultiplexer stopped: %s", strerror(errno));
+
+    return NULL;
+}
+
+/*******************************************************************************
+**
+** Function        demux_release
+**
+** Description     Close the channel sockets and the stop pipe
+**
+** Returns         None
+**
+*******************************************************************************/
+static void demux_release(void)
+{
+    int ch;
+
+    for (ch = 0; ch < CH_MAX; ch++)
+    {
+        if (demux_cb.stack_fds[ch] >= 0)
+            close(demux_cb.stack_fds[ch]);
+        if (demux_cb.fds[ch] >= 0)
+            close(demux_cb.fds[ch]);
+        demux_cb.stack_fds[ch] = -1;
+        demux_cb.fds[ch] = -1;
+    }
+
+    if (demux_cb.stop_fd[0] >= 0)
+        close(demux_cb.stop_fd[0]);
+    if (demux_cb.stop_fd[1] >= 0)
+        close(demux_cb.stop_fd[1]);
+    demux_cb.stop_fd[0] = -1;
+    demux_cb.stop_fd[1] = -1;
+
+    free(demux_cb.p_rx);
+    demux_cb.p_rx = NULL;
+    demux_cb.p_tx = NULL;
+}
+
+/*****************************************************************************
+**   Userial Demux API Functions
+*****************************************************************************/
+
+/*******************************************************************************
+**
+** Function        userial_demux_open
+**
+** Description     Start the demultiplexer on the UART fd, when UART_DEMUX is
+**                 set, and fill p_fds (CH_MAX entries) with the sockets of
+**                 the HCI channels. Not started when SCO is routed to the
+**                 transport, the channels of the stack carry no SCO.
+**
+** Returns         Number of fds of HCI channels, 0 if the demultiplexer is
+**                 off or could not start
+**
+*******************************************************************************/
+int userial_demux_open(int fd, int *p_fds)
+{
+    int pair[2], ch, tx, ok;
+
+    if ((userial_demux == FALSE) || (demux_cb.running == TRUE))
+        return 0;
+
+    /* The channels of the stack carry no SCO; keep the UART fd for all of
+     * them rather than lose the audio */
+    if (SCO_PCM_ROUTING == 1)
+    {
+        ALOGE("HCI demultiplexer off: SCO is routed to the transport");
+        return 0;
+    }
+
+    memset(&demux_cb, 0, sizeof(demux_cb));
+    demux_cb.uart_fd = fd;
+    demux_cb.tx_cur = -1;
+    for (ch = 0; ch < CH_MAX; ch++)
+    {
+        demux_cb.stack_fds[ch] = -1;
+        demux_cb.fds[ch] = -1;
+    }
+
+    ok = ((demux_cb.p_rx = (demux_pkt_t *) malloc((1 + DEMUX_TX_MAX) *
+                                                  sizeof(demux_pkt_t)))
+          != NULL);
+    if (pipe(demux_cb.stop_fd) < 0)
+    {
+        demux_cb.stop_fd[0] = -1;
+        demux_cb.stop_fd[1] = -1;
+        ok = FALSE;
+    }
+
+    for (ch = 0; (ch < CH_MAX) && ok; ch++)
+    {
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) < 0)
+        {
+            ok = FALSE;
+            break;
+        }
+
+        demux_cb.stack_fds[ch] = pair[0];
+        demux_cb.fds[ch] = pair[1];
+        fcntl(pair[1], F_SETFL, fcntl(pair[1], F_GETFL) | O_NONBLOCK);
+    }
+
+    if (ok)
+    {
+        demux_cb.p_rx->len = 0;
+        demux_cb.p_tx = demux_cb.p_rx + 1;
+        for (tx = 0; tx < DEMUX_TX_MAX; tx++)
+        {
+            demux_cb.p_tx[tx].buf[0] = demux_tx_h4[tx];
+            demux_cb.p_tx[tx].len = 1;
+        }
+
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+        ok = (pthread_create(&demux_cb.thread, NULL, demux_thread, NULL) == 0);
+    }
+
+    if (!ok)
+    {
+        ALOGE("HCI demultiplexer can not start: %s", strerror(errno));
+        demux_release();
+        return 0;
+    }
+
+    demux_cb.running = TRUE;
+    memcpy(p_fds, demux_cb.stack_fds, sizeof(demux_cb.stack_fds));
+
+    ALOGI("HCI demultiplexer on fd %d", fd);
+
+    return CH_MAX;
+}
+
+/*******************************************************************************
+**
+** Function        userial_demux_close
+**
+** Description     Stop the demultiplexer and close the channel sockets,
+**                 before the UART is closed
+**
+** Returns         None
+**
+*******************************************************************************/
+void userial_demux_close(void)
+{
+    if (demux_cb.running == FALSE)
+        return;
+
+    if (write(demux_cb.stop_fd[1], "", 1) != 1)
+        ALOGE("HCI demultiplexer stop: %s", strerror(errno));
+
+    pthread_join(demux_cb.thread, NULL);
+    demux_cb.running = FALSE;
+
+    ALOGI("HCI demultiplexer: %u packets in, %u commands and %u ACL out, "
+          "%u bytes and %u SCO dropped", demux_cb.rx_pkts,
+          demux_cb.tx_pkts[DEMUX_TX_CMD], demux_cb.tx_pkts[DEMUX_TX_ACL],
+          demux_cb.dropped, demux_cb.sco_pkts);
+
+    demux_release();
+}
+
+/*******************************************************************************
+**
+** Function        userial_demux_set
+**
+** Description     Conf entry setter of UART_DEMUX
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+int userial_demux_set(char *p_conf_name, char *p_conf_value, int param)
+{
+    userial_demux = (atoi(p_conf_value) != 0) ? TRUE : FALSE;
+
+    return 0;
+}
@@ -33,23 +33,23 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
 #include "bt_vendor.h"
 #include "userial.h"
 #include "userial_vendor.h"
+#include "userial_termios2.h"
+#include "vnd_trace.h"
 
 /******************************************************************************
 **  Constants & Macros
 ******************************************************************************/
 
-#ifndef VNDUSERIAL_DBG
-#define VNDUSERIAL_DBG FALSE
-#endif
-
-#if (VNDUSERIAL_DBG == TRUE)
-#define VNDUSERIALDBG(param, ...) {ALOGD(param, ## __VA_ARGS__);}
-#else
-#define VNDUSERIALDBG(param, ...) {}
-#endif
+#define VNDUSERIALDBG(param, ...) \
+    VND_DBG(VND_TRACE_USERIAL, param, ## __VA_ARGS__)
 
 #define VND_PORT_NAME_MAXLEN    256
 
@@ -62,19 +62,84 @@ typedef struct
 {
     int fd;                     /* fd to Bluetooth device */
     struct termios termios;     /* serial terminal of BT port */
+    uint32_t line_speed;        /* current baud rate */
     char port_name[VND_PORT_NAME_MAXLEN];
 } vnd_userial_cb_t;
 
+/* line speed with a TCIO Bxxx constant */
+typedef struct
+{
+    uint32_t line_speed;
+    uint32_t tcio_baud;
+} userial_tcio_baud_t;
+
 /******************************************************************************
 **  Static variables
 ******************************************************************************/
 
 static vnd_userial_cb_t vnd_userial;
 
+static uint8_t userial_flow_control = UART_FLOW_CONTROL;
+static uint8_t userial_latency_profile = UART_LATENCY_PROFILE;
+
+static const userial_tcio_baud_t userial_tcio_bauds[] =
+{
+    {300, B300},            {600, B600},            {1200, B1200},
+    {2400, B2400},          {9600, B9600},          {19200, B19200},
+    {38400, B38400},        {57600, B57600},        {115200, B115200},
+    {230400, B230400},      {460800, B460800},      {500000, B500000},
+    {576000, B576000},      {921600, B921600},      {1000000, B1000000},
+    {1152000, B1152000},    {1500000, B1500000},    {2000000, B2000000},
+    {2500000, B2500000},    {3000000, B3000000},    {3500000, B3500000},
+    {4000000, B4000000}
+};
+
+#define USERIAL_TCIO_BAUDS \
+    (sizeof(userial_tcio_bauds) / sizeof(userial_tcio_bauds[0]))
+
+/* line speed of the USERIAL_BAUD_xxx symbols */
+static const uint32_t userial_line_speeds[USERIAL_BAUD_AUTO] =
+{
+    300, 600, 1200, 2400, 9600, 19200, 57600, 115200, 230400, 460800,
+    921600, 1000000, 1500000, 2000000, 3000000, 4000000
+};
+
 /*****************************************************************************
 **   Helper Functions
 *****************************************************************************/
 
+/*******************************************************************************
+**
+** Function        userial_tcio_baud_near
+**
+** Description     helper function finds the TCIO baud rate closest to a
+**                  line speed
+**
+** Returns         table entry, of line_speed itself if it has a constant
+**
+*******************************************************************************/
+static const userial_tcio_baud_t *userial_tcio_baud_near(uint32_t line_speed)
+{
+    const userial_tcio_baud_t *p_near = &userial_tcio_bauds[0];
+    uint32_t diff, near_diff = UINT32_MAX;
+    unsigned int i;
+
+    for (i = 0; i < USERIAL_TCIO_BAUDS; i++)
+    {
+        diff = (userial_tcio_bauds[i].line_speed > line_speed) ?
+            (userial_tcio_bauds[i].line_speed - line_speed) :
+            (line_speed - userial_tcio_bauds[i].line_speed);
+
+        if (diff < near_diff)
+        {
+            p_near = &userial_tcio_bauds[i];
+            near_diff = diff;
+        }
+    }
+
+    return p_near;
+}
+
 /*******************************************************************************
 **
 ** Function        userial_to_tcio_baud
@@ -87,40 +152,108 @@ static vnd_userial_cb_t vnd_userial;
 *******************************************************************************/
 uint8_t userial_to_tcio_baud(uint8_t cfg_baud, uint32_t *baud)
 {
-    if (cfg_baud == USERIAL_BAUD_115200)
-        *baud = B115200;
-    else if (cfg_baud == USERIAL_BAUD_4M)
-        *baud = B4000000;
-    else if (cfg_baud == USERIAL_BAUD_3M)
-        *baud = B3000000;
-    else if (cfg_baud == USERIAL_BAUD_2M)
-        *baud = B2000000;
-    else if (cfg_baud == USERIAL_BAUD_1M)
-        *baud = B1000000;
-    else if (cfg_baud == USERIAL_BAUD_921600)
-        *baud = B921600;
-    else if (cfg_baud == USERIAL_BAUD_460800)
-        *baud = B460800;
-    else if (cfg_baud == USERIAL_BAUD_230400)
-        *baud = B230400;
-    else if (cfg_baud == USERIAL_BAUD_57600)
-        *baud = B57600;
-    else if (cfg_baud == USERIAL_BAUD_19200)
-        *baud = B19200;
-    else if (cfg_baud == USERIAL_BAUD_9600)
-        *baud = B9600;
-    else if (cfg_baud == USERIAL_BAUD_1200)
-        *baud = B1200;
-    else if (cfg_baud == USERIAL_BAUD_600)
-        *baud = B600;
-    else
+    const userial_tcio_baud_t *p_tcio;
+
+    if (cfg_baud < USERIAL_BAUD_AUTO)
+    {
+        p_tcio = userial_tcio_baud_near(userial_line_speeds[cfg_baud]);
+        if (p_tcio->line_speed == userial_line_speeds[cfg_baud])
+        {
+            *baud = p_tcio->tcio_baud;
+            return TRUE;
+        }
+    }
+
+    ALOGE( "userial vendor open: unsupported baud idx %i", cfg_baud);
+    *baud = B115200;
+    return FALSE;
+}
+
+/*******************************************************************************
+**
+** Function        userial_set_termios2
+**
+** Description     helper function sets a line speed that has no TCIO
+**                  constant, as an integer through termios2 and BOTHER, along
+**                  with the rest of the terminal settings. The driver rounds
+**                  it to what its clock divisors can make.
+**
+** Returns         0 : Success
+**                 Otherwise : Fail, not supported by the driver
+**
+*******************************************************************************/
+static int userial_set_termios2(uint32_t line_speed)
+{
+    userial_termios2_t ti;
+
+    memset(&ti, 0, sizeof(ti));
+    ti.c_iflag = vnd_userial.termios.c_iflag;
+    ti.c_oflag = vnd_userial.termios.c_oflag;
+    ti.c_cflag = vnd_userial.termios.c_cflag;
+    ti.c_lflag = vnd_userial.termios.c_lflag;
+    ti.c_line = vnd_userial.termios.c_line;
+    memcpy(ti.c_cc, vnd_userial.termios.c_cc, USERIAL_TERMIOS2_NCCS);
+
+    ti.c_cflag &= ~CBAUD;
+    ti.c_cflag |= BOTHER;
+    ti.c_ispeed = line_speed;
+    ti.c_ospeed = line_speed;
+
+    if ((ioctl(vnd_userial.fd, USERIAL_TCSETS2, &ti) < 0) ||
+        (ioctl(vnd_userial.fd, USERIAL_TCGETS2, &ti) < 0))
+        return -1;
+
+    if (ti.c_ospeed != line_speed)
+        ALOGW("userial vendor: speed %u set as %u", line_speed, ti.c_ospeed);
+
+    return 0;
+}
+
+/*******************************************************************************
+**
+** Function        userial_now_us
+**
+** Description     helper function reads the monotonic clock
+**
+** Returns         microseconds
+**
+*******************************************************************************/
+static uint32_t userial_now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t) (ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+/*******************************************************************************
+**
+** Function        userial_set_low_latency
+**
+** Description     helper function asks the driver for ASYNC_LOW_LATENCY, and
+**                 the UART_XMIT_FIFO_SIZE transmit FIFO. Drivers without
+**                 serial settings (USB, pty) are left as they are.
+**
+** Returns         None
+**
+*******************************************************************************/
+static void userial_set_low_latency(int fd)
+{
+    struct serial_struct ss;
+
+    if (ioctl(fd, TIOCGSERIAL, &ss) < 0)
     {
-        ALOGE( "userial vendor open: unsupported baud idx %i", cfg_baud);
-        *baud = B115200;
-        return FALSE;
+        VNDUSERIALDBG("userial vendor open: no serial settings: %s",
+                      strerror(errno));
+        return;
     }
 
-    return TRUE;
+    ss.flags |= ASYNC_LOW_LATENCY;
+    if (UART_XMIT_FIFO_SIZE != 0)
+        ss.xmit_fifo_size = UART_XMIT_FIFO_SIZE;
+
+    if (ioctl(fd, TIOCSSERIAL, &ss) < 0)
+        ALOGW("userial vendor open: low latency not set: %s", strerror(errno));
 }
 
 #if (BT_WAKE_VIA_USERIAL_IOCTL==TRUE)
@@ -183,6 +316,7 @@ int userial_vendor_open(tUSERIAL_CFG *p_cfg)
     uint8_t data_bits;
     uint16_t parity;
     uint8_t stop_bits;
+    uint32_t start = userial_now_us();
 
     vnd_userial.fd = -1;
 
@@ -232,31 +366,39 @@ int userial_vendor_open(tUSERIAL_CFG *p_cfg)
     if ((vnd_userial.fd = open(vnd_userial.port_name, O_RDWR)) == -1)
     {
         ALOGE("userial vendor open: unable to open %s", vnd_userial.port_name);
+        vnd_trace_dump("userial open failed");
         return -1;
     }
 
-    tcflush(vnd_userial.fd, TCIOFLUSH);
-
+    /* All settings in one go, then drop what was received before them */
     tcgetattr(vnd_userial.fd, &vnd_userial.termios);
     cfmakeraw(&vnd_userial.termios);
-    vnd_userial.termios.c_cflag |= (CRTSCTS | stop_bits);
-    tcsetattr(vnd_userial.fd, TCSANOW, &vnd_userial.termios);
-    tcflush(vnd_userial.fd, TCIOFLUSH);
+    vnd_userial.termios.c_cflag &= ~(CSIZE | PARENB | PARODD | CSTOPB);
+    vnd_userial.termios.c_cflag |= (data_bits | parity | stop_bits);
+    if (userial_flow_control == TRUE)
+        vnd_userial.termios.c_cflag |= CRTSCTS;
 
-    tcsetattr(vnd_userial.fd, TCSANOW, &vnd_userial.termios);
-    tcflush(vnd_userial.fd, TCIOFLUSH);
-    tcflush(vnd_userial.fd, TCIOFLUSH);
+    if (userial_latency_profile == UART_LATENCY_LOW)
+    {
+        vnd_userial.termios.c_cc[VMIN] = 1;
+        vnd_userial.termios.c_cc[VTIME] = 0;
+        userial_set_low_latency(vnd_userial.fd);
+    }
 
     /* set input/output baudrate */
     cfsetospeed(&vnd_userial.termios, baud);
     cfsetispeed(&vnd_userial.termios, baud);
     tcsetattr(vnd_userial.fd, TCSANOW, &vnd_userial.termios);
+    tcflush(vnd_userial.fd, TCIOFLUSH);
+    vnd_userial.line_speed = userial_line_speeds[p_cfg->baud];
 
 #if (BT_WAKE_VIA_USERIAL_IOCTL==TRUE)
     userial_ioctl_init_bt_wake(vnd_userial.fd);
 #endif
 
-    ALOGI("device fd = %d open", vnd_userial.fd);
+    ALOGI("device fd = %d open in %u us", vnd_userial.fd,
+          userial_now_us() - start);
+    VND_TRACE(TRC_USERIAL_OPEN, vnd_userial.fd, baud, 0);
 
     return vnd_userial.fd;
 }
@@ -283,6 +425,7 @@ void userial_vendor_close(void)
 #endif
 
     ALOGI("device fd = %d close", vnd_userial.fd);
+    VND_TRACE(TRC_USERIAL_CLOSE, vnd_userial.fd, 0, 0);
 
     if ((result = close(vnd_userial.fd)) < 0)
         ALOGE( "close(fd:%d) FAILED result:%d", vnd_userial.fd, result);
@@ -301,15 +444,104 @@ void userial_vendor_close(void)
 *******************************************************************************/
 void userial_vendor_set_baud(uint8_t userial_baud)
 {
-    uint32_t tcio_baud;
+    if (userial_baud >= USERIAL_BAUD_AUTO)
+    {
+        ALOGE("userial vendor: unsupported baud idx %i", userial_baud);
+        return;
+    }
 
-    userial_to_tcio_baud(userial_baud, &tcio_baud);
+    userial_vendor_set_line_speed(userial_line_speeds[userial_baud]);
+}
+
+/*******************************************************************************
+**
+** Function        userial_vendor_set_line_speed
+**
+** Description     Set new baud rate, as a line speed. Rates without a TCIO
+**                 constant go through termios2; where the driver does not
+**                 take them, the closest TCIO rate is used instead.
+**
+** Returns         None
+**
+*******************************************************************************/
+void userial_vendor_set_line_speed(uint32_t line_speed)
+{
+    const userial_tcio_baud_t *p_tcio = userial_tcio_baud_near(line_speed);
 
-    cfsetospeed(&vnd_userial.termios, tcio_baud);
-    cfsetispeed(&vnd_userial.termios, tcio_baud);
+    VND_TRACE(TRC_USERIAL_BAUD, line_speed, 0, 0);
+    vnd_userial.line_speed = line_speed;
+
+    if ((p_tcio->line_speed != line_speed) &&
+        (userial_set_termios2(line_speed) == 0))
+        return;
+
+    if (p_tcio->line_speed != line_speed)
+        ALOGE("userial vendor: speed %u not supported, using %u", line_speed,
+              p_tcio->line_speed);
+
+    cfsetospeed(&vnd_userial.termios, p_tcio->tcio_baud);
+    cfsetispeed(&vnd_userial.termios, p_tcio->tcio_baud);
     tcsetattr(vnd_userial.fd, TCSANOW, &vnd_userial.termios);
 }
 
+/*******************************************************************************
+**
+** Function        userial_vendor_set_flow_control
+**
+** Description     Turn RTS/CTS flow control of the open port on or off
+**
+** Returns         None
+**
+*******************************************************************************/
+void userial_vendor_set_flow_control(uint8_t on)
+{
+    if (on == TRUE)
+        vnd_userial.termios.c_cflag |= CRTSCTS;
+    else
+        vnd_userial.termios.c_cflag &= ~CRTSCTS;
+
+    userial_vendor_set_line_speed(vnd_userial.line_speed);
+}
+
+/*******************************************************************************
+**
+** Function        userial_vendor_port_name
+**
+** Description     Name of the UART device of the controller
+**
+** Returns         Port name
+**
+*******************************************************************************/
+const char *userial_vendor_port_name(void)
+{
+    return vnd_userial.port_name;
+}
+
+/*******************************************************************************
+**
+** Function        userial_vendor_line_errors
+**
+** Description     Read the framing, parity, overrun and break counts of the
+**                 open port, summed, from the driver (TIOCGICOUNT)
+**
+** Returns         0 : Success
+**                 Otherwise : not supported by the driver
+**
+*******************************************************************************/
+int userial_vendor_line_errors(uint32_t *p_count)
+{
+    struct serial_icounter_struct icount;
+
+    if ((vnd_userial.fd == -1) ||
+        (ioctl(vnd_userial.fd, TIOCGICOUNT, &icount) < 0))
+        return -1;
+
+    *p_count = icount.frame + icount.parity + icount.overrun +
+        icount.buf_overrun + icount.brk;
+
+    return 0;
+}
+
 /*******************************************************************************
 **
 ** Function        userial_vendor_ioctl
@@ -326,11 +558,13 @@ void userial_vendor_ioctl(userial_vendor_ioctl_op_t op, void *p_data)
 #if (BT_WAKE_VIA_USERIAL_IOCTL==TRUE)
         case USERIAL_OP_ASSERT_BT_WAKE:
             VNDUSERIALDBG("## userial_vendor_ioctl: Asserting BT_Wake ##");
+            VND_TRACE(TRC_USERIAL_BT_WAKE, TRUE, 0, 0);
             ioctl(vnd_userial.fd, USERIAL_IOCTL_BT_WAKE_ASSERT, NULL);
             break;
 
         case USERIAL_OP_DEASSERT_BT_WAKE:
             VNDUSERIALDBG("## userial_vendor_ioctl: De-asserting BT_Wake ##");
+            VND_TRACE(TRC_USERIAL_BT_WAKE, FALSE, 0, 0);
             ioctl(vnd_userial.fd, USERIAL_IOCTL_BT_WAKE_DEASSERT, NULL);
             break;
 
@@ -361,3 +595,47 @@ int userial_set_port(char *p_conf_name, char *p_conf_value, int param)
     return 0;
 }
 
+/*******************************************************************************
+**
+** Function        userial_set_flow_control
+**
+** Description     Configure RTS/CTS flow control of the UART
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+int userial_set_flow_control(char *p_conf_name, char *p_conf_value, int param)
+{
+    userial_flow_control = (atoi(p_conf_value) != 0) ? TRUE : FALSE;
+
+    return 0;
+}
+
+/*******************************************************************************
+**
+** Function        userial_set_latency_profile
+**
+** Description     Configure the serial settings of the UART, "default" or
+**                 "low" latency
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+int userial_set_latency_profile(char *p_conf_name, char *p_conf_value,
+                                int param)
+{
+    if (strcmp(p_conf_value, "low") == 0)
+        userial_latency_profile = UART_LATENCY_LOW;
+    else if (strcmp(p_conf_value, "default") == 0)
+        userial_latency_profile = UART_LATENCY_DEFAULT;
+    else
+    {
+        ALOGE("Invalid %s %s", p_conf_name, p_conf_value);
+        return -1;
+    }
+
+    return 0;
+}
+
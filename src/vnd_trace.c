@@ -0,0 +1,271 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      vnd_trace.c
+ *
+ *  Description:   Contains the binary trace ring of the vendor library
+ *
+ *                 Writers claim a slot with an atomic increment of the ring
+ *                 head and publish it by storing its sequence number last;
+ *                 the dump skips slots that are being rewritten.
+ *
+ ******************************************************************************/
+
+#define LOG_TAG "bt_vnd_trace"
+
+#include <utils/Log.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bt_vendor.h"
+#include "vnd_trace.h"
+
+/******************************************************************************
+**  Constants & Macros
+******************************************************************************/
+
+#define VND_TRACE_MASK          (VND_TRACE_RING_SIZE - 1)
+
+#if (VND_TRACE_RING_SIZE & VND_TRACE_MASK)
+#error "VND_TRACE_RING_SIZE must be a power of two"
+#endif
+
+#define VND_TRACE_LINE_LEN      96
+
+/******************************************************************************
+**  Local type definitions
+******************************************************************************/
+
+typedef struct
+{
+    volatile uint32_t seq;              /* index + 1 once complete, 0 before */
+    uint32_t    ts_us;                  /* CLOCK_MONOTONIC, wraps */
+    uint16_t    id;
+    uint32_t    arg[3];
+} vnd_trace_entry_t;
+
+typedef struct
+{
+    uint8_t     sub;
+    uint8_t     index;
+    const char  *p_fmt;                 /* takes the three arguments */
+} vnd_trace_fmt_t;
+
+/******************************************************************************
+**  Variables
+******************************************************************************/
+
+uint8_t vnd_trace_level[VND_TRACE_SUB_MAX] = {
+    VND_TRACE_DEFAULT_LEVEL,
+    VND_TRACE_DEFAULT_LEVEL,
+    VND_TRACE_DEFAULT_LEVEL,
+    VND_TRACE_DEFAULT_LEVEL
+};
+
+/******************************************************************************
+**  Static variables
+******************************************************************************/
+
+static vnd_trace_entry_t vnd_trace_ring[VND_TRACE_RING_SIZE];
+static volatile uint32_t vnd_trace_head;
+
+static const char *vnd_trace_sub_name[VND_TRACE_SUB_MAX] = {
+    "vnd", "hw", "userial", "upio"
+};
+
+static const vnd_trace_fmt_t vnd_trace_fmt[] = {
+    {VND_TRACE_VND, 0, "op %u"},
+
+    {VND_TRACE_HW, 0, "HCI_RESET"},
+    {VND_TRACE_HW, 1, "event opcode 0x%04X status %u credits %u"},
+    {VND_TRACE_HW, 2, "RDSW_VERSION"},
+    {VND_TRACE_HW, 3, "OPEN_PATCHFILE found %u preloaded %u embedded %u"},
+    {VND_TRACE_HW, 4, "SET_UART_CLOCK"},
+    {VND_TRACE_HW, 5, "SET_UART_BAUD %u"},
+    {VND_TRACE_HW, 6, "host UART baud %u"},
+    {VND_TRACE_HW, 7, "MANUFACTURE_ON"},
+    {VND_TRACE_HW, 8, "record %u opcode 0x%04X len %u"},
+    {VND_TRACE_HW, 9, "end of patch, %u records"},
+    {VND_TRACE_HW, 10, "MANUFACTURE_OFF patch enabled %u"},
+    {VND_TRACE_HW, 11, "RDSW_VERSION_RECHECK"},
+    {VND_TRACE_HW, 12, "FW_CFG result %u"},
+    {VND_TRACE_HW, 13, "preloaded %u of %u patches in %u us"},
+    {VND_TRACE_HW, 14, "patch index %u files in %u dirs, %u us"},
+    {VND_TRACE_HW, 15, "patch stream %u records, %u read waits, %u decode waits"},
+    {VND_TRACE_HW, 16, "direct download result %u, %u commands in %u writes"},
+    {VND_TRACE_HW, 17, "record %u event mismatch at byte %u, got 0x%02X"},
+
+    {VND_TRACE_USERIAL, 0, "open fd %d speed 0x%X"},
+    {VND_TRACE_USERIAL, 1, "close fd %d"},
+    {VND_TRACE_USERIAL, 2, "set speed %u"},
+    {VND_TRACE_USERIAL, 3, "ioctl BT_WAKE %u"},
+    {VND_TRACE_USERIAL, 4, "baud probe %u passed %u"},
+
+    {VND_TRACE_UPIO, 0, "power %u"},
+    {VND_TRACE_UPIO, 1, "LPM %u"},
+    {VND_TRACE_UPIO, 2, "BT_WAKE %u"},
+
+    {0, 0, (const char *) NULL}
+};
+
+/******************************************************************************
+**  Static functions
+******************************************************************************/
+
+static uint32_t vnd_trace_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t) (ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+static void vnd_trace_format(const vnd_trace_entry_t *p_entry, char *p_line,
+                             size_t len)
+{
+    const vnd_trace_fmt_t *p_fmt;
+    int n;
+
+    n = snprintf(p_line, len, "[%s] ",
+                 vnd_trace_sub_name[VND_TRACE_SUB(p_entry->id) %
+                                    VND_TRACE_SUB_MAX]);
+
+    for (p_fmt = vnd_trace_fmt; p_fmt->p_fmt != NULL; p_fmt++)
+    {
+        if (VND_TRACE_ID(p_fmt->sub, p_fmt->index) == p_entry->id)
+        {
+            snprintf(p_line + n, len - n, p_fmt->p_fmt, p_entry->arg[0],
+                     p_entry->arg[1], p_entry->arg[2]);
+            return;
+        }
+    }
+
+    snprintf(p_line + n, len - n, "event 0x%04X %u %u %u", p_entry->id,
+             p_entry->arg[0], p_entry->arg[1], p_entry->arg[2]);
+}
+
+/*****************************************************************************
+**   TRACE RING FUNCTIONS
+*****************************************************************************/
+
+/*******************************************************************************
+**
+** Function        vnd_trace_add
+**
+** Description     Append an event to the ring, callable from any thread.
+**                 Use VND_TRACE, which skips the call for silent subsystems.
+**
+** Returns         None
+**
+*******************************************************************************/
+void vnd_trace_add(uint16_t id, uint32_t a0, uint32_t a1, uint32_t a2)
+{
+    uint32_t idx = __sync_fetch_and_add(&vnd_trace_head, 1);
+    vnd_trace_entry_t *p_entry = &vnd_trace_ring[idx & VND_TRACE_MASK];
+    char line[VND_TRACE_LINE_LEN];
+
+    p_entry->seq = 0;
+    __sync_synchronize();
+
+    p_entry->ts_us = vnd_trace_now();
+    p_entry->id = id;
+    p_entry->arg[0] = a0;
+    p_entry->arg[1] = a1;
+    p_entry->arg[2] = a2;
+
+    __sync_synchronize();
+    p_entry->seq = idx + 1;
+
+    if (vnd_trace_level[VND_TRACE_SUB(id) % VND_TRACE_SUB_MAX] >= VND_TRACE_LOG)
+    {
+        vnd_trace_format(p_entry, line, sizeof(line));
+        ALOGD("%s", line);
+    }
+}
+
+/*******************************************************************************
+**
+** Function        vnd_trace_dump
+**
+** Description     Log the content of the ring, oldest event first
+**
+** Returns         None
+**
+*******************************************************************************/
+void vnd_trace_dump(const char *p_reason)
+{
+    vnd_trace_entry_t entry;
+    char line[VND_TRACE_LINE_LEN];
+    uint32_t end = vnd_trace_head;
+    uint32_t idx = (end > VND_TRACE_RING_SIZE) ? end - VND_TRACE_RING_SIZE : 0;
+    uint32_t t0 = 0;
+    int first = 1;
+
+    ALOGI("trace dump (%s): %u events, last %u kept", p_reason, end,
+        end - idx);
+
+    for (; idx != end; idx++)
+    {
+        memcpy(&entry, &vnd_trace_ring[idx & VND_TRACE_MASK], sizeof(entry));
+        __sync_synchronize();
+
+        /* Being written, or already overwritten by a newer event */
+        if ((entry.seq != idx + 1) ||
+            (vnd_trace_ring[idx & VND_TRACE_MASK].seq != idx + 1))
+            continue;
+
+        if (first)
+        {
+            t0 = entry.ts_us;
+            first = 0;
+        }
+
+        vnd_trace_format(&entry, line, sizeof(line));
+        ALOGI("%4u +%6u.%03u ms %s", idx, (entry.ts_us - t0) / 1000,
+            (entry.ts_us - t0) % 1000, line);
+    }
+}
+
+/*******************************************************************************
+**
+** Function        vnd_trace_set_level
+**
+** Description     Conf entry setter, param is the subsystem
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+int vnd_trace_set_level(char *p_conf_name, char *p_conf_value, int param)
+{
+    int level = atoi(p_conf_value);
+
+    if ((param < 0) || (param >= VND_TRACE_SUB_MAX) ||
+        (level < VND_TRACE_OFF) || (level > VND_TRACE_LOG))
+    {
+        ALOGE("Invalid %s %s", p_conf_name, p_conf_value);
+        return -1;
+    }
+
+    vnd_trace_level[param] = level;
+
+    return 0;
+}
@@ -0,0 +1,190 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      btsim.c
+ *
+ *  Description:   Pseudo-terminal frontend of the controller model. Point
+ *                 UartPort of bt_vendor.conf to the printed pty (or to the
+ *                 -L link) to run the controller setup on a Linux host.
+ *
+ ******************************************************************************/
+
+#define LOG_TAG "bt_sim"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include "fw_patch.h"
+#include "fw_repack.h"
+#include "hex_decode.h"
+#include "sim_pty.h"
+
+/******************************************************************************
+**  Constants & Macros
+******************************************************************************/
+
+/* RDSW version answered when neither -v nor -f is given */
+#define BTSIM_DEFAULT_VERSION   "370710010002030d00"
+
+/******************************************************************************
+**  Static variables
+******************************************************************************/
+
+static sim_pty_t *btsim_pty = NULL;
+
+/******************************************************************************
+**  Static functions
+******************************************************************************/
+
+static void btsim_signal(int sig)
+{
+    (void) sig;
+    if (btsim_pty != NULL)
+        btsim_pty->stop = 1;
+}
+
+static void usage(const char *p_prog)
+{
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  -f <patch>    .seq/.bseq/.bseqz file whose events are replayed\n"
+        "  -r <bytes>    repack the patch as the library sends it, with\n"
+        "                <bytes> of data per MEMWRITE (the library uses %u)\n"
+        "  -v <version>  RDSW version, 18 hex digits (default: patch key)\n"
+        "  -b <baud>     controller rate after reset (default %u)\n"
+        "  -l <us>       command processing latency (default 0)\n"
+        "  -m <us>       MEMWRITE processing latency (default: -l)\n"
+        "  -c <credits>  Num_HCI_Command_Packets to advertise (default %u)\n"
+        "  -L <path>     symlink to the pty slave\n"
+        "  -n            do not drop traffic on a host/controller rate mismatch\n",
+        p_prog, FW_REPACK_CHUNK_DEFAULT, SIM_DEFAULT_BAUD, SIM_DEFAULT_CREDITS);
+}
+
+int main(int argc, char **argv)
+{
+    static sim_pty_t pty;
+    sim_cfg_t cfg;
+    fw_patch_t patch;
+    const char *p_version = NULL;
+    const char *p_link = NULL;
+    int memwrite_latency = -1;
+    int chunk = 0;
+    int opt;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.init_baud = SIM_DEFAULT_BAUD;
+    cfg.credits = SIM_DEFAULT_CREDITS;
+    cfg.strict_baud = 1;
+
+    while ((opt = getopt(argc, argv, "f:r:v:b:l:m:c:L:nh")) != -1)
+    {
+        switch (opt)
+        {
+            case 'f':
+                if (fw_patch_open(optarg, &patch) != 0)
+                {
+                    fprintf(stderr, "%s: can not load %s\n", argv[0], optarg);
+                    return 1;
+                }
+                cfg.p_patch = &patch;
+                break;
+
+            case 'r': chunk = atoi(optarg); break;
+            case 'v': p_version = optarg; break;
+            case 'b': cfg.init_baud = atoi(optarg); break;
+            case 'l': cfg.cmd_latency_us = atoi(optarg); break;
+            case 'm': memwrite_latency = atoi(optarg); break;
+            case 'c': cfg.credits = atoi(optarg); break;
+            case 'L': p_link = optarg; break;
+            case 'n': cfg.strict_baud = 0; break;
+
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if ((chunk > 0) && (cfg.p_patch != NULL) &&
+        (fw_repack_image(cfg.p_patch, chunk) != 0))
+    {
+        fprintf(stderr, "%s: can not repack the patch\n", argv[0]);
+        return 1;
+    }
+
+    cfg.memwrite_latency_us = (memwrite_latency >= 0) ?
+        (uint32_t) memwrite_latency : cfg.cmd_latency_us;
+
+    if ((p_version == NULL) && (cfg.p_patch != NULL))
+        memcpy(cfg.version, patch.key, FW_PATCH_KEY_LEN);
+    else if ((p_version == NULL) &&
+        (hex_decode(cfg.version, BTSIM_DEFAULT_VERSION, FW_PATCH_KEY_LEN) != 0))
+        return 1;
+    else if ((p_version != NULL) &&
+        ((strlen(p_version) != FW_PATCH_KEY_STR_LEN) ||
+         (hex_decode(cfg.version, p_version, FW_PATCH_KEY_LEN) != 0)))
+    {
+        fprintf(stderr, "%s: invalid version %s\n", argv[0], p_version);
+        return 1;
+    }
+
+    if (sim_pty_open(&pty, &cfg) != 0)
+    {
+        fprintf(stderr, "%s: can not create a pty: %s\n", argv[0],
+                strerror(errno));
+        return 1;
+    }
+
+    if (p_link != NULL)
+    {
+        unlink(p_link);
+        if (symlink(pty.p_name, p_link) < 0)
+        {
+            fprintf(stderr, "%s: can not link %s: %s\n", argv[0], p_link,
+                    strerror(errno));
+            return 1;
+        }
+    }
+
+    btsim_pty = &pty;
+    signal(SIGINT, btsim_signal);
+    signal(SIGTERM, btsim_signal);
+
+    printf("sim: controller on %s, %u baud, %u credits, latency %u/%u us\n",
+           pty.p_name, pty.sim.cfg.init_baud, pty.sim.cfg.credits,
+           pty.sim.cfg.cmd_latency_us, pty.sim.cfg.memwrite_latency_us);
+    fflush(stdout);
+
+    pty.p_session_cback = sim_print_stats;
+    sim_pty_run(&pty);
+
+    sim_print_stats(&pty.sim.stats);
+
+    if (p_link != NULL)
+        unlink(p_link);
+    if (cfg.p_patch != NULL)
+        fw_patch_close(cfg.p_patch);
+
+    sim_pty_close(&pty);
+
+    return 0;
+}
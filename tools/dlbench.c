@@ -0,0 +1,685 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      dlbench.c
+ *
+ *  Description:   End-to-end firmware download benchmark. For every patch,
+ *                 wire rate and controller latency, runs USERIAL_OPEN and
+ *                 FW_CFG of the host library over a pty against the
+ *                 controller model (replaying that patch), and reports
+ *                 wall time, records/s, payload bytes/s and how the time
+ *                 splits between patch file I/O, waiting on the controller
+ *                 and the rest.
+ *
+ *                 The download rate itself is UART_TARGET_BAUD_RATE, or
+ *                 UartBaud as given with -u; the sweep sets the rate the
+ *                 model times the wire at.
+ *
+ *                 -D sets FwPatchDirect: the download then happens inside
+ *                 USERIAL_OPEN, out of sight of the mock stack, and its
+ *                 waiting time is counted in "other".
+ *
+ *                 -a sets UartBaudAuto, and -m the highest rate the modelled
+ *                 board carries: the rate probe of USERIAL_OPEN is counted
+ *                 in "other", and its power cycle restarts the model.
+ *
+ *                 usage: bt_dlbench [-d <patch dir>] [-k <key,...>]
+ *                                   [-b <baud,...>] [-l <latency us,...>]
+ *                                   [-r <repeats>] [-c <credits>]
+ *                                   [-p <pipeline depth>] [-D] [-a]
+ *                                   [-m <max baud>] [-u <UartBaud>]
+ *                                   [-o <results.csv|results.json>] [-s] [-v]
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include "bt_vendor.h"
+#include "fw_bundle.h"
+#include "fw_patch.h"
+#include "fw_repack.h"
+#include "fw_stats.h"
+#include "hex_decode.h"
+#include "mock_stack.h"
+#include "sim_pty.h"
+#include "upio.h"
+
+/******************************************************************************
+**  Constants & Macros
+******************************************************************************/
+
+#define BENCH_DEFAULT_DIR       "vendor/intel/hardware/bluetooth/fw"
+#define BENCH_DEFAULT_KEYS      "3707100100012d0d00,3707100180012d0d00," \
+                                "370710010002030d00,370710018002030d00"
+#define BENCH_DEFAULT_BAUDS     "115200,921600,3000000"
+#define BENCH_DEFAULT_LATENCIES "0,100,500"
+
+/* No event for that long means the setup is stuck */
+#define BENCH_EVENT_TIMEOUT_MS  5000
+
+#define HCI_INTEL_MEMWRITE      0xFC8E
+#define MEMWRITE_HDR_SIZE       6       /* address (4), mode, length */
+
+#define BENCH_MAX_LIST          16
+
+/******************************************************************************
+**  Externs
+******************************************************************************/
+
+extern int userial_set_port(char *p_conf_name, char *p_conf_value, int param);
+extern int hw_set_patch_file_path(char *p_conf_name, char *p_conf_value,
+                                  int param);
+extern int hw_set_patch_direct(char *p_conf_name, char *p_conf_value,
+                               int param);
+extern int hw_set_patch_pipeline_depth(char *p_conf_name, char *p_conf_value,
+                                       int param);
+extern int hw_set_uart_baud(char *p_conf_name, char *p_conf_value, int param);
+extern int userial_baud_set_auto(char *p_conf_name, char *p_conf_value,
+                                 int param);
+
+/******************************************************************************
+**  Type definitions
+******************************************************************************/
+
+typedef struct
+{
+    char        key[FW_PATCH_KEY_STR_LEN + 1];
+    uint32_t    baud;
+    uint32_t    latency_us;
+    int         result;
+    double      wall;                   /* seconds */
+    double      io;
+    double      wait;
+    uint32_t    records;                /* commands sent */
+    uint32_t    payload;                /* MEMWRITE data bytes */
+    uint32_t    tx_bytes;
+    fw_stats_t  stages;                 /* BT_VND_OP_INTEL_GET_FW_STATS */
+} bench_run_t;
+
+/******************************************************************************
+**  Static variables
+******************************************************************************/
+
+static double bench_io_sec;
+static sim_pty_t bench_pty;
+static int bench_pty_running;
+
+/******************************************************************************
+**  File I/O accounting, linked with -Wl,--wrap=fw_patch_open,--wrap=opendir,
+**  --wrap=readdir,--wrap=closedir when BENCH_WRAP_IO is defined
+******************************************************************************/
+
+static double bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#ifdef BENCH_WRAP_IO
+int __real_fw_patch_open(const char *p_path, fw_patch_t *p_patch);
+DIR *__real_opendir(const char *p_name);
+struct dirent *__real_readdir(DIR *p_dir);
+int __real_closedir(DIR *p_dir);
+
+int __wrap_fw_patch_open(const char *p_path, fw_patch_t *p_patch)
+{
+    double start = bench_now();
+    int ret = __real_fw_patch_open(p_path, p_patch);
+
+    bench_io_sec += bench_now() - start;
+    return ret;
+}
+
+DIR *__wrap_opendir(const char *p_name)
+{
+    double start = bench_now();
+    DIR *p_dir = __real_opendir(p_name);
+
+    bench_io_sec += bench_now() - start;
+    return p_dir;
+}
+
+struct dirent *__wrap_readdir(DIR *p_dir)
+{
+    double start = bench_now();
+    struct dirent *p_ent = __real_readdir(p_dir);
+
+    bench_io_sec += bench_now() - start;
+    return p_ent;
+}
+
+int __wrap_closedir(DIR *p_dir)
+{
+    double start = bench_now();
+    int ret = __real_closedir(p_dir);
+
+    bench_io_sec += bench_now() - start;
+    return ret;
+}
+#endif
+
+/******************************************************************************
+**  Controller power, linked with -Wl,--wrap=upio_set_bluetooth_power when
+**  BENCH_WRAP_POWER is defined
+******************************************************************************/
+
+#ifdef BENCH_WRAP_POWER
+int __real_upio_set_bluetooth_power(int on);
+
+int __wrap_upio_set_bluetooth_power(int on)
+{
+    int ret = __real_upio_set_bluetooth_power(on);
+
+    /* Back at its init rate when the call returns, like the controller */
+    if ((on == UPIO_BT_POWER_ON) && bench_pty_running)
+    {
+        bench_pty.power_cycle = 1;
+        while (bench_pty.power_cycle)
+            usleep(1000);
+    }
+
+    return ret;
+}
+#endif
+
+/******************************************************************************
+**  Static functions
+******************************************************************************/
+
+static int bench_parse_list(char *p_list, uint32_t *p_out)
+{
+    char *p_tok, *p_save = NULL;
+    int n = 0;
+
+    for (p_tok = strtok_r(p_list, ",", &p_save);
+         (p_tok != NULL) && (n < BENCH_MAX_LIST);
+         p_tok = strtok_r(NULL, ",", &p_save))
+        p_out[n++] = strtoul(p_tok, NULL, 0);
+
+    return n;
+}
+
+static void *bench_sim_thread(void *p_arg)
+{
+    sim_pty_run((sim_pty_t *) p_arg);
+    return NULL;
+}
+
+/*******************************************************************************
+**
+** Function        bench_find_bundle
+**
+** Description     Find a bundle of <dir> holding the key
+**
+** Returns         0 : Success, p_path filled
+**                 Otherwise : none
+**
+*******************************************************************************/
+static int bench_find_bundle(const char *p_dir, const uint8_t *p_key,
+                             char *p_path, size_t len)
+{
+    uint8_t keys[BENCH_MAX_LIST][FW_PATCH_KEY_LEN];
+    struct dirent *dp;
+    DIR *dirp;
+    int i, n, ret = -1;
+
+    if ((dirp = opendir(p_dir)) == NULL)
+        return -1;
+
+    while ((ret != 0) && ((dp = readdir(dirp)) != NULL))
+    {
+        if (fw_patch_file_type(dp->d_name) != FW_PATCH_FILE_BUNDLE)
+            continue;
+
+        snprintf(p_path, len, "%s/%s", p_dir, dp->d_name);
+        n = fw_bundle_keys(p_path, keys, BENCH_MAX_LIST);
+        for (i = 0; i < n; i++)
+        {
+            if (memcmp(keys[i], p_key, FW_PATCH_KEY_LEN) == 0)
+                ret = 0;
+        }
+    }
+
+    closedir(dirp);
+
+    return ret;
+}
+
+/*******************************************************************************
+**
+** Function        bench_load_patch
+**
+** Description     Load the patch of the key from the file the library picks
+**                 in <dir>, for the controller to replay, and count its
+**                 MEMWRITE payload. The patch of a bundle is copied, the
+**                 controller model rewinds it.
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+static int bench_load_patch(const char *p_dir, const char *p_key,
+                            fw_patch_t *p_patch, uint32_t *p_payload)
+{
+    static const char *ext[] = {
+        FW_PATCH_BIN_EXTENSION,
+        FW_PATCH_ZIP_EXTENSION,
+        FW_PATCH_SEQ_EXTENSION
+    };
+    uint8_t key[FW_PATCH_KEY_LEN];
+    char path[PATH_MAX];
+    fw_patch_t bundled;
+    fw_patch_rec_t rec;
+    uint8_t *p_copy;
+    uint32_t len = 0;
+    unsigned i;
+
+    for (i = 0; i < sizeof(ext) / sizeof(ext[0]); i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s%s", p_dir, p_key, ext[i]);
+        if (access(path, R_OK) == 0)
+            break;
+    }
+
+    if (fw_patch_key_from_name(p_key, key) != 0)
+        return -1;
+
+    if ((i == sizeof(ext) / sizeof(ext[0])) &&
+        (bench_find_bundle(p_dir, key, path, sizeof(path)) == 0))
+    {
+        if (fw_bundle_open(path, key, &bundled) != 0)
+            return -1;
+
+        if ((p_copy = (uint8_t *) malloc(bundled.rec_size + 1)) == NULL)
+        {
+            fw_patch_close(&bundled);
+            return -1;
+        }
+
+        while (fw_patch_next(&bundled, &rec))
+        {
+            memcpy(p_copy + len, rec.p_pkt - 1, 1 + rec.len);
+            len += 1 + rec.len;
+        }
+
+        memset(p_patch, 0, sizeof(fw_patch_t));
+        memcpy(p_patch->key, key, FW_PATCH_KEY_LEN);
+        p_patch->p_alloc = p_copy;
+        p_patch->p_rec = p_copy;
+        p_patch->rec_size = len;
+        p_patch->rec_count = bundled.rec_count;
+        p_patch->cmd_count = bundled.cmd_count;
+        fw_patch_close(&bundled);
+    }
+    else if (fw_patch_open(path, p_patch) != 0)
+    {
+        return -1;
+    }
+
+    /* The library sends a .seq patch repacked, replay it the same way */
+    if ((FW_PATCH_REPACK == TRUE) &&
+        (fw_patch_file_type(path) == FW_PATCH_FILE_SEQ) &&
+        (fw_repack_image(p_patch, FW_PATCH_REPACK_CHUNK) != 0))
+    {
+        fw_patch_close(p_patch);
+        return -1;
+    }
+
+    *p_payload = 0;
+    while (fw_patch_next(p_patch, &rec))
+    {
+        if ((rec.type == FW_PATCH_REC_CMD) &&
+            (rec.opcode == HCI_INTEL_MEMWRITE) &&
+            (rec.p_pkt[2] > MEMWRITE_HDR_SIZE))
+            *p_payload += rec.p_pkt[2] - MEMWRITE_HDR_SIZE;
+    }
+
+    return 0;
+}
+
+/*******************************************************************************
+**
+** Function        bench_run
+**
+** Description     One USERIAL_OPEN + FW_CFG against a fresh controller
+**
+** Returns         None
+**
+*******************************************************************************/
+static void bench_run(const char *p_dir, sim_cfg_t *p_cfg, bench_run_t *p_run)
+{
+    static unsigned char bdaddr[6] = { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55 };
+    sim_pty_t *p_pty = &bench_pty;
+    pthread_t thread;
+    int fds[CH_MAX];
+    int power, ret, i;
+    double start;
+
+    p_run->result = -1;
+
+    if (sim_pty_open(p_pty, p_cfg) != 0)
+    {
+        fprintf(stderr, "dlbench: can not create a pty\n");
+        return;
+    }
+
+    if (pthread_create(&thread, NULL, bench_sim_thread, p_pty) != 0)
+    {
+        sim_pty_close(p_pty);
+        return;
+    }
+
+    mock_stack_init(NULL);
+    BLUETOOTH_VENDOR_LIB_INTERFACE.init(&mock_stack_cbacks, bdaddr);
+
+    userial_set_port(NULL, (char *) p_pty->p_name, 0);
+    hw_set_patch_file_path(NULL, (char *) p_dir, 0);
+
+    bench_io_sec = 0;
+    start = bench_now();
+
+    /* Same order as the stack: power cycle, UART open, FW_CFG */
+    power = BT_VND_PWR_OFF;
+    BLUETOOTH_VENDOR_LIB_INTERFACE.op(BT_VND_OP_POWER_CTRL, &power);
+    power = BT_VND_PWR_ON;
+    BLUETOOTH_VENDOR_LIB_INTERFACE.op(BT_VND_OP_POWER_CTRL, &power);
+
+    /* The model is only restarted by the power cycles of the rate probe,
+     * it was just created for the one above */
+    bench_pty_running = 1;
+    ret = BLUETOOTH_VENDOR_LIB_INTERFACE.op(BT_VND_OP_USERIAL_OPEN, &fds);
+    bench_pty_running = 0;
+
+    if (ret > 0)
+    {
+        mock_stack_attach(fds[CH_CMD]);
+        BLUETOOTH_VENDOR_LIB_INTERFACE.op(BT_VND_OP_FW_CFG, NULL);
+
+        while (mock_results.fwcfg == MOCK_RESULT_NONE)
+        {
+            if (mock_stack_wait(BENCH_EVENT_TIMEOUT_MS) < 0)
+            {
+                fprintf(stderr, "dlbench: no answer from the controller\n");
+                break;
+            }
+        }
+
+        p_run->wall = bench_now() - start;
+        p_run->result = mock_results.fwcfg;
+
+        BLUETOOTH_VENDOR_LIB_INTERFACE.op(BT_VND_OP_INTEL_GET_FW_STATS,
+                                          &p_run->stages);
+
+        BLUETOOTH_VENDOR_LIB_INTERFACE.op(BT_VND_OP_USERIAL_CLOSE, NULL);
+    }
+
+    BLUETOOTH_VENDOR_LIB_INTERFACE.cleanup();
+    mock_stack_cleanup();
+
+    p_pty->stop = 1;
+    pthread_join(thread, NULL);
+    sim_pty_close(p_pty);
+
+    p_run->io = bench_io_sec;
+    p_run->wait = mock_stats.wait_sec;
+    p_run->records = mock_stats.commands;
+    if (p_run->records == 0)
+        for (i = 0; i < FW_STAT_STAGE_MAX; i++)
+            p_run->records += p_run->stages.stage[i].count;
+    p_run->tx_bytes = mock_stats.tx_bytes;
+}
+
+static void bench_write_csv(FILE *fp, const bench_run_t *p_runs, int n)
+{
+    int i;
+
+    fprintf(fp, "patch,baud,latency_us,result,wall_ms,io_ms,wait_ms,"
+                "other_ms,records,records_per_s,payload_bytes,"
+                "payload_bytes_per_s,tx_bytes\n");
+
+    for (i = 0; i < n; i++)
+    {
+        fprintf(fp, "%s,%u,%u,%d,%.3f,%.3f,%.3f,%.3f,%u,%.1f,%u,%.1f,%u\n",
+                p_runs[i].key, p_runs[i].baud, p_runs[i].latency_us,
+                p_runs[i].result, p_runs[i].wall * 1e3, p_runs[i].io * 1e3,
+                p_runs[i].wait * 1e3,
+                (p_runs[i].wall - p_runs[i].io - p_runs[i].wait) * 1e3,
+                p_runs[i].records, p_runs[i].records / p_runs[i].wall,
+                p_runs[i].payload, p_runs[i].payload / p_runs[i].wall,
+                p_runs[i].tx_bytes);
+    }
+}
+
+static void bench_write_json(FILE *fp, const bench_run_t *p_runs, int n)
+{
+    int i;
+
+    fprintf(fp, "[\n");
+    for (i = 0; i < n; i++)
+    {
+        fprintf(fp, "  {\"patch\": \"%s\", \"baud\": %u, \"latency_us\": %u, "
+                    "\"result\": %d, \"wall_ms\": %.3f, \"io_ms\": %.3f, "
+                    "\"wait_ms\": %.3f, \"other_ms\": %.3f, \"records\": %u, "
+                    "\"records_per_s\": %.1f, \"payload_bytes\": %u, "
+                    "\"payload_bytes_per_s\": %.1f, \"tx_bytes\": %u}%s\n",
+                p_runs[i].key, p_runs[i].baud, p_runs[i].latency_us,
+                p_runs[i].result, p_runs[i].wall * 1e3, p_runs[i].io * 1e3,
+                p_runs[i].wait * 1e3,
+                (p_runs[i].wall - p_runs[i].io - p_runs[i].wait) * 1e3,
+                p_runs[i].records, p_runs[i].records / p_runs[i].wall,
+                p_runs[i].payload, p_runs[i].payload / p_runs[i].wall,
+                p_runs[i].tx_bytes, (i + 1 < n) ? "," : "");
+    }
+    fprintf(fp, "]\n");
+}
+
+static void bench_print_stages(const fw_stats_t *p_stats)
+{
+    static const char *p_names[FW_STAT_STAGE_MAX] = {
+        "HCI_RESET", "RDSW_VERSION", "OPEN_PATCHFILE", "SET_UART_BAUD",
+        "MANUFACTURE_ON", "MEMWRITE", "MANUFACTURE_OFF", "RDSW_VERSION_RECHECK"
+    };
+    const fw_stats_stage_t *p_stage;
+    int i;
+
+    for (i = 0; i < FW_STAT_STAGE_MAX; i++)
+    {
+        p_stage = &p_stats->stage[i];
+        if (p_stage->count == 0)
+            continue;
+
+        printf("    %-20s +%9.3f ms %4u x min/avg/max/p99 %u/%u/%u/%u us\n",
+               p_names[i], p_stage->start_us / 1e3, p_stage->count,
+               p_stage->min_us, p_stage->avg_us, p_stage->max_us,
+               p_stage->p99_us);
+    }
+}
+
+static void usage(const char *p_prog)
+{
+    fprintf(stderr,
+        "usage: %s [-d <patch dir>] [-k <key,...>] [-b <baud,...>]\n"
+        "          [-l <latency us,...>] [-r <repeats>] [-c <credits>]\n"
+        "          [-p <pipeline depth>] [-D] [-a] [-m <max baud>]\n"
+        "          [-u <UartBaud>]\n"
+        "          [-o <results.csv|results.json>] [-s] [-v]\n",
+        p_prog);
+}
+
+int main(int argc, char **argv)
+{
+    static fw_patch_t patch;
+    char keys[256] = BENCH_DEFAULT_KEYS;
+    char bauds_arg[256] = BENCH_DEFAULT_BAUDS;
+    char lat_arg[256] = BENCH_DEFAULT_LATENCIES;
+    const char *p_dir = BENCH_DEFAULT_DIR;
+    const char *p_out = NULL;
+    uint32_t bauds[BENCH_MAX_LIST], lats[BENCH_MAX_LIST];
+    bench_run_t *p_runs;
+    sim_cfg_t cfg;
+    char *p_key, *p_save = NULL;
+    uint32_t payload, max_baud = 0;
+    int n_bauds, n_lats, repeats = 3, credits = 1, verbose = 0, stages = 0;
+    int n_runs = 0, failures = 0;
+    int b, l, r, opt, fd;
+    FILE *fp;
+
+    while ((opt = getopt(argc, argv, "d:k:b:l:r:c:p:o:Dam:u:sv")) != -1)
+    {
+        switch (opt)
+        {
+            case 'd': p_dir = optarg; break;
+            case 'k': snprintf(keys, sizeof(keys), "%s", optarg); break;
+            case 'b': snprintf(bauds_arg, sizeof(bauds_arg), "%s", optarg); break;
+            case 'l': snprintf(lat_arg, sizeof(lat_arg), "%s", optarg); break;
+            case 'r': repeats = atoi(optarg); break;
+            case 'c': credits = atoi(optarg); break;
+            case 'p': hw_set_patch_pipeline_depth(NULL, optarg, 0); break;
+            case 'o': p_out = optarg; break;
+            case 'D': hw_set_patch_direct(NULL, "1", 0); break;
+            case 'a': userial_baud_set_auto(NULL, "1", 0); break;
+            case 'm': max_baud = strtoul(optarg, NULL, 0); break;
+            case 'u':
+                if (hw_set_uart_baud(NULL, optarg, 0) != 0)
+                {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 's': stages = 1; break;
+            case 'v': verbose = 1; break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    n_bauds = bench_parse_list(bauds_arg, bauds);
+    n_lats = bench_parse_list(lat_arg, lats);
+    if ((n_bauds == 0) || (n_lats == 0) || (repeats <= 0))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    p_runs = calloc(4 * BENCH_MAX_LIST * n_bauds * n_lats * repeats,
+                    sizeof(bench_run_t));
+    if (p_runs == NULL)
+        return 1;
+
+    /* The library logs every step, keep that out of the measurement */
+    if (!verbose && ((fd = open("/dev/null", O_WRONLY)) >= 0))
+    {
+        dup2(fd, STDERR_FILENO);
+        close(fd);
+    }
+
+    printf("%-18s %8s %7s %4s %9s %8s %9s %9s %9s %12s\n", "patch", "baud",
+           "lat us", "res", "wall ms", "io ms", "wait ms", "other ms",
+           "records/s", "payload B/s");
+
+    for (p_key = strtok_r(keys, ",", &p_save);
+         (p_key != NULL) && (n_runs < 4 * BENCH_MAX_LIST * n_bauds * n_lats *
+                             repeats);
+         p_key = strtok_r(NULL, ",", &p_save))
+    {
+        if (bench_load_patch(p_dir, p_key, &patch, &payload) != 0)
+        {
+            printf("%-18s can not load the patch from %s\n", p_key, p_dir);
+            failures++;
+            continue;
+        }
+
+        for (b = 0; b < n_bauds; b++)
+        {
+            for (l = 0; l < n_lats; l++)
+            {
+                for (r = 0; r < repeats; r++)
+                {
+                    bench_run_t *p_run = &p_runs[n_runs++];
+
+                    memset(&cfg, 0, sizeof(cfg));
+                    cfg.init_baud = SIM_DEFAULT_BAUD;
+                    cfg.wire_baud = bauds[b];
+                    cfg.cmd_latency_us = lats[l];
+                    cfg.memwrite_latency_us = lats[l];
+                    cfg.credits = credits;
+                    cfg.strict_baud = 1;
+                    cfg.max_baud = max_baud;
+                    cfg.p_patch = &patch;
+                    memcpy(cfg.version, patch.key, FW_PATCH_KEY_LEN);
+
+                    snprintf(p_run->key, sizeof(p_run->key), "%s", p_key);
+                    p_run->baud = bauds[b];
+                    p_run->latency_us = lats[l];
+                    p_run->payload = payload;
+
+                    bench_run(p_dir, &cfg, p_run);
+                    if (p_run->result != BT_VND_OP_RESULT_SUCCESS)
+                        failures++;
+
+                    printf("%-18s %8u %7u %4d %9.2f %8.2f %9.2f %9.2f %9.0f "
+                           "%12.0f\n", p_run->key, p_run->baud,
+                           p_run->latency_us, p_run->result,
+                           p_run->wall * 1e3, p_run->io * 1e3,
+                           p_run->wait * 1e3,
+                           (p_run->wall - p_run->io - p_run->wait) * 1e3,
+                           p_run->records / p_run->wall,
+                           p_run->payload / p_run->wall);
+                    if (stages)
+                        bench_print_stages(&p_run->stages);
+                    fflush(stdout);
+                }
+            }
+        }
+
+        fw_patch_close(&patch);
+    }
+
+    if (p_out != NULL)
+    {
+        if ((fp = fopen(p_out, "w")) == NULL)
+        {
+            printf("can not write %s\n", p_out);
+            failures++;
+        }
+        else
+        {
+            if (strstr(p_out, ".json") != NULL)
+                bench_write_json(fp, p_runs, n_runs);
+            else
+                bench_write_csv(fp, p_runs, n_runs);
+            fclose(fp);
+        }
+    }
+
+    free(p_runs);
+
+    return (failures > 0) ? 1 : 0;
+}
@@ -0,0 +1,300 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      hexbench.c
+ *
+ *  Description:   Host microbenchmark of the .seq hex decoding. Decodes the
+ *                 hex digit runs of the given patch files with the former
+ *                 strtol() based form_byte(), the lookup table decoder and
+ *                 the SIMD decoder, and reports MB/s of hex text.
+ *
+ *                 usage: bt_hexbench [-n <rounds>] <patch.seq> ...
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "hex_decode.h"
+
+/******************************************************************************
+**  Constants & Macros
+******************************************************************************/
+
+#define BENCH_DEFAULT_ROUNDS    200
+
+/******************************************************************************
+**  Type definitions
+******************************************************************************/
+
+/* One run of hex digits of a patch file */
+typedef struct
+{
+    const char  *p_text;
+    size_t      len;                        /* number of bytes it decodes to */
+} hex_run_t;
+
+typedef struct
+{
+    char        *p_text;
+    hex_run_t   *p_runs;
+    int         run_count;
+    size_t      hex_chars;
+} bench_file_t;
+
+typedef int (*hex_decoder_t)(uint8_t *p_out, const char *p_in, size_t len);
+
+/******************************************************************************
+**  Static functions
+******************************************************************************/
+
+/* The decoder the .seq loader used before hex_decode, kept for reference */
+static unsigned char legacy_char_to_hex(char c)
+{
+    volatile uint8_t x;
+    char str[2];
+    str[0] = c;
+    str[1] = '\0';
+    x = strtol(str, NULL, 16);
+    return x;
+}
+
+static unsigned char legacy_form_byte(char msb, char lsb)
+{
+    unsigned char byte;
+    byte = (legacy_char_to_hex(msb)) << 4;
+    byte |= legacy_char_to_hex(lsb);
+    return byte;
+}
+
+static int legacy_decode(uint8_t *p_out, const char *p_in, size_t len)
+{
+    while (len--)
+    {
+        *p_out++ = legacy_form_byte(p_in[0], p_in[1]);
+        p_in += 2;
+    }
+    return 0;
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*******************************************************************************
+**
+** Function        bench_load
+**
+** Description     Read a .seq file and collect the hex digit runs of its
+**                 command and event lines, the way fw_patch_parse_seq
+**                 splits them
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+static int bench_load(const char *p_path, bench_file_t *p_file)
+{
+    FILE *fp;
+    long size;
+    char *p, *p_end, *p_eol, *p_tok;
+
+    memset(p_file, 0, sizeof(bench_file_t));
+
+    if ((fp = fopen(p_path, "rb")) == NULL)
+        return -1;
+
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    rewind(fp);
+
+    p_file->p_text = malloc(size + 1);
+    /* Never more runs than characters */
+    p_file->p_runs = malloc((size + 1) * sizeof(hex_run_t));
+
+    if ((p_file->p_text == NULL) || (p_file->p_runs == NULL) ||
+        (fread(p_file->p_text, 1, size, fp) != (size_t) size))
+    {
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+
+    p_end = p_file->p_text + size;
+    *p_end = '\0';
+
+    for (p = p_file->p_text; p < p_end; p = p_eol + 1)
+    {
+        if ((p_eol = memchr(p, '\n', p_end - p)) == NULL)
+            p_eol = p_end;
+
+        if ((p_eol - p < 2) || (p[0] != '0') || ((p[1] != '1') && (p[1] != '2')))
+            continue;
+
+        for (p += 2; p < p_eol; p = p_tok)
+        {
+            if ((unsigned char) *p <= ' ')
+            {
+                p_tok = p + 1;
+                continue;
+            }
+
+            for (p_tok = p; (p_tok < p_eol) && ((unsigned char) *p_tok > ' ');
+                 p_tok++);
+
+            p_file->p_runs[p_file->run_count].p_text = p;
+            p_file->p_runs[p_file->run_count].len = (p_tok - p) / 2;
+            p_file->run_count++;
+            p_file->hex_chars += p_tok - p;
+        }
+    }
+
+    return 0;
+}
+
+/*******************************************************************************
+**
+** Function        bench_run
+**
+** Description     Decode all runs of p_file rounds times with decoder
+**
+** Returns         MB/s of hex text
+**
+*******************************************************************************/
+static double bench_run(const bench_file_t *p_file, hex_decoder_t decoder,
+                        int rounds, uint8_t *p_out)
+{
+    double start, elapsed;
+    int r, i;
+
+    start = now_sec();
+    for (r = 0; r < rounds; r++)
+    {
+        for (i = 0; i < p_file->run_count; i++)
+            decoder(p_out, p_file->p_runs[i].p_text, p_file->p_runs[i].len);
+    }
+    elapsed = now_sec() - start;
+
+    return (double) p_file->hex_chars * rounds / elapsed / 1e6;
+}
+
+/*******************************************************************************
+**
+** Function        bench_check
+**
+** Description     Verify both new decoders agree with the legacy one
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+static int bench_check(const bench_file_t *p_file)
+{
+    uint8_t ref[256], out[256];
+    const hex_run_t *p_run;
+    int i;
+
+    for (i = 0; i < p_file->run_count; i++)
+    {
+        p_run = &p_file->p_runs[i];
+        if (p_run->len > sizeof(ref))
+            continue;
+
+        legacy_decode(ref, p_run->p_text, p_run->len);
+
+        if ((hex_decode_scalar(out, p_run->p_text, p_run->len) != 0) ||
+            (memcmp(ref, out, p_run->len) != 0))
+            return -1;
+
+        if ((hex_decode(out, p_run->p_text, p_run->len) != 0) ||
+            (memcmp(ref, out, p_run->len) != 0))
+            return -1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    bench_file_t file;
+    uint8_t out[4096];
+    int rounds = BENCH_DEFAULT_ROUNDS;
+    int opt, i;
+    double legacy, scalar, simd;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n':
+                rounds = atoi(optarg);
+                break;
+
+            default:
+                fprintf(stderr, "usage: %s [-n <rounds>] <patch.seq> ...\n",
+                        argv[0]);
+                return 1;
+        }
+    }
+
+    if ((optind >= argc) || (rounds <= 0))
+    {
+        fprintf(stderr, "usage: %s [-n <rounds>] <patch.seq> ...\n", argv[0]);
+        return 1;
+    }
+
+    printf("%-28s %9s %12s %12s %12s\n", "file", "hex chars",
+           "form_byte", "lut", "simd");
+
+    for (i = optind; i < argc; i++)
+    {
+        if (bench_load(argv[i], &file) != 0)
+        {
+            fprintf(stderr, "%s: can not read %s\n", argv[0], argv[i]);
+            return 1;
+        }
+
+        if (bench_check(&file) != 0)
+        {
+            fprintf(stderr, "%s: decoders disagree on %s\n", argv[0], argv[i]);
+            return 1;
+        }
+
+        /* The legacy decoder is about two orders of magnitude slower */
+        legacy = bench_run(&file, legacy_decode, (rounds + 9) / 10, out);
+        scalar = bench_run(&file, hex_decode_scalar, rounds, out);
+        simd = bench_run(&file, hex_decode, rounds, out);
+
+        printf("%-28s %9zu %7.1f MB/s %7.1f MB/s %7.1f MB/s\n",
+               strrchr(argv[i], '/') ? strrchr(argv[i], '/') + 1 : argv[i],
+               file.hex_chars, legacy, scalar, simd);
+
+        free(file.p_runs);
+        free(file.p_text);
+    }
+
+    return 0;
+}
@@ -0,0 +1,442 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      mock_stack.c
+ *
+ *  Description:   In-process stand-in for the bluedroid HCI layer
+ *
+ *                 Behaves like the KitKat hci_h4 internal command path:
+ *                 at most MOCK_INT_CMD_MAX internal commands outstanding,
+ *                 commands are sent while the controller grants credits
+ *                 and freed once sent, a Command Complete/Status is handed
+ *                 to the callback of the oldest outstanding command when
+ *                 the opcode matches.
+ *
+ *                 The controller is either the model of sim_controller.c
+ *                 called in-process, or whatever is on the other side of
+ *                 the UART given to mock_stack_attach().
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include "bt_vendor_lib.h"
+#include "bt_hci_bdroid.h"
+#include "mock_stack.h"
+
+/******************************************************************************
+**  Constants & Macros
+******************************************************************************/
+
+#ifndef FALSE
+#define FALSE  0
+#endif
+
+#ifndef TRUE
+#define TRUE   (!FALSE)
+#endif
+
+#define HCI_EVT_CMD_CMPL        0x0E
+#define HCI_EVT_CMD_STAT        0x0F
+
+/******************************************************************************
+**  Type definitions
+******************************************************************************/
+
+typedef struct
+{
+    uint16_t        opcode;
+    HC_BT_HDR       *p_buf;
+    tINT_CMD_CBACK  p_cback;
+} mock_cmd_t;
+
+typedef struct
+{
+    mock_cmd_t  cmd[MOCK_INT_CMD_MAX];  /* queued and outstanding commands */
+    int         head;
+    int         sent;                   /* commands at head sent already */
+    int         count;
+    uint8_t     credits;
+    int         fd;                     /* UART, -1 for the in-process model */
+    uint8_t     rx_pkt[SIM_PKT_MAX];    /* H4 event being received */
+    uint16_t    rx_len;
+    sim_ctrl_t  sim;
+} mock_cb_t;
+
+/******************************************************************************
+**  Variables
+******************************************************************************/
+
+mock_stats_t mock_stats;
+mock_results_t mock_results;
+
+/******************************************************************************
+**  Static variables
+******************************************************************************/
+
+static mock_cb_t mock_cb;
+
+/******************************************************************************
+**  Callbacks
+******************************************************************************/
+
+static void mock_fwcfg_cb(bt_vendor_op_result_t result)
+{
+    mock_results.fwcfg = result;
+}
+
+static void mock_scocfg_cb(bt_vendor_op_result_t result)
+{
+    mock_results.scocfg = result;
+}
+
+static void mock_lpm_cb(bt_vendor_op_result_t result)
+{
+    mock_results.lpm = result;
+}
+
+static void mock_epilog_cb(bt_vendor_op_result_t result)
+{
+    mock_results.epilog = result;
+}
+
+static void *mock_alloc(int size)
+{
+    mock_stats.allocs++;
+    mock_stats.alloc_bytes += size;
+    return malloc(size);
+}
+
+static void mock_dealloc(void *p_buf)
+{
+    mock_stats.deallocs++;
+    free(p_buf);
+}
+
+static uint8_t mock_xmit_cb(uint16_t opcode, void *p_buf,
+                            tINT_CMD_CBACK p_cback)
+{
+    mock_cmd_t *p_cmd;
+
+    if (mock_cb.count == MOCK_INT_CMD_MAX)
+    {
+        mock_stats.xmit_rejects++;
+        return FALSE;
+    }
+
+    p_cmd = &mock_cb.cmd[(mock_cb.head + mock_cb.count) % MOCK_INT_CMD_MAX];
+    p_cmd->opcode = opcode;
+    p_cmd->p_buf = (HC_BT_HDR *) p_buf;
+    p_cmd->p_cback = p_cback;
+    mock_cb.count++;
+
+    return TRUE;
+}
+
+const bt_vendor_callbacks_t mock_stack_cbacks =
+{
+    sizeof(bt_vendor_callbacks_t),
+    mock_fwcfg_cb,
+    mock_scocfg_cb,
+    mock_lpm_cb,
+    mock_alloc,
+    mock_dealloc,
+    mock_xmit_cb,
+    mock_epilog_cb
+};
+
+/******************************************************************************
+**  Static functions
+******************************************************************************/
+
+/*******************************************************************************
+**
+** Function        mock_send
+**
+** Description     Send queued commands while the controller grants credits
+**
+** Returns         number of commands sent
+**
+*******************************************************************************/
+static int mock_send(void)
+{
+    mock_cmd_t *p_cmd;
+    uint8_t pkt[1 + 3 + 255];
+    int n = 0;
+
+    while ((mock_cb.credits > 0) && (mock_cb.sent < mock_cb.count))
+    {
+        p_cmd = &mock_cb.cmd[(mock_cb.head + mock_cb.sent) % MOCK_INT_CMD_MAX];
+
+        pkt[0] = SIM_H4_CMD;
+        memcpy(pkt + 1, (uint8_t *) (p_cmd->p_buf + 1) + p_cmd->p_buf->offset,
+               p_cmd->p_buf->len);
+
+        if (mock_cb.fd < 0)
+            sim_rx(&mock_cb.sim, pkt, p_cmd->p_buf->len + 1, 0.0, 0);
+        else if (write(mock_cb.fd, pkt, p_cmd->p_buf->len + 1) !=
+                 p_cmd->p_buf->len + 1)
+            fprintf(stderr, "mock: short write on the UART\n");
+
+        mock_stats.tx_bytes += p_cmd->p_buf->len + 1;
+
+        /* The HCI layer releases the command once it is on the wire */
+        mock_dealloc(p_cmd->p_buf);
+        p_cmd->p_buf = NULL;
+
+        mock_cb.sent++;
+        mock_cb.credits--;
+        mock_stats.commands++;
+        n++;
+    }
+
+    return n;
+}
+
+/*******************************************************************************
+**
+** Function        mock_deliver
+**
+** Description     Hand one controller event to the library
+**
+** Returns         None
+**
+*******************************************************************************/
+static void mock_deliver(const uint8_t *p_evt, uint16_t len)
+{
+    mock_cmd_t cmd;
+    HC_BT_HDR *p_buf;
+    uint16_t opcode = 0;
+
+    if (p_evt[0] == HCI_EVT_CMD_CMPL)
+    {
+        mock_cb.credits = p_evt[2];
+        opcode = p_evt[3] | (p_evt[4] << 8);
+    }
+    else if (p_evt[0] == HCI_EVT_CMD_STAT)
+    {
+        mock_cb.credits = p_evt[3];
+        opcode = p_evt[4] | (p_evt[5] << 8);
+    }
+
+    if ((opcode == 0) || (mock_cb.sent == 0) ||
+        (mock_cb.cmd[mock_cb.head].opcode != opcode))
+    {
+        /* Would go up to the stack */
+        mock_stats.unsolicited++;
+        return;
+    }
+
+    cmd = mock_cb.cmd[mock_cb.head];
+    mock_cb.head = (mock_cb.head + 1) % MOCK_INT_CMD_MAX;
+    mock_cb.sent--;
+    mock_cb.count--;
+
+    if ((p_buf = (HC_BT_HDR *) malloc(BT_HC_HDR_SIZE + len)) == NULL)
+        return;
+
+    p_buf->event = MSG_HC_TO_STACK_HCI_EVT;
+    p_buf->offset = 0;
+    p_buf->len = len;
+    p_buf->layer_specific = 0;
+    memcpy(p_buf + 1, p_evt, len);
+
+    mock_stats.events++;
+    cmd.p_cback(p_buf);
+}
+
+/******************************************************************************
+**  Functions
+******************************************************************************/
+
+/*******************************************************************************
+**
+** Function        mock_stack_init
+**
+** Description     Reset the mock and power on the controller model
+**
+** Returns         None
+**
+*******************************************************************************/
+void mock_stack_init(const sim_cfg_t *p_cfg)
+{
+    sim_cfg_t cfg;
+
+    mock_stack_cleanup();
+
+    mock_cb.fd = -1;
+    mock_cb.rx_len = 0;
+
+    memset(&mock_stats, 0, sizeof(mock_stats_t));
+    mock_results.fwcfg = MOCK_RESULT_NONE;
+    mock_results.scocfg = MOCK_RESULT_NONE;
+    mock_results.lpm = MOCK_RESULT_NONE;
+    mock_results.epilog = MOCK_RESULT_NONE;
+
+    /* No wire here, the host always runs at the controller's rate */
+    if (p_cfg != NULL)
+    {
+        cfg = *p_cfg;
+        cfg.strict_baud = 0;
+        sim_init(&mock_cb.sim, &cfg);
+    }
+
+    mock_cb.credits = 1;
+}
+
+/*******************************************************************************
+**
+** Function        mock_stack_pump
+**
+** Description     Send the queued commands and deliver the controller's
+**                 events until nothing moves any more
+**
+** Returns         number of events delivered
+**
+*******************************************************************************/
+int mock_stack_pump(void)
+{
+    const sim_pkt_t *p_pkt;
+    uint8_t evt[SIM_PKT_MAX];
+    uint32_t events = mock_stats.events;
+    int progress;
+
+    do
+    {
+        progress = mock_send();
+
+        /* Time does not matter in-process, take whatever is queued */
+        while (sim_tx_due(&mock_cb.sim) >= 0)
+        {
+            if ((p_pkt = sim_tx_pop(&mock_cb.sim, 1e30, 0)) == NULL)
+                continue;
+
+            /* Copy out, the callback may queue further events */
+            memcpy(evt, p_pkt->pkt + 1, p_pkt->len - 1);
+            mock_deliver(evt, p_pkt->len - 1);
+            progress++;
+        }
+    } while (progress > 0);
+
+    return mock_stats.events - events;
+}
+
+/*******************************************************************************
+**
+** Function        mock_stack_attach
+**
+** Description     Talk H4 over the UART fd from now on
+**
+** Returns         None
+**
+*******************************************************************************/
+void mock_stack_attach(int fd)
+{
+    mock_cb.fd = fd;
+    mock_cb.rx_len = 0;
+}
+
+/*******************************************************************************
+**
+** Function        mock_stack_wait
+**
+** Description     Send the queued commands, then wait up to timeout_ms for
+**                 data on the UART and deliver the complete events
+**
+** Returns         number of events delivered, -1 on timeout or error
+**
+*******************************************************************************/
+int mock_stack_wait(int timeout_ms)
+{
+    struct pollfd pfd;
+    struct timespec t0, t1;
+    uint8_t buf[1024];
+    uint32_t events = mock_stats.events;
+    uint16_t need;
+    int i, n;
+
+    mock_send();
+
+    pfd.fd = mock_cb.fd;
+    pfd.events = POLLIN;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    n = poll(&pfd, 1, timeout_ms);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    mock_stats.wait_sec += (t1.tv_sec - t0.tv_sec) +
+        (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+    if ((n <= 0) || ((n = read(mock_cb.fd, buf, sizeof(buf))) <= 0))
+        return -1;
+
+    mock_stats.rx_bytes += n;
+
+    for (i = 0; i < n; i++)
+    {
+        if ((mock_cb.rx_len == 0) && (buf[i] != SIM_H4_EVT))
+            continue;
+
+        mock_cb.rx_pkt[mock_cb.rx_len++] = buf[i];
+
+        /* indicator, event code, length, parameters */
+        need = (mock_cb.rx_len < 3) ? 3 : 3 + mock_cb.rx_pkt[2];
+        if (mock_cb.rx_len == need)
+        {
+            mock_cb.rx_len = 0;
+            mock_deliver(mock_cb.rx_pkt + 1, need - 1);
+        }
+    }
+
+    return mock_stats.events - events;
+}
+
+/*******************************************************************************
+**
+** Function        mock_stack_cleanup
+**
+** Description     Drop anything still queued
+**
+** Returns         number of buffers that were still queued
+**
+*******************************************************************************/
+int mock_stack_cleanup(void)
+{
+    int n = 0;
+
+    while (mock_cb.count > 0)
+    {
+        if (mock_cb.cmd[mock_cb.head].p_buf != NULL)
+        {
+            mock_dealloc(mock_cb.cmd[mock_cb.head].p_buf);
+            n++;
+        }
+        mock_cb.head = (mock_cb.head + 1) % MOCK_INT_CMD_MAX;
+        mock_cb.count--;
+    }
+
+    mock_cb.head = 0;
+    mock_cb.sent = 0;
+
+    return n;
+}
@@ -0,0 +1,145 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      mock_stack.h
+ *
+ *  Description:   In-process stand-in for the bluedroid HCI layer, driving
+ *                 BLUETOOTH_VENDOR_LIB_INTERFACE against the controller
+ *                 model of sim_controller.h, directly or over a UART
+ *
+ ******************************************************************************/
+
+#ifndef MOCK_STACK_H
+#define MOCK_STACK_H
+
+#include <stdint.h>
+#include "bt_vendor_lib.h"
+#include "sim_controller.h"
+
+/******************************************************************************
+**  Constants & Macros
+******************************************************************************/
+
+/* Depth of the internal command queue of the HCI layer */
+#define MOCK_INT_CMD_MAX        8
+
+/* Result not reported yet */
+#define MOCK_RESULT_NONE        (-1)
+
+/******************************************************************************
+**  Type definitions
+******************************************************************************/
+
+typedef struct
+{
+    uint32_t    allocs;                 /* alloc callback */
+    uint32_t    alloc_bytes;
+    uint32_t    deallocs;               /* dealloc callback */
+    uint32_t    commands;               /* commands sent to the controller */
+    uint32_t    xmit_rejects;           /* xmit_cb calls refused */
+    uint32_t    events;                 /* events handed to the library */
+    uint32_t    unsolicited;            /* events nobody waited for */
+    uint32_t    tx_bytes;               /* H4 bytes sent */
+    uint32_t    rx_bytes;               /* H4 bytes received on the UART */
+    double      wait_sec;               /* blocked waiting for the UART */
+} mock_stats_t;
+
+/* Results reported through the callbacks, MOCK_RESULT_NONE until then */
+typedef struct
+{
+    int         fwcfg;
+    int         scocfg;
+    int         lpm;
+    int         epilog;
+} mock_results_t;
+
+/******************************************************************************
+**  Variables
+******************************************************************************/
+
+extern const bt_vendor_callbacks_t mock_stack_cbacks;
+
+extern mock_stats_t mock_stats;
+extern mock_results_t mock_results;
+
+/******************************************************************************
+**  Functions
+******************************************************************************/
+
+/*******************************************************************************
+**
+** Function        mock_stack_init
+**
+** Description     Reset the mock and power on the controller model, p_cfg
+**                 NULL when a real UART is attached later
+**
+** Returns         None
+**
+*******************************************************************************/
+void mock_stack_init(const sim_cfg_t *p_cfg);
+
+/*******************************************************************************
+**
+** Function        mock_stack_pump
+**
+** Description     Send the queued commands and deliver the controller's
+**                 events until nothing moves any more
+**
+** Returns         number of events delivered
+**
+*******************************************************************************/
+int mock_stack_pump(void);
+
+/*******************************************************************************
+**
+** Function        mock_stack_attach
+**
+** Description     Talk H4 over the UART fd (from BT_VND_OP_USERIAL_OPEN)
+**                 instead of the in-process controller model
+**
+** Returns         None
+**
+*******************************************************************************/
+void mock_stack_attach(int fd);
+
+/*******************************************************************************
+**
+** Function        mock_stack_wait
+**
+** Description     Send the queued commands, then wait up to timeout_ms for
+**                 data on the UART and deliver the complete events
+**
+** Returns         number of events delivered, -1 on timeout or error
+**
+*******************************************************************************/
+int mock_stack_wait(int timeout_ms);
+
+/*******************************************************************************
+**
+** Function        mock_stack_cleanup
+**
+** Description     Drop anything still queued
+**
+** Returns         number of buffers that were still queued
+**
+*******************************************************************************/
+int mock_stack_cleanup(void);
+
+#endif /* MOCK_STACK_H */
@@ -0,0 +1,322 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      seq2bseq.c
+ *
+ *  Description:   Host tool compiling a textual firmware patch (.seq) into
+ *                 the binary patch format (.bseq) loaded by fw_patch.c,
+ *                 optionally repacking its MEMWRITE records (fw_repack.c)
+ *                 and deflating them into a compressed patch (.bseqz), or
+ *                 bundling several patches into one file (fw_bundle.c), or
+ *                 into the C tables of the embedded patches (fw_embedded.h)
+ *
+ ******************************************************************************/
+
+#define LOG_TAG "bt_seq2bseq"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "fw_bundle.h"
+#include "fw_patch.h"
+#include "fw_repack.h"
+
+/*******************************************************************************
+**
+** Function        usage
+**
+** Description     Print the command line help
+**
+** Returns         None
+**
+*******************************************************************************/
+static void usage(const char *p_prog)
+{
+    fprintf(stderr,
+        "usage: %s [-k <version key>] [-r] [-m <chunk>] [-z] <patch.seq> <patch.bseq>\n"
+        "       %s [-r] [-m <chunk>] -b <bundle> <patch.seq> ...\n"
+        "       %s [-r] [-m <chunk>] -c <tables.c> <patch.seq> ...\n"
+        "       %s -n [-m <chunk>] <patch.seq> ...\n"
+        "  -k  18 hex digit RDSW version key, default: taken from the\n"
+        "      name of the .seq file\n"
+        "  -r  repack the MEMWRITE records\n"
+        "  -m  MEMWRITE data bytes when repacking, default %d, at most %d\n"
+        "  -z  deflate the records, the output is a .bseqz\n"
+        "  -b  write the patches, keyed by their file names, to one\n"
+        "      bundle file\n"
+        "  -c  write the patches, keyed by their file names, as the C\n"
+        "      tables of FW_PATCH_EMBEDDED\n"
+        "  -n  only report the command count of each patch before and\n"
+        "      after repacking\n", p_prog, p_prog, p_prog, p_prog,
+        FW_REPACK_CHUNK_DEFAULT,
+        FW_REPACK_DATA_MAX);
+}
+
+/*******************************************************************************
+**
+** Function        repack
+**
+** Description     Repack the loaded patch and report the command counts
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+static int repack(const char *p_name, fw_patch_t *p_patch, int chunk)
+{
+    uint32_t before = p_patch->cmd_count;
+
+    if (fw_repack_image(p_patch, chunk) != 0)
+    {
+        fprintf(stderr, "%s: can not repack\n", p_name);
+        return -1;
+    }
+
+    printf("%s: %u commands, %u after repacking (%d bytes per MEMWRITE)\n",
+        p_name, before, p_patch->cmd_count, chunk);
+
+    return 0;
+}
+
+/*******************************************************************************
+**
+** Function        embed
+**
+** Description     Write the count patches of p_patches to p_out as the C
+**                 tables declared in fw_embedded.h
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+static int embed(const char *p_out, const fw_patch_t *p_patches, int count)
+{
+    FILE *fp;
+    uint32_t j;
+    int i, k;
+
+    if ((fp = fopen(p_out, "w")) == NULL)
+        return -1;
+
+    fprintf(fp, "/* Generated by bt_seq2bseq, do not edit */\n\n"
+        "#include \"fw_embedded.h\"\n");
+
+    for (i = 0; i < count; i++)
+    {
+        fprintf(fp, "\nstatic const uint8_t fw_embedded_rec_%d[] = {", i);
+        for (j = 0; j < p_patches[i].rec_size; j++)
+            fprintf(fp, "%s0x%02X,", (j % 12) ? " " : "\n    ",
+                p_patches[i].p_rec[j]);
+        fprintf(fp, "\n};\n");
+    }
+
+    fprintf(fp, "\nconst fw_embedded_patch_t fw_embedded_patches[] = {\n");
+    for (i = 0; i < count; i++)
+    {
+        fprintf(fp, "    {\n        {");
+        for (k = 0; k < FW_PATCH_KEY_LEN; k++)
+            fprintf(fp, "%s0x%02X", k ? ", " : " ", p_patches[i].key[k]);
+        fprintf(fp, " },\n        fw_embedded_rec_%d, %u, %u, %u\n    },\n", i,
+            p_patches[i].rec_size, p_patches[i].rec_count,
+            p_patches[i].cmd_count);
+    }
+    fprintf(fp, "};\n\nconst uint32_t fw_embedded_count = %d;\n", count);
+
+    return (fclose(fp) == 0) ? 0 : -1;
+}
+
+/*******************************************************************************
+**
+** Function        bundle
+**
+** Description     Load, repack if asked, and write the count patches of
+**                 pp_files to p_out as a bundle, or as C tables if to_c
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+static int bundle(const char *p_out, char **pp_files, int count, int do_repack,
+                  int chunk, int to_c)
+{
+    fw_patch_t *p_patches;
+    struct stat st;
+    uint32_t plain = 0;
+    int i, n, ret = 0;
+
+    if ((p_patches = (fw_patch_t *) calloc(count, sizeof(fw_patch_t))) == NULL)
+        return -1;
+
+    for (n = 0; (n < count) && (ret == 0); n++)
+    {
+        if (fw_patch_open(pp_files[n], &p_patches[n]) != 0)
+        {
+            fprintf(stderr, "can not load %s\n", pp_files[n]);
+            ret = -1;
+        }
+        else if (do_repack && (repack(pp_files[n], &p_patches[n], chunk) != 0))
+        {
+            ret = -1;
+        }
+    }
+
+    if ((ret == 0) && (((to_c ? embed(p_out, p_patches, count) :
+                         fw_bundle_save(p_patches, count, p_out)) != 0) ||
+                       (stat(p_out, &st) != 0)))
+    {
+        fprintf(stderr, "can not write %s\n", p_out);
+        unlink(p_out);
+        ret = -1;
+    }
+
+    if ((ret == 0) && !to_c)
+    {
+        for (i = 0; i < count; i++)
+            plain += sizeof(fw_patch_hdr_t) + p_patches[i].rec_size;
+        printf("%s: %d patches, %u bytes (%u as .bseq files)\n", p_out, count,
+            (unsigned) st.st_size, plain);
+    }
+
+    for (i = 0; i < n; i++)
+        fw_patch_close(&p_patches[i]);
+    free(p_patches);
+
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    fw_patch_t patch;
+    const char *p_key = NULL;
+    const char *p_bundle = NULL;
+    int to_c = 0;
+    int chunk = FW_REPACK_CHUNK_DEFAULT;
+    int do_repack = 0;
+    int report = 0;
+    uint8_t flags = 0;
+    struct stat st;
+    int opt, i;
+
+    while ((opt = getopt(argc, argv, "k:rm:zb:c:nh")) != -1)
+    {
+        switch (opt)
+        {
+            case 'k':
+                p_key = optarg;
+                break;
+
+            case 'r':
+                do_repack = 1;
+                break;
+
+            case 'm':
+                chunk = atoi(optarg);
+                break;
+
+            case 'z':
+                flags |= FW_PATCH_FLAG_DEFLATE;
+                break;
+
+            case 'b':
+                p_bundle = optarg;
+                break;
+
+            case 'c':
+                p_bundle = optarg;
+                to_c = 1;
+                break;
+
+            case 'n':
+                report = 1;
+                break;
+
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if ((chunk < 1) || (chunk > FW_REPACK_DATA_MAX) ||
+        ((report || p_bundle) ? (optind == argc) : (argc - optind != 2)))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (p_bundle != NULL)
+        return (bundle(p_bundle, argv + optind, argc - optind, do_repack,
+                       chunk, to_c) == 0) ? 0 : 1;
+
+    if (report)
+    {
+        for (i = optind; i < argc; i++)
+        {
+            if (fw_patch_open(argv[i], &patch) != 0)
+            {
+                fprintf(stderr, "%s: can not load %s\n", argv[0], argv[i]);
+                return 1;
+            }
+            if (repack(argv[i], &patch, chunk) != 0)
+            {
+                fw_patch_close(&patch);
+                return 1;
+            }
+            fw_patch_close(&patch);
+        }
+        return 0;
+    }
+
+    if (fw_patch_open(argv[optind], &patch) != 0)
+    {
+        fprintf(stderr, "%s: can not load %s\n", argv[0], argv[optind]);
+        return 1;
+    }
+
+    if (do_repack && (repack(argv[optind], &patch, chunk) != 0))
+    {
+        fw_patch_close(&patch);
+        return 1;
+    }
+    if ((p_key != NULL) && (fw_patch_key_from_name(p_key, patch.key) != 0))
+    {
+        fprintf(stderr, "%s: invalid version key %s\n", argv[0], p_key);
+        fw_patch_close(&patch);
+        return 1;
+    }
+
+    if ((fw_patch_save(&patch, argv[optind + 1], flags) != 0) ||
+        (stat(argv[optind + 1], &st) != 0))
+    {
+        fprintf(stderr, "%s: can not write %s\n", argv[0], argv[optind + 1]);
+        unlink(argv[optind + 1]);
+        fw_patch_close(&patch);
+        return 1;
+    }
+
+    printf("%s: %u records (%u commands), %u bytes (%u of records)\n",
+        argv[optind + 1], patch.rec_count, patch.cmd_count,
+        (unsigned) st.st_size, patch.rec_size);
+
+    fw_patch_close(&patch);
+
+    return 0;
+}
@@ -0,0 +1,510 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      sim_controller.c
+ *
+ *  Description:   Host model of an Intel Bluetooth controller
+ *
+ *                 Every byte takes 10 bit times of the controller rate on
+ *                 the wire, in both directions. Commands are processed one
+ *                 at a time, each taking the configured latency, and are
+ *                 answered either from the replayed patch file or by the
+ *                 built-in handlers below.
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include "sim_controller.h"
+
+/******************************************************************************
+**  Constants & Macros
+******************************************************************************/
+
+#define HCI_RESET                   0x0C03
+#define HCI_INTEL_RDSW_VERSION      0xFC05
+#define HCI_INTEL_MANUFACTURE       0xFC11
+#define HCI_VSC_UPDATE_BAUDRATE     0xFC18
+#define HCI_VSC_WRITE_UART_CLOCK    0xFC45
+#define HCI_INTEL_MEMWRITE          0xFC8E
+
+#define HCI_EVT_CMD_CMPL            0x0E
+#define HCI_EVT_CMD_STAT            0x0F
+
+#define SIM_BITS_PER_BYTE           10
+
+#define SIM_MAX(a, b)               (((a) > (b)) ? (a) : (b))
+
+/******************************************************************************
+**  Static functions
+******************************************************************************/
+
+/*******************************************************************************
+**
+** Function        sim_wire_baud
+**
+** Description     Rate the bytes are timed at on the wire
+**
+** Returns         line speed
+**
+*******************************************************************************/
+static uint32_t sim_wire_baud(const sim_ctrl_t *p_sim)
+{
+    return (p_sim->cfg.wire_baud != 0) ? p_sim->cfg.wire_baud : p_sim->baud;
+}
+
+/*******************************************************************************
+**
+** Function        sim_link_ok
+**
+** Description     Check whether bytes sent at the controller rate baud get
+**                 through to a host UART at host_baud
+**
+** Returns         TRUE/FALSE
+**
+*******************************************************************************/
+static int sim_link_ok(const sim_ctrl_t *p_sim, uint32_t baud,
+                       uint32_t host_baud)
+{
+    if (p_sim->cfg.strict_baud && (host_baud != baud))
+        return 0;
+
+    /* Beyond what the board carries */
+    if ((p_sim->cfg.max_baud != 0) && (baud > p_sim->cfg.max_baud))
+        return 0;
+
+    return 1;
+}
+
+/*******************************************************************************
+**
+** Function        sim_queue
+**
+** Description     Schedule an event towards the host once the controller is
+**                 done at time ready
+**
+** Returns         None
+**
+*******************************************************************************/
+static void sim_queue(sim_ctrl_t *p_sim, const uint8_t *p_evt, uint16_t len,
+                      double ready, uint8_t completes)
+{
+    sim_pkt_t *p_pkt;
+
+    if ((p_sim->txq_count == SIM_TXQ_SIZE) || (len + 1 > SIM_PKT_MAX))
+    {
+        fprintf(stderr, "sim: tx queue overflow, event 0x%02X dropped\n",
+                p_evt[0]);
+        return;
+    }
+
+    p_pkt = &p_sim->txq[(p_sim->txq_head + p_sim->txq_count) % SIM_TXQ_SIZE];
+    p_sim->txq_count++;
+
+    p_pkt->pkt[0] = SIM_H4_EVT;
+    memcpy(p_pkt->pkt + 1, p_evt, len);
+    p_pkt->len = len + 1;
+    p_pkt->baud = p_sim->baud;
+    p_pkt->completes = completes;
+
+    /* Command Complete/Status advertise the configured credits */
+    if (p_evt[0] == HCI_EVT_CMD_CMPL)
+        p_pkt->pkt[3] = p_sim->cfg.credits;
+    else if (p_evt[0] == HCI_EVT_CMD_STAT)
+        p_pkt->pkt[4] = p_sim->cfg.credits;
+
+    p_sim->tx_busy = SIM_MAX(ready, p_sim->tx_busy) +
+        (double) p_pkt->len * SIM_BITS_PER_BYTE / sim_wire_baud(p_sim);
+    p_pkt->due = p_sim->tx_busy;
+}
+
+/*******************************************************************************
+**
+** Function        sim_cmd_complete
+**
+** Description     Schedule a Command Complete event with a success status
+**                 and ret_len return parameters
+**
+** Returns         None
+**
+*******************************************************************************/
+static void sim_cmd_complete(sim_ctrl_t *p_sim, uint16_t opcode,
+                             const uint8_t *p_ret, uint8_t ret_len,
+                             double ready)
+{
+    uint8_t evt[6 + 255];
+
+    evt[0] = HCI_EVT_CMD_CMPL;
+    evt[1] = 4 + ret_len;
+    evt[2] = p_sim->cfg.credits;
+    evt[3] = opcode & 0xFF;
+    evt[4] = opcode >> 8;
+    evt[5] = 0;
+    if (ret_len > 0)
+        memcpy(evt + 6, p_ret, ret_len);
+
+    sim_queue(p_sim, evt, 6 + ret_len, ready, 1);
+}
+
+/*******************************************************************************
+**
+** Function        sim_replay_next
+**
+** Description     Move the replay position to the next patch command
+**
+** Returns         None
+**
+*******************************************************************************/
+static void sim_replay_next(sim_ctrl_t *p_sim)
+{
+    p_sim->replay_valid = 0;
+
+    if (p_sim->cfg.p_patch == NULL)
+        return;
+
+    while (fw_patch_next(p_sim->cfg.p_patch, &p_sim->replay))
+    {
+        if (p_sim->replay.type == FW_PATCH_REC_CMD)
+        {
+            p_sim->replay_valid = 1;
+            return;
+        }
+    }
+}
+
+/*******************************************************************************
+**
+** Function        sim_replay
+**
+** Description     Answer the command with the events following it in the
+**                 patch file, when it is the next command of the patch
+**
+** Returns         1 if the command was answered, 0 otherwise
+**
+*******************************************************************************/
+static int sim_replay(sim_ctrl_t *p_sim, const uint8_t *p_cmd, uint16_t len,
+                      double ready)
+{
+    fw_patch_rec_t rec;
+    uint8_t completes = 1;
+
+    if ((p_sim->replay_valid == 0) || (p_sim->replay.len != len) ||
+        (memcmp(p_sim->replay.p_pkt, p_cmd, len) != 0))
+        return 0;
+
+    p_sim->replay_valid = 0;
+
+    while (fw_patch_next(p_sim->cfg.p_patch, &rec))
+    {
+        if (rec.type == FW_PATCH_REC_CMD)
+        {
+            p_sim->replay = rec;
+            p_sim->replay_valid = 1;
+            break;
+        }
+
+        /* Only the first event answers the command, any further one is
+         * unsolicited */
+        sim_queue(p_sim, rec.p_pkt, rec.len, ready, completes);
+        completes = 0;
+    }
+
+    /* A command without events in the patch still needs its answer */
+    if (completes)
+        sim_cmd_complete(p_sim, p_cmd[0] | (p_cmd[1] << 8), NULL, 0, ready);
+
+    p_sim->stats.replayed++;
+
+    return 1;
+}
+
+/*******************************************************************************
+**
+** Function        sim_reset
+**
+** Description     HCI_RESET: close the statistics of the previous session
+**                 and restart the patch replay
+**
+** Returns         None
+**
+*******************************************************************************/
+static void sim_reset(sim_ctrl_t *p_sim)
+{
+    if (p_sim->stats.commands > 0)
+    {
+        p_sim->last_stats = p_sim->stats;
+        p_sim->session_done = 1;
+    }
+
+    memset(&p_sim->stats, 0, sizeof(sim_stats_t));
+    p_sim->outstanding = 0;
+
+    if (p_sim->cfg.p_patch != NULL)
+    {
+        fw_patch_rewind(p_sim->cfg.p_patch);
+        sim_replay_next(p_sim);
+    }
+}
+
+/*******************************************************************************
+**
+** Function        sim_command
+**
+** Description     Process a complete HCI command (without H4 indicator)
+**                 received at time arrival
+**
+** Returns         None
+**
+*******************************************************************************/
+static void sim_command(sim_ctrl_t *p_sim, const uint8_t *p_cmd, uint16_t len,
+                        double arrival)
+{
+    uint16_t opcode = p_cmd[0] | (p_cmd[1] << 8);
+    const uint8_t *p_param = p_cmd + 3;
+    uint8_t plen = p_cmd[2];
+    uint32_t latency;
+    double ready;
+
+    if (opcode == HCI_RESET)
+        sim_reset(p_sim);
+
+    if (p_sim->stats.commands++ == 0)
+        p_sim->stats.t_first = arrival;
+
+    if (p_sim->outstanding >= p_sim->cfg.credits)
+        p_sim->stats.credit_violations++;
+    p_sim->outstanding++;
+
+    if (opcode == HCI_INTEL_MEMWRITE)
+    {
+        p_sim->stats.memwrites++;
+        latency = p_sim->cfg.memwrite_latency_us;
+    }
+    else
+        latency = p_sim->cfg.cmd_latency_us;
+
+    ready = SIM_MAX(arrival, p_sim->proc_busy) + latency / 1e6;
+    p_sim->proc_busy = ready;
+
+    if ((opcode == HCI_INTEL_MANUFACTURE) && (plen >= 1))
+    {
+        if (p_param[0] != 0)
+            p_sim->stats.t_dl_start = arrival;
+        else
+            p_sim->stats.t_dl_end = ready;
+    }
+
+    if (sim_replay(p_sim, p_cmd, len, ready))
+        return;
+
+    if ((p_sim->replay_valid) && (opcode == HCI_INTEL_MEMWRITE))
+    {
+        fprintf(stderr, "sim: MEMWRITE does not match the patch record %u\n",
+                p_sim->replay.index);
+        p_sim->stats.unexpected++;
+    }
+
+    switch (opcode)
+    {
+        case HCI_INTEL_RDSW_VERSION:
+            sim_cmd_complete(p_sim, opcode, p_sim->cfg.version,
+                             FW_PATCH_KEY_LEN, ready);
+            break;
+
+        case HCI_VSC_UPDATE_BAUDRATE:
+            sim_cmd_complete(p_sim, opcode, NULL, 0, ready);
+            /* The answer still goes out at the old rate */
+            if (plen >= 6)
+            {
+                p_sim->baud = p_param[2] | (p_param[3] << 8) |
+                    (p_param[4] << 16) | ((uint32_t) p_param[5] << 24);
+            }
+            break;
+
+        case HCI_RESET:
+        case HCI_INTEL_MANUFACTURE:
+        case HCI_VSC_WRITE_UART_CLOCK:
+        case HCI_INTEL_MEMWRITE:
+        default:
+            sim_cmd_complete(p_sim, opcode, NULL, 0, ready);
+            break;
+    }
+}
+
+/******************************************************************************
+**  Functions
+******************************************************************************/
+
+/*******************************************************************************
+**
+** Function        sim_init
+**
+** Description     Initialize the controller model, as after a power-on
+**
+** Returns         None
+**
+*******************************************************************************/
+void sim_init(sim_ctrl_t *p_sim, const sim_cfg_t *p_cfg)
+{
+    memset(p_sim, 0, sizeof(sim_ctrl_t));
+    p_sim->cfg = *p_cfg;
+
+    if (p_sim->cfg.init_baud == 0)
+        p_sim->cfg.init_baud = SIM_DEFAULT_BAUD;
+    if (p_sim->cfg.credits == 0)
+        p_sim->cfg.credits = SIM_DEFAULT_CREDITS;
+
+    p_sim->baud = p_sim->cfg.init_baud;
+
+    if (p_sim->cfg.p_patch != NULL)
+    {
+        fw_patch_rewind(p_sim->cfg.p_patch);
+        sim_replay_next(p_sim);
+    }
+}
+
+/*******************************************************************************
+**
+** Function        sim_rx
+**
+** Description     Feed bytes written by the host at time now
+**
+** Returns         None
+**
+*******************************************************************************/
+void sim_rx(sim_ctrl_t *p_sim, const uint8_t *p_data, int len, double now,
+            uint32_t host_baud)
+{
+    double byte_time = (double) SIM_BITS_PER_BYTE / sim_wire_baud(p_sim);
+    uint16_t need;
+
+    p_sim->stats.rx_bytes += len;
+
+    if (!sim_link_ok(p_sim, p_sim->baud, host_baud))
+    {
+        /* Framing errors on the controller side, nothing gets through */
+        p_sim->stats.dropped_bytes += len;
+        p_sim->rx_len = 0;
+        return;
+    }
+
+    while (len-- > 0)
+    {
+        p_sim->rx_busy = SIM_MAX(now, p_sim->rx_busy) + byte_time;
+
+        if ((p_sim->rx_len == 0) && (*p_data != SIM_H4_CMD))
+        {
+            /* Only commands are modelled, resync on the next one */
+            p_sim->stats.dropped_bytes++;
+            p_data++;
+            continue;
+        }
+
+        p_sim->rx_pkt[p_sim->rx_len++] = *p_data++;
+
+        /* indicator, opcode (2), length, parameters */
+        need = (p_sim->rx_len < 4) ? 4 : 4 + p_sim->rx_pkt[3];
+        if (p_sim->rx_len == need)
+        {
+            sim_command(p_sim, p_sim->rx_pkt + 1, need - 1, p_sim->rx_busy);
+            p_sim->rx_len = 0;
+        }
+    }
+}
+
+/*******************************************************************************
+**
+** Function        sim_tx_due
+**
+** Description     Time the next packet towards the host is due
+**
+** Returns         due time, a negative value if nothing is queued
+**
+*******************************************************************************/
+double sim_tx_due(const sim_ctrl_t *p_sim)
+{
+    if (p_sim->txq_count == 0)
+        return -1.0;
+
+    return p_sim->txq[p_sim->txq_head].due;
+}
+
+/*******************************************************************************
+**
+** Function        sim_tx_pop
+**
+** Description     Dequeue the next packet towards the host if it is due
+**
+** Returns         packet to send, NULL if none is due or it was dropped
+**
+*******************************************************************************/
+const sim_pkt_t *sim_tx_pop(sim_ctrl_t *p_sim, double now, uint32_t host_baud)
+{
+    const sim_pkt_t *p_pkt;
+
+    if ((p_sim->txq_count == 0) || (p_sim->txq[p_sim->txq_head].due > now))
+        return NULL;
+
+    p_pkt = &p_sim->txq[p_sim->txq_head];
+    p_sim->txq_head = (p_sim->txq_head + 1) % SIM_TXQ_SIZE;
+    p_sim->txq_count--;
+
+    if (p_pkt->completes && (p_sim->outstanding > 0))
+        p_sim->outstanding--;
+
+    p_sim->stats.t_last = p_pkt->due;
+
+    if (!sim_link_ok(p_sim, p_pkt->baud, host_baud))
+    {
+        p_sim->stats.dropped_bytes += p_pkt->len;
+        return NULL;
+    }
+
+    p_sim->stats.tx_bytes += p_pkt->len;
+
+    return p_pkt;
+}
+
+/*******************************************************************************
+**
+** Function        sim_print_stats
+**
+** Description     Print session statistics to stdout
+**
+** Returns         None
+**
+*******************************************************************************/
+void sim_print_stats(const sim_stats_t *p_stats)
+{
+    printf("sim: %u commands (%u MEMWRITE, %u replayed, %u unexpected), "
+           "%u credit violations\n", p_stats->commands, p_stats->memwrites,
+           p_stats->replayed, p_stats->unexpected,
+           p_stats->credit_violations);
+    printf("sim: rx %u bytes, tx %u bytes, %u bytes lost to rate mismatch\n",
+           p_stats->rx_bytes, p_stats->tx_bytes, p_stats->dropped_bytes);
+
+    if (p_stats->t_last > p_stats->t_first)
+        printf("sim: session %.1f ms", (p_stats->t_last - p_stats->t_first) * 1e3);
+    if (p_stats->t_dl_end > p_stats->t_dl_start && p_stats->t_dl_start > 0)
+        printf(", download %.1f ms",
+               (p_stats->t_dl_end - p_stats->t_dl_start) * 1e3);
+    printf("\n");
+    fflush(stdout);
+}
@@ -0,0 +1,181 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      sim_controller.h
+ *
+ *  Description:   Host model of an Intel Bluetooth controller as seen over
+ *                 its H4 UART: command handling, patch event replay, UART
+ *                 rate, command latency and command credits. The model is
+ *                 driven with a clock in seconds and does no I/O itself.
+ *
+ ******************************************************************************/
+
+#ifndef SIM_CONTROLLER_H
+#define SIM_CONTROLLER_H
+
+#include <stdint.h>
+#include "fw_patch.h"
+
+/******************************************************************************
+**  Constants & Macros
+******************************************************************************/
+
+#define SIM_H4_CMD                  0x01
+#define SIM_H4_ACL                  0x02
+#define SIM_H4_SCO                  0x03
+#define SIM_H4_EVT                  0x04
+
+/* H4 indicator + event code + length + 255 parameters */
+#define SIM_PKT_MAX                 (3 + 255)
+#define SIM_TXQ_SIZE                64
+
+#define SIM_DEFAULT_BAUD            115200
+#define SIM_DEFAULT_CREDITS         1
+
+/******************************************************************************
+**  Type definitions
+******************************************************************************/
+
+typedef struct
+{
+    uint32_t    init_baud;              /* controller UART rate after reset */
+    uint32_t    wire_baud;              /* time the wire at this rate instead
+                                           of the UART rate, 0 to follow it */
+    uint32_t    cmd_latency_us;         /* processing time of a command */
+    uint32_t    memwrite_latency_us;    /* processing time of a MEMWRITE */
+    uint8_t     credits;                /* Num_HCI_Command_Packets */
+    uint8_t     version[FW_PATCH_KEY_LEN];  /* RDSW version */
+    uint8_t     strict_baud;            /* drop traffic on a rate mismatch */
+    uint32_t    max_baud;               /* rates above lose all traffic,
+                                           0 for no limit */
+    fw_patch_t  *p_patch;               /* .seq to replay, may be NULL */
+} sim_cfg_t;
+
+/* H4 packet scheduled towards the host */
+typedef struct
+{
+    double      due;                    /* last byte leaves the controller */
+    uint32_t    baud;                   /* controller rate it is sent at */
+    uint8_t     completes;              /* answers an outstanding command */
+    uint16_t    len;
+    uint8_t     pkt[SIM_PKT_MAX];
+} sim_pkt_t;
+
+typedef struct
+{
+    uint32_t    commands;
+    uint32_t    memwrites;
+    uint32_t    replayed;               /* commands answered from the patch */
+    uint32_t    unexpected;             /* commands not matching the patch */
+    uint32_t    credit_violations;
+    uint32_t    rx_bytes;
+    uint32_t    tx_bytes;
+    uint32_t    dropped_bytes;          /* lost to a rate mismatch */
+    double      t_first;                /* first command received */
+    double      t_dl_start;             /* MANUFACTURE on received */
+    double      t_dl_end;               /* MANUFACTURE off answered */
+    double      t_last;                 /* last event sent */
+} sim_stats_t;
+
+typedef struct
+{
+    sim_cfg_t       cfg;
+    uint32_t        baud;               /* current controller UART rate */
+    double          rx_busy;            /* modelled end of the last rx byte */
+    double          proc_busy;          /* end of the last processed command */
+    double          tx_busy;            /* end of the last tx byte */
+    uint8_t         rx_pkt[SIM_PKT_MAX + 2];
+    uint16_t        rx_len;
+    int             outstanding;        /* commands not answered yet */
+    sim_pkt_t       txq[SIM_TXQ_SIZE];
+    int             txq_head;
+    int             txq_count;
+    fw_patch_rec_t  replay;             /* next command of the patch */
+    int             replay_valid;
+    sim_stats_t     stats;
+    sim_stats_t     last_stats;         /* session ended by the last reset */
+    uint8_t         session_done;       /* last_stats is new */
+} sim_ctrl_t;
+
+/******************************************************************************
+**  Functions
+******************************************************************************/
+
+/*******************************************************************************
+**
+** Function        sim_init
+**
+** Description     Initialize the controller model, as after a power-on
+**
+** Returns         None
+**
+*******************************************************************************/
+void sim_init(sim_ctrl_t *p_sim, const sim_cfg_t *p_cfg);
+
+/*******************************************************************************
+**
+** Function        sim_rx
+**
+** Description     Feed bytes written by the host at time now. host_baud is
+**                 the rate the host UART is configured for.
+**
+** Returns         None
+**
+*******************************************************************************/
+void sim_rx(sim_ctrl_t *p_sim, const uint8_t *p_data, int len, double now,
+            uint32_t host_baud);
+
+/*******************************************************************************
+**
+** Function        sim_tx_due
+**
+** Description     Time the next packet towards the host is due
+**
+** Returns         due time, a negative value if nothing is queued
+**
+*******************************************************************************/
+double sim_tx_due(const sim_ctrl_t *p_sim);
+
+/*******************************************************************************
+**
+** Function        sim_tx_pop
+**
+** Description     Dequeue the next packet towards the host if it is due at
+**                 time now. host_baud is the rate of the host UART.
+**
+** Returns         packet to send, NULL if none is due. A packet sent while
+**                 the rates mismatch is dropped and NULL returned when
+**                 strict_baud is set.
+**
+*******************************************************************************/
+const sim_pkt_t *sim_tx_pop(sim_ctrl_t *p_sim, double now, uint32_t host_baud);
+
+/*******************************************************************************
+**
+** Function        sim_print_stats
+**
+** Description     Print session statistics to stdout
+**
+** Returns         None
+**
+*******************************************************************************/
+void sim_print_stats(const sim_stats_t *p_stats);
+
+#endif /* SIM_CONTROLLER_H */
@@ -0,0 +1,265 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      sim_pty.c
+ *
+ *  Description:   Pseudo-terminal transport of the controller model. The
+ *                 host UART rate is taken from the termios of the pty, so
+ *                 userial_vendor_set_line_speed() is seen by the model,
+ *                 termios2 rates included.
+ *
+ ******************************************************************************/
+
+/* posix_openpt(), grantpt(), unlockpt() and ptsname() */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "sim_pty.h"
+#include "userial_termios2.h"
+
+/******************************************************************************
+**  Constants & Macros
+******************************************************************************/
+
+/* Longest sleep while idle, bounds the reaction time to p_pty->stop */
+#define SIM_PTY_IDLE_POLL_MS    50
+
+/******************************************************************************
+**  Static variables
+******************************************************************************/
+
+static const struct
+{
+    speed_t     speed;
+    uint32_t    baud;
+} sim_pty_speeds[] =
+{
+    { B9600, 9600 },       { B19200, 19200 },     { B38400, 38400 },
+    { B57600, 57600 },     { B115200, 115200 },   { B230400, 230400 },
+    { B460800, 460800 },   { B500000, 500000 },   { B576000, 576000 },
+    { B921600, 921600 },   { B1000000, 1000000 }, { B1152000, 1152000 },
+    { B1500000, 1500000 }, { B2000000, 2000000 }, { B2500000, 2500000 },
+    { B3000000, 3000000 }, { B3500000, 3500000 }, { B4000000, 4000000 },
+};
+
+#define SIM_PTY_SPEEDS  (sizeof(sim_pty_speeds) / sizeof(sim_pty_speeds[0]))
+
+/******************************************************************************
+**  Static functions
+******************************************************************************/
+
+static double sim_pty_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/******************************************************************************
+**  Functions
+******************************************************************************/
+
+/*******************************************************************************
+**
+** Function        sim_pty_open
+**
+** Description     Create the pty and power on the controller model
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+int sim_pty_open(sim_pty_t *p_pty, const sim_cfg_t *p_cfg)
+{
+    struct termios ti;
+    unsigned int i;
+
+    memset(p_pty, 0, sizeof(sim_pty_t));
+    p_pty->slave_fd = -1;
+
+    if ((p_pty->master_fd = posix_openpt(O_RDWR | O_NOCTTY)) < 0)
+        return -1;
+
+    if ((grantpt(p_pty->master_fd) < 0) || (unlockpt(p_pty->master_fd) < 0) ||
+        ((p_pty->p_name = ptsname(p_pty->master_fd)) == NULL) ||
+        ((p_pty->slave_fd = open(p_pty->p_name, O_RDWR | O_NOCTTY)) < 0))
+    {
+        close(p_pty->master_fd);
+        return -1;
+    }
+
+    sim_init(&p_pty->sim, p_cfg);
+
+    tcgetattr(p_pty->slave_fd, &ti);
+    cfmakeraw(&ti);
+    for (i = 0; i < SIM_PTY_SPEEDS; i++)
+    {
+        if (sim_pty_speeds[i].baud == p_pty->sim.cfg.init_baud)
+        {
+            cfsetospeed(&ti, sim_pty_speeds[i].speed);
+            cfsetispeed(&ti, sim_pty_speeds[i].speed);
+        }
+    }
+    tcsetattr(p_pty->slave_fd, TCSANOW, &ti);
+
+    return 0;
+}
+
+/*******************************************************************************
+**
+** Function        sim_pty_host_baud
+**
+** Description     Rate the host configured on its side of the pty
+**
+** Returns         line speed, 0 if unknown
+**
+*******************************************************************************/
+uint32_t sim_pty_host_baud(const sim_pty_t *p_pty)
+{
+    struct termios ti;
+    userial_termios2_t ti2;
+    speed_t speed;
+    unsigned int i;
+
+    if (tcgetattr(p_pty->slave_fd, &ti) < 0)
+        return 0;
+
+    /* Rate given as an integer through termios2 */
+    if ((ti.c_cflag & CBAUD) == BOTHER)
+    {
+        if (ioctl(p_pty->slave_fd, USERIAL_TCGETS2, &ti2) < 0)
+            return 0;
+
+        return ti2.c_ospeed;
+    }
+
+    speed = cfgetospeed(&ti);
+    for (i = 0; i < SIM_PTY_SPEEDS; i++)
+    {
+        if (sim_pty_speeds[i].speed == speed)
+            return sim_pty_speeds[i].baud;
+    }
+
+    return 0;
+}
+
+/*******************************************************************************
+**
+** Function        sim_pty_run
+**
+** Description     Serve the host until p_pty->stop is set. Events are
+**                 written to the pty when the model says their last byte
+**                 has crossed the wire.
+**
+** Returns         None
+**
+*******************************************************************************/
+void sim_pty_run(sim_pty_t *p_pty)
+{
+    const sim_pkt_t *p_pkt;
+    sim_cfg_t cfg;
+    struct pollfd pfd;
+    struct timespec ts;
+    uint8_t buf[1024];
+    double now, due, wait;
+    int n;
+
+    pfd.fd = p_pty->master_fd;
+    pfd.events = POLLIN;
+
+    while (!p_pty->stop)
+    {
+        if (p_pty->power_cycle)
+        {
+            /* Controller off and on again, at its init rate */
+            cfg = p_pty->sim.cfg;
+            sim_init(&p_pty->sim, &cfg);
+            tcflush(p_pty->master_fd, TCIFLUSH);
+            p_pty->power_cycle = 0;
+        }
+
+        /* Send whatever the model has finished by now */
+        now = sim_pty_now();
+        while (((due = sim_tx_due(&p_pty->sim)) >= 0) && (due <= now))
+        {
+            p_pkt = sim_tx_pop(&p_pty->sim, now, sim_pty_host_baud(p_pty));
+            if ((p_pkt != NULL) &&
+                (write(p_pty->master_fd, p_pkt->pkt, p_pkt->len) != p_pkt->len))
+                fprintf(stderr, "sim: short write to the pty\n");
+        }
+
+        wait = (due >= 0) ? due - now : SIM_PTY_IDLE_POLL_MS / 1e3;
+        if (wait > SIM_PTY_IDLE_POLL_MS / 1e3)
+            wait = SIM_PTY_IDLE_POLL_MS / 1e3;
+        ts.tv_sec = (time_t) wait;
+        ts.tv_nsec = (long) ((wait - ts.tv_sec) * 1e9);
+
+        if (ppoll(&pfd, 1, &ts, NULL) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (pfd.revents & POLLIN)
+        {
+            n = read(p_pty->master_fd, buf, sizeof(buf));
+            if (n > 0)
+                sim_rx(&p_pty->sim, buf, n, sim_pty_now(),
+                       sim_pty_host_baud(p_pty));
+        }
+
+        if (p_pty->sim.session_done)
+        {
+            if (p_pty->p_session_cback != NULL)
+                p_pty->p_session_cback(&p_pty->sim.last_stats);
+            p_pty->sim.session_done = 0;
+        }
+    }
+}
+
+/*******************************************************************************
+**
+** Function        sim_pty_close
+**
+** Description     Close both sides of the pty
+**
+** Returns         None
+**
+*******************************************************************************/
+void sim_pty_close(sim_pty_t *p_pty)
+{
+    if (p_pty->slave_fd >= 0)
+        close(p_pty->slave_fd);
+    if (p_pty->master_fd >= 0)
+        close(p_pty->master_fd);
+
+    p_pty->slave_fd = -1;
+    p_pty->master_fd = -1;
+}
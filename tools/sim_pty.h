@@ -0,0 +1,103 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      sim_pty.h
+ *
+ *  Description:   Pseudo-terminal transport of the controller model
+ *
+ ******************************************************************************/
+
+#ifndef SIM_PTY_H
+#define SIM_PTY_H
+
+#include <signal.h>
+#include "sim_controller.h"
+
+/******************************************************************************
+**  Type definitions
+******************************************************************************/
+
+typedef void (*sim_session_cback_t)(const sim_stats_t *p_stats);
+
+typedef struct
+{
+    sim_ctrl_t          sim;
+    int                 master_fd;
+    int                 slave_fd;           /* kept open, see sim_pty_open */
+    const char          *p_name;            /* slave device */
+    volatile sig_atomic_t stop;             /* set to leave sim_pty_run */
+    volatile sig_atomic_t power_cycle;      /* set to restart the model,
+                                               cleared once done */
+    sim_session_cback_t p_session_cback;    /* called on each HCI_RESET */
+} sim_pty_t;
+
+/******************************************************************************
+**  Functions
+******************************************************************************/
+
+/*******************************************************************************
+**
+** Function        sim_pty_open
+**
+** Description     Create the pty and power on the controller model. The
+**                 slave side is kept open, raw and at the controller init
+**                 rate, so that it survives the host closing and reopening
+**                 it.
+**
+** Returns         0 : Success
+**                 Otherwise : Fail
+**
+*******************************************************************************/
+int sim_pty_open(sim_pty_t *p_pty, const sim_cfg_t *p_cfg);
+
+/*******************************************************************************
+**
+** Function        sim_pty_host_baud
+**
+** Description     Rate the host configured on its side of the pty
+**
+** Returns         line speed, 0 if unknown
+**
+*******************************************************************************/
+uint32_t sim_pty_host_baud(const sim_pty_t *p_pty);
+
+/*******************************************************************************
+**
+** Function        sim_pty_run
+**
+** Description     Serve the host until p_pty->stop is set
+**
+** Returns         None
+**
+*******************************************************************************/
+void sim_pty_run(sim_pty_t *p_pty);
+
+/*******************************************************************************
+**
+** Function        sim_pty_close
+**
+** Description     Close both sides of the pty
+**
+** Returns         None
+**
+*******************************************************************************/
+void sim_pty_close(sim_pty_t *p_pty);
+
+#endif /* SIM_PTY_H */
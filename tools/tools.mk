@@ -0,0 +1,181 @@
+LOCAL_PATH := $(BT_VENDOR_TOP)
+
+# Firmware patch compiler, turns a .seq patch-file into a .bseq or .bseqz,
+# or several into a bundle
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        tools/seq2bseq.c \
+        src/fw_bundle.c \
+        src/fw_patch.c \
+        src/fw_repack.c \
+        src/hex_decode.c
+
+LOCAL_C_INCLUDES += \
+        $(BT_VENDOR_TOP)/include
+
+LOCAL_STATIC_LIBRARIES := \
+        libz \
+        liblog
+
+LOCAL_MODULE := bt_seq2bseq
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE_OWNER := Intel
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# Microbenchmark of the .seq hex decoding
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        tools/hexbench.c \
+        src/hex_decode.c
+
+LOCAL_C_INCLUDES += \
+        $(BT_VENDOR_TOP)/include
+
+LOCAL_MODULE := bt_hexbench
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE_OWNER := Intel
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# Controller simulator on a pseudo-terminal, for off-target download runs
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        tools/btsim.c \
+        tools/sim_pty.c \
+        tools/sim_controller.c \
+        src/fw_patch.c \
+        src/fw_repack.c \
+        src/hex_decode.c
+
+LOCAL_C_INCLUDES += \
+        $(BT_VENDOR_TOP)/include
+
+LOCAL_STATIC_LIBRARIES := \
+        libz \
+        liblog
+
+LOCAL_MODULE := bt_sim
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE_OWNER := Intel
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# Host build of the library, for the off-target benchmarks
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := $(BT_VENDOR_SRC_FILES)
+
+LOCAL_C_INCLUDES += \
+        $(BT_VENDOR_TOP)/include \
+        $(BDROID_DIR)/hci/include
+
+LOCAL_MODULE := libbt-vendor-host
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE_OWNER := Intel
+
+include $(BT_VENDOR_TOP)/vnd_buildcfg.mk
+
+include $(BUILD_HOST_STATIC_LIBRARY)
+
+# FW_CFG/LPM/SCO benchmark of the host library against a mock stack
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        tools/vndbench.c \
+        tools/mock_stack.c \
+        tools/sim_controller.c
+
+LOCAL_C_INCLUDES += \
+        $(BT_VENDOR_TOP)/include \
+        $(BDROID_DIR)/hci/include
+
+LOCAL_STATIC_LIBRARIES := \
+        libbt-vendor-host \
+        libcutils \
+        libz \
+        liblog
+
+LOCAL_LDLIBS := -lpthread -lrt
+
+ifeq ($(HOST_OS),linux)
+# Count the library's heap allocations
+LOCAL_CFLAGS += -DBENCH_WRAP_MALLOC
+LOCAL_LDFLAGS += -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc
+endif
+
+LOCAL_MODULE := bt_vndbench
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE_OWNER := Intel
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# End-to-end USERIAL_OPEN + FW_CFG benchmark over a pty, per shipped patch
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        tools/dlbench.c \
+        tools/mock_stack.c \
+        tools/sim_pty.c \
+        tools/sim_controller.c
+
+LOCAL_C_INCLUDES += \
+        $(BT_VENDOR_TOP)/include \
+        $(BDROID_DIR)/hci/include
+
+LOCAL_STATIC_LIBRARIES := \
+        libbt-vendor-host \
+        libcutils \
+        libz \
+        liblog
+
+LOCAL_LDLIBS := -lpthread -lrt
+
+ifeq ($(HOST_OS),linux)
+# Time the patch file accesses of the library
+LOCAL_CFLAGS += -DBENCH_WRAP_IO
+LOCAL_LDFLAGS += -Wl,--wrap=fw_patch_open,--wrap=opendir,--wrap=readdir,--wrap=closedir
+# Power cycles of the rate probe restart the controller model
+LOCAL_CFLAGS += -DBENCH_WRAP_POWER
+LOCAL_LDFLAGS += -Wl,--wrap=upio_set_bluetooth_power
+endif
+
+LOCAL_MODULE := bt_dlbench
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE_OWNER := Intel
+
+include $(BT_VENDOR_TOP)/vnd_buildcfg.mk
+
+include $(BUILD_HOST_EXECUTABLE)
+
+# UART throughput/latency/error sweep over rates and flow control, on a
+# loopback or the controller model
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        tools/uartbench.c \
+        tools/sim_pty.c \
+        tools/sim_controller.c
+
+LOCAL_C_INCLUDES += \
+        $(BT_VENDOR_TOP)/include \
+        $(BDROID_DIR)/hci/include
+
+LOCAL_STATIC_LIBRARIES := \
+        libbt-vendor-host \
+        libcutils \
+        libz \
+        liblog
+
+LOCAL_LDLIBS := -lpthread -lrt
+
+LOCAL_MODULE := bt_uartbench
+LOCAL_MODULE_TAGS := optional
+LOCAL_MODULE_OWNER := Intel
+
+include $(BT_VENDOR_TOP)/vnd_buildcfg.mk
+
+include $(BUILD_HOST_EXECUTABLE)
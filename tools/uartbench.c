@@ -0,0 +1,618 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      uartbench.c
+ *
+ *  Description:   UART characterization. The port is opened and set up by
+ *                 the library (userial_vendor_open, set_line_speed and
+ *                 set_flow_control), and every rate of the sweep measured,
+ *                 with and without RTS/CTS flow control, for throughput,
+ *                 one-way latency and errors. The table ends with the best
+ *                 setting, as the UartBaud and UartFlowControl entries of
+ *                 the conf file.
+ *
+ *                 -P <port> measures a port with a loopback stand-in in
+ *                 place of the controller: TX wired to RX, and RTS to CTS.
+ *                 The bytes sent are read back and compared.
+ *
+ *                 Without -P, the controller model is run on a pty and the
+ *                 link measured over HCI: each rate is switched to with
+ *                 HCI_VSC_UPDATE_BAUDRATE, latency is half the round trip
+ *                 of RDSW_VERSION, and throughput the MEMWRITE payload rate
+ *                 of a download. -m is the highest rate the modelled board
+ *                 carries, -l the command processing time of the model. A
+ *                 rate that does not hold costs a power cycle of the model.
+ *
+ *                 Errors are bytes lost or corrupted on a loopback, and
+ *                 exchanges lost on the model, plus the framing, parity and
+ *                 overrun counts of the driver where it keeps them.
+ *
+ *                 -L sets UartLatencyProfile for the open, to compare the
+ *                 latency of the profiles.
+ *
+ *                 usage: bt_uartbench [-P <port>] [-b <baud,...>]
+ *                                     [-f <flow control,...>] [-n <bytes>]
+ *                                     [-r <rounds>] [-m <max baud>]
+ *                                     [-l <latency us>]
+ *                                     [-L <default|low>]
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "bt_vendor.h"
+#include "userial.h"
+#include "userial_vendor.h"
+#include "sim_pty.h"
+
+/******************************************************************************
+**  Constants & Macros
+******************************************************************************/
+
+#define UBENCH_DEFAULT_BAUDS    "115200,921600,1000000,1500000,2000000," \
+                                "3000000,3250000,3500000,4000000"
+#define UBENCH_DEFAULT_BYTES    16384
+#define UBENCH_DEFAULT_ROUNDS   16
+
+/* Flow control settings swept by default: the pty has no handshake lines */
+#define UBENCH_DEFAULT_FLOWS_LOOP   "1,0"
+#define UBENCH_DEFAULT_FLOWS_SIM    "1"
+
+/* Nothing received for that long, the rest is lost */
+#define UBENCH_TIMEOUT_MS       200
+
+/* Loopback writes, and MEMWRITE payload */
+#define UBENCH_WRITE_CHUNK      256
+#define UBENCH_MEMWRITE_DATA    FW_PATCH_REPACK_CHUNK
+
+#define HCI_VSC_UPDATE_BAUDRATE 0xFC18
+#define HCI_INTEL_RDSW_VERSION  0xFC05
+#define HCI_INTEL_MEMWRITE      0xFC8E
+#define MEMWRITE_HDR_SIZE       6       /* address (4), mode, length */
+
+#define HCI_CMD_COMPLETE_EVT    0x0E
+
+#define UBENCH_MAX_LIST         16
+
+/******************************************************************************
+**  Externs
+******************************************************************************/
+
+extern int userial_set_port(char *p_conf_name, char *p_conf_value, int param);
+extern int userial_set_latency_profile(char *p_conf_name, char *p_conf_value,
+                                       int param);
+
+/******************************************************************************
+**  Type definitions
+******************************************************************************/
+
+typedef struct
+{
+    uint32_t    baud;
+    uint8_t     flow;                   /* RTS/CTS on */
+    int         ok;                     /* the rate held, no error */
+    double      throughput;             /* payload bytes/s */
+    double      lat_avg;                /* one-way, us */
+    double      lat_max;
+    uint32_t    errors;
+} ubench_case_t;
+
+/******************************************************************************
+**  Static variables
+******************************************************************************/
+
+static sim_pty_t ubench_pty;
+static uint32_t ubench_sim_baud;        /* rate the model is at */
+
+/******************************************************************************
+**  Static functions
+******************************************************************************/
+
+static double ubench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int ubench_parse_list(char *p_list, uint32_t *p_out)
+{
+    char *p_tok, *p_save = NULL;
+    int n = 0;
+
+    for (p_tok = strtok_r(p_list, ",", &p_save);
+         (p_tok != NULL) && (n < UBENCH_MAX_LIST);
+         p_tok = strtok_r(NULL, ",", &p_save))
+        p_out[n++] = strtoul(p_tok, NULL, 0);
+
+    return n;
+}
+
+static void *ubench_sim_thread(void *p_arg)
+{
+    sim_pty_run((sim_pty_t *) p_arg);
+    return NULL;
+}
+
+/*******************************************************************************
+**
+** Function        ubench_read
+**
+** Description     Read len bytes, giving up after UBENCH_TIMEOUT_MS without
+**                 any
+**
+** Returns         Bytes read
+**
+*******************************************************************************/
+static int ubench_read(int fd, uint8_t *p_buf, int len)
+{
+    struct pollfd pfd;
+    int n = 0, ret;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+
+    while (n < len)
+    {
+        if (poll(&pfd, 1, UBENCH_TIMEOUT_MS) <= 0)
+            break;
+
+        if ((ret = read(fd, p_buf + n, len - n)) < 0)
+        {
+            if ((errno != EINTR) && (errno != EAGAIN))
+                break;
+            continue;
+        }
+
+        n += ret;
+    }
+
+    return n;
+}
+
+/*******************************************************************************
+**
+** Function        ubench_cmd
+**
+** Description     Send an HCI command and wait for its Command Complete
+**
+** Returns         0 : Success
+**                 Otherwise : lost
+**
+*******************************************************************************/
+static int ubench_cmd(int fd, uint16_t opcode, const uint8_t *p_param,
+                      uint8_t len)
+{
+    uint8_t pkt[4 + 255];
+    uint8_t evt[3 + 255];
+
+    pkt[0] = SIM_H4_CMD;
+    pkt[1] = (uint8_t) opcode;
+    pkt[2] = (uint8_t) (opcode >> 8);
+    pkt[3] = len;
+    if (len > 0)
+        memcpy(pkt + 4, p_param, len);
+
+    if (write(fd, pkt, 4 + len) != 4 + len)
+        return -1;
+
+    for (;;)
+    {
+        if ((ubench_read(fd, evt, 3) != 3) || (evt[0] != SIM_H4_EVT) ||
+            (ubench_read(fd, evt + 3, evt[2]) != evt[2]))
+            return -1;
+
+        if ((evt[1] == HCI_CMD_COMPLETE_EVT) && (evt[2] >= 4) &&
+            ((evt[4] | (evt[5] << 8)) == opcode))
+            return (evt[2] > 3) ? evt[6] : 0;
+    }
+}
+
+/*******************************************************************************
+**
+** Function        ubench_sim_restart
+**
+** Description     Power cycle the model back to its init rate, and follow
+**                 with the host
+**
+** Returns         None
+**
+*******************************************************************************/
+static void ubench_sim_restart(int fd)
+{
+    ubench_pty.power_cycle = 1;
+    while (ubench_pty.power_cycle)
+        usleep(1000);
+
+    userial_vendor_set_line_speed(ubench_pty.sim.cfg.init_baud);
+    tcflush(fd, TCIOFLUSH);
+    ubench_sim_baud = ubench_pty.sim.cfg.init_baud;
+}
+
+/*******************************************************************************
+**
+** Function        ubench_sim_case
+**
+** Description     Measure one rate against the controller model
+**
+** Returns         None
+**
+*******************************************************************************/
+static void ubench_sim_case(int fd, ubench_case_t *p_case, int bytes,
+                            int rounds)
+{
+    uint8_t param[MEMWRITE_HDR_SIZE + UBENCH_MEMWRITE_DATA];
+    uint32_t addr = 0;
+    double start, rtt, lat_sum = 0;
+    int i, len, sent = 0;
+
+    if (p_case->baud != ubench_sim_baud)
+    {
+        param[0] = 0; /* encoded baud rate */
+        param[1] = 0; /* use encoded form */
+        param[2] = (uint8_t) p_case->baud;
+        param[3] = (uint8_t) (p_case->baud >> 8);
+        param[4] = (uint8_t) (p_case->baud >> 16);
+        param[5] = (uint8_t) (p_case->baud >> 24);
+
+        /* Answered at the old rate */
+        if (ubench_cmd(fd, HCI_VSC_UPDATE_BAUDRATE, param, 6) != 0)
+        {
+            p_case->errors++;
+            ubench_sim_restart(fd);
+            return;
+        }
+
+        userial_vendor_set_line_speed(p_case->baud);
+        tcflush(fd, TCIFLUSH);
+        ubench_sim_baud = p_case->baud;
+    }
+
+    userial_vendor_set_flow_control(p_case->flow);
+
+    for (i = 0; i < rounds; i++)
+    {
+        start = ubench_now();
+        if (ubench_cmd(fd, HCI_INTEL_RDSW_VERSION, NULL, 0) != 0)
+        {
+            p_case->errors++;
+            ubench_sim_restart(fd);
+            return;
+        }
+
+        rtt = (ubench_now() - start) * 1e6;
+        lat_sum += rtt / 2;
+        if (rtt / 2 > p_case->lat_max)
+            p_case->lat_max = rtt / 2;
+    }
+    p_case->lat_avg = lat_sum / rounds;
+
+    memset(param, 0xA5, sizeof(param));
+    start = ubench_now();
+
+    while (sent < bytes)
+    {
+        len = bytes - sent;
+        if (len > UBENCH_MEMWRITE_DATA)
+            len = UBENCH_MEMWRITE_DATA;
+
+        param[0] = (uint8_t) addr;
+        param[1] = (uint8_t) (addr >> 8);
+        param[2] = (uint8_t) (addr >> 16);
+        param[3] = (uint8_t) (addr >> 24);
+        param[4] = 0;
+        param[5] = (uint8_t) len;
+
+        if (ubench_cmd(fd, HCI_INTEL_MEMWRITE, param,
+                       MEMWRITE_HDR_SIZE + len) != 0)
+        {
+            p_case->errors++;
+            ubench_sim_restart(fd);
+            return;
+        }
+
+        sent += len;
+        addr += len;
+    }
+
+    p_case->throughput = sent / (ubench_now() - start);
+    p_case->ok = (p_case->errors == 0);
+}
+
+/*******************************************************************************
+**
+** Function        ubench_loop_case
+**
+** Description     Measure one rate and flow control setting on a loopback
+**
+** Returns         None
+**
+*******************************************************************************/
+static void ubench_loop_case(int fd, ubench_case_t *p_case, int bytes,
+                             int rounds)
+{
+    uint8_t *p_tx, *p_rx;
+    struct pollfd pfd;
+    double start, last, lat, lat_sum = 0;
+    int i, n, flags, sent = 0, recvd = 0;
+    uint8_t byte;
+
+    userial_vendor_set_line_speed(p_case->baud);
+    userial_vendor_set_flow_control(p_case->flow);
+    tcflush(fd, TCIOFLUSH);
+
+    for (i = 0; i < rounds; i++)
+    {
+        byte = (uint8_t) i;
+        start = ubench_now();
+        if ((write(fd, &byte, 1) != 1) || (ubench_read(fd, &byte, 1) != 1) ||
+            (byte != (uint8_t) i))
+        {
+            p_case->errors++;
+            continue;
+        }
+
+        lat = (ubench_now() - start) * 1e6;
+        lat_sum += lat;
+        if (lat > p_case->lat_max)
+            p_case->lat_max = lat;
+    }
+    if (rounds > (int) p_case->errors)
+        p_case->lat_avg = lat_sum / (rounds - p_case->errors);
+
+    p_tx = (uint8_t *) malloc(bytes);
+    p_rx = (uint8_t *) malloc(bytes);
+    if ((p_tx == NULL) || (p_rx == NULL))
+    {
+        free(p_tx);
+        free(p_rx);
+        return;
+    }
+
+    for (i = 0; i < bytes; i++)
+        p_tx[i] = (uint8_t) ((i * 7) ^ (i >> 8));
+
+    /* Written while read back, the loop would stall on flow control
+     * otherwise */
+    tcflush(fd, TCIOFLUSH);
+    flags = fcntl(fd, F_GETFL);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+
+    pfd.fd = fd;
+    start = last = ubench_now();
+
+    while (recvd < bytes)
+    {
+        pfd.events = POLLIN | ((sent < bytes) ? POLLOUT : 0);
+        if (poll(&pfd, 1, UBENCH_TIMEOUT_MS) <= 0)
+            break;
+
+        if ((pfd.revents & POLLOUT) && (sent < bytes))
+        {
+            n = bytes - sent;
+            if (n > UBENCH_WRITE_CHUNK)
+                n = UBENCH_WRITE_CHUNK;
+            if ((n = write(fd, p_tx + sent, n)) > 0)
+                sent += n;
+        }
+
+        if (pfd.revents & POLLIN)
+        {
+            if ((n = read(fd, p_rx + recvd, bytes - recvd)) > 0)
+            {
+                recvd += n;
+                last = ubench_now();
+            }
+        }
+    }
+
+    fcntl(fd, F_SETFL, flags);
+
+    p_case->errors += bytes - recvd;
+    for (i = 0; i < recvd; i++)
+    {
+        if (p_rx[i] != p_tx[i])
+            p_case->errors++;
+    }
+
+    if (last > start)
+        p_case->throughput = recvd / (last - start);
+    p_case->ok = (p_case->errors == 0);
+
+    free(p_tx);
+    free(p_rx);
+}
+
+static void usage(const char *p_prog)
+{
+    fprintf(stderr,
+        "usage: %s [-P <port>] [-b <baud,...>] [-f <flow control,...>]\n"
+        "          [-n <bytes>] [-r <rounds>] [-m <max baud>]\n"
+        "          [-l <latency us>] [-L <default|low>]\n",
+        p_prog);
+}
+
+int main(int argc, char **argv)
+{
+    char bauds_arg[256] = UBENCH_DEFAULT_BAUDS;
+    char flows_arg[256] = "";
+    const char *p_port = NULL;
+    uint32_t bauds[UBENCH_MAX_LIST], flows[UBENCH_MAX_LIST];
+    uint32_t errors_before, errors_after;
+    ubench_case_t cases[UBENCH_MAX_LIST * UBENCH_MAX_LIST];
+    ubench_case_t *p_case, *p_best = NULL;
+    tUSERIAL_CFG cfg;
+    sim_cfg_t sim_cfg;
+    pthread_t thread;
+    int bytes = UBENCH_DEFAULT_BYTES, rounds = UBENCH_DEFAULT_ROUNDS;
+    int n_bauds, n_flows, n_cases = 0, icount, sim;
+    int b, f, opt, fd;
+
+    memset(&sim_cfg, 0, sizeof(sim_cfg));
+    sim_cfg.init_baud = SIM_DEFAULT_BAUD;
+    sim_cfg.credits = 1;
+    sim_cfg.strict_baud = 1;
+
+    while ((opt = getopt(argc, argv, "P:b:f:n:r:m:l:L:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'P': p_port = optarg; break;
+            case 'b': snprintf(bauds_arg, sizeof(bauds_arg), "%s", optarg); break;
+            case 'f': snprintf(flows_arg, sizeof(flows_arg), "%s", optarg); break;
+            case 'n': bytes = atoi(optarg); break;
+            case 'r': rounds = atoi(optarg); break;
+            case 'm': sim_cfg.max_baud = strtoul(optarg, NULL, 0); break;
+            case 'l':
+                sim_cfg.cmd_latency_us = strtoul(optarg, NULL, 0);
+                sim_cfg.memwrite_latency_us = sim_cfg.cmd_latency_us;
+                break;
+            case 'L':
+                if (userial_set_latency_profile("UartLatencyProfile", optarg,
+                                                0) != 0)
+                {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (flows_arg[0] == '\0')
+        snprintf(flows_arg, sizeof(flows_arg), "%s", (p_port != NULL) ?
+                 UBENCH_DEFAULT_FLOWS_LOOP : UBENCH_DEFAULT_FLOWS_SIM);
+
+    n_bauds = ubench_parse_list(bauds_arg, bauds);
+    n_flows = ubench_parse_list(flows_arg, flows);
+    if ((n_bauds == 0) || (n_flows == 0) || (bytes <= 0) || (rounds <= 0))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    userial_vendor_init();
+
+    /* No port, the controller model stands in on a pty */
+    if ((sim = (p_port == NULL)))
+    {
+        if (sim_pty_open(&ubench_pty, &sim_cfg) != 0)
+        {
+            fprintf(stderr, "uartbench: can not create a pty\n");
+            return 1;
+        }
+
+        if (pthread_create(&thread, NULL, ubench_sim_thread, &ubench_pty) != 0)
+        {
+            sim_pty_close(&ubench_pty);
+            return 1;
+        }
+
+        p_port = ubench_pty.p_name;
+        ubench_sim_baud = sim_cfg.init_baud;
+    }
+
+    userial_set_port(NULL, (char *) p_port, 0);
+
+    cfg.fmt = USERIAL_DATABITS_8 | USERIAL_PARITY_NONE | USERIAL_STOPBITS_1;
+    cfg.baud = USERIAL_BAUD_115200;
+
+    if ((fd = userial_vendor_open(&cfg)) < 0)
+    {
+        fprintf(stderr, "uartbench: can not open %s\n", p_port);
+        return 1;
+    }
+
+    printf("%s, %s, %d bytes, %d rounds\n", p_port,
+           sim ? "controller model" : "loopback",
+           bytes, rounds);
+    printf("%8s %4s %4s %12s %6s %9s %9s %8s\n", "baud", "flow", "ok",
+           "payload B/s", "eff %", "lat us", "max us", "errors");
+
+    for (b = 0; b < n_bauds; b++)
+    {
+        for (f = 0; f < n_flows; f++)
+        {
+            p_case = &cases[n_cases++];
+            memset(p_case, 0, sizeof(ubench_case_t));
+            p_case->baud = bauds[b];
+            p_case->flow = (flows[f] != 0) ? TRUE : FALSE;
+
+            icount = (userial_vendor_line_errors(&errors_before) == 0);
+
+            if (sim)
+                ubench_sim_case(fd, p_case, bytes, rounds);
+            else
+                ubench_loop_case(fd, p_case, bytes, rounds);
+
+            if (icount && (userial_vendor_line_errors(&errors_after) == 0) &&
+                (errors_after != errors_before))
+            {
+                p_case->errors += errors_after - errors_before;
+                p_case->ok = FALSE;
+            }
+
+            printf("%8u %4u %4s %12.0f %6.1f %9.1f %9.1f %8u\n",
+                   p_case->baud, p_case->flow, p_case->ok ? "yes" : "no",
+                   p_case->throughput,
+                   p_case->throughput * 1000 / p_case->baud,
+                   p_case->lat_avg, p_case->lat_max, p_case->errors);
+            fflush(stdout);
+
+            /* Flow control kept on a tie, it costs nothing when not needed */
+            if (p_case->ok && ((p_best == NULL) ||
+                (p_case->throughput > p_best->throughput * 1.01) ||
+                ((p_case->throughput > p_best->throughput * 0.99) &&
+                 (p_case->flow > p_best->flow))))
+                p_best = p_case;
+        }
+    }
+
+    userial_vendor_close();
+
+    if (sim)
+    {
+        ubench_pty.stop = 1;
+        pthread_join(thread, NULL);
+        sim_pty_close(&ubench_pty);
+    }
+
+    if (p_best == NULL)
+    {
+        printf("no rate held\n");
+        return 1;
+    }
+
+    printf("best: UartBaud=%u UartFlowControl=%u (%.0f B/s)\n",
+           p_best->baud, p_best->flow, p_best->throughput);
+
+    return 0;
+}
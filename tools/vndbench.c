@@ -0,0 +1,326 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2013-2014 Intel Mobile Communications GmbH
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Filename:      vndbench.c
+ *
+ *  Description:   Host benchmark of the vendor library state machines.
+ *                 Runs complete FW_CFG, LPM and SCO sequences against the
+ *                 mock stack and reports CPU time, commands and allocations
+ *                 per sequence. Exits non-zero when a sequence fails or
+ *                 leaks buffers.
+ *
+ *                 usage: bt_vndbench [-n <runs>] [-d <patch dir>]
+ *                                    [-p <pipeline depth>] [-c <credits>]
+ *                                    [-s fwcfg,lpm,sco] [-v]
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include "bt_vendor.h"
+#include "fw_repack.h"
+#include "hex_decode.h"
+#include "mock_stack.h"
+
+/******************************************************************************
+**  Constants & Macros
+******************************************************************************/
+
+#define BENCH_DEFAULT_RUNS      1000
+#define BENCH_DEFAULT_VERSION   "370710010002030d00"
+
+/******************************************************************************
+**  Externs
+******************************************************************************/
+
+extern int hw_set_patch_file_path(char *p_conf_name, char *p_conf_value,
+                                  int param);
+extern int hw_set_patch_pipeline_depth(char *p_conf_name, char *p_conf_value,
+                                       int param);
+
+/******************************************************************************
+**  Type definitions
+******************************************************************************/
+
+typedef int (*bench_seq_t)(void);
+
+typedef struct
+{
+    const char  *p_name;
+    bench_seq_t seq;
+} bench_entry_t;
+
+typedef struct
+{
+    uint32_t    runs;
+    uint32_t    failures;
+    double      cpu;                    /* seconds */
+    uint64_t    commands;
+    uint64_t    stack_allocs;
+    uint64_t    heap_allocs;            /* malloc() calls of the library */
+    int64_t     leaked;                 /* stack buffers not given back */
+} bench_result_t;
+
+/******************************************************************************
+**  Static variables
+******************************************************************************/
+
+static sim_cfg_t bench_sim_cfg;
+static uint64_t bench_mallocs;
+
+/******************************************************************************
+**  Heap accounting, linked with -Wl,--wrap=malloc,--wrap=calloc,
+**  --wrap=realloc when BENCH_WRAP_MALLOC is defined
+******************************************************************************/
+
+#ifdef BENCH_WRAP_MALLOC
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    bench_mallocs++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    bench_mallocs++;
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t size)
+{
+    bench_mallocs++;
+    return __real_realloc(p, size);
+}
+#endif
+
+/******************************************************************************
+**  Sequences
+******************************************************************************/
+
+static unsigned char bench_bdaddr[6] = { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55 };
+
+static int bench_fwcfg(void)
+{
+    BLUETOOTH_VENDOR_LIB_INTERFACE.op(BT_VND_OP_FW_CFG, NULL);
+    mock_stack_pump();
+
+    return (mock_results.fwcfg == BT_VND_OP_RESULT_SUCCESS) ? 0 : -1;
+}
+
+static int bench_lpm(void)
+{
+    uint8_t mode, state;
+
+    mode = BT_VND_LPM_ENABLE;
+    BLUETOOTH_VENDOR_LIB_INTERFACE.op(BT_VND_OP_LPM_SET_MODE, &mode);
+    mock_stack_pump();
+    if (mock_results.lpm != BT_VND_OP_RESULT_SUCCESS)
+        return -1;
+
+    state = BT_VND_LPM_WAKE_ASSERT;
+    BLUETOOTH_VENDOR_LIB_INTERFACE.op(BT_VND_OP_LPM_WAKE_SET_STATE, &state);
+    state = BT_VND_LPM_WAKE_DEASSERT;
+    BLUETOOTH_VENDOR_LIB_INTERFACE.op(BT_VND_OP_LPM_WAKE_SET_STATE, &state);
+
+    mock_results.lpm = MOCK_RESULT_NONE;
+    mode = BT_VND_LPM_DISABLE;
+    BLUETOOTH_VENDOR_LIB_INTERFACE.op(BT_VND_OP_LPM_SET_MODE, &mode);
+    mock_stack_pump();
+
+    return (mock_results.lpm == BT_VND_OP_RESULT_SUCCESS) ? 0 : -1;
+}
+
+static int bench_sco(void)
+{
+    if (BLUETOOTH_VENDOR_LIB_INTERFACE.op(BT_VND_OP_SCO_CFG, NULL) != 0)
+        return -1;
+    mock_stack_pump();
+
+    return (mock_results.scocfg == BT_VND_OP_RESULT_SUCCESS) ? 0 : -1;
+}
+
+static const bench_entry_t bench_entries[] =
+{
+    { "fwcfg", bench_fwcfg },
+    { "lpm",   bench_lpm },
+    { "sco",   bench_sco },
+};
+
+/******************************************************************************
+**  Static functions
+******************************************************************************/
+
+static double bench_cpu_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*******************************************************************************
+**
+** Function        bench_run
+**
+** Description     Run one sequence runs times, each from init() to cleanup()
+**
+** Returns         None
+**
+*******************************************************************************/
+static void bench_run(const bench_entry_t *p_entry, uint32_t runs,
+                      bench_result_t *p_res)
+{
+    double start;
+    uint64_t mallocs;
+    uint32_t i;
+
+    memset(p_res, 0, sizeof(bench_result_t));
+
+    for (i = 0; i < runs; i++)
+    {
+        mock_stack_init(&bench_sim_cfg);
+
+        mallocs = bench_mallocs;
+        start = bench_cpu_sec();
+
+        BLUETOOTH_VENDOR_LIB_INTERFACE.init(&mock_stack_cbacks, bench_bdaddr);
+        if (p_entry->seq() != 0)
+            p_res->failures++;
+        BLUETOOTH_VENDOR_LIB_INTERFACE.cleanup();
+
+        p_res->cpu += bench_cpu_sec() - start;
+
+        mock_stack_cleanup();
+
+        /* The mock's own mallocs are one per stack alloc and per event */
+        p_res->heap_allocs += bench_mallocs - mallocs -
+            mock_stats.allocs - mock_stats.events;
+        p_res->stack_allocs += mock_stats.allocs;
+        p_res->commands += mock_stats.commands;
+        p_res->leaked += (int64_t) mock_stats.allocs + mock_stats.events -
+            mock_stats.deallocs;
+        p_res->runs++;
+    }
+}
+
+static void usage(const char *p_prog)
+{
+    fprintf(stderr,
+        "usage: %s [-n <runs>] [-d <patch dir>] [-p <pipeline depth>]\n"
+        "          [-c <credits>] [-s fwcfg,lpm,sco] [-v]\n", p_prog);
+}
+
+int main(int argc, char **argv)
+{
+    static fw_patch_t patch;
+    bench_result_t res;
+    const char *p_dir = NULL;
+    const char *p_seqs = "fwcfg,lpm,sco";
+    char path[PATH_MAX];
+    uint32_t runs = BENCH_DEFAULT_RUNS;
+    int verbose = 0;
+    int status = 0;
+    unsigned int i;
+    int opt, fd;
+
+    memset(&bench_sim_cfg, 0, sizeof(sim_cfg_t));
+    bench_sim_cfg.credits = 1;
+    hex_decode(bench_sim_cfg.version, BENCH_DEFAULT_VERSION, FW_PATCH_KEY_LEN);
+
+    while ((opt = getopt(argc, argv, "n:d:p:c:s:v")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n': runs = atoi(optarg); break;
+            case 'd': p_dir = optarg; break;
+            case 'p': hw_set_patch_pipeline_depth(NULL, optarg, 0); break;
+            case 'c': bench_sim_cfg.credits = atoi(optarg); break;
+            case 's': p_seqs = optarg; break;
+            case 'v': verbose = 1; break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (runs == 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (p_dir != NULL)
+    {
+        hw_set_patch_file_path(NULL, (char *) p_dir, 0);
+
+        /* Let the controller model answer with the patch's own events */
+        snprintf(path, sizeof(path), "%s/%s.seq", p_dir, BENCH_DEFAULT_VERSION);
+        if (fw_patch_open(path, &patch) == 0)
+        {
+            /* As sent by the library */
+            if (FW_PATCH_REPACK == TRUE)
+                fw_repack_image(&patch, FW_PATCH_REPACK_CHUNK);
+            bench_sim_cfg.p_patch = &patch;
+        }
+    }
+
+    /* The library logs every step, keep that out of the measurement */
+    if (!verbose && ((fd = open("/dev/null", O_WRONLY)) >= 0))
+    {
+        dup2(fd, STDERR_FILENO);
+        close(fd);
+    }
+
+    printf("%-8s %7s %12s %9s %13s %12s %8s %7s\n", "sequence", "runs",
+           "cpu us/seq", "cmds/seq", "stack allocs", "heap allocs",
+           "failures", "leaked");
+
+    for (i = 0; i < sizeof(bench_entries) / sizeof(bench_entries[0]); i++)
+    {
+        if (strstr(p_seqs, bench_entries[i].p_name) == NULL)
+            continue;
+
+        bench_run(&bench_entries[i], runs, &res);
+
+        printf("%-8s %7u %12.2f %9.1f %13.1f %12.1f %8u %7lld\n",
+               bench_entries[i].p_name, res.runs, res.cpu * 1e6 / res.runs,
+               (double) res.commands / res.runs,
+               (double) res.stack_allocs / res.runs,
+               (double) res.heap_allocs / res.runs,
+               res.failures, (long long) res.leaked);
+
+        if ((res.failures > 0) || (res.leaked != 0))
+            status = 1;
+    }
+
+    if (bench_sim_cfg.p_patch != NULL)
+        fw_patch_close(bench_sim_cfg.p_patch);
+
+    return status;
+}